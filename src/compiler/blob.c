@@ -36,6 +36,60 @@
 
 #define BLOB_INITIAL_SIZE 4096
 
+/* Size of the chunks of a chunked blob. Big enough for the per-chunk
+ * overhead to be negligible, small enough not to waste much on small blobs.
+ */
+#define BLOB_CHUNK_SIZE (16 * 1024)
+
+/* Append \to_write bytes to a chunked blob, or zeros if \bytes is NULL,
+ * starting new chunks as needed.
+ */
+static bool
+write_chunked(struct blob *blob, const void *bytes, size_t to_write)
+{
+   const uint8_t *src = bytes;
+
+   if (blob->out_of_memory)
+      return false;
+
+   while (to_write) {
+      struct blob_chunk *chunk = blob->last_chunk;
+
+      if (chunk == NULL || chunk->size == chunk->allocated) {
+         chunk = malloc(sizeof(*chunk) + BLOB_CHUNK_SIZE);
+         if (chunk == NULL) {
+            blob->out_of_memory = true;
+            return false;
+         }
+
+         chunk->next = NULL;
+         chunk->data = (uint8_t *) (chunk + 1);
+         chunk->allocated = BLOB_CHUNK_SIZE;
+         chunk->size = 0;
+
+         if (blob->last_chunk)
+            blob->last_chunk->next = chunk;
+         else
+            blob->chunks = chunk;
+         blob->last_chunk = chunk;
+      }
+
+      size_t n = MIN2(to_write, chunk->allocated - chunk->size);
+      if (src) {
+         memcpy(chunk->data + chunk->size, src, n);
+         src += n;
+      } else {
+         memset(chunk->data + chunk->size, 0, n);
+      }
+
+      chunk->size += n;
+      blob->size += n;
+      to_write -= n;
+   }
+
+   return true;
+}
+
 /* Ensure that \blob will be able to fit an additional object of size
  * \additional.  The growing (if any) will occur by doubling the existing
  * allocation.
@@ -88,6 +142,9 @@ align_blob(struct blob *blob, size_t alignment)
    const size_t new_size = ALIGN(blob->size, alignment);
 
    if (blob->size < new_size) {
+      if (blob->chunked)
+         return write_chunked(blob, NULL, new_size - blob->size);
+
       if (!grow_to_fit(blob, new_size - blob->size))
          return false;
 
@@ -112,17 +169,56 @@ blob_init(struct blob *blob)
    blob->allocated = 0;
    blob->size = 0;
    blob->fixed_allocation = false;
+   blob->chunked = false;
+   blob->chunks = NULL;
+   blob->last_chunk = NULL;
    blob->out_of_memory = false;
 }
 
 void
 blob_init_fixed(struct blob *blob, void *data, size_t size)
 {
+   blob_init(blob);
    blob->data = data;
    blob->allocated = size;
-   blob->size = 0;
    blob->fixed_allocation = true;
-   blob->out_of_memory = false;
+}
+
+void
+blob_init_chunked(struct blob *blob)
+{
+   blob_init(blob);
+   blob->chunked = true;
+}
+
+void
+blob_finish(struct blob *blob)
+{
+   blob_free_chunks(blob->chunks);
+   if (!blob->fixed_allocation)
+      free(blob->data);
+}
+
+struct blob_chunk *
+blob_steal_chunks(struct blob *blob)
+{
+   struct blob_chunk *chunks = blob->chunks;
+
+   blob->chunks = NULL;
+   blob->last_chunk = NULL;
+   blob->size = 0;
+
+   return chunks;
+}
+
+void
+blob_free_chunks(struct blob_chunk *chunks)
+{
+   while (chunks) {
+      struct blob_chunk *next = chunks->next;
+      free(chunks);
+      chunks = next;
+   }
 }
 
 bool
@@ -137,8 +233,26 @@ blob_overwrite_bytes(struct blob *blob,
 
    VG(VALGRIND_CHECK_MEM_IS_DEFINED(bytes, to_write));
 
-   if (blob->data)
+   if (blob->chunked) {
+      const uint8_t *src = bytes;
+      size_t chunk_offset = 0;
+
+      for (struct blob_chunk *chunk = blob->chunks; to_write;
+           chunk = chunk->next) {
+         if (offset < chunk_offset + chunk->size) {
+            size_t start = offset - chunk_offset;
+            size_t n = MIN2(to_write, chunk->size - start);
+
+            memcpy(chunk->data + start, src, n);
+            src += n;
+            offset += n;
+            to_write -= n;
+         }
+         chunk_offset += chunk->size;
+      }
+   } else if (blob->data) {
       memcpy(blob->data + offset, bytes, to_write);
+   }
 
    return true;
 }
@@ -146,6 +260,11 @@ blob_overwrite_bytes(struct blob *blob,
 bool
 blob_write_bytes(struct blob *blob, const void *bytes, size_t to_write)
 {
+   if (blob->chunked) {
+      VG(VALGRIND_CHECK_MEM_IS_DEFINED(bytes, to_write));
+      return write_chunked(blob, bytes, to_write);
+   }
+
    if (! grow_to_fit(blob, to_write))
        return false;
 
@@ -163,6 +282,11 @@ blob_reserve_bytes(struct blob *blob, size_t to_write)
 {
    intptr_t ret;
 
+   if (blob->chunked) {
+      ret = blob->size;
+      return write_chunked(blob, NULL, to_write) ? ret : -1;
+   }
+
    if (! grow_to_fit (blob, to_write))
       return -1;
 
@@ -44,7 +44,27 @@ extern "C" {
  *
  * A blob is efficient in that it dynamically grows by doubling in size, so
  * allocation costs are logarithmic.
+ *
+ * A chunked blob (see blob_init_chunked) instead writes into a list of
+ * fixed-size chunks, so written data is never moved and large blobs can be
+ * handed off chunk by chunk without being copied into one buffer.
+ */
+
+/**
+ * One piece of the data of a chunked blob.
  */
+struct blob_chunk {
+   struct blob_chunk *next;
+
+   /** The data written to this chunk. */
+   uint8_t *data;
+
+   /** Number of bytes that have been allocated for \c data. */
+   size_t allocated;
+
+   /** The number of bytes that have actual data written to them. */
+   size_t size;
+};
 
 struct blob {
    /* The data actually written to the blob. */
@@ -62,6 +82,16 @@ struct blob {
     */
    bool fixed_allocation;
 
+   /** True if the data is written to \c chunks rather than to \c data.
+    *
+    * \see blob_init_chunked
+    */
+   bool chunked;
+
+   /** The chunks of a chunked blob, in order, and the one being written. */
+   struct blob_chunk *chunks;
+   struct blob_chunk *last_chunk;
+
    /**
     * True if we've ever failed to realloc or if we go pas the end of a fixed
     * allocation blob.
@@ -104,18 +134,40 @@ blob_init(struct blob *blob);
 void
 blob_init_fixed(struct blob *blob, void *data, size_t size);
 
+/**
+ * Init a new, empty chunked blob.
+ *
+ * A chunked blob writes its data to a list of chunks rather than to one
+ * contiguous allocation: \c data stays NULL and the written data is found by
+ * walking \c chunks. Everything else, including overwriting previously
+ * written data, works as for a regular blob.
+ */
+void
+blob_init_chunked(struct blob *blob);
+
 /**
  * Finish a blob and free its memory.
  *
  * If \blob was initialized with blob_init_fixed, the data pointer is
  * considered to be owned by the user and will not be freed.
  */
-static inline void
-blob_finish(struct blob *blob)
-{
-   if (!blob->fixed_allocation)
-      free(blob->data);
-}
+void
+blob_finish(struct blob *blob);
+
+/**
+ * Take the chunks of a chunked blob, which is left empty.
+ *
+ * The caller becomes responsible for freeing the returned chunks with
+ * blob_free_chunks().
+ */
+struct blob_chunk *
+blob_steal_chunks(struct blob *blob);
+
+/**
+ * Free a list of chunks returned by blob_steal_chunks().
+ */
+void
+blob_free_chunks(struct blob_chunk *chunks);
 
 /**
  * Add some unstructured, fixed-size data to a blob.
@@ -83,6 +83,7 @@
 #include <math.h>
 #include "builtin_functions.h"
 #include "util/hash_table.h"
+#include "util/set.h"
 
 #define M_PIf   ((float) M_PI)
 #define M_PI_2f ((float) M_PI_2)
@@ -655,21 +656,41 @@ public:
    ir_function_signature *find(_mesa_glsl_parse_state *state,
                                const char *name, exec_list *actual_parameters);
 
+   /**
+    * Look up the built-in function \p name, creating it if this is the first
+    * time it is asked for.
+    */
+   ir_function *get_function(const char *name);
+
    /**
     * A shader to hold all the built-in signatures; created by this module.
     *
-    * This includes signatures for every built-in, regardless of version or
-    * enabled extensions.  The availability predicate associated with each
-    * signature allows matching_signature() to filter out the irrelevant ones.
+    * A function gets all of its signatures, regardless of version or enabled
+    * extensions, the first time get_function() is called for it.  The
+    * availability predicate associated with each signature allows
+    * matching_signature() to filter out the irrelevant ones.
     */
    gl_shader *shader;
 
 private:
    void *mem_ctx;
 
+   /**
+    * Names of all the built-in functions, whether they have been created
+    * yet or not.
+    */
+   struct set *function_names;
+
+   /**
+    * The function create_intrinsics() and create_builtins() should create,
+    * or NULL to only collect the names of all of them.
+    */
+   const char *wanted_function;
+
    void create_shader();
    void create_intrinsics();
    void create_builtins();
+   bool wants_function(const char *name);
 
    /**
     * IR builder helpers:
@@ -1011,7 +1032,7 @@ enum image_function_flags {
  *  @{
  */
 builtin_builder::builtin_builder()
-   : shader(NULL)
+   : shader(NULL), function_names(NULL), wanted_function(NULL)
 {
    mem_ctx = NULL;
 }
@@ -1034,7 +1055,7 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
     */
    state->uses_builtin_functions = true;
 
-   ir_function *f = shader->symbols->get_function(name);
+   ir_function *f = get_function(name);
    if (f == NULL)
       return NULL;
 
@@ -1055,8 +1076,48 @@ builtin_builder::initialize()
 
    mem_ctx = ralloc_context(NULL);
    create_shader();
+
+   /* Building the IR for every signature up front takes a while and a lot
+    * of memory, and a shader only ever uses a handful of them.  So just walk
+    * the list of built-ins to collect their names here, and let
+    * get_function() build each function the first time it is needed.
+    */
+   function_names = _mesa_set_create(mem_ctx, _mesa_key_hash_string,
+                                     _mesa_key_string_equal);
+   wanted_function = NULL;
+   create_intrinsics();
+   create_builtins();
+}
+
+ir_function *
+builtin_builder::get_function(const char *name)
+{
+   ir_function *f = shader->symbols->get_function(name);
+   if (f != NULL || _mesa_set_search(function_names, name) == NULL)
+      return f;
+
+   /* Building a function may need other functions (usually intrinsics), so
+    * this can recurse.
+    */
+   const char *outer = wanted_function;
+   wanted_function = name;
    create_intrinsics();
    create_builtins();
+   wanted_function = outer;
+
+   return shader->symbols->get_function(name);
+}
+
+bool
+builtin_builder::wants_function(const char *name)
+{
+   if (wanted_function == NULL) {
+      /* The names are all string literals, so there's no need to copy them. */
+      _mesa_set_add(function_names, name);
+      return false;
+   }
+
+   return strcmp(name, wanted_function) == 0;
 }
 
 void
@@ -1064,6 +1125,7 @@ builtin_builder::release()
 {
    ralloc_free(mem_ctx);
    mem_ctx = NULL;
+   function_names = NULL;
 
    ralloc_free(shader);
    shader = NULL;
@@ -1082,6 +1144,17 @@ builtin_builder::create_shader()
 
 /** @} */
 
+/**
+ * The arguments of add_function() are the code that builds the IR for each
+ * signature, so only evaluate them for the function that is wanted.  Within
+ * its own expansion, add_function refers to the method again.
+ */
+#define add_function(name, ...)                 \
+   do {                                         \
+      if (wants_function(name))                 \
+         add_function(name, __VA_ARGS__);       \
+   } while (0)
+
 /**
  * Create ir_function and ir_function_signature objects for each
  * intrinsic.
@@ -3331,6 +3404,8 @@ builtin_builder::create_builtins()
 #undef FIU2_MIXED
 }
 
+#undef add_function
+
 void
 builtin_builder::add_function(const char *name, ...)
 {
@@ -3365,6 +3440,9 @@ builtin_builder::add_image_function(const char *name,
                                     unsigned flags,
                                     enum ir_intrinsic_id intrinsic_id)
 {
+   if (!wants_function(name))
+      return;
+
    static const glsl_type *const types[] = {
       glsl_type::image1D_type,
       glsl_type::image2D_type,
@@ -5813,7 +5891,7 @@ builtin_builder::_atomic_counter_op(const char *intrinsic,
    MAKE_SIG(glsl_type::uint_type, avail, 1, counter);
 
    ir_variable *retval = body.make_temp(glsl_type::uint_type, "atomic_retval");
-   body.emit(call(shader->symbols->get_function(intrinsic), retval,
+   body.emit(call(get_function(intrinsic), retval,
                   sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -5843,8 +5921,7 @@ builtin_builder::_atomic_counter_op1(const char *intrinsic,
       parameters.push_tail(new(mem_ctx) ir_dereference_variable(counter));
       parameters.push_tail(new(mem_ctx) ir_dereference_variable(neg_data));
 
-      ir_function *const func =
-         shader->symbols->get_function("__intrinsic_atomic_add");
+      ir_function *const func = get_function("__intrinsic_atomic_add");
       ir_instruction *const c = call(func, retval, parameters);
 
       assert(c != NULL);
@@ -5852,7 +5929,7 @@ builtin_builder::_atomic_counter_op1(const char *intrinsic,
 
       body.emit(c);
    } else {
-      body.emit(call(shader->symbols->get_function(intrinsic), retval,
+      body.emit(call(get_function(intrinsic), retval,
                      sig->parameters));
    }
 
@@ -5870,7 +5947,7 @@ builtin_builder::_atomic_counter_op2(const char *intrinsic,
    MAKE_SIG(glsl_type::uint_type, avail, 3, counter, compare, data);
 
    ir_variable *retval = body.make_temp(glsl_type::uint_type, "atomic_retval");
-   body.emit(call(shader->symbols->get_function(intrinsic), retval,
+   body.emit(call(get_function(intrinsic), retval,
                   sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -5886,7 +5963,7 @@ builtin_builder::_atomic_op2(const char *intrinsic,
    MAKE_SIG(type, avail, 2, atomic, data);
 
    ir_variable *retval = body.make_temp(type, "atomic_retval");
-   body.emit(call(shader->symbols->get_function(intrinsic), retval,
+   body.emit(call(get_function(intrinsic), retval,
                   sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -5903,7 +5980,7 @@ builtin_builder::_atomic_op3(const char *intrinsic,
    MAKE_SIG(type, avail, 3, atomic, data1, data2);
 
    ir_variable *retval = body.make_temp(type, "atomic_retval");
-   body.emit(call(shader->symbols->get_function(intrinsic), retval,
+   body.emit(call(get_function(intrinsic), retval,
                   sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -6092,7 +6169,7 @@ builtin_builder::_image(image_prototype_ctr prototype,
 
    if (flags & IMAGE_FUNCTION_EMIT_STUB) {
       ir_factory body(&sig->body, mem_ctx);
-      ir_function *f = shader->symbols->get_function(intrinsic_name);
+      ir_function *f = get_function(intrinsic_name);
 
       if (flags & IMAGE_FUNCTION_RETURNS_VOID) {
          body.emit(call(f, NULL, sig->parameters));
@@ -6125,7 +6202,7 @@ builtin_builder::_memory_barrier(const char *intrinsic_name,
                                  builtin_available_predicate avail)
 {
    MAKE_SIG(glsl_type::void_type, avail, 0);
-   body.emit(call(shader->symbols->get_function(intrinsic_name),
+   body.emit(call(get_function(intrinsic_name),
                   NULL, sig->parameters));
    return sig;
 }
@@ -6147,7 +6224,7 @@ builtin_builder::_ballot()
    MAKE_SIG(glsl_type::uint64_t_type, shader_ballot, 1, value);
    ir_variable *retval = body.make_temp(glsl_type::uint64_t_type, "retval");
 
-   body.emit(call(shader->symbols->get_function("__intrinsic_ballot"),
+   body.emit(call(get_function("__intrinsic_ballot"),
                   retval, sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -6170,7 +6247,7 @@ builtin_builder::_read_first_invocation(const glsl_type *type)
    MAKE_SIG(type, shader_ballot, 1, value);
    ir_variable *retval = body.make_temp(type, "retval");
 
-   body.emit(call(shader->symbols->get_function("__intrinsic_read_first_invocation"),
+   body.emit(call(get_function("__intrinsic_read_first_invocation"),
                   retval, sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -6195,7 +6272,7 @@ builtin_builder::_read_invocation(const glsl_type *type)
    MAKE_SIG(type, shader_ballot, 2, value, invocation);
    ir_variable *retval = body.make_temp(type, "retval");
 
-   body.emit(call(shader->symbols->get_function("__intrinsic_read_invocation"),
+   body.emit(call(get_function("__intrinsic_read_invocation"),
                   retval, sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -6217,7 +6294,7 @@ builtin_builder::_shader_clock(builtin_available_predicate avail,
 
    ir_variable *retval = body.make_temp(glsl_type::uvec2_type, "clock_retval");
 
-   body.emit(call(shader->symbols->get_function("__intrinsic_shader_clock"),
+   body.emit(call(get_function("__intrinsic_shader_clock"),
                   retval, sig->parameters));
 
    if (type == glsl_type::uint64_t_type) {
@@ -6248,7 +6325,7 @@ builtin_builder::_vote(const char *intrinsic_name,
 
    ir_variable *retval = body.make_temp(glsl_type::bool_type, "retval");
 
-   body.emit(call(shader->symbols->get_function(intrinsic_name),
+   body.emit(call(get_function(intrinsic_name),
                   retval, sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -6300,7 +6377,7 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    ir_function *f;
    bool ret = false;
    mtx_lock(&builtins_lock);
-   f = builtins.shader->symbols->get_function(name);
+   f = builtins.get_function(name);
    if (f != NULL) {
       foreach_in_list(ir_function_signature, sig, &f->signatures) {
          if (sig->is_builtin_available(state)) {
@@ -6314,6 +6391,17 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    return ret;
 }
 
+ir_function *
+_mesa_glsl_find_builtin_function_by_name(const char *name)
+{
+   ir_function *f;
+   mtx_lock(&builtins_lock);
+   f = builtins.get_function(name);
+   mtx_unlock(&builtins_lock);
+
+   return f;
+}
+
 gl_shader *
 _mesa_glsl_get_builtin_function_shader()
 {
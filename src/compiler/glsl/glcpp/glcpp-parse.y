@@ -1360,6 +1360,7 @@ glcpp_parser_create(const struct gl_extensions *extension_list,
    parser->defines = _mesa_hash_table_create(NULL, _mesa_key_hash_string,
                                              _mesa_key_string_equal);
    parser->linalloc = linear_alloc_parent(parser, 0);
+   parser->identifiers = _mesa_string_intern_create(parser);
    parser->active = NULL;
    parser->lexing_directive = 0;
    parser->lexing_version_directive = 0;
@@ -1409,6 +1410,196 @@ glcpp_parser_destroy(glcpp_parser_t *parser)
    ralloc_free (parser);
 }
 
+/* The state of the preprocessor at the start of a line. Everything in it is
+ * owned by the snapshot, so that it outlives the parser it was taken from.
+ */
+struct glcpp_snapshot {
+   void *linalloc;
+
+   /* Macros are never modified once they are defined, so the parsers that
+    * a snapshot is restored into share these rather than copying them.
+    */
+   macro_t **macros;
+   unsigned num_macros;
+
+   skip_node_t *skip_stack;
+
+   char *output;
+   char *info_log;
+
+   int line_number;
+   int source_number;
+
+   unsigned version;
+   bool version_set;
+   bool is_gles;
+};
+
+static token_list_t *
+_token_list_copy_to(void *lin_ctx, const token_list_t *other)
+{
+   token_list_t *copy;
+   token_node_t *node;
+
+   if (other == NULL)
+      return NULL;
+
+   copy = linear_zalloc_child(lin_ctx, sizeof(token_list_t));
+   for (node = other->head; node; node = node->next) {
+      token_t *token = linear_alloc_child(lin_ctx, sizeof(token_t));
+      token_node_t *new_node = linear_alloc_child(lin_ctx, sizeof(token_node_t));
+
+      *token = *node->token;
+      if (token->type == IDENTIFIER || token->type == INTEGER_STRING ||
+          token->type == OTHER)
+         token->value.str = linear_strdup(lin_ctx, token->value.str);
+
+      new_node->token = token;
+      new_node->next = NULL;
+
+      if (copy->head == NULL)
+         copy->head = new_node;
+      else
+         copy->tail->next = new_node;
+
+      copy->tail = new_node;
+      if (token->type != SPACE)
+         copy->non_space_tail = new_node;
+   }
+
+   return copy;
+}
+
+static string_list_t *
+_string_list_copy_to(void *lin_ctx, const string_list_t *other)
+{
+   string_list_t *copy;
+   string_node_t *node;
+
+   if (other == NULL)
+      return NULL;
+
+   copy = linear_zalloc_child(lin_ctx, sizeof(string_list_t));
+   for (node = other->head; node; node = node->next) {
+      string_node_t *new_node = linear_alloc_child(lin_ctx, sizeof(string_node_t));
+
+      new_node->str = linear_strdup(lin_ctx, node->str);
+      new_node->next = NULL;
+
+      if (copy->head == NULL)
+         copy->head = new_node;
+      else
+         copy->tail->next = new_node;
+      copy->tail = new_node;
+   }
+
+   return copy;
+}
+
+static skip_node_t *
+_skip_stack_copy_to(void *lin_ctx, const skip_node_t *other)
+{
+   skip_node_t *copy = NULL, **tail = &copy;
+
+   for (; other; other = other->next) {
+      skip_node_t *node = linear_alloc_child(lin_ctx, sizeof(skip_node_t));
+
+      *node = *other;
+      node->next = NULL;
+      *tail = node;
+      tail = &node->next;
+   }
+
+   return copy;
+}
+
+glcpp_snapshot_t *
+glcpp_parser_snapshot(void *mem_ctx, glcpp_parser_t *parser)
+{
+   glcpp_snapshot_t *snapshot;
+   struct hash_entry *entry;
+   unsigned i = 0;
+
+   /* The parser must be at the start of a line, with no directive, macro
+    * invocation or comment left open, and must not have failed.
+    */
+   if (parser->error || !parser->last_token_was_newline ||
+       parser->in_control_line || parser->newline_as_space ||
+       parser->paren_count || parser->commented_newlines ||
+       parser->lex_from_list || parser->active)
+      return NULL;
+
+   snapshot = ralloc(mem_ctx, glcpp_snapshot_t);
+   snapshot->linalloc = linear_alloc_parent(snapshot, 0);
+
+   snapshot->num_macros = parser->defines->entries;
+   snapshot->macros = ralloc_array(snapshot, macro_t *, snapshot->num_macros);
+   hash_table_foreach(parser->defines, entry) {
+      const macro_t *macro = entry->data;
+      macro_t *copy = linear_alloc_child(snapshot->linalloc, sizeof(macro_t));
+
+      copy->is_function = macro->is_function;
+      copy->parameters = _string_list_copy_to(snapshot->linalloc,
+                                              macro->parameters);
+      copy->identifier = linear_strdup(snapshot->linalloc, macro->identifier);
+      copy->replacements = _token_list_copy_to(snapshot->linalloc,
+                                               macro->replacements);
+      snapshot->macros[i++] = copy;
+   }
+
+   snapshot->skip_stack = _skip_stack_copy_to(snapshot->linalloc,
+                                              parser->skip_stack);
+
+   snapshot->output = ralloc_strndup(snapshot, parser->output->buf,
+                                     parser->output->length);
+   snapshot->info_log = ralloc_strndup(snapshot, parser->info_log->buf,
+                                       parser->info_log->length);
+
+   /* A #line on the last line only takes effect with the next token, and
+    * new_source_number keeps the source number once it has been applied.
+    */
+   snapshot->line_number = parser->has_new_line_number ?
+                           parser->new_line_number :
+                           glcpp_lex_get_line_number(parser);
+   snapshot->source_number = parser->new_source_number;
+
+   snapshot->version = parser->version;
+   snapshot->version_set = parser->version_set;
+   snapshot->is_gles = parser->is_gles;
+
+   return snapshot;
+}
+
+void
+glcpp_parser_restore(glcpp_parser_t *parser, const glcpp_snapshot_t *snapshot)
+{
+   assert(parser->defines->entries == 0 && parser->output->length == 0);
+
+   for (unsigned i = 0; i < snapshot->num_macros; i++) {
+      _mesa_hash_table_insert(parser->defines,
+                              snapshot->macros[i]->identifier,
+                              snapshot->macros[i]);
+   }
+
+   parser->skip_stack = _skip_stack_copy_to(parser->linalloc,
+                                            snapshot->skip_stack);
+
+   _mesa_string_buffer_append(parser->output, snapshot->output);
+   _mesa_string_buffer_append(parser->info_log, snapshot->info_log);
+
+   parser->last_token_was_newline = 1;
+   parser->first_non_space_token_this_line = 1;
+
+   parser->has_new_line_number = 1;
+   parser->new_line_number = snapshot->line_number;
+   parser->has_new_source_number = 1;
+   parser->new_source_number = snapshot->source_number;
+
+   parser->version = snapshot->version;
+   parser->version_set = snapshot->version_set;
+   parser->is_gles = snapshot->is_gles;
+}
+
 typedef enum function_status
 {
    FUNCTION_STATUS_SUCCESS,
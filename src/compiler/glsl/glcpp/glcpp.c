@@ -104,6 +104,7 @@ init_fake_gl_context (struct gl_context *gl_ctx)
 {
 	gl_ctx->API = API_OPENGL_COMPAT;
 	gl_ctx->Const.DisableGLSLLineContinuations = false;
+	gl_ctx->PreprocessorCache = NULL;
 }
 
 static void
@@ -34,6 +34,7 @@
 #include "util/hash_table.h"
 
 #include "util/string_buffer.h"
+#include "util/string_intern.h"
 
 #define yyscan_t void*
 
@@ -184,6 +185,7 @@ typedef void (*glcpp_extension_iterator)(
 
 struct glcpp_parser {
 	void *linalloc;
+	struct _mesa_string_intern *identifiers;
 	yyscan_t scanner;
 	struct hash_table *defines;
 	active_list_t *active;
@@ -238,6 +240,30 @@ glcpp_parser_destroy (glcpp_parser_t *parser);
 void
 glcpp_parser_resolve_implicit_version(glcpp_parser_t *parser);
 
+/**
+ * Preprocessor state at the start of a line, which can be restored into a
+ * new parser to continue with the rest of a source from there.
+ */
+typedef struct glcpp_snapshot glcpp_snapshot_t;
+
+/**
+ * Save the state of \p parser after it has parsed a prefix of a source that
+ * ends with a newline.
+ *
+ * \return The snapshot, allocated out of \p mem_ctx, or NULL if the parser
+ * failed or stopped in the middle of a directive, a macro invocation or a
+ * comment, in which case parsing the prefix on its own isn't equivalent to
+ * parsing it as part of the whole source.
+ */
+glcpp_snapshot_t *
+glcpp_parser_snapshot(void *mem_ctx, glcpp_parser_t *parser);
+
+/**
+ * Load \p snapshot into a parser that hasn't parsed anything yet.
+ */
+void
+glcpp_parser_restore(glcpp_parser_t *parser, const glcpp_snapshot_t *snapshot);
+
 int
 glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
 		 glcpp_extension_iterator extensions, void *state,
@@ -259,6 +285,9 @@ glcpp_lex_init_extra (glcpp_parser_t *parser, yyscan_t* scanner);
 void
 glcpp_lex_set_source_string(glcpp_parser_t *parser, const char *shader);
 
+int
+glcpp_lex_get_line_number(glcpp_parser_t *parser);
+
 int
 glcpp_lex (YYSTYPE *lvalp, YYLTYPE *llocp, yyscan_t scanner);
 
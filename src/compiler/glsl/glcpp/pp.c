@@ -25,6 +25,7 @@
 #include <string.h>
 #include <ctype.h>
 #include "glcpp.h"
+#include "util/debug.h"
 
 void
 glcpp_error (YYLTYPE *locp, glcpp_parser_t *parser, const char *fmt, ...)
@@ -220,6 +221,193 @@ remove_line_continuations(glcpp_parser_t *ctx, const char *shader)
 	return sb->buf;
 }
 
+/* Engines often compile many variants of a shader which only start to
+ * differ after a long prelude of #version, #extension and #define lines
+ * and helper code.  When MESA_GLSL_PREPROCESSOR_CACHE is set, each context
+ * keeps the state of the preprocessor after the prefixes its sources share
+ * with the source compiled before them, and sources starting with one of
+ * those prefixes continue from the saved state instead of preprocessing the
+ * prefix again.
+ */
+#define PREFIX_CACHE_SIZE 16
+
+/* Prefixes shorter than this aren't worth a snapshot. */
+#define PREFIX_CACHE_MIN_LENGTH 1024
+
+struct prefix_cache_entry {
+	char *prefix;
+	size_t length;
+
+	/* NULL if the source can't be cut at the end of the prefix. */
+	glcpp_snapshot_t *snapshot;
+
+	unsigned last_use;
+};
+
+struct glcpp_prefix_cache {
+	struct prefix_cache_entry entries[PREFIX_CACHE_SIZE];
+	unsigned num_entries;
+	unsigned use_count;
+
+	/* The previous source, to find the prefix it shares with the next. */
+	char *last_source;
+};
+
+static struct glcpp_prefix_cache *
+get_prefix_cache(struct gl_context *gl_ctx)
+{
+	if (gl_ctx->PreprocessorCache == NULL &&
+	    env_var_as_boolean("MESA_GLSL_PREPROCESSOR_CACHE", false))
+		gl_ctx->PreprocessorCache = rzalloc(NULL,
+						    struct glcpp_prefix_cache);
+
+	return gl_ctx->PreprocessorCache;
+}
+
+/* Whether \p shader can be cut after its first \p length characters. The
+ * lexer takes "\n\r" as a single newline, so it mustn't be split.
+ */
+static bool
+is_line_start(const char *shader, size_t length)
+{
+	return length > 0 && shader[length - 1] == '\n' &&
+	       shader[length] != '\r';
+}
+
+static bool
+entry_matches(const struct prefix_cache_entry *entry, const char *shader)
+{
+	return strncmp(entry->prefix, shader, entry->length) == 0 &&
+	       is_line_start(shader, entry->length);
+}
+
+/* Length of the longest prefix of \p a and \p b that ends a line. */
+static size_t
+shared_lines_length(const char *a, const char *b)
+{
+	size_t length = 0;
+
+	for (size_t i = 0; a[i] != '\0' && a[i] == b[i]; i++) {
+		if (is_line_start(a, i + 1) && b[i + 1] != '\r')
+			length = i + 1;
+	}
+
+	return length;
+}
+
+static glcpp_snapshot_t *
+snapshot_prefix(struct glcpp_prefix_cache *cache, const char *shader,
+		size_t length, const struct prefix_cache_entry *base,
+		glcpp_extension_iterator extensions, void *state,
+		struct gl_context *gl_ctx)
+{
+	glcpp_parser_t *parser =
+		glcpp_parser_create(&gl_ctx->Extensions, extensions, state, gl_ctx->API);
+	glcpp_snapshot_t *snapshot;
+	size_t start = 0;
+
+	if (base) {
+		glcpp_parser_restore(parser, base->snapshot);
+		start = base->length;
+	}
+
+	glcpp_lex_set_source_string(parser,
+				    ralloc_strndup(parser, shader + start,
+						   length - start));
+	glcpp_parser_parse(parser);
+
+	snapshot = glcpp_parser_snapshot(cache, parser);
+
+	glcpp_parser_destroy(parser);
+	return snapshot;
+}
+
+/* Add an entry, replacing the least recently used one but \p keep, which
+ * the caller is still going to use, if the cache is full.
+ */
+static struct prefix_cache_entry *
+prefix_cache_add(struct glcpp_prefix_cache *cache, const char *shader,
+		 size_t length, glcpp_snapshot_t *snapshot,
+		 const struct prefix_cache_entry *keep)
+{
+	struct prefix_cache_entry *entry;
+
+	if (cache->num_entries < PREFIX_CACHE_SIZE) {
+		entry = &cache->entries[cache->num_entries++];
+	} else {
+		entry = NULL;
+		for (unsigned i = 0; i < PREFIX_CACHE_SIZE; i++) {
+			if (&cache->entries[i] == keep)
+				continue;
+
+			if (entry == NULL ||
+			    cache->entries[i].last_use < entry->last_use)
+				entry = &cache->entries[i];
+		}
+
+		ralloc_free(entry->prefix);
+		ralloc_free(entry->snapshot);
+	}
+
+	entry->prefix = ralloc_strndup(cache, shader, length);
+	entry->length = length;
+	entry->snapshot = snapshot;
+	entry->last_use = cache->use_count;
+
+	return entry;
+}
+
+/* Find the saved state to preprocess \p shader from, saving a new one if
+ * it shares a longer prefix with the previous source than any saved state.
+ */
+static struct prefix_cache_entry *
+prefix_cache_lookup(struct glcpp_prefix_cache *cache, const char *shader,
+		    glcpp_extension_iterator extensions, void *state,
+		    struct gl_context *gl_ctx)
+{
+	struct prefix_cache_entry *best = NULL;
+	bool known = false;
+	size_t length = 0;
+
+	if (cache->last_source)
+		length = shared_lines_length(shader, cache->last_source);
+
+	for (unsigned i = 0; i < cache->num_entries; i++) {
+		struct prefix_cache_entry *entry = &cache->entries[i];
+
+		if (!entry_matches(entry, shader))
+			continue;
+
+		if (entry->length == length)
+			known = true;
+
+		if (entry->snapshot &&
+		    (best == NULL || entry->length > best->length))
+			best = entry;
+	}
+
+	if (!known && length >= PREFIX_CACHE_MIN_LENGTH &&
+	    (best == NULL || length >= best->length + PREFIX_CACHE_MIN_LENGTH)) {
+		glcpp_snapshot_t *snapshot =
+			snapshot_prefix(cache, shader, length, best,
+					extensions, state, gl_ctx);
+		struct prefix_cache_entry *entry =
+			prefix_cache_add(cache, shader, length, snapshot,
+					 best);
+
+		if (snapshot)
+			best = entry;
+	}
+
+	ralloc_free(cache->last_source);
+	cache->last_source = ralloc_strdup(cache, shader);
+
+	if (best)
+		best->last_use = ++cache->use_count;
+
+	return best;
+}
+
 int
 glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
                  glcpp_extension_iterator extensions, void *state,
@@ -228,11 +416,25 @@ glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
 	int errors;
 	glcpp_parser_t *parser =
 		glcpp_parser_create(&gl_ctx->Extensions, extensions, state, gl_ctx->API);
+	struct glcpp_prefix_cache *cache = get_prefix_cache(gl_ctx);
+	const char *source;
 
 	if (! gl_ctx->Const.DisableGLSLLineContinuations)
 		*shader = remove_line_continuations(parser, *shader);
 
-	glcpp_lex_set_source_string (parser, *shader);
+	source = *shader;
+	if (cache) {
+		const struct prefix_cache_entry *entry =
+			prefix_cache_lookup(cache, *shader, extensions, state,
+					    gl_ctx);
+
+		if (entry) {
+			glcpp_parser_restore(parser, entry->snapshot);
+			source += entry->length;
+		}
+	}
+
+	glcpp_lex_set_source_string (parser, source);
 
 	glcpp_parser_parse (parser);
 
@@ -30,6 +30,16 @@
 
 static int classify_identifier(struct _mesa_glsl_parse_state *, const char *);
 
+/* Returns the parse state's shared copy of an identifier.  The length is
+ * passed along, since flex already found it and stored it in yyleng.
+ */
+static inline const char *
+intern_identifier(struct _mesa_glsl_parse_state *state,
+                  const char *text, size_t len)
+{
+   return _mesa_string_intern_len(state->identifiers, text, len);
+}
+
 #ifdef _MSC_VER
 #define YY_NO_UNISTD_H
 #endif
@@ -81,13 +91,7 @@ static int classify_identifier(struct _mesa_glsl_parse_state *, const char *);
 			  "illegal use of reserved word `%s'", yytext);	\
 	 return ERROR_TOK;						\
       } else {								\
-	 /* We're not doing linear_strdup here, to avoid an implicit    \
-	  * call on strlen() for the length of the string, as this is   \
-	  * already found by flex and stored in yyleng */               \
-	 void *mem_ctx = yyextra->linalloc;				\
-         char *id = (char *) linear_alloc_child(mem_ctx, yyleng + 1);   \
-         memcpy(id, yytext, yyleng + 1);                                \
-         yylval->identifier = id;                                       \
+	 yylval->identifier = intern_identifier(yyextra, yytext, yyleng); \
 	 return classify_identifier(yyextra, yytext);			\
       }									\
    } while (0)
@@ -266,14 +270,8 @@ HASH		^{SPC}#{SPC}
 <PP>[ \t\r]*			{ }
 <PP>:				return COLON;
 <PP>[_a-zA-Z][_a-zA-Z0-9]*	{
-				   /* We're not doing linear_strdup here, to avoid an implicit call
-				    * on strlen() for the length of the string, as this is already
-				    * found by flex and stored in yyleng
-				    */
-                                    void *mem_ctx = yyextra->linalloc;
-                                    char *id = (char *) linear_alloc_child(mem_ctx, yyleng + 1);
-                                    memcpy(id, yytext, yyleng + 1);
-                                    yylval->identifier = id;
+				   yylval->identifier =
+				      intern_identifier(yyextra, yytext, yyleng);
 				   return IDENTIFIER;
 				}
 <PP>[1-9][0-9]*			{
@@ -460,14 +458,8 @@ layout		{
                       || yyextra->ARB_tessellation_shader_enable) {
 		      return LAYOUT_TOK;
 		   } else {
-		      /* We're not doing linear_strdup here, to avoid an implicit call
-		       * on strlen() for the length of the string, as this is already
-		       * found by flex and stored in yyleng
-		       */
-                      void *mem_ctx = yyextra->linalloc;
-                      char *id = (char *) linear_alloc_child(mem_ctx, yyleng + 1);
-                      memcpy(id, yytext, yyleng + 1);
-                      yylval->identifier = id;
+		      yylval->identifier =
+		         intern_identifier(yyextra, yytext, yyleng);
 		      return classify_identifier(yyextra, yytext);
 		   }
 		}
@@ -637,19 +629,13 @@ u64vec4		KEYWORD_WITH_ALT(0, 0, 0, 0, yyextra->ARB_gpu_shader_int64_enable, U64V
 
 [_a-zA-Z][_a-zA-Z0-9]*	{
 			    struct _mesa_glsl_parse_state *state = yyextra;
-			    void *ctx = state->linalloc;
 			    if (state->es_shader && yyleng > 1024) {
 			       _mesa_glsl_error(yylloc, state,
 			                        "Identifier `%s' exceeds 1024 characters",
 			                        yytext);
 			    } else {
-			      /* We're not doing linear_strdup here, to avoid an implicit call
-			       * on strlen() for the length of the string, as this is already
-			       * found by flex and stored in yyleng
-			       */
-                              char *id = (char *) linear_alloc_child(ctx, yyleng + 1);
-                              memcpy(id, yytext, yyleng + 1);
-                              yylval->identifier = id;
+			      yylval->identifier =
+			         intern_identifier(state, yytext, yyleng);
 			    }
 			    return classify_identifier(state, yytext);
 			}
@@ -35,6 +35,7 @@
 #include "util/ralloc.h"
 #include "util/disk_cache.h"
 #include "util/mesa-sha1.h"
+#include "compiler/pass_profile.h"
 #include "ast.h"
 #include "glsl_parser_extras.h"
 #include "glsl_parser.h"
@@ -73,6 +74,7 @@ _mesa_glsl_parse_state::_mesa_glsl_parse_state(struct gl_context *_ctx,
    this->symbols = new(mem_ctx) glsl_symbol_table;
 
    this->linalloc = linear_alloc_parent(this, 0);
+   this->identifiers = _mesa_string_intern_create(this);
 
    this->info_log = ralloc_strdup(mem_ctx, "");
    this->error = false;
@@ -1977,6 +1979,25 @@ do_late_parsing_checks(struct _mesa_glsl_parse_state *state)
    }
 }
 
+/**
+ * Retain any live IR of \c shader, but trash the rest.
+ *
+ * The IR is built out of the arena of _mesa_glsl_compile_shader(), whose
+ * allocations can't be handed to reparent_ir() one by one, so the live IR
+ * is cloned into the shader instead.
+ */
+static void
+retain_live_ir(struct gl_shader *shader)
+{
+   exec_list *ir = new(shader) exec_list;
+
+   clone_ir_list(ir, ir, shader->ir);
+
+   ralloc_steal(ir, shader->symbols);
+   ralloc_free(shader->ir);
+   shader->ir = ir;
+}
+
 static void
 opt_shader_and_create_symbol_table(struct gl_context *ctx,
                                    struct glsl_symbol_table *source_symbols,
@@ -2024,8 +2045,7 @@ opt_shader_and_create_symbol_table(struct gl_context *ctx,
 
    validate_ir_tree(shader->ir);
 
-   /* Retain any live IR, but trash the rest. */
-   reparent_ir(shader->ir, shader->ir);
+   retain_live_ir(shader);
 
    /* Destroy the symbol table.  Create a new symbol table that contains only
     * the variables and functions that still exist in the IR.  The symbol
@@ -2083,8 +2103,13 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
       }
    }
 
+   /* The AST, the IR and everything else allocated while compiling lives
+    * in an arena, which is freed in one go at the end.  Only the live IR is
+    * kept, see retain_live_ir().
+    */
+   void *mem_ctx = ralloc_arena_context(NULL);
    struct _mesa_glsl_parse_state *state =
-      new(shader) _mesa_glsl_parse_state(ctx, shader->Stage, shader);
+      new(mem_ctx) _mesa_glsl_parse_state(ctx, shader->Stage, shader);
 
    if (ctx->Const.GenerateTemporaryNames)
       (void) p_atomic_cmpxchg(&ir_variable::temporaries_allocate_names,
@@ -2140,7 +2165,7 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
       if (!ctx->Cache || force_recompile)
          opt_shader_and_create_symbol_table(ctx, state->symbols, shader);
       else {
-         reparent_ir(shader->ir, shader->ir);
+         retain_live_ir(shader);
          shader->CompileStatus = compiled_no_opts;
       }
    }
@@ -2151,7 +2176,7 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
    }
 
    delete state->symbols;
-   ralloc_free(state);
+   ralloc_free(mem_ctx);
 }
 
 } /* extern "C" */
@@ -2183,6 +2208,12 @@ do_common_optimization(exec_list *ir, bool linked,
    const bool debug = false;
    GLboolean progress = GL_FALSE;
 
+   /* With MESA_PASS_PROFILE set, each pass is recorded, and so is the
+    * whole call, which makes the iterations of the callers' fixed-point
+    * loops stand out in the trace.
+    */
+   const int64_t start = pass_profile_begin();
+
 #define OPT(PASS, ...) do {                                             \
       if (debug) {                                                      \
          fprintf(stderr, "START GLSL optimization %s\n", #PASS);        \
@@ -2192,6 +2223,12 @@ do_common_optimization(exec_list *ir, bool linked,
             _mesa_print_ir(stderr, ir, NULL);                           \
          fprintf(stderr, "GLSL optimization %s: %s progress\n",         \
                  #PASS, opt_progress ? "made" : "no");                  \
+      } else if (unlikely(start)) {                                     \
+         const int64_t opt_start = pass_profile_begin();                \
+         const bool opt_progress = PASS(__VA_ARGS__);                   \
+         pass_profile_end("glsl", #PASS, ir, NULL, NULL, opt_start,     \
+                          opt_progress);                                \
+         progress = opt_progress || progress;                           \
       } else {                                                          \
          progress = PASS(__VA_ARGS__) || progress;                      \
       }                                                                 \
@@ -2244,9 +2281,12 @@ do_common_optimization(exec_list *ir, bool linked,
    OPT(optimize_redundant_jumps, ir);
 
    if (options->MaxUnrollIterations) {
+      const int64_t unroll_start = pass_profile_begin();
+      bool unroll_progress = false;
       loop_state *ls = analyze_loop_variables(ir);
       if (ls->loop_found) {
          bool loop_progress = unroll_loops(ir, ls, options);
+         unroll_progress = loop_progress;
          while (loop_progress) {
             loop_progress = false;
             loop_progress |= do_constant_propagation(ir);
@@ -2255,10 +2295,15 @@ do_common_optimization(exec_list *ir, bool linked,
          progress |= loop_progress;
       }
       delete ls;
+      pass_profile_end("glsl", "unroll_loops", ir, NULL, NULL, unroll_start,
+                       unroll_progress);
    }
 
 #undef OPT
 
+   pass_profile_end("glsl", "do_common_optimization", ir, NULL, NULL, start,
+                    progress);
+
    return progress;
 }
 
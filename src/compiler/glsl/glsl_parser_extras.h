@@ -32,6 +32,7 @@
 
 #include <stdlib.h>
 #include "glsl_symbol_table.h"
+#include "util/string_intern.h"
 
 struct gl_context;
 
@@ -349,6 +350,12 @@ struct _mesa_glsl_parse_state {
 
    void *linalloc;
 
+   /**
+    * Identifiers returned by the lexer, so that all occurrences of a name
+    * share one copy instead of each token getting its own.
+    */
+   struct _mesa_string_intern *identifiers;
+
    unsigned num_supported_versions;
    struct {
       unsigned ver;
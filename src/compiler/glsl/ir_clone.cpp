@@ -294,6 +294,10 @@ ir_function_signature::clone(void *mem_ctx, struct hash_table *ht) const
 {
    ir_function_signature *copy = this->clone_prototype(mem_ctx, ht);
 
+   /* Unlike a prototype, the clone has a body of its own, so it doesn't need
+    * to (and, as the original may be freed, shouldn't) refer back to it.
+    */
+   copy->origin = this->origin;
    copy->is_defined = this->is_defined;
 
    /* Clone the instruction list.
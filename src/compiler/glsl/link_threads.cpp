@@ -0,0 +1,132 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file link_threads.cpp
+ * Running the per-stage parts of linking on worker threads.
+ *
+ * Once the stages of a program have been cross-validated, most of what is
+ * left to do (optimizing, lowering, translating to the driver's IR) only
+ * looks at one stage at a time.  If MESA_GLSL_LINK_THREADS is set to a
+ * non-zero number, link_foreach_stage() hands all but the first stage to
+ * a process-wide pool of that many threads, and does the first one itself.
+ */
+
+#include "main/mtypes.h"
+#include "util/debug.h"
+#include "util/u_queue.h"
+#include "ir.h"
+#include "program.h"
+
+namespace {
+
+struct stage_job {
+   struct gl_context *ctx;
+   struct gl_linked_shader *shader;
+   link_stage_func func;
+   void *data;
+   struct util_queue_fence fence;
+};
+
+} /* anonymous namespace */
+
+static struct util_queue link_queue;
+static once_flag link_queue_once = ONCE_FLAG_INIT;
+
+static void
+init_link_queue(void)
+{
+   unsigned num_threads = env_var_as_unsigned("MESA_GLSL_LINK_THREADS", 0);
+   if (num_threads == 0)
+      return;
+
+   /* One stage is always done by the linking thread itself. */
+   num_threads = MIN2(num_threads, MESA_SHADER_STAGES - 1);
+
+   util_queue_init(&link_queue, "glsl_link", 32, num_threads,
+                   UTIL_QUEUE_INIT_RESIZE_IF_FULL);
+}
+
+static void
+execute_stage_job(void *data, int thread_index)
+{
+   struct stage_job *job = (struct stage_job *) data;
+
+   job->func(job->ctx, job->shader, job->data);
+}
+
+void
+link_foreach_stage(struct gl_context *ctx, struct gl_shader_program *prog,
+                   link_stage_func func, void *data)
+{
+   call_once(&link_queue_once, init_link_queue);
+
+   unsigned num_stages = 0;
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (prog->_LinkedShaders[i])
+         num_stages++;
+   }
+
+   if (num_stages < 2 || !util_queue_is_initialized(&link_queue)) {
+      for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+         if (prog->_LinkedShaders[i])
+            func(ctx, prog->_LinkedShaders[i], data);
+      }
+      return;
+   }
+
+   struct stage_job jobs[MESA_SHADER_STAGES];
+   unsigned num_jobs = 0;
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      struct gl_linked_shader *sh = prog->_LinkedShaders[i];
+      if (sh == NULL)
+         continue;
+
+      /* Passes allocate new IR out of ralloc_parent() of the IR they
+       * replace, which can be a context shared by all stages of the
+       * program (the linker's mem_ctx, say).  ralloc isn't thread-safe, so
+       * move everything under the stage's own IR list first.
+       */
+      reparent_ir(sh->ir, sh->ir);
+
+      struct stage_job *job = &jobs[num_jobs++];
+      job->ctx = ctx;
+      job->shader = sh;
+      job->func = func;
+      job->data = data;
+   }
+
+   for (unsigned i = 1; i < num_jobs; i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&link_queue, &jobs[i], &jobs[i].fence,
+                         execute_stage_job, NULL);
+   }
+
+   execute_stage_job(&jobs[0], 0);
+
+   for (unsigned i = 1; i < num_jobs; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+}
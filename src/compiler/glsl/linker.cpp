@@ -4733,6 +4733,22 @@ linker_optimisation_loop(struct gl_context *ctx, exec_list *ir,
       }
 }
 
+static void
+linker_optimize_stage(struct gl_context *ctx, struct gl_linked_shader *sh,
+                      void *data)
+{
+   /* Call opts before lowering const arrays to uniforms so we can const
+    * propagate any elements accessed directly.
+    */
+   linker_optimisation_loop(ctx, sh->ir, sh->Stage);
+
+   /* Call opts after lowering const arrays to copy propagate things. */
+   if (lower_const_arrays_to_uniforms(sh->ir, sh->Stage))
+      linker_optimisation_loop(ctx, sh->ir, sh->Stage);
+
+   propagate_invariance(sh->ir);
+}
+
 void
 link_shaders(struct gl_context *ctx, struct gl_shader_program *prog)
 {
@@ -5038,19 +5054,10 @@ link_shaders(struct gl_context *ctx, struct gl_shader_program *prog)
       if (ctx->Const.LowerTessLevel) {
          lower_tess_level(prog->_LinkedShaders[i]);
       }
-
-      /* Call opts before lowering const arrays to uniforms so we can const
-       * propagate any elements accessed directly.
-       */
-      linker_optimisation_loop(ctx, prog->_LinkedShaders[i]->ir, i);
-
-      /* Call opts after lowering const arrays to copy propagate things. */
-      if (lower_const_arrays_to_uniforms(prog->_LinkedShaders[i]->ir, i))
-         linker_optimisation_loop(ctx, prog->_LinkedShaders[i]->ir, i);
-
-      propagate_invariance(prog->_LinkedShaders[i]->ir);
    }
 
+   link_foreach_stage(ctx, prog, linker_optimize_stage, NULL);
+
    /* Validation for special cases where we allow sampler array indexing
     * with loop induction variable. This check emits a warning or error
     * depending if backend can handle dynamic indexing.
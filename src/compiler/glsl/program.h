@@ -32,6 +32,7 @@ extern "C" {
 struct gl_context;
 struct gl_shader;
 struct gl_shader_program;
+struct gl_linked_shader;
 
 extern void
 _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
@@ -44,6 +45,21 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
 extern void
 link_shaders(struct gl_context *ctx, struct gl_shader_program *prog);
 
+typedef void (*link_stage_func)(struct gl_context *ctx,
+                                struct gl_linked_shader *shader,
+                                void *data);
+
+/**
+ * Calls \p func on each linked shader of \p prog.
+ *
+ * The calls may happen concurrently on worker threads, so \p func must only
+ * modify the shader it is given.  In particular it must not report errors
+ * to \p prog.
+ */
+extern void
+link_foreach_stage(struct gl_context *ctx, struct gl_shader_program *prog,
+                   link_stage_func func, void *data);
+
 extern void
 build_program_resource_list(struct gl_context *ctx,
                             struct gl_shader_program *shProg);
@@ -29,6 +29,7 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "util/macros.h"
 #include "util/ralloc.h"
 #include "blob.h"
 
@@ -312,6 +313,83 @@ test_big_objects(void)
    ralloc_free(ctx);
 }
 
+/* Write the same data to a regular and a chunked blob, with writes and
+ * reservations straddling chunk boundaries, and check that the chunks hold
+ * the same bytes as the regular blob.
+ */
+static void
+test_chunked(void)
+{
+   struct blob blob, chunked;
+   struct blob_chunk *chunks, *chunk;
+   uint8_t buf[3000];
+   size_t offsets[64];
+   size_t i, size;
+   uint8_t *data;
+
+   for (i = 0; i < sizeof(buf); i++)
+      buf[i] = i * 7;
+
+   blob_init(&blob);
+   blob_init_chunked(&chunked);
+
+   for (i = 0; i < ARRAY_SIZE(offsets); i++) {
+      blob_write_bytes(&blob, buf, sizeof(buf) - i * 13);
+      blob_write_bytes(&chunked, buf, sizeof(buf) - i * 13);
+
+      offsets[i] = blob_reserve_uint32(&blob);
+      expect_equal(offsets[i], blob_reserve_uint32(&chunked),
+                   "chunked blob_reserve_uint32");
+
+      blob_write_string(&blob, string_test_str);
+      blob_write_string(&chunked, string_test_str);
+
+      blob_write_uint64(&blob, uint64_test + i);
+      blob_write_uint64(&chunked, uint64_test + i);
+   }
+
+   for (i = 0; i < ARRAY_SIZE(offsets); i++) {
+      blob_overwrite_uint32(&blob, offsets[i], i);
+      blob_overwrite_uint32(&chunked, offsets[i], i);
+   }
+
+   /* Overwriting across a chunk boundary. */
+   blob_overwrite_bytes(&blob, 16 * 1024 - 5, bytes_test_str,
+                        sizeof(bytes_test_str));
+   blob_overwrite_bytes(&chunked, 16 * 1024 - 5, bytes_test_str,
+                        sizeof(bytes_test_str));
+
+   expect_equal(false, blob_overwrite_bytes(&chunked, chunked.size - 2,
+                                            bytes_test_str,
+                                            sizeof(bytes_test_str)),
+                "chunked blob_overwrite_bytes past the end");
+
+   expect_equal(blob.size, chunked.size, "chunked blob size");
+   expect_equal(false, chunked.out_of_memory, "chunked blob out_of_memory");
+   expect_equal(true, chunked.data == NULL, "chunked blob data");
+
+   chunks = blob_steal_chunks(&chunked);
+   expect_equal(0, chunked.size, "chunked blob size after stealing");
+
+   data = malloc(blob.size);
+   size = 0;
+   for (chunk = chunks; chunk; chunk = chunk->next) {
+      if (size + chunk->size > blob.size)
+         break;
+      memcpy(data + size, chunk->data, chunk->size);
+      size += chunk->size;
+   }
+
+   expect_equal(blob.size, size, "chunked blob total chunk size");
+   if (size == blob.size)
+      expect_equal_bytes(blob.data, data, size, "chunked blob data");
+
+   free(data);
+   blob_free_chunks(chunks);
+   blob_finish(&chunked);
+   blob_finish(&blob);
+}
+
 int
 main (void)
 {
@@ -319,6 +397,7 @@ main (void)
    test_alignment ();
    test_overrun ();
    test_big_objects ();
+   test_chunked ();
 
    return error ? 1 : 0;
 }
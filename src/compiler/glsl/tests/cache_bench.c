@@ -0,0 +1,361 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Compares put and get performance of the per-file and pack disk_cache
+ * backends, or the compression codecs on an existing cache.
+ *
+ * Usage: cache-bench [num_items [item_size]]
+ *        cache-bench -corpus <cache dir>
+ *
+ * The caches are created below ./cache-bench-tmp, which is left behind so
+ * the on-disk layout can be inspected afterwards.
+ *
+ * With -corpus, all entries of a per-file cache (e.g.
+ * ~/.cache/mesa_shader_cache) are decompressed, then recompressed and loaded
+ * with each codec built in, reporting the size on disk and load time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ftw.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "util/disk_cache.h"
+#include "util/disk_cache_codec.h"
+#include "util/macros.h"
+
+#define CACHE_BENCH_TMP "./cache-bench-tmp"
+
+#ifdef ENABLE_SHADER_CACHE
+
+static double
+now_usec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void
+run(const char *name, bool pack, unsigned num_items, unsigned item_size)
+{
+   struct disk_cache *cache;
+   cache_key *keys;
+   uint8_t *data;
+   struct disk_cache_get_request *requests;
+   double start, put_time, cold_time, warm_time, batch_time;
+   unsigned i, misses = 0;
+
+   setenv("MESA_GLSL_CACHE_DIR", pack ? CACHE_BENCH_TMP "/pack" :
+                                        CACHE_BENCH_TMP "/files", 1);
+   setenv("MESA_GLSL_CACHE_PACK", pack ? "true" : "false", 1);
+
+   keys = malloc(num_items * sizeof(*keys));
+   requests = malloc(num_items * sizeof(*requests));
+   data = malloc(item_size);
+   if (!keys || !requests || !data) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+
+   cache = disk_cache_create("bench", "cache_bench", 0);
+   if (!cache) {
+      fprintf(stderr, "%s: failed to create the cache\n", name);
+      exit(1);
+   }
+
+   /* Shader binaries compress somewhat, so don't use random data only. */
+   for (i = 0; i < item_size; i++)
+      data[i] = (i & 3) ? rand() : 0;
+
+   for (i = 0; i < num_items; i++) {
+      memcpy(data, &i, sizeof(i));
+      disk_cache_compute_key(cache, data, item_size, keys[i]);
+   }
+
+   /* Puts go through the cache's single, low priority writer thread, so
+    * measure until the last one can be read back.
+    */
+   start = now_usec();
+   for (i = 0; i < num_items; i++) {
+      memcpy(data, &i, sizeof(i));
+      disk_cache_put(cache, keys[i], data, item_size, NULL);
+   }
+   for (;;) {
+      struct timespec req = { 0, 100000 };
+      void *result = disk_cache_get(cache, keys[num_items - 1], NULL);
+
+      if (result) {
+         free(result);
+         break;
+      }
+      nanosleep(&req, NULL);
+   }
+   put_time = now_usec() - start;
+
+   disk_cache_destroy(cache);
+
+   /* Reopen the cache, which is what a new application instance sees. */
+   start = now_usec();
+   cache = disk_cache_create("bench", "cache_bench", 0);
+   for (i = 0; i < num_items; i++) {
+      void *result = disk_cache_get(cache, keys[i], NULL);
+
+      if (!result)
+         misses++;
+      free(result);
+   }
+   cold_time = now_usec() - start;
+
+   start = now_usec();
+   for (i = 0; i < num_items; i++)
+      free(disk_cache_get(cache, keys[i], NULL));
+   warm_time = now_usec() - start;
+
+   start = now_usec();
+   for (i = 0; i < num_items; i++)
+      memcpy(requests[i].key, keys[i], sizeof(cache_key));
+   disk_cache_get_batch(cache, requests, num_items);
+   for (i = 0; i < num_items; i++)
+      free(disk_cache_get_finish(&requests[i], NULL));
+   batch_time = now_usec() - start;
+
+   disk_cache_destroy(cache);
+
+   printf("%-6s put+get %8.1f us/item   reopen+get %8.1f us/item   "
+          "get %8.1f us/item   batch get %8.1f us/item   misses %u\n", name,
+          put_time / num_items, cold_time / num_items,
+          warm_time / num_items, batch_time / num_items, misses);
+
+   free(keys);
+   free(requests);
+   free(data);
+}
+
+struct corpus_item {
+   void *data;
+   size_t size;
+};
+
+static struct {
+   struct corpus_item *items;
+   unsigned num_items, max_items;
+   size_t stored_size;
+} corpus;
+
+/* Extracts the uncompressed data of a cache file, following the layout
+ * written by disk_cache.c.
+ */
+static void *
+parse_cache_file(const uint8_t *item, size_t item_size, size_t *size)
+{
+   const uint8_t *ptr = item, *end = item + item_size;
+   uint32_t md_type, num_keys, cf_data[2];
+   size_t tag_size;
+
+   /* Driver keys: version, timestamp, GPU name, pointer size, flags. */
+   if (ptr == end || *ptr++ != 1)
+      return NULL;
+   for (unsigned i = 0; i < 2; i++) {
+      const uint8_t *nul = memchr(ptr, 0, end - ptr);
+      if (!nul)
+         return NULL;
+      ptr = nul + 1;
+   }
+   ptr += 1 + sizeof(uint64_t);
+
+   if (end - ptr < (ptrdiff_t) sizeof(md_type))
+      return NULL;
+   memcpy(&md_type, ptr, sizeof(md_type));
+   ptr += sizeof(md_type);
+   if (md_type == CACHE_ITEM_TYPE_GLSL) {
+      if (end - ptr < (ptrdiff_t) sizeof(num_keys))
+         return NULL;
+      memcpy(&num_keys, ptr, sizeof(num_keys));
+      ptr += sizeof(num_keys) + num_keys * sizeof(cache_key);
+   }
+
+   /* CRC and uncompressed size, then the compressed data. */
+   if (end - ptr <= (ptrdiff_t) sizeof(cf_data))
+      return NULL;
+   memcpy(cf_data, ptr, sizeof(cf_data));
+   ptr += sizeof(cf_data);
+
+   enum disk_cache_codec codec = disk_cache_codec_detect(ptr, &tag_size);
+   ptr += tag_size;
+
+   void *data = malloc(cf_data[1]);
+   if (!data ||
+       !disk_cache_decompress(codec, ptr, end - ptr, data, cf_data[1])) {
+      free(data);
+      return NULL;
+   }
+
+   *size = cf_data[1];
+   return data;
+}
+
+static int
+add_corpus_file(const char *path, const struct stat *sb, int typeflag,
+                struct FTW *ftwbuf)
+{
+   const char *name = path + ftwbuf->base;
+   void *item, *data;
+   size_t size;
+   int fd;
+
+   /* Cache entries are named by the 38 remaining hex digits of their key. */
+   if (typeflag != FTW_F || strlen(name) != 38 || strchr(name, '.'))
+      return 0;
+
+   fd = open(path, O_RDONLY);
+   if (fd == -1)
+      return 0;
+
+   item = malloc(sb->st_size);
+   if (item && read(fd, item, sb->st_size) == sb->st_size) {
+      data = parse_cache_file(item, sb->st_size, &size);
+      if (data) {
+         if (corpus.num_items == corpus.max_items) {
+            corpus.max_items = MAX2(corpus.max_items * 2, 256);
+            corpus.items = realloc(corpus.items, corpus.max_items *
+                                   sizeof(*corpus.items));
+         }
+         corpus.items[corpus.num_items].data = data;
+         corpus.items[corpus.num_items].size = size;
+         corpus.num_items++;
+         corpus.stored_size += sb->st_size;
+      }
+   }
+
+   free(item);
+   close(fd);
+   return 0;
+}
+
+static int
+run_corpus(const char *dir)
+{
+   size_t total_size = 0;
+   unsigned i, c;
+
+   if (nftw(dir, add_corpus_file, 16, FTW_PHYS) == -1 ||
+       corpus.num_items == 0) {
+      fprintf(stderr, "no cache entries found in %s\n", dir);
+      return 1;
+   }
+
+   for (i = 0; i < corpus.num_items; i++)
+      total_size += corpus.items[i].size;
+
+   printf("%u entries, %zu bytes uncompressed, %zu bytes on disk\n",
+          corpus.num_items, total_size, corpus.stored_size);
+
+   for (c = 0; c < DISK_CACHE_CODEC_COUNT; c++) {
+      void **compressed;
+      size_t *compressed_size, packed_size = 0;
+      double start, compress_time, load_time;
+      bool ok = true;
+
+      if (!disk_cache_codec_supported(c))
+         continue;
+
+      compressed = calloc(corpus.num_items, sizeof(*compressed));
+      compressed_size = calloc(corpus.num_items, sizeof(*compressed_size));
+
+      start = now_usec();
+      for (i = 0; i < corpus.num_items; i++) {
+         size_t bound = disk_cache_codec_bound(c, corpus.items[i].size);
+
+         compressed[i] = malloc(bound);
+         compressed_size[i] = disk_cache_compress(c, corpus.items[i].data,
+                                                  corpus.items[i].size,
+                                                  compressed[i], bound);
+         packed_size += compressed_size[i];
+      }
+      compress_time = now_usec() - start;
+
+      /* Loading allocates the destination like disk_cache_get() does. */
+      start = now_usec();
+      for (i = 0; i < corpus.num_items; i++) {
+         void *data = malloc(corpus.items[i].size);
+
+         ok &= disk_cache_decompress(c, compressed[i], compressed_size[i],
+                                     data, corpus.items[i].size);
+         free(data);
+      }
+      load_time = now_usec() - start;
+
+      printf("%-6s %10zu bytes (%5.1f%%)   compress %8.1f ms   "
+             "load %8.1f ms%s\n", disk_cache_codec_name(c), packed_size,
+             100.0 * packed_size / total_size, compress_time / 1000,
+             load_time / 1000, ok ? "" : "   DECOMPRESSION FAILED");
+
+      for (i = 0; i < corpus.num_items; i++)
+         free(compressed[i]);
+      free(compressed);
+      free(compressed_size);
+   }
+
+   for (i = 0; i < corpus.num_items; i++)
+      free(corpus.items[i].data);
+   free(corpus.items);
+
+   return 0;
+}
+
+#endif /* ENABLE_SHADER_CACHE */
+
+int
+main(int argc, char **argv)
+{
+#ifdef ENABLE_SHADER_CACHE
+   if (argc == 3 && strcmp(argv[1], "-corpus") == 0)
+      return run_corpus(argv[2]);
+
+   unsigned num_items = argc > 1 ? atoi(argv[1]) : 2000;
+   unsigned item_size = argc > 2 ? atoi(argv[2]) : 16 * 1024;
+
+   if (num_items == 0 || item_size < sizeof(unsigned)) {
+      fprintf(stderr, "usage: %s [num_items [item_size]]\n"
+                      "       %s -corpus <cache dir>\n", argv[0], argv[0]);
+      return 1;
+   }
+
+   mkdir(CACHE_BENCH_TMP, 0755);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1G", 1);
+
+   printf("%u items of %u bytes, %s compressed\n", num_items, item_size,
+          disk_cache_codec_name(disk_cache_codec_default()));
+   run("files", false, num_items, item_size);
+   run("pack", true, num_items, item_size);
+#endif /* ENABLE_SHADER_CACHE */
+
+   return 0;
+}
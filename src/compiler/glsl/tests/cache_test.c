@@ -37,6 +37,7 @@
 
 #include "util/mesa-sha1.h"
 #include "util/disk_cache.h"
+#include "util/disk_cache_codec.h"
 
 bool error = false;
 
@@ -477,6 +478,239 @@ test_put_key_and_get_key(void)
 
    disk_cache_destroy(cache);
 }
+
+static void
+test_put_and_get_pack(void)
+{
+   struct disk_cache *cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   uint8_t *items[4];
+   uint8_t item_keys[4][20];
+   char *result;
+   size_t size;
+   unsigned i, j;
+
+   setenv("MESA_GLSL_CACHE_PACK", "true", 1);
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/pack-cache-dir", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1M", 1);
+
+   cache = disk_cache_create("test", "make_check", 0);
+   expect_non_null(cache, "disk_cache_create with MESA_GLSL_CACHE_PACK set");
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_null(result, "pack disk_cache_get with non-existent item (pointer)");
+   expect_equal(size, 0, "pack disk_cache_get with non-existent item (size)");
+
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   wait_until_file_written(cache, blob_key);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "pack disk_cache_get of existing item (pointer)");
+   expect_equal(size, sizeof(blob), "pack disk_cache_get of existing item (size)");
+   free(result);
+
+   /* Entries must survive reopening the cache. */
+   disk_cache_destroy(cache);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "pack disk_cache_get after reopening (pointer)");
+   expect_equal(size, sizeof(blob), "pack disk_cache_get after reopening (size)");
+   free(result);
+
+   disk_cache_remove(cache, blob_key);
+   expect_true(!does_cache_contain(cache, blob_key), "pack disk_cache_remove");
+
+   /* Check that eviction keeps the most recently used entry: fill a 16K
+    * cache with three incompressible 4K items, touch the first one and
+    * then add a fourth.
+    */
+   disk_cache_destroy(cache);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "16K", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   srand(42);
+   for (i = 0; i < 4; i++) {
+      items[i] = malloc(4096);
+      for (j = 0; j < 4096; j++)
+         items[i][j] = rand();
+      disk_cache_compute_key(cache, items[i], 4096, item_keys[i]);
+   }
+
+   for (i = 0; i < 3; i++) {
+      disk_cache_put(cache, item_keys[i], items[i], 4096, NULL);
+      wait_until_file_written(cache, item_keys[i]);
+   }
+
+   /* Access times are only recorded with a one second granularity. */
+   sleep(2);
+   expect_true(does_cache_contain(cache, item_keys[0]),
+               "pack disk_cache_get before eviction");
+
+   disk_cache_put(cache, item_keys[3], items[3], 4096, NULL);
+   wait_until_file_written(cache, item_keys[3]);
+
+   expect_true(does_cache_contain(cache, item_keys[0]),
+               "pack eviction keeps the recently used item");
+   expect_true(does_cache_contain(cache, item_keys[3]),
+               "pack eviction keeps the new item");
+   expect_true(!does_cache_contain(cache, item_keys[1]) &&
+               !does_cache_contain(cache, item_keys[2]),
+               "pack eviction drops the least recently used items");
+
+   for (i = 0; i < 4; i++)
+      free(items[i]);
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_GLSL_CACHE_PACK");
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/mesa-glsl-cache-dir", 1);
+}
+
+static void
+test_codecs(void)
+{
+   struct disk_cache *cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   char *result;
+   size_t size;
+   unsigned c;
+
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/codec-cache-dir", 1);
+
+   /* Entries written with any codec must be readable whatever the codec
+    * for new entries is.
+    */
+   for (c = 0; c < DISK_CACHE_CODEC_COUNT; c++) {
+      if (!disk_cache_codec_supported(c))
+         continue;
+
+      setenv("MESA_GLSL_CACHE_CODEC", disk_cache_codec_name(c), 1);
+      cache = disk_cache_create("test", "make_check", 0);
+
+      blob[0] = 'A' + c;
+      disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+      disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+      wait_until_file_written(cache, blob_key);
+      disk_cache_destroy(cache);
+
+      unsetenv("MESA_GLSL_CACHE_CODEC");
+      cache = disk_cache_create("test", "make_check", 0);
+
+      result = disk_cache_get(cache, blob_key, &size);
+      expect_equal_str(blob, result, "disk_cache_get with another codec (pointer)");
+      expect_equal(size, sizeof(blob), "disk_cache_get with another codec (size)");
+      free(result);
+
+      disk_cache_destroy(cache);
+   }
+
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/mesa-glsl-cache-dir", 1);
+}
+
+static void
+count_release(void *data)
+{
+   (*(unsigned *) data)++;
+}
+
+static void
+test_put_segments(void)
+{
+   struct disk_cache *cache;
+   struct disk_cache_segment segments[3];
+   uint8_t key[20];
+   uint8_t *data, *result;
+   size_t size, i;
+   unsigned c, released = 0;
+
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/segments-cache-dir", 1);
+
+   /* Big enough for the segments to be compressed in several steps. */
+   size = 3 * 40000;
+   data = malloc(size);
+   for (i = 0; i < size; i++)
+      data[i] = (i * 2654435761u) >> 24;
+
+   segments[0].data = data;
+   segments[0].size = 1;
+   segments[1].data = data + 1;
+   segments[1].size = 80000 - 1;
+   segments[2].data = data + 80000;
+   segments[2].size = size - 80000;
+
+   for (c = 0; c < DISK_CACHE_CODEC_COUNT; c++) {
+      if (!disk_cache_codec_supported(c))
+         continue;
+
+      setenv("MESA_GLSL_CACHE_CODEC", disk_cache_codec_name(c), 1);
+      cache = disk_cache_create("test", "make_check", 0);
+
+      data[0] = c;
+      disk_cache_compute_key(cache, data, size, key);
+      disk_cache_put_segments(cache, key, segments, 3,
+                              count_release, &released, NULL);
+      wait_until_file_written(cache, key);
+
+      result = disk_cache_get(cache, key, &i);
+      expect_equal(i, size, "disk_cache_get of segments (size)");
+      expect_equal(result && memcmp(result, data, size) == 0, true,
+                   "disk_cache_get of segments (data)");
+      free(result);
+
+      disk_cache_destroy(cache);
+      expect_equal(released, 1, "disk_cache_put_segments release");
+      released = 0;
+   }
+
+   free(data);
+   unsetenv("MESA_GLSL_CACHE_CODEC");
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/mesa-glsl-cache-dir", 1);
+}
+
+static void
+test_get_batch(void)
+{
+   struct disk_cache *cache;
+   struct disk_cache_get_request requests[3];
+   char blob[] = "This is a blob of thirty-seven bytes";
+   char string[] = "While this string has thirty-four";
+   char *result;
+   size_t size;
+
+   cache = disk_cache_create("test", "make_check", 0);
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), requests[0].key);
+   disk_cache_compute_key(cache, string, sizeof(string), requests[1].key);
+   memset(requests[2].key, 0xff, sizeof(cache_key));
+
+   disk_cache_put(cache, requests[0].key, blob, sizeof(blob), NULL);
+   disk_cache_put(cache, requests[1].key, string, sizeof(string), NULL);
+   wait_until_file_written(cache, requests[0].key);
+   wait_until_file_written(cache, requests[1].key);
+
+   disk_cache_get_batch(cache, requests, 3);
+
+   result = disk_cache_get_finish(&requests[0], &size);
+   expect_equal_str(blob, result, "disk_cache_get_batch of 1st item (pointer)");
+   expect_equal(size, sizeof(blob), "disk_cache_get_batch of 1st item (size)");
+   free(result);
+
+   result = disk_cache_get_finish(&requests[1], &size);
+   expect_equal_str(string, result, "disk_cache_get_batch of 2nd item (pointer)");
+   expect_equal(size, sizeof(string), "disk_cache_get_batch of 2nd item (size)");
+   free(result);
+
+   result = disk_cache_get_finish(&requests[2], &size);
+   expect_null(result, "disk_cache_get_batch of non-existent item (pointer)");
+   expect_equal(size, 0, "disk_cache_get_batch of non-existent item (size)");
+
+   disk_cache_destroy(cache);
+}
 #endif /* ENABLE_SHADER_CACHE */
 
 int
@@ -491,6 +725,14 @@ main(void)
 
    test_put_key_and_get_key();
 
+   test_get_batch();
+
+   test_put_and_get_pack();
+
+   test_codecs();
+
+   test_put_segments();
+
    err = rmrf_local(CACHE_TEST_TMP);
    expect_equal(err, 0, "Removing " CACHE_TEST_TMP " again");
 #endif /* ENABLE_SHADER_CACHE */
@@ -0,0 +1,323 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Measures the time _mesa_glsl_compile_shader() takes to compile a corpus
+ * of shaders: the GLSL front end (preprocessor, lexer, parser and AST to
+ * HIR conversion) followed by the IR optimizations it runs at compile time
+ * when there is no shader cache, which usually take most of the time.
+ *
+ * Usage: frontend-bench [-n iterations] [-v glsl_version] [-V variants] file...
+ *
+ * The stage of each shader is taken from its extension, as with
+ * glsl_compiler.  Every shader is compiled once up front, so that the
+ * built-in functions and the types they use are set up before the clock
+ * starts; shaders that fail to compile are reported and left out.
+ *
+ * With -V, each shader is instead compiled as that many variants, the way
+ * engines build #define-parameterized permutations: "#define VARIANT n" is
+ * inserted in front of the line declaring main(), so all variants of a
+ * shader share everything before it.  The corpus is timed once as it is and
+ * once more with MESA_GLSL_PREPROCESSOR_CACHE set.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "main/mtypes.h"
+#include "util/ralloc.h"
+#include "ir.h"
+#include "builtin_functions.h"
+#include "glsl_types.h"
+#include "program.h"
+#include "standalone_scaffolding.h"
+
+struct bench_shader {
+   const char *file;
+   GLenum type;
+   char *source;
+};
+
+static double
+now_usec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static bool
+type_from_filename(const char *file, GLenum *type)
+{
+   static const struct {
+      const char *ext;
+      GLenum type;
+   } exts[] = {
+      { ".vert", GL_VERTEX_SHADER },
+      { ".glsl", GL_VERTEX_SHADER },
+      { ".tesc", GL_TESS_CONTROL_SHADER },
+      { ".tese", GL_TESS_EVALUATION_SHADER },
+      { ".geom", GL_GEOMETRY_SHADER },
+      { ".frag", GL_FRAGMENT_SHADER },
+      { ".comp", GL_COMPUTE_SHADER },
+   };
+   const size_t len = strlen(file);
+
+   if (len < 5)
+      return false;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(exts); i++) {
+      if (strcmp(file + len - 5, exts[i].ext) == 0) {
+         *type = exts[i].type;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static char *
+read_file(void *mem_ctx, const char *file)
+{
+   FILE *fp = fopen(file, "rb");
+   if (fp == NULL)
+      return NULL;
+
+   fseek(fp, 0, SEEK_END);
+   long size = ftell(fp);
+   fseek(fp, 0, SEEK_SET);
+
+   char *text = (char *) ralloc_size(mem_ctx, size + 1);
+   if (size < 0 || fread(text, 1, size, fp) != (size_t) size) {
+      fclose(fp);
+      return NULL;
+   }
+   text[size] = '\0';
+
+   fclose(fp);
+   return text;
+}
+
+static bool
+compile(struct gl_context *ctx, const struct bench_shader *s)
+{
+   struct gl_shader *shader = rzalloc(NULL, struct gl_shader);
+
+   shader->Type = s->type;
+   shader->Stage = _mesa_shader_enum_to_shader_stage(s->type);
+   shader->Source = s->source;
+
+   _mesa_glsl_compile_shader(ctx, shader, false, false, true);
+
+   const bool success = shader->CompileStatus == compile_success;
+   ralloc_free(shader);
+
+   return success;
+}
+
+/* Returns the offset of the line holding the declaration of main() in
+ * \p source, or -1 if there isn't one.
+ */
+static long
+main_line_offset(const char *source)
+{
+   for (const char *p = strstr(source, "main"); p; p = strstr(p + 1, "main")) {
+      const char *q = p + 4;
+
+      if (p > source && (isalnum(p[-1]) || p[-1] == '_'))
+         continue;
+      while (*q == ' ' || *q == '\t')
+         q++;
+      if (*q != '(')
+         continue;
+
+      while (p > source && p[-1] != '\n')
+         p--;
+      return p - source;
+   }
+
+   return -1;
+}
+
+static struct bench_shader *
+make_variants(void *mem_ctx, const struct bench_shader *shaders,
+              unsigned num_shaders, unsigned variants, unsigned *num_variants)
+{
+   struct bench_shader *result =
+      ralloc_array(mem_ctx, struct bench_shader, num_shaders * variants);
+   unsigned n = 0;
+
+   for (unsigned i = 0; i < num_shaders; i++) {
+      const long offset = main_line_offset(shaders[i].source);
+
+      if (offset < 0) {
+         fprintf(stderr, "%s: no main() found, skipped\n", shaders[i].file);
+         continue;
+      }
+
+      for (unsigned v = 0; v < variants; v++) {
+         result[n] = shaders[i];
+         result[n].source =
+            ralloc_asprintf(mem_ctx, "%.*s#define VARIANT %u\n%s",
+                            (int) offset, shaders[i].source, v,
+                            shaders[i].source + offset);
+         n++;
+      }
+   }
+
+   *num_variants = n;
+   return result;
+}
+
+static void
+run(struct gl_context *ctx, const struct bench_shader *shaders,
+    unsigned num_shaders, unsigned iterations)
+{
+   double best = 0, total = 0;
+
+   for (unsigned i = 0; i < iterations; i++) {
+      const double start = now_usec();
+
+      for (unsigned j = 0; j < num_shaders; j++)
+         compile(ctx, &shaders[j]);
+
+      const double time = now_usec() - start;
+      if (i == 0 || time < best)
+         best = time;
+      total += time;
+   }
+
+   printf("best %.2f ms, mean %.2f ms, %.1f us per shader\n",
+          best / 1000, total / iterations / 1000, best / num_shaders);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned iterations = 10;
+   unsigned version = 450;
+   unsigned variants = 0;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:v:V:")) != -1) {
+      switch (opt) {
+      case 'n':
+         iterations = atoi(optarg);
+         break;
+      case 'v':
+         version = atoi(optarg);
+         break;
+      case 'V':
+         variants = atoi(optarg);
+         break;
+      default:
+         optind = argc;
+         break;
+      }
+   }
+
+   if (optind >= argc || iterations == 0) {
+      fprintf(stderr,
+              "usage: %s [-n iterations] [-v glsl_version] [-V variants] "
+              "file...\n",
+              argv[0]);
+      return 1;
+   }
+
+   struct gl_context ctx;
+   const bool es = version == 100 || version == 300 || version == 310 ||
+                   version == 320;
+
+   initialize_context_to_defaults(&ctx, es ? API_OPENGLES2 :
+                                  version > 130 ? API_OPENGL_CORE :
+                                  API_OPENGL_COMPAT);
+   ctx.Const.GLSLVersion = version;
+
+   void *mem_ctx = ralloc_context(NULL);
+   struct bench_shader *shaders =
+      ralloc_array(mem_ctx, struct bench_shader, argc - optind);
+   unsigned num_shaders = 0;
+   size_t corpus_size = 0;
+
+   for (int i = optind; i < argc; i++) {
+      struct bench_shader *s = &shaders[num_shaders];
+
+      s->file = argv[i];
+      if (!type_from_filename(s->file, &s->type)) {
+         fprintf(stderr, "%s: unknown shader stage, skipped\n", s->file);
+         continue;
+      }
+
+      s->source = read_file(mem_ctx, s->file);
+      if (s->source == NULL) {
+         fprintf(stderr, "%s: can't read file, skipped\n", s->file);
+         continue;
+      }
+
+      if (!compile(&ctx, s)) {
+         fprintf(stderr, "%s: failed to compile, skipped\n", s->file);
+         continue;
+      }
+
+      corpus_size += strlen(s->source);
+      num_shaders++;
+   }
+
+   if (num_shaders == 0) {
+      ralloc_free(mem_ctx);
+      return 1;
+   }
+
+   if (variants > 0) {
+      shaders = make_variants(mem_ctx, shaders, num_shaders, variants,
+                              &num_shaders);
+      if (num_shaders == 0) {
+         ralloc_free(mem_ctx);
+         return 1;
+      }
+
+      corpus_size = 0;
+      for (unsigned i = 0; i < num_shaders; i++)
+         corpus_size += strlen(shaders[i].source);
+   }
+
+   printf("%u shaders, %zu bytes of source, %u iterations\n",
+          num_shaders, corpus_size, iterations);
+   run(&ctx, shaders, num_shaders, iterations);
+
+   if (variants > 0) {
+      setenv("MESA_GLSL_PREPROCESSOR_CACHE", "true", 1);
+      printf("with the preprocessor prefix cache:\n");
+      run(&ctx, shaders, num_shaders, iterations);
+   }
+
+   ralloc_free(mem_ctx);
+   _mesa_glsl_release_types();
+   _mesa_glsl_release_builtin_functions();
+
+   return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "main/mtypes.h"
+#include "util/ralloc.h"
+#include "glsl_parser_extras.h"
+#include "standalone_scaffolding.h"
+
+static std::string
+padding(const char *line, unsigned length)
+{
+   std::string s;
+
+   while (s.size() < length)
+      s += line;
+
+   return s;
+}
+
+/* Preprocesses \p sources in order in one context, with or without the
+ * prefix cache, and returns the outputs.
+ */
+static std::vector<std::string>
+preprocess(const std::vector<std::string> &sources, bool cache)
+{
+   struct gl_context ctx;
+   std::vector<std::string> outputs;
+
+   if (cache)
+      setenv("MESA_GLSL_PREPROCESSOR_CACHE", "true", 1);
+   else
+      unsetenv("MESA_GLSL_PREPROCESSOR_CACHE");
+
+   initialize_context_to_defaults(&ctx, API_OPENGL_COMPAT);
+
+   for (unsigned i = 0; i < sources.size(); i++) {
+      void *mem_ctx = ralloc_context(NULL);
+      const char *shader = ralloc_strdup(mem_ctx, sources[i].c_str());
+      char *info_log = ralloc_strdup(mem_ctx, "");
+
+      glcpp_preprocess(mem_ctx, &shader, &info_log, NULL, NULL, &ctx);
+      outputs.push_back(std::string(shader) + info_log);
+      ralloc_free(mem_ctx);
+   }
+
+   EXPECT_EQ(cache, ctx.PreprocessorCache != NULL);
+   ralloc_free(ctx.PreprocessorCache);
+   unsetenv("MESA_GLSL_PREPROCESSOR_CACHE");
+
+   return outputs;
+}
+
+/* Checks that preprocessing \p sources gives the same output and info log
+ * for each with the prefix cache as without it.
+ */
+static void
+expect_same_output(const std::vector<std::string> &sources)
+{
+   const std::vector<std::string> cached = preprocess(sources, true);
+   const std::vector<std::string> uncached = preprocess(sources, false);
+
+   ASSERT_EQ(uncached.size(), cached.size());
+   for (unsigned i = 0; i < cached.size(); i++)
+      EXPECT_EQ(uncached[i], cached[i]) << "source " << i;
+}
+
+/* Fills the cache and then adds an entry that has no snapshot, because the
+ * prefix ends in a comment, while the least recently used entry is the one
+ * the new source continues from.  That entry must not be replaced.
+ */
+TEST(glcpp_prefix_cache, failed_snapshot_in_full_cache)
+{
+   const std::string p0 = "#version 110\n" +
+                          padding("// a line of padding\n", 1100);
+   const std::string q = padding("#define X 1\n", 1100);
+   const std::string c = p0 + q + "/*\n";
+   const std::string e = c + "*/\n";
+   std::vector<std::string> sources;
+
+   /* An entry for p0, and one for e continuing from it. */
+   sources.push_back(p0 + "int a;\n");
+   sources.push_back(p0 + "int b;\n");
+   sources.push_back(e + "int c;\n");
+   sources.push_back(e + "int d;\n");
+
+   /* Fill the rest of the cache with unrelated prefixes. */
+   for (unsigned i = 0; i < 14; i++) {
+      const std::string r = "// prefix " + std::to_string(i) + "\n" +
+                            padding("// more padding\n", 1100);
+      sources.push_back(r + "int a;\n");
+      sources.push_back(r + "int b;\n");
+   }
+
+   /* Continues from e, which leaves p0 least recently used... */
+   sources.push_back(e + "int e;\n");
+
+   /* ...which this continues from, while the prefix it shares with the
+    * previous source ends inside a comment.
+    */
+   sources.push_back(c + "x */\nint f;\n");
+   sources.push_back(c + "y */\nint g;\n");
+
+   expect_same_output(sources);
+}
+
+/* Sources sharing a prefix which ends inside a multi-line comment.  The
+ * comment is closed by the rest of each source but the last.
+ */
+TEST(glcpp_prefix_cache, prefix_ends_in_comment)
+{
+   const std::string p = "#version 110\n" +
+                         padding("#define A 1\n", 1100) +
+                         "/* a comment\n" +
+                         padding("   spanning lines\n", 1100);
+   std::vector<std::string> sources;
+
+   sources.push_back(p + "*/ int a = A;\n");
+   sources.push_back(p + "*/ int b = A;\n");
+   sources.push_back(p + "still commented */\nint c = A;\n");
+   sources.push_back(p + "int d = A;\n");
+
+   expect_same_output(sources);
+}
+
+/* Sources sharing a prefix which ends inside an #if block, both one whose
+ * lines are kept and one whose lines are skipped, and which is closed by
+ * #else, #elif, #endif or not at all by the rest of each source.
+ */
+TEST(glcpp_prefix_cache, prefix_ends_in_if)
+{
+   const std::string p = "#version 110\n#define B 2\n#if B > 1\n" +
+                         padding("int taken;\n", 1100);
+   const std::string q = p + "#endif\n#if B < 1\n" +
+                         padding("int skipped;\n", 1100);
+   std::vector<std::string> sources;
+
+   sources.push_back(p + "#else\nint x;\n#endif\nint a = B;\n");
+   sources.push_back(p + "#else\nint y;\n#endif\nint b = B;\n");
+   sources.push_back(p + "int c = B;\n");
+   sources.push_back(q + "#elif B == 2\nint d = B;\n#endif\n");
+   sources.push_back(q + "#else\nint e = B;\n#endif\n");
+   sources.push_back(q + "#endif\nint f = B;\n");
+   sources.push_back(q + "int g = B;\n");
+
+   expect_same_output(sources);
+}
@@ -25,14 +25,149 @@
 #include "main/macros.h"
 #include "compiler/glsl/glsl_parser_extras.h"
 #include "glsl_types.h"
+#include "compiler/blob.h"
 #include "util/hash_table.h"
 
 
+/**
+ * A hash set of types that can be searched without taking
+ * glsl_type::hash_mutex.
+ *
+ * Types are only ever added, with hash_mutex held.  The hash of a slot is
+ * written before its type pointer is published with a release store, and a
+ * table that is replaced by a bigger one stays allocated until
+ * _mesa_glsl_release_types(), so a concurrent reader using acquire loads sees
+ * at worst a slightly stale set of types.  A miss is retried with the lock
+ * held before a new type is created.
+ *
+ * p_atomic_set()/p_atomic_read() only have release/acquire semantics with the
+ * GCC __atomic builtins, so without them every search takes the lock.
+ */
+struct glsl_type_table {
+   unsigned size; /**< Number of slots, a power of two. */
+   unsigned entries;
+   struct glsl_type_table *prev; /**< The table this one replaced. */
+   struct {
+      uint32_t hash;
+      const glsl_type *type;
+   } *slots;
+};
+
+#ifdef USE_GCC_ATOMIC_BUILTINS
+#define TYPE_TABLE_LOCKLESS_SEARCH 1
+#define type_table_load(_v) __atomic_load_n((_v), __ATOMIC_ACQUIRE)
+#define type_table_publish(_v, _i) __atomic_store_n((_v), (_i), __ATOMIC_RELEASE)
+#else
+#define TYPE_TABLE_LOCKLESS_SEARCH 0
+#define type_table_load(_v) (*(_v))
+#define type_table_publish(_v, _i) (*(_v) = (_i))
+#endif
+
+typedef bool (*type_table_match_func)(const glsl_type *type, const void *key);
+
+/**
+ * Searches the table.  Without TYPE_TABLE_LOCKLESS_SEARCH this must be
+ * called with glsl_type::hash_mutex held.
+ */
+static const glsl_type *
+type_table_search(glsl_type_table *const *table_ptr, uint32_t hash,
+                  type_table_match_func match, const void *key)
+{
+   const glsl_type_table *table = type_table_load(table_ptr);
+   if (table == NULL)
+      return NULL;
+
+   /* The table is never more than half full, so this terminates. */
+   const unsigned mask = table->size - 1;
+   for (unsigned i = hash & mask; ; i = (i + 1) & mask) {
+      const glsl_type *type = type_table_load(&table->slots[i].type);
+      if (type == NULL)
+         return NULL;
+      if (table->slots[i].hash == hash && match(type, key))
+         return type;
+   }
+}
+
+/**
+ * Searches the table without glsl_type::hash_mutex held.  Returns NULL,
+ * sending the caller down the locked path, when that isn't safe.
+ */
+static const glsl_type *
+type_table_search_unlocked(glsl_type_table *const *table_ptr, uint32_t hash,
+                           type_table_match_func match, const void *key)
+{
+   if (!TYPE_TABLE_LOCKLESS_SEARCH)
+      return NULL;
+
+   return type_table_search(table_ptr, hash, match, key);
+}
+
+/**
+ * Adds \p type to the table.  Must be called with glsl_type::hash_mutex
+ * held, after a search under the lock found nothing.
+ */
+static void
+type_table_insert(glsl_type_table **table_ptr, uint32_t hash,
+                  const glsl_type *type)
+{
+   glsl_type_table *table = *table_ptr;
+
+   if (table == NULL || (table->entries + 1) * 2 > table->size) {
+      const unsigned size = table ? table->size * 2 : 64;
+
+      glsl_type_table *grown =
+         (glsl_type_table *) calloc(1, sizeof(glsl_type_table));
+      grown->slots = (decltype(grown->slots))
+         calloc(size, sizeof(*grown->slots));
+      grown->size = size;
+      grown->prev = table;
+      if (table) {
+         for (unsigned i = 0; i < table->size; i++) {
+            if (table->slots[i].type == NULL)
+               continue;
+
+            unsigned j = table->slots[i].hash & (size - 1);
+            while (grown->slots[j].type != NULL)
+               j = (j + 1) & (size - 1);
+            grown->slots[j] = table->slots[i];
+         }
+         grown->entries = table->entries;
+      }
+
+      type_table_publish(table_ptr, grown);
+      table = grown;
+   }
+
+   unsigned i = hash & (table->size - 1);
+   while (table->slots[i].type != NULL)
+      i = (i + 1) & (table->size - 1);
+
+   table->slots[i].hash = hash;
+   type_table_publish(&table->slots[i].type, type);
+   table->entries++;
+}
+
+static void
+type_table_destroy(glsl_type_table **table_ptr)
+{
+   glsl_type_table *table = *table_ptr;
+
+   while (table != NULL) {
+      glsl_type_table *prev = table->prev;
+      free(table->slots);
+      free(table);
+      table = prev;
+   }
+
+   *table_ptr = NULL;
+}
+
+
 mtx_t glsl_type::mem_mutex = _MTX_INITIALIZER_NP;
 mtx_t glsl_type::hash_mutex = _MTX_INITIALIZER_NP;
-hash_table *glsl_type::array_types = NULL;
-hash_table *glsl_type::record_types = NULL;
-hash_table *glsl_type::interface_types = NULL;
+glsl_type_table *glsl_type::array_types = NULL;
+glsl_type_table *glsl_type::record_types = NULL;
+glsl_type_table *glsl_type::interface_types = NULL;
 hash_table *glsl_type::function_types = NULL;
 hash_table *glsl_type::subroutine_types = NULL;
 void *glsl_type::mem_ctx = NULL;
@@ -411,20 +546,9 @@ _mesa_glsl_release_types(void)
     * object, or if process terminates), so no mutex-locking should be
     * necessary.
     */
-   if (glsl_type::array_types != NULL) {
-      _mesa_hash_table_destroy(glsl_type::array_types, NULL);
-      glsl_type::array_types = NULL;
-   }
-
-   if (glsl_type::record_types != NULL) {
-      _mesa_hash_table_destroy(glsl_type::record_types, NULL);
-      glsl_type::record_types = NULL;
-   }
-
-   if (glsl_type::interface_types != NULL) {
-      _mesa_hash_table_destroy(glsl_type::interface_types, NULL);
-      glsl_type::interface_types = NULL;
-   }
+   type_table_destroy(&glsl_type::array_types);
+   type_table_destroy(&glsl_type::record_types);
+   type_table_destroy(&glsl_type::interface_types);
 
    if (glsl_type::function_types != NULL) {
       _mesa_hash_table_destroy(glsl_type::function_types, NULL);
@@ -872,127 +996,132 @@ glsl_type::get_image_instance(enum glsl_sampler_dim dim,
    unreachable("switch statement above should be complete");
 }
 
+namespace {
+
+struct array_key {
+   const glsl_type *base;
+   unsigned size;
+};
+
+} /* anonymous namespace */
+
+static bool
+array_key_match(const glsl_type *type, const void *data)
+{
+   const array_key *key = (const array_key *) data;
+
+   return type->fields.array == key->base && type->length == key->size;
+}
+
 const glsl_type *
 glsl_type::get_array_instance(const glsl_type *base, unsigned array_size)
 {
-   /* Generate a name using the base type pointer in the key.  This is
-    * done because the name of the base type may not be unique across
-    * shaders.  For example, two shaders may have different record types
-    * named 'foo'.
+   /* The key uses the base type pointer rather than its name, because the
+    * name of the base type may not be unique across shaders.  For example,
+    * two shaders may have different record types named 'foo'.
     */
-   char key[128];
-   snprintf(key, sizeof(key), "%p[%u]", (void *) base, array_size);
-
-   mtx_lock(&glsl_type::hash_mutex);
+   const array_key key = { base, array_size };
+   const uint32_t hash = _mesa_hash_pointer(base) ^ (array_size * 0x9e3779b1);
 
-   if (array_types == NULL) {
-      array_types = _mesa_hash_table_create(NULL, _mesa_key_hash_string,
-                                            _mesa_key_string_equal);
-   }
+   const glsl_type *t = type_table_search_unlocked(&array_types, hash,
+                                                   array_key_match, &key);
+   if (t != NULL)
+      return t;
 
-   const struct hash_entry *entry = _mesa_hash_table_search(array_types, key);
-   if (entry == NULL) {
-      const glsl_type *t = new glsl_type(base, array_size);
+   mtx_lock(&glsl_type::hash_mutex);
 
-      entry = _mesa_hash_table_insert(array_types,
-                                      ralloc_strdup(mem_ctx, key),
-                                      (void *) t);
+   t = type_table_search(&array_types, hash, array_key_match, &key);
+   if (t == NULL) {
+      t = new glsl_type(base, array_size);
+      type_table_insert(&array_types, hash, t);
    }
 
-   assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_ARRAY);
-   assert(((glsl_type *) entry->data)->length == array_size);
-   assert(((glsl_type *) entry->data)->fields.array == base);
+   assert(t->base_type == GLSL_TYPE_ARRAY);
+   assert(t->length == array_size);
+   assert(t->fields.array == base);
 
    mtx_unlock(&glsl_type::hash_mutex);
 
-   return (glsl_type *) entry->data;
+   return t;
 }
 
 
-bool
-glsl_type::record_compare(const glsl_type *b, bool match_locations) const
+/**
+ * Compares the \p length fields of two records or interfaces.
+ */
+static bool
+struct_fields_match(const glsl_struct_field *a, const glsl_struct_field *b,
+                    unsigned length, bool match_locations)
 {
-   if (this->length != b->length)
-      return false;
-
-   if (this->interface_packing != b->interface_packing)
-      return false;
-
-   if (this->interface_row_major != b->interface_row_major)
-      return false;
-
-   /* From the GLSL 4.20 specification (Sec 4.2):
-    *
-    *     "Structures must have the same name, sequence of type names, and
-    *     type definitions, and field names to be considered the same type."
-    *
-    * GLSL ES behaves the same (Ver 1.00 Sec 4.2.4, Ver 3.00 Sec 4.2.5).
-    */
-   if (strcmp(this->name, b->name) != 0)
-      return false;
-
-   for (unsigned i = 0; i < this->length; i++) {
-      if (this->fields.structure[i].type != b->fields.structure[i].type)
+   for (unsigned i = 0; i < length; i++) {
+      if (a[i].type != b[i].type)
          return false;
-      if (strcmp(this->fields.structure[i].name,
-                 b->fields.structure[i].name) != 0)
+      if (strcmp(a[i].name, b[i].name) != 0)
          return false;
-      if (this->fields.structure[i].matrix_layout
-         != b->fields.structure[i].matrix_layout)
-        return false;
-      if (match_locations && this->fields.structure[i].location
-          != b->fields.structure[i].location)
+      if (a[i].matrix_layout != b[i].matrix_layout)
          return false;
-      if (this->fields.structure[i].offset
-          != b->fields.structure[i].offset)
+      if (match_locations && a[i].location != b[i].location)
          return false;
-      if (this->fields.structure[i].interpolation
-          != b->fields.structure[i].interpolation)
+      if (a[i].offset != b[i].offset)
          return false;
-      if (this->fields.structure[i].centroid
-          != b->fields.structure[i].centroid)
+      if (a[i].interpolation != b[i].interpolation)
          return false;
-      if (this->fields.structure[i].sample
-          != b->fields.structure[i].sample)
+      if (a[i].centroid != b[i].centroid)
          return false;
-      if (this->fields.structure[i].patch
-          != b->fields.structure[i].patch)
+      if (a[i].sample != b[i].sample)
          return false;
-      if (this->fields.structure[i].memory_read_only
-          != b->fields.structure[i].memory_read_only)
+      if (a[i].patch != b[i].patch)
          return false;
-      if (this->fields.structure[i].memory_write_only
-          != b->fields.structure[i].memory_write_only)
+      if (a[i].memory_read_only != b[i].memory_read_only)
          return false;
-      if (this->fields.structure[i].memory_coherent
-          != b->fields.structure[i].memory_coherent)
+      if (a[i].memory_write_only != b[i].memory_write_only)
          return false;
-      if (this->fields.structure[i].memory_volatile
-          != b->fields.structure[i].memory_volatile)
+      if (a[i].memory_coherent != b[i].memory_coherent)
          return false;
-      if (this->fields.structure[i].memory_restrict
-          != b->fields.structure[i].memory_restrict)
+      if (a[i].memory_volatile != b[i].memory_volatile)
          return false;
-      if (this->fields.structure[i].image_format
-          != b->fields.structure[i].image_format)
+      if (a[i].memory_restrict != b[i].memory_restrict)
          return false;
-      if (this->fields.structure[i].precision
-          != b->fields.structure[i].precision)
+      if (a[i].image_format != b[i].image_format)
          return false;
-      if (this->fields.structure[i].explicit_xfb_buffer
-          != b->fields.structure[i].explicit_xfb_buffer)
+      if (a[i].precision != b[i].precision)
          return false;
-      if (this->fields.structure[i].xfb_buffer
-          != b->fields.structure[i].xfb_buffer)
+      if (a[i].explicit_xfb_buffer != b[i].explicit_xfb_buffer)
          return false;
-      if (this->fields.structure[i].xfb_stride
-          != b->fields.structure[i].xfb_stride)
+      if (a[i].xfb_buffer != b[i].xfb_buffer)
+         return false;
+      if (a[i].xfb_stride != b[i].xfb_stride)
          return false;
    }
 
    return true;
 }
 
+bool
+glsl_type::record_compare(const glsl_type *b, bool match_locations) const
+{
+   if (this->length != b->length)
+      return false;
+
+   if (this->interface_packing != b->interface_packing)
+      return false;
+
+   if (this->interface_row_major != b->interface_row_major)
+      return false;
+
+   /* From the GLSL 4.20 specification (Sec 4.2):
+    *
+    *     "Structures must have the same name, sequence of type names, and
+    *     type definitions, and field names to be considered the same type."
+    *
+    * GLSL ES behaves the same (Ver 1.00 Sec 4.2.4, Ver 3.00 Sec 4.2.5).
+    */
+   if (strcmp(this->name, b->name) != 0)
+      return false;
+
+   return struct_fields_match(this->fields.structure, b->fields.structure,
+                              this->length, match_locations);
+}
 
 bool
 glsl_type::record_key_compare(const void *a, const void *b)
@@ -1028,35 +1157,70 @@ glsl_type::record_key_hash(const void *a)
 }
 
 
+namespace {
+
+struct record_key {
+   const glsl_struct_field *fields;
+   unsigned num_fields;
+   unsigned packing;
+   bool row_major;
+   const char *name;
+};
+
+} /* anonymous namespace */
+
+static uint32_t
+hash_record_key(const record_key *key)
+{
+   uint32_t hash = _mesa_hash_string(key->name) ^ key->num_fields;
+
+   for (unsigned i = 0; i < key->num_fields; i++)
+      hash = hash * 13 + _mesa_hash_pointer(key->fields[i].type);
+
+   return hash;
+}
+
+static bool
+record_key_match(const glsl_type *type, const void *data)
+{
+   const record_key *key = (const record_key *) data;
+
+   return type->length == key->num_fields &&
+          type->interface_packing == key->packing &&
+          type->interface_row_major == key->row_major &&
+          strcmp(type->name, key->name) == 0 &&
+          struct_fields_match(type->fields.structure, key->fields,
+                              key->num_fields, true);
+}
+
 const glsl_type *
 glsl_type::get_record_instance(const glsl_struct_field *fields,
                                unsigned num_fields,
                                const char *name)
 {
-   const glsl_type key(fields, num_fields, name);
+   const record_key key = { fields, num_fields, 0, false, name };
+   const uint32_t hash = hash_record_key(&key);
 
-   mtx_lock(&glsl_type::hash_mutex);
-
-   if (record_types == NULL) {
-      record_types = _mesa_hash_table_create(NULL, record_key_hash,
-                                             record_key_compare);
-   }
+   const glsl_type *t = type_table_search_unlocked(&record_types, hash,
+                                                   record_key_match, &key);
+   if (t != NULL)
+      return t;
 
-   const struct hash_entry *entry = _mesa_hash_table_search(record_types,
-                                                            &key);
-   if (entry == NULL) {
-      const glsl_type *t = new glsl_type(fields, num_fields, name);
+   mtx_lock(&glsl_type::hash_mutex);
 
-      entry = _mesa_hash_table_insert(record_types, t, (void *) t);
+   t = type_table_search(&record_types, hash, record_key_match, &key);
+   if (t == NULL) {
+      t = new glsl_type(fields, num_fields, name);
+      type_table_insert(&record_types, hash, t);
    }
 
-   assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_STRUCT);
-   assert(((glsl_type *) entry->data)->length == num_fields);
-   assert(strcmp(((glsl_type *) entry->data)->name, name) == 0);
+   assert(t->base_type == GLSL_TYPE_STRUCT);
+   assert(t->length == num_fields);
+   assert(strcmp(t->name, name) == 0);
 
    mtx_unlock(&glsl_type::hash_mutex);
 
-   return (glsl_type *) entry->data;
+   return t;
 }
 
 
@@ -1067,31 +1231,31 @@ glsl_type::get_interface_instance(const glsl_struct_field *fields,
                                   bool row_major,
                                   const char *block_name)
 {
-   const glsl_type key(fields, num_fields, packing, row_major, block_name);
-
-   mtx_lock(&glsl_type::hash_mutex);
+   const record_key key = {
+      fields, num_fields, (unsigned) packing, row_major, block_name
+   };
+   const uint32_t hash = hash_record_key(&key);
 
-   if (interface_types == NULL) {
-      interface_types = _mesa_hash_table_create(NULL, record_key_hash,
-                                                record_key_compare);
-   }
+   const glsl_type *t = type_table_search_unlocked(&interface_types, hash,
+                                                   record_key_match, &key);
+   if (t != NULL)
+      return t;
 
-   const struct hash_entry *entry = _mesa_hash_table_search(interface_types,
-                                                            &key);
-   if (entry == NULL) {
-      const glsl_type *t = new glsl_type(fields, num_fields,
-                                         packing, row_major, block_name);
+   mtx_lock(&glsl_type::hash_mutex);
 
-      entry = _mesa_hash_table_insert(interface_types, t, (void *) t);
+   t = type_table_search(&interface_types, hash, record_key_match, &key);
+   if (t == NULL) {
+      t = new glsl_type(fields, num_fields, packing, row_major, block_name);
+      type_table_insert(&interface_types, hash, t);
    }
 
-   assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_INTERFACE);
-   assert(((glsl_type *) entry->data)->length == num_fields);
-   assert(strcmp(((glsl_type *) entry->data)->name, block_name) == 0);
+   assert(t->base_type == GLSL_TYPE_INTERFACE);
+   assert(t->length == num_fields);
+   assert(strcmp(t->name, block_name) == 0);
 
    mtx_unlock(&glsl_type::hash_mutex);
 
-   return (glsl_type *) entry->data;
+   return t;
 }
 
 const glsl_type *
@@ -2065,3 +2229,177 @@ glsl_type::coordinate_components() const
 
 #include "compiler/builtin_type_macros.h"
 /** @} */
+
+static void
+get_struct_type_field_and_pointer_sizes(size_t *s_field_size,
+                                        size_t *s_field_ptrs)
+{
+   *s_field_size = sizeof(glsl_struct_field);
+   *s_field_ptrs =
+     sizeof(((glsl_struct_field *)0)->type) +
+     sizeof(((glsl_struct_field *)0)->name);
+}
+
+void
+encode_type_to_blob(struct blob *blob, const glsl_type *type)
+{
+   uint32_t encoding;
+
+   if (!type) {
+      blob_write_uint32(blob, 0);
+      return;
+   }
+
+   switch (type->base_type) {
+   case GLSL_TYPE_UINT:
+   case GLSL_TYPE_INT:
+   case GLSL_TYPE_FLOAT:
+   case GLSL_TYPE_BOOL:
+   case GLSL_TYPE_DOUBLE:
+   case GLSL_TYPE_UINT64:
+   case GLSL_TYPE_INT64:
+      encoding = (type->base_type << 24) |
+         (type->vector_elements << 4) |
+         (type->matrix_columns);
+      break;
+   case GLSL_TYPE_SAMPLER:
+      encoding = (type->base_type) << 24 |
+         (type->sampler_dimensionality << 4) |
+         (type->sampler_shadow << 3) |
+         (type->sampler_array << 2) |
+         (type->sampled_type);
+      break;
+   case GLSL_TYPE_SUBROUTINE:
+      encoding = type->base_type << 24;
+      blob_write_uint32(blob, encoding);
+      blob_write_string(blob, type->name);
+      return;
+   case GLSL_TYPE_IMAGE:
+      encoding = (type->base_type) << 24 |
+         (type->sampler_dimensionality << 3) |
+         (type->sampler_array << 2) |
+         (type->sampled_type);
+      break;
+   case GLSL_TYPE_ATOMIC_UINT:
+      encoding = (type->base_type << 24);
+      break;
+   case GLSL_TYPE_ARRAY:
+      blob_write_uint32(blob, (type->base_type) << 24);
+      blob_write_uint32(blob, type->length);
+      encode_type_to_blob(blob, type->fields.array);
+      return;
+   case GLSL_TYPE_STRUCT:
+   case GLSL_TYPE_INTERFACE:
+      blob_write_uint32(blob, (type->base_type) << 24);
+      blob_write_string(blob, type->name);
+      blob_write_uint32(blob, type->length);
+
+      size_t s_field_size, s_field_ptrs;
+      get_struct_type_field_and_pointer_sizes(&s_field_size, &s_field_ptrs);
+
+      for (unsigned i = 0; i < type->length; i++) {
+         encode_type_to_blob(blob, type->fields.structure[i].type);
+         blob_write_string(blob, type->fields.structure[i].name);
+
+         /* Write the struct field skipping the pointers */
+         blob_write_bytes(blob,
+                          ((char *)&type->fields.structure[i]) + s_field_ptrs,
+                          s_field_size - s_field_ptrs);
+      }
+
+      if (type->is_interface()) {
+         blob_write_uint32(blob, type->interface_packing);
+         blob_write_uint32(blob, type->interface_row_major);
+      }
+      return;
+   case GLSL_TYPE_VOID:
+      encoding = (type->base_type << 24);
+      break;
+   case GLSL_TYPE_ERROR:
+   default:
+      assert(!"Cannot encode type!");
+      encoding = 0;
+      break;
+   }
+
+   blob_write_uint32(blob, encoding);
+}
+
+const glsl_type *
+decode_type_from_blob(struct blob_reader *blob)
+{
+   uint32_t u = blob_read_uint32(blob);
+
+   if (u == 0) {
+      return NULL;
+   }
+
+   glsl_base_type base_type = (glsl_base_type) (u >> 24);
+
+   switch (base_type) {
+   case GLSL_TYPE_UINT:
+   case GLSL_TYPE_INT:
+   case GLSL_TYPE_FLOAT:
+   case GLSL_TYPE_BOOL:
+   case GLSL_TYPE_DOUBLE:
+   case GLSL_TYPE_UINT64:
+   case GLSL_TYPE_INT64:
+      return glsl_type::get_instance(base_type, (u >> 4) & 0x0f, u & 0x0f);
+   case GLSL_TYPE_SAMPLER:
+      return glsl_type::get_sampler_instance((enum glsl_sampler_dim) ((u >> 4) & 0x07),
+                                             (u >> 3) & 0x01,
+                                             (u >> 2) & 0x01,
+                                             (glsl_base_type) ((u >> 0) & 0x03));
+   case GLSL_TYPE_SUBROUTINE:
+      return glsl_type::get_subroutine_instance(blob_read_string(blob));
+   case GLSL_TYPE_IMAGE:
+      return glsl_type::get_image_instance((enum glsl_sampler_dim) ((u >> 3) & 0x07),
+                                             (u >> 2) & 0x01,
+                                             (glsl_base_type) ((u >> 0) & 0x03));
+   case GLSL_TYPE_ATOMIC_UINT:
+      return glsl_type::atomic_uint_type;
+   case GLSL_TYPE_ARRAY: {
+      unsigned length = blob_read_uint32(blob);
+      return glsl_type::get_array_instance(decode_type_from_blob(blob),
+                                           length);
+   }
+   case GLSL_TYPE_STRUCT:
+   case GLSL_TYPE_INTERFACE: {
+      char *name = blob_read_string(blob);
+      unsigned num_fields = blob_read_uint32(blob);
+
+      size_t s_field_size, s_field_ptrs;
+      get_struct_type_field_and_pointer_sizes(&s_field_size, &s_field_ptrs);
+
+      glsl_struct_field *fields =
+         (glsl_struct_field *) malloc(s_field_size * num_fields);
+      for (unsigned i = 0; i < num_fields; i++) {
+         fields[i].type = decode_type_from_blob(blob);
+         fields[i].name = blob_read_string(blob);
+
+         blob_copy_bytes(blob, ((uint8_t *) &fields[i]) + s_field_ptrs,
+                         s_field_size - s_field_ptrs);
+      }
+
+      const glsl_type *t;
+      if (base_type == GLSL_TYPE_INTERFACE) {
+         enum glsl_interface_packing packing =
+            (glsl_interface_packing) blob_read_uint32(blob);
+         bool row_major = blob_read_uint32(blob);
+         t = glsl_type::get_interface_instance(fields, num_fields, packing,
+                                               row_major, name);
+      } else {
+         t = glsl_type::get_record_instance(fields, num_fields, name);
+      }
+
+      free(fields);
+      return t;
+   }
+   case GLSL_TYPE_VOID:
+      return glsl_type::void_type;
+   case GLSL_TYPE_ERROR:
+   default:
+      assert(!"Cannot decode type!");
+      return NULL;
+   }
+}
@@ -36,6 +36,9 @@ extern "C" {
 
 struct _mesa_glsl_parse_state;
 struct glsl_symbol_table;
+struct glsl_type;
+struct blob;
+struct blob_reader;
 
 extern void
 _mesa_glsl_initialize_types(struct _mesa_glsl_parse_state *state);
@@ -43,6 +46,16 @@ _mesa_glsl_initialize_types(struct _mesa_glsl_parse_state *state);
 extern void
 _mesa_glsl_release_types(void);
 
+/**
+ * Serialize \p type (which may be NULL) to \p blob, in a form that
+ * decode_type_from_blob() turns back into the same type.
+ */
+void
+encode_type_to_blob(struct blob *blob, const struct glsl_type *type);
+
+const struct glsl_type *
+decode_type_from_blob(struct blob_reader *blob);
+
 #ifdef __cplusplus
 }
 #endif
@@ -888,14 +901,14 @@ private:
    /** Constructor for subroutine types */
    glsl_type(const char *name);
 
-   /** Hash table containing the known array types. */
-   static struct hash_table *array_types;
+   /** Table containing the known array types. */
+   static struct glsl_type_table *array_types;
 
-   /** Hash table containing the known record types. */
-   static struct hash_table *record_types;
+   /** Table containing the known record types. */
+   static struct glsl_type_table *record_types;
 
-   /** Hash table containing the known interface types. */
-   static struct hash_table *interface_types;
+   /** Table containing the known interface types. */
+   static struct glsl_type_table *interface_types;
 
    /** Hash table containing the known subroutine types. */
    static struct hash_table *subroutine_types;
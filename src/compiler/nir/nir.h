@@ -39,6 +39,7 @@
 #include "compiler/nir_types.h"
 #include "compiler/shader_enums.h"
 #include "compiler/shader_info.h"
+#include "compiler/pass_profile.h"
 #include <stdio.h>
 
 #ifdef DEBUG
@@ -1611,6 +1612,9 @@ typedef struct {
    struct exec_list body; /** < list of nir_cf_node */
 
    nir_loop_info *info;
+
+   /* Set once nir_opt_loop_unroll has unrolled the loop partially */
+   bool partially_unrolled;
 } nir_loop;
 
 /**
@@ -1784,6 +1788,37 @@ typedef struct nir_function {
    nir_function_impl *impl;
 } nir_function;
 
+struct nir_shader;
+
+/** Unroll factor asking nir_opt_loop_unroll to unroll a loop completely */
+#define NIR_LOOP_UNROLL_FULL (~0u)
+
+/**
+ * A driver's cost model for loop unrolling.
+ *
+ * Returns how many iterations of \p loop nir_opt_loop_unroll should unroll,
+ * from the loop's info as set up by nir_loop_analyze and whatever the
+ * driver knows about its register file and SIMD width:
+ *
+ *  - 0 leaves the loop alone.
+ *
+ *  - NIR_LOOP_UNROLL_FULL, or anything no smaller than the trip count,
+ *    unrolls the loop completely.
+ *
+ *  - Anything in between unrolls the loop partially: the loop is kept,
+ *    running that many iterations of the original one each time around, and
+ *    the remaining trip count % factor iterations are peeled off in front of
+ *    it.  This is only done for loops with a known trip count, a single exit
+ *    and no other jumps, that haven't been unrolled partially before;
+ *    otherwise the loop is left alone.
+ *
+ * It is called for the innermost loops nir_opt_loop_unroll knows how to
+ * unroll completely, which can include loops unrolled partially earlier
+ * whose new trip count has been worked out.
+ */
+typedef unsigned (*nir_loop_unroll_factor_cb)(const struct nir_shader *shader,
+                                              const nir_loop *loop);
+
 typedef struct nir_shader_compiler_options {
    bool lower_fdiv;
    bool lower_ffma;
@@ -1859,6 +1894,13 @@ typedef struct nir_shader_compiler_options {
    unsigned max_subgroup_size;
 
    unsigned max_unroll_iterations;
+
+   /**
+    * Decides how far loops get unrolled.  If NULL,
+    * nir_loop_unroll_default_factor() is used, which unrolls loops
+    * completely when they are small enough given max_unroll_iterations.
+    */
+   nir_loop_unroll_factor_cb loop_unroll_factor;
 } nir_shader_compiler_options;
 
 typedef struct nir_shader {
@@ -2311,6 +2353,8 @@ nir_variable *nir_variable_clone(const nir_variable *c, nir_shader *shader);
 nir_deref *nir_deref_clone(const nir_deref *deref, void *mem_ctx);
 nir_deref_var *nir_deref_var_clone(const nir_deref_var *deref, void *mem_ctx);
 
+nir_shader *nir_shader_serialize_deserialize(void *mem_ctx, nir_shader *s);
+
 #ifdef DEBUG
 void nir_validate_shader(nir_shader *shader);
 void nir_metadata_set_validation_flag(nir_shader *shader);
@@ -2326,6 +2370,16 @@ should_clone_nir(void)
    return should_clone;
 }
 
+static inline bool
+should_serialize_deserialize_nir(void)
+{
+   static int test_serialize = -1;
+   if (test_serialize < 0)
+      test_serialize = env_var_as_boolean("NIR_TEST_SERIALIZE", false);
+
+   return test_serialize;
+}
+
 static inline bool
 should_print_nir(void)
 {
@@ -2340,6 +2394,7 @@ static inline void nir_validate_shader(nir_shader *shader) { (void) shader; }
 static inline void nir_metadata_set_validation_flag(nir_shader *shader) { (void) shader; }
 static inline void nir_metadata_check_validation_flag(nir_shader *shader) { (void) shader; }
 static inline bool should_clone_nir(void) { return false; }
+static inline bool should_serialize_deserialize_nir(void) { return false; }
 static inline bool should_print_nir(void) { return false; }
 #endif /* DEBUG */
 
@@ -2351,13 +2406,33 @@ static inline bool should_print_nir(void) { return false; }
       ralloc_free(nir);                                              \
       nir = clone;                                                   \
    }                                                                 \
+   if (should_serialize_deserialize_nir()) {                         \
+      void *mem_ctx = ralloc_parent(nir);                            \
+      nir = nir_shader_serialize_deserialize(mem_ctx, nir);          \
+   }                                                                 \
 } while (0)
 
+/* Records a pass run for MESA_PASS_PROFILE, see pass_profile.h. */
+static inline void
+nir_profile_pass(const nir_shader *nir, const char *pass, int64_t start,
+                 int progress)
+{
+   if (likely(start == 0))
+      return;
+
+   pass_profile_end("nir", pass, nir,
+                    _mesa_shader_stage_to_abbrev(nir->info.stage),
+                    nir->info.name, start, progress);
+}
+
 #define NIR_PASS(progress, nir, pass, ...) _PASS(nir,                \
    nir_metadata_set_validation_flag(nir);                            \
    if (should_print_nir())                                           \
       printf("%s\n", #pass);                                         \
-   if (pass(nir, ##__VA_ARGS__)) {                                   \
+   int64_t _pass_start = pass_profile_begin();                       \
+   bool _pass_progress = pass(nir, ##__VA_ARGS__);                   \
+   nir_profile_pass(nir, #pass, _pass_start, _pass_progress);        \
+   if (_pass_progress) {                                             \
       progress = true;                                               \
       if (should_print_nir())                                        \
          nir_print_shader(nir, stdout);                              \
@@ -2368,7 +2443,9 @@ static inline bool should_print_nir(void) { return false; }
 #define NIR_PASS_V(nir, pass, ...) _PASS(nir,                        \
    if (should_print_nir())                                           \
       printf("%s\n", #pass);                                         \
+   int64_t _pass_start = pass_profile_begin();                       \
    pass(nir, ##__VA_ARGS__);                                         \
+   nir_profile_pass(nir, #pass, _pass_start, -1);                    \
    if (should_print_nir())                                           \
       nir_print_shader(nir, stdout);                                 \
 )
@@ -2635,6 +2712,20 @@ void nir_loop_analyze_impl(nir_function_impl *impl,
 
 bool nir_ssa_defs_interfere(nir_ssa_def *a, nir_ssa_def *b);
 
+/**
+ * Liveness information computed on demand, for the SSA values that are
+ * asked about only, rather than for every value in every block as
+ * nir_metadata_live_ssa_defs does.  Creating one numbers the SSA values'
+ * live_index like nir_live_ssa_defs_impl() and requires block indices and
+ * dominance; it is only valid until the function is changed.
+ */
+typedef struct nir_sparse_liveness nir_sparse_liveness;
+
+nir_sparse_liveness *nir_sparse_liveness_create(void *mem_ctx,
+                                                nir_function_impl *impl);
+bool nir_sparse_liveness_ssa_defs_interfere(nir_sparse_liveness *live,
+                                            nir_ssa_def *a, nir_ssa_def *b);
+
 bool nir_repair_ssa_impl(nir_function_impl *impl);
 bool nir_repair_ssa(nir_shader *shader);
 
@@ -2668,11 +2759,15 @@ bool nir_opt_dead_cf(nir_shader *shader);
 
 bool nir_opt_gcm(nir_shader *shader, bool value_number);
 
+bool nir_opt_gvn(nir_shader *shader);
+
 bool nir_opt_if(nir_shader *shader);
 
 bool nir_opt_intrinsics(nir_shader *shader);
 
 bool nir_opt_loop_unroll(nir_shader *shader, nir_variable_mode indirect_mask);
+unsigned nir_loop_unroll_default_factor(const nir_shader *shader,
+                                        const nir_loop *loop);
 
 bool nir_opt_move_comparisons(nir_shader *shader);
 
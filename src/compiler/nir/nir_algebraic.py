@@ -495,6 +495,141 @@ class SearchAndReplace(object):
 
       BitSizeValidator(varset).validate(self.search, self.replace)
 
+class TreeAutomaton(object):
+   """A bottom-up tree automaton that finds the transforms which may match
+   an instruction.
+
+   Trying every transform for an opcode with nir_replace_instr() is slow for
+   opcodes like iand or fmul which have dozens of them, and most of those are
+   rejected because one of the sources is produced by the wrong opcode.  The
+   automaton assigns each SSA value a state, which is the set of search
+   sub-expressions it may match considering only the opcodes of the
+   instructions involved.  The state of an ALU instruction is looked up in a
+   per-opcode table indexed by the states of its sources, so computing the
+   states of a whole shader is a single forward walk.  Then only the
+   transforms whose search expression is part of the instruction's state need
+   to be tried.
+
+   The matching is conservative: everything the automaton ignores (variable
+   conditions and types, constant values, bit sizes, swizzles, whether a
+   variable appears twice) is still checked by nir_search, so the result is
+   exactly that of trying every transform in order.
+
+   An item is a search expression reduced to its opcode and its sources,
+   where variables become '*' (anything) and constants or constant
+   variables become '#' (a load_const).  A state is a frozenset of items.
+   State 0 is the empty set and state 1 is the state of load_const
+   instructions, which is the only one containing '#'.
+   """
+
+   wildcard = '*'
+   constant = '#'
+
+   def __init__(self, transforms):
+      self.opcodes = {}
+      self.xform_items = {}
+      for xform in transforms:
+         self.xform_items[xform.id] = self._add_item(xform.search)
+
+      self.states = []
+      self._state_index = {}
+      self._add_state(frozenset())
+      self._add_state(frozenset([self.constant]))
+
+      self.filtered_states = {}
+      self._filtered_index = {}
+      self.tables = {}
+      self._src_patterns = {}
+      for op, items in self.opcodes.items():
+         patterns = set()
+         for item in items:
+            patterns.update(item[1])
+         patterns.discard(self.wildcard)
+         self._src_patterns[op] = frozenset(patterns)
+         self.filtered_states[op] = []
+         self._filtered_index[op] = {}
+         self.tables[op] = {}
+
+      self._build()
+
+   def _add_item(self, val):
+      if isinstance(val, Expression):
+         item = (val.opcode, tuple(self._add_item(src) for src in val.sources))
+         items = self.opcodes.setdefault(val.opcode, [])
+         if item not in items:
+            items.append(item)
+         return item
+      elif isinstance(val, Constant) or val.is_constant:
+         return self.constant
+      else:
+         return self.wildcard
+
+   def _add_state(self, state):
+      if state not in self._state_index:
+         self._state_index[state] = len(self.states)
+         self.states.append(state)
+      return self._state_index[state]
+
+   def _match(self, srcs, states):
+      return all(src == self.wildcard or src in state
+                 for src, state in zip(srcs, states))
+
+   def _transition(self, op, filtered):
+      srcs = [self.filtered_states[op][i] for i in filtered]
+      commutative = 'commutative' in opcodes[op].algebraic_properties
+      state = frozenset(item for item in self.opcodes[op]
+                        if self._match(item[1], srcs) or
+                           (commutative and self._match(item[1], srcs[::-1])))
+      return self._add_state(state)
+
+   def _build(self):
+      # Every time we find a new state, project it onto the sources of each
+      # opcode.  If that gives a new filtered state, fill in the table
+      # entries using it, which may in turn find more states.
+      i = 0
+      while i < len(self.states):
+         state = self.states[i]
+         i += 1
+         for op in self.opcodes:
+            filtered = state & self._src_patterns[op]
+            if filtered in self._filtered_index[op]:
+               continue
+
+            new_index = len(self.filtered_states[op])
+            self._filtered_index[op][filtered] = new_index
+            self.filtered_states[op].append(filtered)
+
+            num_inputs = opcodes[op].num_inputs
+            for srcs in itertools.product(range(new_index + 1),
+                                          repeat=num_inputs):
+               if new_index in srcs:
+                  self.tables[op][srcs] = self._transition(op, srcs)
+
+   def filter(self, op):
+      """Returns the map from states to filtered states of op's sources."""
+      return [self._filtered_index[op][state & self._src_patterns[op]]
+              for state in self.states]
+
+   def table(self, op):
+      """Returns op's transition table, flattened in row-major order."""
+      num_filtered = len(self.filtered_states[op])
+      return [self.tables[op][srcs] for srcs in
+              itertools.product(range(num_filtered),
+                                repeat=opcodes[op].num_inputs)]
+
+   def state_xforms(self, xform_dict):
+      """Returns the transforms to try for each state, in pass order."""
+      result = []
+      for state in self.states:
+         ops = set(item[0] for item in state if item != self.constant)
+         assert len(ops) <= 1
+         xforms = []
+         for op in ops:
+            xforms = [xform for xform in xform_dict.get(op, [])
+                      if self.xform_items[xform.id] in state]
+         result.append(xforms)
+      return result
+
 _algebraic_pass_template = mako.template.Template("""
 #include "nir.h"
 #include "nir_search.h"
@@ -509,6 +644,17 @@ struct transform {
    unsigned condition_offset;
 };
 
+struct transform_list {
+   const struct transform *xforms;
+   unsigned num_xforms;
+};
+
+struct per_op_table {
+   const uint16_t *filter;
+   unsigned num_filtered_states;
+   const uint16_t *table;
+};
+
 #endif
 
 % for (opcode, xform_list) in xform_dict.iteritems():
@@ -516,17 +662,93 @@ struct transform {
    ${xform.search.render()}
    ${xform.replace.render()}
 % endfor
+% endfor
 
-static const struct transform ${pass_name}_${opcode}_xforms[] = {
-% for xform in xform_list:
+% for (i, xforms) in enumerate(state_xforms):
+% if xforms:
+static const struct transform ${pass_name}_state${i}_xforms[] = {
+% for xform in xforms:
    { &${xform.search.name}, ${xform.replace.c_ptr}, ${xform.condition_index} },
 % endfor
 };
+% endif
+% endfor
+
+static const struct transform_list ${pass_name}_state_xforms[] = {
+% for (i, xforms) in enumerate(state_xforms):
+% if xforms:
+   { ${pass_name}_state${i}_xforms, ${len(xforms)} },
+% else:
+   { NULL, 0 },
+% endif
+% endfor
+};
+
+% for (i, filter) in enumerate(filters):
+static const uint16_t ${pass_name}_filter${i}[] = {
+% for j in range(0, len(filter), 16):
+   ${', '.join(str(state) for state in filter[j:j + 16])},
+% endfor
+};
+
 % endfor
+% for opcode in sorted(automaton.opcodes):
+static const uint16_t ${pass_name}_${opcode}_table[] = {
+% for j in range(0, len(tables[opcode]), 16):
+   ${', '.join(str(state) for state in tables[opcode][j:j + 16])},
+% endfor
+};
+
+% endfor
+static const struct per_op_table ${pass_name}_table[nir_num_opcodes] = {
+% for opcode in sorted(automaton.opcodes):
+   [nir_op_${opcode}] = {
+      ${pass_name}_filter${filter_index[opcode]},
+      ${len(automaton.filtered_states[opcode])},
+      ${pass_name}_${opcode}_table,
+   },
+% endfor
+};
+
+static void
+${pass_name}_compute_states(nir_function_impl *impl, uint16_t *states)
+{
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type == nir_instr_type_load_const) {
+            states[nir_instr_as_load_const(instr)->def.index] = 1;
+            continue;
+         }
+
+         if (instr->type != nir_instr_type_alu)
+            continue;
+
+         nir_alu_instr *alu = nir_instr_as_alu(instr);
+         if (!alu->dest.dest.is_ssa)
+            continue;
+
+         const struct per_op_table *tbl = &${pass_name}_table[alu->op];
+         if (tbl->table == NULL)
+            continue;
+
+         /* Sources which are phis, or not SSA at all, are in state 0.  Since
+          * phis aren't ALU instructions, that's right for matching anyway.
+          */
+         unsigned index = 0;
+         for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+            index *= tbl->num_filtered_states;
+            if (alu->src[i].src.is_ssa)
+               index += tbl->filter[states[alu->src[i].src.ssa->index]];
+         }
+
+         states[alu->dest.dest.ssa.index] = tbl->table[index];
+      }
+   }
+}
 
 static bool
 ${pass_name}_block(nir_block *block, const bool *condition_flags,
-                   void *mem_ctx)
+                   const uint16_t *states, void *mem_ctx)
 {
    bool progress = false;
 
@@ -538,22 +760,21 @@ ${pass_name}_block(nir_block *block, const bool *condition_flags,
       if (!alu->dest.dest.is_ssa)
          continue;
 
-      switch (alu->op) {
-      % for opcode in xform_dict.keys():
-      case nir_op_${opcode}:
-         for (unsigned i = 0; i < ARRAY_SIZE(${pass_name}_${opcode}_xforms); i++) {
-            const struct transform *xform = &${pass_name}_${opcode}_xforms[i];
-            if (condition_flags[xform->condition_offset] &&
-                nir_replace_instr(alu, xform->search, xform->replace,
-                                  mem_ctx)) {
-               progress = true;
-               break;
-            }
+      /* The replacement instructions are inserted before the instruction
+       * they replace, so we never visit them.  The instructions we do visit
+       * still have the sources their states were computed from.
+       */
+      const struct transform_list *list =
+         &${pass_name}_state_xforms[states[alu->dest.dest.ssa.index]];
+
+      for (unsigned i = 0; i < list->num_xforms; i++) {
+         const struct transform *xform = &list->xforms[i];
+         if (condition_flags[xform->condition_offset] &&
+             nir_replace_instr(alu, xform->search, xform->replace,
+                               mem_ctx)) {
+            progress = true;
+            break;
          }
-         break;
-      % endfor
-      default:
-         break;
       }
    }
 
@@ -566,10 +787,15 @@ ${pass_name}_impl(nir_function_impl *impl, const bool *condition_flags)
    void *mem_ctx = ralloc_parent(impl);
    bool progress = false;
 
+   uint16_t *states = calloc(impl->ssa_alloc, sizeof(*states));
+   ${pass_name}_compute_states(impl, states);
+
    nir_foreach_block_reverse(block, impl) {
-      progress |= ${pass_name}_block(block, condition_flags, mem_ctx);
+      progress |= ${pass_name}_block(block, condition_flags, states, mem_ctx);
    }
 
+   free(states);
+
    if (progress)
       nir_metadata_preserve(impl, nir_metadata_block_index |
                                   nir_metadata_dominance);
@@ -626,7 +852,30 @@ class AlgebraicPass(object):
       if error:
          sys.exit(1)
 
+      self.automaton = TreeAutomaton(xform
+                                     for xform_list in self.xform_dict.values()
+                                     for xform in xform_list)
+      assert len(self.automaton.states) < (1 << 16)
+
    def render(self):
-      return _algebraic_pass_template.render(pass_name=self.pass_name,
-                                             xform_dict=self.xform_dict,
-                                             condition_list=condition_list)
+      # Opcodes with the same sources in their patterns share a filter.
+      filters = []
+      filter_index = {}
+      for opcode in sorted(self.automaton.opcodes):
+         filter = self.automaton.filter(opcode)
+         if filter not in filters:
+            filters.append(filter)
+         filter_index[opcode] = filters.index(filter)
+
+      tables = dict((opcode, self.automaton.table(opcode))
+                    for opcode in self.automaton.opcodes)
+
+      return _algebraic_pass_template.render(
+         pass_name=self.pass_name,
+         xform_dict=self.xform_dict,
+         condition_list=condition_list,
+         automaton=self.automaton,
+         state_xforms=self.automaton.state_xforms(self.xform_dict),
+         filters=filters,
+         filter_index=filter_index,
+         tables=tables)
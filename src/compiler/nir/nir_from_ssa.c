@@ -40,6 +40,7 @@ struct from_ssa_state {
    void *dead_ctx;
    bool phi_webs_only;
    struct hash_table *merge_node_table;
+   nir_sparse_liveness *liveness;
    nir_instr *instr;
    bool progress;
 };
@@ -141,9 +142,11 @@ get_merge_node(nir_ssa_def *def, struct from_ssa_state *state)
 }
 
 static bool
-merge_nodes_interfere(merge_node *a, merge_node *b)
+merge_nodes_interfere(merge_node *a, merge_node *b,
+                      struct from_ssa_state *state)
 {
-   return nir_ssa_defs_interfere(a->def, b->def);
+   return nir_sparse_liveness_ssa_defs_interfere(state->liveness,
+                                                 a->def, b->def);
 }
 
 /* Merges b into a */
@@ -181,7 +184,7 @@ merge_merge_sets(merge_set *a, merge_set *b)
  * Boissinot et al.
  */
 static bool
-merge_sets_interfere(merge_set *a, merge_set *b)
+merge_sets_interfere(merge_set *a, merge_set *b, struct from_ssa_state *state)
 {
    NIR_VLA(merge_node *, dom, a->size + b->size);
    int dom_idx = -1;
@@ -215,7 +218,7 @@ merge_sets_interfere(merge_set *a, merge_set *b)
              !ssa_def_dominates(dom[dom_idx]->def, current->def))
          dom_idx--;
 
-      if (dom_idx >= 0 && merge_nodes_interfere(current, dom[dom_idx]))
+      if (dom_idx >= 0 && merge_nodes_interfere(current, dom[dom_idx], state))
          return true;
 
       dom[++dom_idx] = current;
@@ -416,7 +419,7 @@ aggressive_coalesce_parallel_copy(nir_parallel_copy_instr *pcopy,
       if (src_node->set == dest_node->set)
          continue;
 
-      if (!merge_sets_interfere(src_node->set, dest_node->set))
+      if (!merge_sets_interfere(src_node->set, dest_node->set, state))
          merge_merge_sets(src_node->set, dest_node->set);
    }
 }
@@ -763,7 +766,7 @@ nir_convert_from_ssa_impl(nir_function_impl *impl, bool phi_webs_only)
    struct from_ssa_state state;
 
    nir_builder_init(&state.builder, impl);
-   state.dead_ctx = ralloc_context(NULL);
+   state.dead_ctx = ralloc_arena_context(NULL);
    state.phi_webs_only = phi_webs_only;
    state.merge_node_table = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
                                                     _mesa_key_pointer_equal);
@@ -781,8 +784,10 @@ nir_convert_from_ssa_impl(nir_function_impl *impl, bool phi_webs_only)
    nir_metadata_preserve(impl, nir_metadata_block_index |
                                nir_metadata_dominance);
 
-   nir_metadata_require(impl, nir_metadata_live_ssa_defs |
-                              nir_metadata_dominance);
+   /* Only the values in phi webs and parallel copies are ever checked for
+    * interference, so liveness is worked out for just those.
+    */
+   state.liveness = nir_sparse_liveness_create(state.dead_ctx, impl);
 
    nir_foreach_block(block, impl) {
       coalesce_phi_nodes_block(block, &state);
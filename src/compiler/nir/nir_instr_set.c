@@ -47,6 +47,17 @@ hash_alu_src(uint32_t hash, const nir_alu_src *src, unsigned num_components)
    return hash;
 }
 
+/* Returns true if the first two sources of the operation can be swapped
+ * without changing the result.  Besides the commutative binary operations,
+ * this is the case for the two factors of ffma.
+ */
+static bool
+alu_srcs_commute(nir_op op)
+{
+   return (nir_op_infos[op].algebraic_properties & NIR_OP_IS_COMMUTATIVE) ||
+          op == nir_op_ffma;
+}
+
 static uint32_t
 hash_alu(uint32_t hash, const nir_alu_instr *instr)
 {
@@ -55,8 +66,9 @@ hash_alu(uint32_t hash, const nir_alu_instr *instr)
    hash = HASH(hash, instr->dest.dest.ssa.bit_size);
    /* We explicitly don't hash instr->dest.dest.exact */
 
-   if (nir_op_infos[instr->op].algebraic_properties & NIR_OP_IS_COMMUTATIVE) {
-      assert(nir_op_infos[instr->op].num_inputs == 2);
+   unsigned first_src = 0;
+   if (alu_srcs_commute(instr->op)) {
+      assert(nir_op_infos[instr->op].num_inputs >= 2);
       uint32_t hash0 = hash_alu_src(hash, &instr->src[0],
                                     nir_ssa_alu_instr_src_components(instr, 0));
       uint32_t hash1 = hash_alu_src(hash, &instr->src[1],
@@ -68,11 +80,12 @@ hash_alu(uint32_t hash, const nir_alu_instr *instr)
        * collision.  Either addition or multiplication will also work.
        */
       hash = hash0 * hash1;
-   } else {
-      for (unsigned i = 0; i < nir_op_infos[instr->op].num_inputs; i++) {
-         hash = hash_alu_src(hash, &instr->src[i],
-                             nir_ssa_alu_instr_src_components(instr, i));
-      }
+      first_src = 2;
+   }
+
+   for (unsigned i = first_src; i < nir_op_infos[instr->op].num_inputs; i++) {
+      hash = hash_alu_src(hash, &instr->src[i],
+                          nir_ssa_alu_instr_src_components(instr, i));
    }
 
    return hash;
@@ -275,17 +288,20 @@ nir_instrs_equal(const nir_instr *instr1, const nir_instr *instr2)
 
       /* We explicitly don't hash instr->dest.dest.exact */
 
-      if (nir_op_infos[alu1->op].algebraic_properties & NIR_OP_IS_COMMUTATIVE) {
-         assert(nir_op_infos[alu1->op].num_inputs == 2);
-         return (nir_alu_srcs_equal(alu1, alu2, 0, 0) &&
-                 nir_alu_srcs_equal(alu1, alu2, 1, 1)) ||
-                (nir_alu_srcs_equal(alu1, alu2, 0, 1) &&
-                 nir_alu_srcs_equal(alu1, alu2, 1, 0));
-      } else {
-         for (unsigned i = 0; i < nir_op_infos[alu1->op].num_inputs; i++) {
-            if (!nir_alu_srcs_equal(alu1, alu2, i, i))
-               return false;
-         }
+      unsigned first_src = 0;
+      if (alu_srcs_commute(alu1->op)) {
+         assert(nir_op_infos[alu1->op].num_inputs >= 2);
+         if (!(nir_alu_srcs_equal(alu1, alu2, 0, 0) &&
+               nir_alu_srcs_equal(alu1, alu2, 1, 1)) &&
+             !(nir_alu_srcs_equal(alu1, alu2, 0, 1) &&
+               nir_alu_srcs_equal(alu1, alu2, 1, 0)))
+            return false;
+         first_src = 2;
+      }
+
+      for (unsigned i = first_src; i < nir_op_infos[alu1->op].num_inputs; i++) {
+         if (!nir_alu_srcs_equal(alu1, alu2, i, i))
+            return false;
       }
       return true;
    }
@@ -502,31 +518,47 @@ nir_instr_set_destroy(struct set *instr_set)
    _mesa_set_destroy(instr_set, NULL);
 }
 
+static void
+rewrite_to_match(nir_instr *instr, nir_instr *match)
+{
+   nir_ssa_def *def = nir_instr_get_dest_ssa_def(instr);
+   nir_ssa_def *new_def = nir_instr_get_dest_ssa_def(match);
+
+   /* It's safe to replace an exact instruction with an inexact one as
+    * long as we make it exact.  If we got here, the two instructions are
+    * exactly identical in every other way so, once we've set the exact
+    * bit, they are the same.
+    */
+   if (instr->type == nir_instr_type_alu && nir_instr_as_alu(instr)->exact)
+      nir_instr_as_alu(match)->exact = true;
+
+   nir_ssa_def_rewrite_uses(def, nir_src_for_ssa(new_def));
+}
+
 bool
 nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr)
 {
    if (!instr_can_rewrite(instr))
       return false;
 
-   struct set_entry *entry = _mesa_set_search(instr_set, instr);
-   if (entry) {
-      nir_ssa_def *def = nir_instr_get_dest_ssa_def(instr);
-      nir_instr *match = (nir_instr *) entry->key;
-      nir_ssa_def *new_def = nir_instr_get_dest_ssa_def(match);
-
-      /* It's safe to replace an exact instruction with an inexact one as
-       * long as we make it exact.  If we got here, the two instructions are
-       * exactly identical in every other way so, once we've set the exact
-       * bit, they are the same.
-       */
-      if (instr->type == nir_instr_type_alu && nir_instr_as_alu(instr)->exact)
-         nir_instr_as_alu(match)->exact = true;
+   return nir_instr_set_add_or_rewrite_pre_hashed(instr_set, instr,
+                                                  hash_instr(instr));
+}
+
+bool
+nir_instr_set_add_or_rewrite_pre_hashed(struct set *instr_set,
+                                        nir_instr *instr, uint32_t hash)
+{
+   assert(instr_can_rewrite(instr));
 
-      nir_ssa_def_rewrite_uses(def, nir_src_for_ssa(new_def));
+   struct set_entry *entry =
+      _mesa_set_search_pre_hashed(instr_set, hash, instr);
+   if (entry) {
+      rewrite_to_match(instr, (nir_instr *) entry->key);
       return true;
    }
 
-   _mesa_set_add(instr_set, instr);
+   _mesa_set_add_pre_hashed(instr_set, hash, instr);
    return false;
 }
 
@@ -541,3 +573,56 @@ nir_instr_set_remove(struct set *instr_set, nir_instr *instr)
       _mesa_set_remove(instr_set, entry);
 }
 
+void
+nir_instr_set_remove_pre_hashed(struct set *instr_set, nir_instr *instr,
+                                uint32_t hash)
+{
+   assert(instr_can_rewrite(instr));
+
+   struct set_entry *entry =
+      _mesa_set_search_pre_hashed(instr_set, hash, instr);
+   if (entry && entry->key == instr)
+      _mesa_set_remove(instr_set, entry);
+}
+
+bool
+nir_instr_set_add(struct set *instr_set, nir_instr *instr)
+{
+   if (!instr_can_rewrite(instr))
+      return false;
+
+   const uint32_t hash = hash_instr(instr);
+   if (_mesa_set_search_pre_hashed(instr_set, hash, instr))
+      return false;
+
+   _mesa_set_add_pre_hashed(instr_set, hash, instr);
+   return true;
+}
+
+nir_instr *
+nir_instr_set_search(struct set *instr_set, nir_instr *instr)
+{
+   if (!instr_can_rewrite(instr))
+      return NULL;
+
+   struct set_entry *entry = _mesa_set_search(instr_set, instr);
+   return entry ? (nir_instr *) entry->key : NULL;
+}
+
+void
+nir_instr_set_rewrite(nir_instr *instr, nir_instr *match)
+{
+   rewrite_to_match(instr, match);
+}
+
+bool
+nir_instr_can_cse(nir_instr *instr)
+{
+   return instr_can_rewrite(instr);
+}
+
+uint32_t
+nir_instr_hash(const nir_instr *instr)
+{
+   return hash_instr(instr);
+}
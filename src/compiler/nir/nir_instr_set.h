@@ -59,6 +59,43 @@ bool nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr);
  */
 void nir_instr_set_remove(struct set *instr_set, nir_instr *instr);
 
+/**
+ * Returns true if the instruction is one an instruction set can hold, which
+ * is what nir_instr_hash() and the _pre_hashed functions below need.
+ */
+bool nir_instr_can_cse(nir_instr *instr);
+
+/** Returns the hash an instruction set uses for the instruction. */
+uint32_t nir_instr_hash(const nir_instr *instr);
+
+/**
+ * Like nir_instr_set_add_or_rewrite() and nir_instr_set_remove(), given the
+ * hash of the instruction, so that a caller adding and later removing the
+ * same instruction only has to hash it once.
+ */
+bool nir_instr_set_add_or_rewrite_pre_hashed(struct set *instr_set,
+                                             nir_instr *instr, uint32_t hash);
+void nir_instr_set_remove_pre_hashed(struct set *instr_set, nir_instr *instr,
+                                     uint32_t hash);
+
+/**
+ * Adds an instruction to an instruction set without touching anything else.
+ * Returns 'false', and leaves the set alone, if the instruction isn't one
+ * the set can hold or the set already has a duplicate of it.
+ */
+bool nir_instr_set_add(struct set *instr_set, nir_instr *instr);
+
+/**
+ * Returns the instruction in the set that \p instr is a duplicate of, or
+ * NULL if there isn't one.
+ */
+nir_instr *nir_instr_set_search(struct set *instr_set, nir_instr *instr);
+
+/**
+ * Rewrites all uses of \p instr to use \p match, a duplicate of it, instead.
+ */
+void nir_instr_set_rewrite(nir_instr *instr, nir_instr *match);
+
 /*@}*/
 
 #endif /* NIR_INSTR_SET_H */
@@ -291,3 +291,229 @@ nir_ssa_defs_interfere(nir_ssa_def *a, nir_ssa_def *b)
       return nir_ssa_def_is_live_at(b, a->parent_instr);
    }
 }
+
+/*
+ * Sparse liveness.
+ *
+ * The analysis above keeps two sets, each as large as the number of SSA
+ * values in the function, in every block.  On big shaders with lots of
+ * blocks that is a lot of memory and a lot of time spent or-ing mostly empty
+ * words together, even when the caller only cares about a few values.
+ *
+ * Instead, a nir_sparse_liveness finds the blocks a single value is live out
+ * of on demand, by walking the CFG backwards from the value's uses until it
+ * reaches the block defining it, as in "Computing Liveness Sets for
+ * SSA-Form Programs" by Brandner et al.  The result is kept, as a sorted
+ * list of block indices, only for the values that are asked about.
+ * Interference is then checked the way Boissinot et al. suggest in
+ * "Revisiting Out-of-SSA Translation for Correctness, Code Quality, and
+ * Efficiency": two values interfere if the one defined first dominates the
+ * definition of the other and is live there.
+ */
+
+struct live_out_blocks {
+   unsigned num_blocks;
+   unsigned blocks[];
+};
+
+struct nir_sparse_liveness {
+   /* For every block, the number of the last walk that found the value
+    * live in and live out of it.
+    */
+   unsigned *live_in_walk;
+   unsigned *live_out_walk;
+   unsigned walk;
+
+   /* Scratch space for a walk, one entry per block. */
+   nir_block **stack;
+   unsigned *out;
+
+   /* Maps an SSA def to its struct live_out_blocks */
+   struct hash_table *live_out;
+};
+
+nir_sparse_liveness *
+nir_sparse_liveness_create(void *mem_ctx, nir_function_impl *impl)
+{
+   struct live_ssa_defs_state state;
+
+   nir_metadata_require(impl, nir_metadata_block_index |
+                              nir_metadata_dominance);
+
+   /* Number the values the same way nir_live_ssa_defs_impl does, so that
+    * callers can keep ordering them by live_index.
+    */
+   state.num_ssa_defs = 1;
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block)
+         nir_foreach_ssa_def(instr, index_ssa_def, &state);
+   }
+
+   nir_sparse_liveness *live = ralloc(mem_ctx, nir_sparse_liveness);
+   live->live_in_walk = rzalloc_array(live, unsigned, impl->num_blocks);
+   live->live_out_walk = rzalloc_array(live, unsigned, impl->num_blocks);
+   live->walk = 0;
+   live->stack = ralloc_array(live, nir_block *, impl->num_blocks);
+   live->out = ralloc_array(live, unsigned, impl->num_blocks);
+   live->live_out = _mesa_hash_table_create(live, _mesa_hash_pointer,
+                                            _mesa_key_pointer_equal);
+
+   return live;
+}
+
+struct live_walk {
+   nir_sparse_liveness *live;
+   nir_block *def_block;
+   unsigned num_stack;
+   unsigned num_out;
+};
+
+static void
+walk_live_in(struct live_walk *w, nir_block *block)
+{
+   nir_sparse_liveness *live = w->live;
+
+   if (live->live_in_walk[block->index] == live->walk)
+      return;
+
+   live->live_in_walk[block->index] = live->walk;
+   live->stack[w->num_stack++] = block;
+}
+
+static void
+walk_live_out(struct live_walk *w, nir_block *block)
+{
+   nir_sparse_liveness *live = w->live;
+
+   if (live->live_out_walk[block->index] == live->walk)
+      return;
+
+   live->live_out_walk[block->index] = live->walk;
+   live->out[w->num_out++] = block->index;
+
+   /* A value can't be live into the block that defines it. */
+   if (block != w->def_block)
+      walk_live_in(w, block);
+}
+
+static int
+compare_block_index(const void *a, const void *b)
+{
+   const unsigned ia = *(const unsigned *)a, ib = *(const unsigned *)b;
+
+   return ia < ib ? -1 : ia > ib;
+}
+
+static const struct live_out_blocks *
+get_live_out_blocks(nir_sparse_liveness *live, nir_ssa_def *def)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(live->live_out, def);
+   if (entry)
+      return entry->data;
+
+   struct live_walk w = {
+      .live = live,
+      .def_block = def->parent_instr->block,
+   };
+
+   live->walk++;
+
+   /* As in the analysis above, a phi source is live out of the
+    * corresponding predecessor rather than into the block of the phi.
+    */
+   nir_foreach_use(use, def) {
+      nir_instr *instr = use->parent_instr;
+
+      if (instr->type == nir_instr_type_phi)
+         walk_live_out(&w, exec_node_data(nir_phi_src, use, src)->pred);
+      else if (instr->block != w.def_block)
+         walk_live_in(&w, instr->block);
+   }
+
+   nir_foreach_if_use(use, def) {
+      nir_block *block =
+         nir_cf_node_as_block(nir_cf_node_prev(&use->parent_if->cf_node));
+
+      if (block != w.def_block)
+         walk_live_in(&w, block);
+   }
+
+   while (w.num_stack > 0) {
+      nir_block *block = live->stack[--w.num_stack];
+
+      struct set_entry *pred_entry;
+      set_foreach(block->predecessors, pred_entry)
+         walk_live_out(&w, (nir_block *)pred_entry->key);
+   }
+
+   qsort(live->out, w.num_out, sizeof(*live->out), compare_block_index);
+
+   struct live_out_blocks *blocks =
+      ralloc_size(live, sizeof(*blocks) + w.num_out * sizeof(unsigned));
+   blocks->num_blocks = w.num_out;
+   memcpy(blocks->blocks, live->out, w.num_out * sizeof(unsigned));
+
+   _mesa_hash_table_insert(live->live_out, def, blocks);
+
+   return blocks;
+}
+
+static bool
+sparse_is_live_out(nir_sparse_liveness *live, nir_ssa_def *def,
+                   nir_block *block)
+{
+   const struct live_out_blocks *blocks = get_live_out_blocks(live, def);
+
+   return bsearch(&block->index, blocks->blocks, blocks->num_blocks,
+                  sizeof(unsigned), compare_block_index) != NULL;
+}
+
+/* Returns true if def is live at instr, which it has to dominate to be. */
+static bool
+sparse_is_live_at(nir_sparse_liveness *live, nir_ssa_def *def,
+                  nir_instr *instr)
+{
+   nir_block *block = instr->block;
+
+   if (!nir_block_dominates(def->parent_instr->block, block))
+      return false;
+
+   if (sparse_is_live_out(live, def, block))
+      return true;
+
+   /* Otherwise, def is only live at instr if it's used further down the
+    * block.  The condition of an if is read after all of the block before
+    * it.
+    */
+   nir_foreach_if_use(use, def) {
+      if (nir_cf_node_prev(&use->parent_if->cf_node) == &block->cf_node)
+         return true;
+   }
+
+   nir_foreach_use(use, def) {
+      if (use->parent_instr->block == block &&
+          use->parent_instr->type != nir_instr_type_phi)
+         return search_for_use_after_instr(instr, def);
+   }
+
+   return false;
+}
+
+bool
+nir_sparse_liveness_ssa_defs_interfere(nir_sparse_liveness *live,
+                                       nir_ssa_def *a, nir_ssa_def *b)
+{
+   if (a->parent_instr == b->parent_instr) {
+      /* Two variables defined at the same time interfere assuming at
+       * least one isn't dead.
+       */
+      return true;
+   } else if (a->live_index == 0 || b->live_index == 0) {
+      /* If either variable is an ssa_undef, then there's no interference */
+      return false;
+   } else if (a->live_index < b->live_index) {
+      return sparse_is_live_at(live, a, b->parent_instr);
+   } else {
+      return sparse_is_live_at(live, b, a->parent_instr);
+   }
+}
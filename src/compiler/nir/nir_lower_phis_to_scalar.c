@@ -272,7 +272,7 @@ lower_phis_to_scalar_impl(nir_function_impl *impl)
    bool progress = false;
 
    state.mem_ctx = ralloc_parent(impl);
-   state.dead_ctx = ralloc_context(NULL);
+   state.dead_ctx = ralloc_arena_context(NULL);
    state.phi_table = _mesa_hash_table_create(state.dead_ctx, _mesa_hash_pointer,
                                              _mesa_key_pointer_equal);
 
@@ -643,7 +643,7 @@ nir_lower_vars_to_ssa_impl(nir_function_impl *impl)
    struct lower_variables_state state;
 
    state.shader = impl->function->shader;
-   state.dead_ctx = ralloc_context(state.shader);
+   state.dead_ctx = ralloc_arena_context(state.shader);
    state.impl = impl;
 
    state.deref_var_nodes = _mesa_hash_table_create(state.dead_ctx,
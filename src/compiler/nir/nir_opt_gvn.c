@@ -0,0 +1,290 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "nir.h"
+#include "nir_instr_set.h"
+#include "util/u_dynarray.h"
+
+/*
+ * Implements global value numbering.
+ *
+ * This does what nir_opt_cse does, walking the dominance tree with the
+ * values that dominate the current block in an instruction set, and adds
+ * to it:
+ *
+ *  - Instructions computed at the start of both sides of an if, from values
+ *    available before the if, are hoisted above it.  That removes one of
+ *    the two, and lets the other be numbered along with everything the if
+ *    dominates.
+ *
+ *  - Phis whose sources are all the same value are replaced by that value,
+ *    which is what hoisting tends to leave behind.
+ *
+ *  - Each instruction is hashed only once, when it's numbered, rather than
+ *    once more when it's taken back out of the set.
+ *
+ * Like the instruction set, this treats the sources of commutative
+ * operations as unordered.
+ */
+
+struct gvn_entry {
+   nir_instr *instr;
+   uint32_t hash;
+};
+
+struct gvn_state {
+   struct set *instr_set;
+
+   /* The instructions in instr_set, in the order they were added. */
+   struct util_dynarray stack;
+
+   bool progress;
+};
+
+/* Returns true if the value is available at the end of the block. */
+static bool
+ssa_def_is_available(nir_ssa_def *def, nir_block *block)
+{
+   return nir_block_dominates(def->parent_instr->block, block);
+}
+
+static bool
+src_is_available(nir_src *src, void *block)
+{
+   return src->is_ssa && ssa_def_is_available(src->ssa, block);
+}
+
+static bool
+get_ssa_def(nir_ssa_def *def, void *out)
+{
+   *(nir_ssa_def **)out = def;
+   return true;
+}
+
+static bool
+can_hoist(nir_instr *instr, nir_block *before_if)
+{
+   return instr->type != nir_instr_type_phi &&
+          nir_instr_can_cse(instr) &&
+          nir_foreach_src(instr, src_is_available, before_if);
+}
+
+/* Moves instructions found in the first blocks of both sides of an if in
+ * front of the if.  These blocks are run in full whenever their side is, so
+ * this doesn't make anything run that didn't run before.
+ */
+static bool
+hoist_if(nir_if *nif)
+{
+   nir_block *before_if =
+      nir_cf_node_as_block(nir_cf_node_prev(&nif->cf_node));
+   nir_block *then_block = nir_if_first_then_block(nif);
+   nir_block *else_block = nir_if_first_else_block(nif);
+   struct set *else_set = nir_instr_set_create(NULL);
+   bool progress = false;
+
+   nir_foreach_instr(instr, else_block) {
+      if (can_hoist(instr, before_if))
+         nir_instr_set_add(else_set, instr);
+   }
+
+   nir_foreach_instr_safe(instr, then_block) {
+      if (!can_hoist(instr, before_if))
+         continue;
+
+      nir_instr *match = nir_instr_set_search(else_set, instr);
+      if (match == NULL)
+         continue;
+
+      nir_instr_set_remove(else_set, match);
+
+      nir_instr_remove(instr);
+      nir_instr_insert(nir_after_block_before_jump(before_if), instr);
+
+      nir_instr_set_rewrite(match, instr);
+      nir_instr_remove(match);
+
+      /* The instructions in the else block that used the match now use an
+       * available value, which may make them hoistable too.  Instructions
+       * in the then block are looked at in order, so their users there
+       * are still to come.
+       */
+      nir_ssa_def *def = NULL;
+      nir_foreach_ssa_def(instr, get_ssa_def, &def);
+      nir_foreach_use(use, def) {
+         if (use->parent_instr->block == else_block &&
+             can_hoist(use->parent_instr, before_if))
+            nir_instr_set_add(else_set, use->parent_instr);
+      }
+
+      progress = true;
+   }
+
+   nir_instr_set_destroy(else_set);
+
+   return progress;
+}
+
+static bool
+hoist_cf_list(struct exec_list *cf_list)
+{
+   bool progress = false;
+
+   foreach_list_typed(nir_cf_node, node, node, cf_list) {
+      switch (node->type) {
+      case nir_cf_node_block:
+         break;
+
+      case nir_cf_node_if: {
+         nir_if *nif = nir_cf_node_as_if(node);
+
+         /* Inner ifs go first, so that what they hoist to the start of a
+          * side of this one can be hoisted further.
+          */
+         progress |= hoist_cf_list(&nif->then_list);
+         progress |= hoist_cf_list(&nif->else_list);
+         progress |= hoist_if(nif);
+         break;
+      }
+
+      case nir_cf_node_loop:
+         progress |= hoist_cf_list(&nir_cf_node_as_loop(node)->body);
+         break;
+
+      default:
+         unreachable("Invalid CF node type");
+      }
+   }
+
+   return progress;
+}
+
+/* Returns the value all the sources of the phi have, or NULL. */
+static nir_ssa_def *
+phi_single_value(nir_phi_instr *phi)
+{
+   nir_ssa_def *value = NULL;
+
+   nir_foreach_phi_src(src, phi) {
+      assert(src->src.is_ssa);
+
+      /* Loop header phis may have themselves as a source. */
+      if (src->src.ssa == &phi->dest.ssa)
+         continue;
+
+      if (value != NULL && value != src->src.ssa)
+         return NULL;
+
+      value = src->src.ssa;
+   }
+
+   return value;
+}
+
+static void
+gvn_block(nir_block *block, struct gvn_state *state)
+{
+   const unsigned stack_size = state->stack.size;
+
+   nir_foreach_instr_safe(instr, block) {
+      if (instr->type == nir_instr_type_phi) {
+         nir_phi_instr *phi = nir_instr_as_phi(instr);
+         nir_ssa_def *value = phi_single_value(phi);
+
+         if (value != NULL && phi->dest.is_ssa) {
+            nir_ssa_def_rewrite_uses(&phi->dest.ssa, nir_src_for_ssa(value));
+            nir_instr_remove(instr);
+            state->progress = true;
+            continue;
+         }
+      }
+
+      if (!nir_instr_can_cse(instr))
+         continue;
+
+      const uint32_t hash = nir_instr_hash(instr);
+      if (nir_instr_set_add_or_rewrite_pre_hashed(state->instr_set, instr,
+                                                  hash)) {
+         nir_instr_remove(instr);
+         state->progress = true;
+      } else if (instr->type != nir_instr_type_phi) {
+         /* Phis are left in the set: a phi only ever matches another phi
+          * in the same block, and the hash of a loop header phi changes
+          * when the value coming around the back edge gets rewritten.
+          */
+         struct gvn_entry entry = { instr, hash };
+         util_dynarray_append(&state->stack, struct gvn_entry, entry);
+      }
+   }
+
+   for (unsigned i = 0; i < block->num_dom_children; i++)
+      gvn_block(block->dom_children[i], state);
+
+   while (state->stack.size > stack_size) {
+      struct gvn_entry entry =
+         util_dynarray_pop(&state->stack, struct gvn_entry);
+      nir_instr_set_remove_pre_hashed(state->instr_set, entry.instr,
+                                      entry.hash);
+   }
+}
+
+static bool
+nir_opt_gvn_impl(nir_function_impl *impl)
+{
+   struct gvn_state state;
+
+   nir_metadata_require(impl, nir_metadata_block_index |
+                              nir_metadata_dominance);
+
+   /* Hoisting only moves instructions between existing blocks, so it
+    * leaves the dominance information intact.
+    */
+   state.progress = hoist_cf_list(&impl->body);
+
+   state.instr_set = nir_instr_set_create(NULL);
+   util_dynarray_init(&state.stack, NULL);
+
+   gvn_block(nir_start_block(impl), &state);
+
+   util_dynarray_fini(&state.stack);
+   nir_instr_set_destroy(state.instr_set);
+
+   if (state.progress)
+      nir_metadata_preserve(impl, nir_metadata_block_index |
+                                  nir_metadata_dominance);
+
+   return state.progress;
+}
+
+bool
+nir_opt_gvn(nir_shader *shader)
+{
+   bool progress = false;
+
+   nir_foreach_function(function, shader) {
+      if (function->impl)
+         progress |= nir_opt_gvn_impl(function->impl);
+   }
+
+   return progress;
+}
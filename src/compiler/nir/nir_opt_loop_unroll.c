@@ -25,6 +25,7 @@
 #include "nir_builder.h"
 #include "nir_control_flow.h"
 #include "nir_loop_analyze.h"
+#include "util/debug.h"
 
 
 /* This limit is chosen fairly arbitrarily.  GLSL IR max iteration is 32
@@ -217,6 +218,99 @@ simple_unroll(nir_loop *loop)
    _mesa_hash_table_destroy(remap_table, NULL);
 }
 
+/**
+ * Partially unroll a loop where we know exactly how many iterations there are
+ * and there is a single exit point, so that each time around it runs
+ * \p factor iterations of the original loop.  The trip count % factor
+ * iterations left over are peeled off in front of the loop, after which the
+ * exit condition only needs checking once every \p factor iterations.
+ *
+ *     loop {
+ *         ...header...
+ *         if (cond) break;
+ *         ...body...
+ *     }
+ *
+ * If the iteration count is 5 and the factor is 2, the output will be:
+ *
+ *     ...header... ...body...
+ *     loop {
+ *         ...header...
+ *         if (cond) break;
+ *         ...body... ...header... ...body...
+ *     }
+ */
+static void
+partial_unroll(nir_loop *loop, unsigned factor)
+{
+   nir_loop_terminator *term = loop->info->limiting_terminator;
+   assert(list_length(&loop->info->loop_terminator_list) == 1);
+   assert(nir_is_trivial_loop_if(term->nif, term->break_block));
+   assert(factor >= 2 && factor < loop->info->trip_count);
+
+   const unsigned num_peeled = loop->info->trip_count % factor;
+
+   loop_prepare_for_unroll(loop);
+
+   nir_block *first_break_block;
+   nir_block *first_continue_block;
+   get_first_blocks_in_terminator(term, &first_break_block,
+                                  &first_continue_block);
+
+   /* Move the continue from block of the terminator into the loop body */
+   nir_cf_list continue_from_lst;
+   nir_cf_extract(&continue_from_lst, nir_before_block(first_continue_block),
+                  nir_after_block(term->continue_from_block));
+   nir_cf_reinsert(&continue_from_lst,
+                   nir_after_cf_node(&term->nif->cf_node));
+
+   /* Pluck out the loop header and body, leaving the terminator behind */
+   nir_cf_list lp_header;
+   nir_cf_extract(&lp_header, nir_before_block(nir_loop_first_block(loop)),
+                  nir_before_cf_node(&term->nif->cf_node));
+
+   nir_cf_list loop_body;
+   nir_cf_extract(&loop_body, nir_after_cf_node(&term->nif->cf_node),
+                  nir_after_block(nir_loop_last_block(loop)));
+
+   struct hash_table *remap_table =
+      _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                              _mesa_key_pointer_equal);
+
+   /* Temp list to store the cloned header and body as we unroll */
+   nir_cf_list cloned;
+
+   /* Peel off the iterations left over before the loop */
+   for (unsigned i = 0; i < num_peeled; i++) {
+      nir_cf_list_clone(&cloned, &lp_header, loop->cf_node.parent,
+                        remap_table);
+      nir_cf_reinsert(&cloned, nir_before_cf_node(&loop->cf_node));
+
+      nir_cf_list_clone(&cloned, &loop_body, loop->cf_node.parent,
+                        remap_table);
+      nir_cf_reinsert(&cloned, nir_before_cf_node(&loop->cf_node));
+   }
+
+   /* Append factor - 1 more iterations to the end of the loop, where the
+    * original body goes in front of them.
+    */
+   for (unsigned i = 1; i < factor; i++) {
+      nir_cf_list_clone(&cloned, &lp_header, &loop->cf_node, remap_table);
+      nir_cf_reinsert(&cloned, nir_after_cf_list(&loop->body));
+
+      nir_cf_list_clone(&cloned, &loop_body, &loop->cf_node, remap_table);
+      nir_cf_reinsert(&cloned, nir_after_cf_list(&loop->body));
+   }
+
+   /* Put the original header and body back around the terminator */
+   nir_cf_reinsert(&lp_header, nir_before_cf_node(&term->nif->cf_node));
+   nir_cf_reinsert(&loop_body, nir_after_cf_node(&term->nif->cf_node));
+
+   loop->partially_unrolled = true;
+
+   _mesa_hash_table_destroy(remap_table, NULL);
+}
+
 static void
 move_cf_list_into_loop_term(nir_cf_list *lst, nir_loop_terminator *term)
 {
@@ -461,7 +555,8 @@ complex_unroll(nir_loop *loop, nir_loop_terminator *unlimit_term,
 }
 
 static bool
-is_loop_small_enough_to_unroll(nir_shader *shader, nir_loop_info *li)
+is_loop_small_enough_to_unroll(const nir_shader *shader,
+                               const nir_loop_info *li)
 {
    unsigned max_iter = shader->options->max_unroll_iterations;
 
@@ -477,6 +572,70 @@ is_loop_small_enough_to_unroll(nir_shader *shader, nir_loop_info *li)
    return loop_not_too_large;
 }
 
+unsigned
+nir_loop_unroll_default_factor(const nir_shader *shader, const nir_loop *loop)
+{
+   if (!is_loop_small_enough_to_unroll(shader, loop->info))
+      return 0;
+
+   return NIR_LOOP_UNROLL_FULL;
+}
+
+/* Partial unrolling keeps the loop, so every jump in it has to be the break
+ * of its only terminator, aside from a continue at the very end.
+ */
+static bool
+can_unroll_partially(nir_loop *loop)
+{
+   if (!loop->info->is_trip_count_known || loop->partially_unrolled ||
+       list_length(&loop->info->loop_terminator_list) != 1)
+      return false;
+
+   nir_loop_terminator *term = loop->info->limiting_terminator;
+   nir_instr *break_instr = nir_block_last_instr(term->break_block);
+   nir_instr *last_instr = nir_block_last_instr(nir_loop_last_block(loop));
+
+   foreach_list_typed(nir_cf_node, node, node, &loop->body) {
+      nir_instr *expected_jump =
+         node->type == nir_cf_node_block ? last_instr : break_instr;
+
+      if (contains_other_jump(node, expected_jump))
+         return false;
+   }
+
+   return true;
+}
+
+/* Lists the decisions made with NIR_PRINT_LOOP_UNROLL set */
+static void
+print_unroll_decision(nir_shader *sh, nir_loop *loop, unsigned factor,
+                      const char *decision)
+{
+   static int should_print = -1;
+   if (should_print < 0)
+      should_print = env_var_as_boolean("NIR_PRINT_LOOP_UNROLL", false);
+   if (!should_print)
+      return;
+
+   nir_function_impl *impl = nir_cf_node_get_function(&loop->cf_node);
+   nir_loop_info *li = loop->info;
+   char trip_count[16] = "unknown";
+   char factor_str[16] = "full";
+
+   if (li->is_trip_count_known)
+      snprintf(trip_count, sizeof(trip_count), "%u", li->trip_count);
+   if (factor != NIR_LOOP_UNROLL_FULL)
+      snprintf(factor_str, sizeof(factor_str), "%u", factor);
+
+   fprintf(stderr, "loop_unroll: %s %s block %u: %u instrs, %u exits, "
+           "trip count %s, %s factor %s: %s\n",
+           _mesa_shader_stage_to_abbrev(sh->info.stage),
+           impl->function->name, nir_loop_first_block(loop)->index,
+           li->num_instructions, list_length(&li->loop_terminator_list),
+           trip_count, sh->options->loop_unroll_factor ? "driver" : "default",
+           factor_str, decision);
+}
+
 static bool
 process_loops(nir_shader *sh, nir_cf_node *cf_node, bool *innermost_loop)
 {
@@ -513,40 +672,64 @@ process_loops(nir_shader *sh, nir_cf_node *cf_node, bool *innermost_loop)
       if (loop->info->limiting_terminator == NULL)
          return progress;
 
-      if (!is_loop_small_enough_to_unroll(sh, loop->info))
+      /* Loops with an unknown trip count are only unrolled when they have
+       * two terminators.
+       */
+      if (!loop->info->is_trip_count_known &&
+          list_length(&loop->info->loop_terminator_list) != 2)
+         return progress;
+
+      const unsigned factor = sh->options->loop_unroll_factor ?
+         sh->options->loop_unroll_factor(sh, loop) :
+         nir_loop_unroll_default_factor(sh, loop);
+
+      if (factor == 0) {
+         print_unroll_decision(sh, loop, factor, "not unrolled");
+         return progress;
+      }
+
+      if (factor < loop->info->trip_count) {
+         if (factor >= 2 && can_unroll_partially(loop)) {
+            print_unroll_decision(sh, loop, factor, "unrolled partially");
+            partial_unroll(loop, factor);
+            progress = true;
+         } else {
+            print_unroll_decision(sh, loop, factor, factor >= 2 ?
+                                  "can't unroll partially, not unrolled" :
+                                  "not unrolled");
+         }
          return progress;
+      }
+
+      print_unroll_decision(sh, loop, factor, "unrolled");
 
       if (loop->info->is_trip_count_known) {
          simple_unroll(loop);
          progress = true;
       } else {
-         /* Attempt to unroll loops with two terminators. */
-         unsigned num_lt = list_length(&loop->info->loop_terminator_list);
-         if (num_lt == 2) {
-            bool limiting_term_second = true;
-            nir_loop_terminator *terminator =
-               list_last_entry(&loop->info->loop_terminator_list,
-                                nir_loop_terminator, loop_terminator_link);
-
-
-            if (terminator->nif == loop->info->limiting_terminator->nif) {
-               limiting_term_second = false;
-               terminator =
-                  list_first_entry(&loop->info->loop_terminator_list,
-                                  nir_loop_terminator, loop_terminator_link);
-            }
-
-            /* If the first terminator has a trip count of zero and is the
-             * limiting terminator just do a simple unroll as the second
-             * terminator can never be reached.
-             */
-            if (loop->info->trip_count == 0 && !limiting_term_second) {
-               simple_unroll(loop);
-            } else {
-               complex_unroll(loop, terminator, limiting_term_second);
-            }
-            progress = true;
+         /* Unroll loops with two terminators. */
+         bool limiting_term_second = true;
+         nir_loop_terminator *terminator =
+            list_last_entry(&loop->info->loop_terminator_list,
+                             nir_loop_terminator, loop_terminator_link);
+
+         if (terminator->nif == loop->info->limiting_terminator->nif) {
+            limiting_term_second = false;
+            terminator =
+               list_first_entry(&loop->info->loop_terminator_list,
+                               nir_loop_terminator, loop_terminator_link);
          }
+
+         /* If the first terminator has a trip count of zero and is the
+          * limiting terminator just do a simple unroll as the second
+          * terminator can never be reached.
+          */
+         if (loop->info->trip_count == 0 && !limiting_term_second) {
+            simple_unroll(loop);
+         } else {
+            complex_unroll(loop, terminator, limiting_term_second);
+         }
+         progress = true;
       }
    }
 
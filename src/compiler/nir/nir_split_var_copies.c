@@ -259,7 +259,7 @@ split_var_copies_impl(nir_function_impl *impl)
    struct split_var_copies_state state;
 
    state.shader = impl->function->shader;
-   state.dead_ctx = ralloc_context(NULL);
+   state.dead_ctx = ralloc_arena_context(NULL);
    state.progress = false;
 
    nir_foreach_block(block, impl) {
@@ -0,0 +1,150 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+
+class nir_gvn_test : public ::testing::Test {
+protected:
+   nir_gvn_test();
+   ~nir_gvn_test();
+
+   unsigned count_alu(nir_op op);
+
+   nir_builder b;
+   nir_ssa_def *x, *y, *z;
+   nir_variable *out;
+};
+
+static const nir_shader_compiler_options options = { };
+
+nir_gvn_test::nir_gvn_test()
+{
+   nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_COMPUTE, &options);
+
+   nir_variable *in =
+      nir_variable_create(b.shader, nir_var_uniform, glsl_vec4_type(), "in");
+   nir_ssa_def *v = nir_load_var(&b, in);
+   x = nir_channel(&b, v, 0);
+   y = nir_channel(&b, v, 1);
+   z = nir_channel(&b, v, 2);
+
+   out = nir_variable_create(b.shader, nir_var_shader_out,
+                             glsl_float_type(), "out");
+}
+
+nir_gvn_test::~nir_gvn_test()
+{
+   ralloc_free(b.shader);
+}
+
+unsigned
+nir_gvn_test::count_alu(nir_op op)
+{
+   unsigned count = 0;
+
+   nir_foreach_block(block, b.impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type == nir_instr_type_alu &&
+             nir_instr_as_alu(instr)->op == op)
+            count++;
+      }
+   }
+
+   return count;
+}
+
+TEST_F(nir_gvn_test, commutative)
+{
+   nir_ssa_def *a = nir_fadd(&b, x, y);
+   nir_ssa_def *c = nir_fadd(&b, y, x);
+   nir_ssa_def *d = nir_ffma(&b, x, y, z);
+   nir_ssa_def *e = nir_ffma(&b, y, x, z);
+   nir_ssa_def *f = nir_ffma(&b, x, z, y);
+   nir_store_var(&b, out, nir_fmul(&b, nir_fmul(&b, a, c),
+                                   nir_fmul(&b, nir_fmul(&b, d, e), f)), 0x1);
+
+   EXPECT_TRUE(nir_opt_gvn(b.shader));
+   nir_validate_shader(b.shader);
+
+   EXPECT_EQ(count_alu(nir_op_fadd), 1u);
+   /* Only the first two sources of ffma commute. */
+   EXPECT_EQ(count_alu(nir_op_ffma), 2u);
+}
+
+TEST_F(nir_gvn_test, hoist_from_if)
+{
+   nir_if *nif = nir_push_if(&b, nir_flt(&b, x, y));
+   nir_ssa_def *then_val = nir_fmul(&b, nir_fadd(&b, x, y), z);
+   nir_push_else(&b, nif);
+   nir_ssa_def *else_val = nir_fmul(&b, z, nir_fadd(&b, y, x));
+   nir_pop_if(&b, nif);
+   nir_ssa_def *phi = nir_if_phi(&b, then_val, else_val);
+   nir_store_var(&b, out, phi, 0x1);
+
+   EXPECT_TRUE(nir_opt_gvn(b.shader));
+   nir_validate_shader(b.shader);
+
+   /* Both the fadd and the fmul using it get hoisted, which leaves a phi
+    * of the same value on both sides, which goes away as well.
+    */
+   EXPECT_EQ(count_alu(nir_op_fadd), 1u);
+   EXPECT_EQ(count_alu(nir_op_fmul), 1u);
+   EXPECT_TRUE(nir_block_first_instr(nir_if_first_then_block(nif)) == NULL);
+   EXPECT_TRUE(nir_block_first_instr(nir_if_first_else_block(nif)) == NULL);
+
+   nir_block *after = nir_cf_node_as_block(nir_cf_node_next(&nif->cf_node));
+   nir_instr *first = nir_block_first_instr(after);
+   EXPECT_TRUE(first == NULL || first->type != nir_instr_type_phi);
+}
+
+TEST_F(nir_gvn_test, no_hoist_of_different_values)
+{
+   /* Nothing is computed on both sides, so nothing moves. */
+   nir_if *nif = nir_push_if(&b, nir_flt(&b, x, y));
+   nir_ssa_def *then_val = nir_fadd(&b, nir_fmul(&b, x, x), y);
+   nir_push_else(&b, nif);
+   nir_ssa_def *else_val = nir_fadd(&b, nir_fmul(&b, y, y), y);
+   nir_pop_if(&b, nif);
+   nir_store_var(&b, out, nir_if_phi(&b, then_val, else_val), 0x1);
+
+   EXPECT_FALSE(nir_opt_gvn(b.shader));
+   nir_validate_shader(b.shader);
+
+   EXPECT_EQ(count_alu(nir_op_fadd), 2u);
+   EXPECT_EQ(count_alu(nir_op_fmul), 2u);
+}
+
+TEST_F(nir_gvn_test, dominating_duplicate)
+{
+   nir_ssa_def *a = nir_fadd(&b, x, y);
+   nir_if *nif = nir_push_if(&b, nir_flt(&b, x, y));
+   nir_ssa_def *c = nir_fadd(&b, y, x);
+   nir_store_var(&b, out, nir_fmul(&b, a, c), 0x1);
+   nir_pop_if(&b, nif);
+
+   EXPECT_TRUE(nir_opt_gvn(b.shader));
+   nir_validate_shader(b.shader);
+
+   EXPECT_EQ(count_alu(nir_op_fadd), 1u);
+}
@@ -0,0 +1,298 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Compares nir_metadata_live_ssa_defs with nir_sparse_liveness on shaders
+ * shaped like large unrolled compute kernels: long runs of arithmetic on a
+ * set of variables, with ifs and loops in between, turned into SSA.
+ *
+ * Usage: liveness_bench [-s seed] [-n shaders] [statements...]
+ *
+ * For each size, this prints the number of SSA values and blocks, the time
+ * the dense analysis takes along with the interference checks made on the
+ * values read by each ALU instruction and each phi, the memory its sets
+ * take, the time the same takes with the sparse analysis, and the time
+ * nir_convert_from_ssa takes.  The program fails if the sparse analysis
+ * misses any interference the dense one finds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nir.h"
+#include "nir_builder.h"
+
+#define NUM_VARS 64
+
+static unsigned seed;
+
+static unsigned
+rand_below(unsigned n)
+{
+   seed = seed * 1103515245 + 12345;
+   return (seed >> 8) % n;
+}
+
+static int64_t
+now_nsec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static void
+build_statements(nir_builder *b, nir_variable **vars, unsigned *budget,
+                 unsigned depth)
+{
+   while (*budget > 0) {
+      const unsigned r = rand_below(100);
+      (*budget)--;
+
+      if (r < 4 && depth < 4) {
+         nir_ssa_def *v = nir_load_var(b, vars[rand_below(NUM_VARS)]);
+         nir_ssa_def *c = nir_channel(b, v, 0);
+         nir_if *nif = nir_push_if(b, nir_flt(b, c, nir_imm_float(b, 0.5)));
+         unsigned then_budget = 1 + rand_below(16);
+         build_statements(b, vars, &then_budget, depth + 1);
+         nir_push_else(b, nif);
+         unsigned else_budget = 1 + rand_below(16);
+         build_statements(b, vars, &else_budget, depth + 1);
+         nir_pop_if(b, nif);
+      } else if (r < 5 && depth < 3) {
+         nir_loop *loop = nir_push_loop(b);
+         unsigned body_budget = 1 + rand_below(32);
+         build_statements(b, vars, &body_budget, depth + 1);
+         nir_ssa_def *v = nir_load_var(b, vars[rand_below(NUM_VARS)]);
+         nir_ssa_def *c = nir_channel(b, v, 1);
+         nir_if *nif = nir_push_if(b, nir_flt(b, c, nir_imm_float(b, 0.25)));
+         nir_jump(b, nir_jump_break);
+         nir_pop_if(b, nif);
+         nir_pop_loop(b, loop);
+      } else if (r < 6 && depth > 0) {
+         return;
+      } else {
+         nir_ssa_def *x = nir_load_var(b, vars[rand_below(NUM_VARS)]);
+         nir_ssa_def *y = nir_load_var(b, vars[rand_below(NUM_VARS)]);
+         nir_ssa_def *z = r < 60 ? nir_fadd(b, x, y) : nir_ffma(b, x, y, x);
+         nir_store_var(b, vars[rand_below(NUM_VARS)], z, 0xf);
+      }
+   }
+}
+
+static nir_shader *
+build_shader(const nir_shader_compiler_options *options, unsigned statements)
+{
+   nir_builder b;
+   nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_COMPUTE, options);
+
+   nir_variable *vars[NUM_VARS];
+   for (unsigned i = 0; i < NUM_VARS; i++) {
+      vars[i] = nir_local_variable_create(b.impl, glsl_vec4_type(), "v");
+      nir_store_var(&b, vars[i], nir_imm_vec4(&b, i, 0, 0, 1), 0xf);
+   }
+
+   build_statements(&b, vars, &statements, 0);
+
+   /* Keep every variable alive until the end */
+   nir_ssa_def *sum = nir_load_var(&b, vars[0]);
+   for (unsigned i = 1; i < NUM_VARS; i++)
+      sum = nir_fadd(&b, sum, nir_load_var(&b, vars[i]));
+   nir_variable *out =
+      nir_variable_create(b.shader, nir_var_shader_out, glsl_vec4_type(),
+                          "out");
+   nir_store_var(&b, out, sum, 0xf);
+
+   nir_lower_vars_to_ssa(b.shader);
+   nir_validate_shader(b.shader);
+
+   return b.shader;
+}
+
+struct def_pair {
+   nir_ssa_def *a, *b;
+};
+
+/* Collects the pairs of values read together by an ALU instruction, and
+ * those of phi destinations with their sources and the other phis in the
+ * block, which are the kinds of pairs nir_convert_from_ssa checks.
+ */
+static struct def_pair *
+collect_pairs(nir_function_impl *impl, unsigned *num_pairs)
+{
+   struct def_pair *pairs = NULL;
+   unsigned num = 0, size = 0;
+
+#define ADD_PAIR(x, y) do {                                          \
+      if (num == size) {                                             \
+         size = size ? size * 2 : 1024;                              \
+         pairs = realloc(pairs, size * sizeof(*pairs));              \
+      }                                                              \
+      pairs[num].a = (x);                                            \
+      pairs[num].b = (y);                                            \
+      num++;                                                         \
+   } while (0)
+
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type == nir_instr_type_alu) {
+            nir_alu_instr *alu = nir_instr_as_alu(instr);
+            const unsigned n = nir_op_infos[alu->op].num_inputs;
+
+            for (unsigned i = 0; i + 1 < n; i++) {
+               if (alu->src[i].src.is_ssa && alu->src[i + 1].src.is_ssa &&
+                   alu->src[i].src.ssa != alu->src[i + 1].src.ssa)
+                  ADD_PAIR(alu->src[i].src.ssa, alu->src[i + 1].src.ssa);
+            }
+         } else if (instr->type == nir_instr_type_phi) {
+            nir_phi_instr *phi = nir_instr_as_phi(instr);
+
+            nir_foreach_phi_src(src, phi)
+               ADD_PAIR(&phi->dest.ssa, src->src.ssa);
+
+            for (nir_instr *other = nir_instr_prev(instr); other;
+                 other = nir_instr_prev(other))
+               ADD_PAIR(&nir_instr_as_phi(other)->dest.ssa, &phi->dest.ssa);
+         }
+      }
+   }
+
+#undef ADD_PAIR
+
+   *num_pairs = num;
+   return pairs;
+}
+
+static bool
+count_ssa_def(nir_ssa_def *def, void *state)
+{
+   (*(unsigned *)state)++;
+   return true;
+}
+
+static void
+run(const nir_shader_compiler_options *options, unsigned statements,
+    unsigned *missed, unsigned *extra)
+{
+   nir_shader *shader = build_shader(options, statements);
+   nir_function_impl *impl = nir_shader_get_entrypoint(shader);
+
+   unsigned num_pairs;
+   struct def_pair *pairs = collect_pairs(impl, &num_pairs);
+   bool *dense = malloc(num_pairs * sizeof(bool));
+   unsigned num_ssa = 0;
+
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block)
+         nir_foreach_ssa_def(instr, count_ssa_def, &num_ssa);
+   }
+
+   int64_t start = now_nsec();
+   nir_metadata_require(impl, nir_metadata_block_index |
+                              nir_metadata_dominance);
+   const int64_t dom_time = now_nsec() - start;
+
+   start = now_nsec();
+   nir_metadata_require(impl, nir_metadata_live_ssa_defs);
+   for (unsigned i = 0; i < num_pairs; i++)
+      dense[i] = nir_ssa_defs_interfere(pairs[i].a, pairs[i].b);
+   const int64_t dense_time = now_nsec() - start;
+   const size_t dense_size =
+      2 * impl->num_blocks * BITSET_WORDS(num_ssa + 1) * sizeof(BITSET_WORD);
+
+   void *mem_ctx = ralloc_context(NULL);
+   start = now_nsec();
+   nir_sparse_liveness *live = nir_sparse_liveness_create(mem_ctx, impl);
+   for (unsigned i = 0; i < num_pairs; i++) {
+      const bool sparse =
+         nir_sparse_liveness_ssa_defs_interfere(live, pairs[i].a, pairs[i].b);
+
+      if (dense[i] && !sparse)
+         (*missed)++;
+      else if (sparse && !dense[i])
+         (*extra)++;
+   }
+   const int64_t sparse_time = now_nsec() - start;
+   ralloc_free(mem_ctx);
+
+   start = now_nsec();
+   nir_convert_from_ssa(shader, false);
+   const int64_t from_ssa_time = now_nsec() - start;
+   nir_validate_shader(shader);
+
+   printf("%6u values %5u blocks %7u pairs | "
+          "dense %8.2f ms, %8zu KB of sets | sparse %8.2f ms | "
+          "from_ssa %8.2f ms\n",
+          num_ssa, impl->num_blocks, num_pairs,
+          (dom_time + dense_time) / 1e6, dense_size / 1024,
+          (dom_time + sparse_time) / 1e6, from_ssa_time / 1e6);
+
+   free(dense);
+   free(pairs);
+   ralloc_free(shader);
+}
+
+int
+main(int argc, char **argv)
+{
+   static const unsigned default_sizes[] = { 1000, 4000, 16000 };
+   const nir_shader_compiler_options options = { 0 };
+   unsigned num_shaders = 1;
+   unsigned missed = 0, extra = 0;
+   int opt;
+
+   seed = 1;
+   while ((opt = getopt(argc, argv, "s:n:")) != -1) {
+      switch (opt) {
+      case 's':
+         seed = atoi(optarg);
+         break;
+      case 'n':
+         num_shaders = atoi(optarg);
+         break;
+      default:
+         fprintf(stderr,
+                 "usage: %s [-s seed] [-n shaders] [statements...]\n",
+                 argv[0]);
+         return 1;
+      }
+   }
+
+   for (unsigned i = 0; i < num_shaders; i++) {
+      if (optind < argc) {
+         for (int j = optind; j < argc; j++)
+            run(&options, atoi(argv[j]), &missed, &extra);
+      } else {
+         for (unsigned j = 0; j < ARRAY_SIZE(default_sizes); j++)
+            run(&options, default_sizes[j], &missed, &extra);
+      }
+   }
+
+   printf("sparse analysis: %u missed interferences, %u extra\n",
+          missed, extra);
+
+   return missed ? 1 : 0;
+}
@@ -0,0 +1,351 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Compares nir_opt_loop_unroll with the default heuristic against a cost
+ * model that unrolls partially, on shaders shaped like compute kernels:
+ * arithmetic on a set of accumulators in counted loops of various trip
+ * counts and sizes, some of them nested.
+ *
+ * Usage: loop_unroll_bench [-s seed] [-n shaders] [-v] [loops...]
+ *
+ * For each number of loops, this runs a small optimization loop like the
+ * drivers' over the shader with each cost model and prints the time it
+ * takes, the number of instructions left, the largest number of SSA values
+ * live into a block, as a measure of register pressure, and how many loops
+ * were unrolled completely, unrolled partially and left alone.  With -v, the
+ * decisions are also listed one by one, as NIR_PRINT_LOOP_UNROLL does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nir.h"
+#include "nir_builder.h"
+
+#define NUM_VARS 16
+
+static unsigned seed;
+
+static unsigned
+rand_below(unsigned n)
+{
+   seed = seed * 1103515245 + 12345;
+   return (seed >> 8) % n;
+}
+
+static int64_t
+now_nsec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static void
+build_loop(nir_builder *b, nir_variable **vars, unsigned depth)
+{
+   static const unsigned trip_counts[] = { 2, 4, 8, 16, 64, 256 };
+   const unsigned trip_count = trip_counts[rand_below(ARRAY_SIZE(trip_counts))];
+   const unsigned statements = 1 + rand_below(depth ? 8 : 40);
+
+   nir_variable *i = nir_local_variable_create(b->impl, glsl_int_type(), "i");
+   nir_store_var(b, i, nir_imm_int(b, 0), 0x1);
+
+   nir_loop *loop = nir_push_loop(b);
+   nir_ssa_def *i_val = nir_load_var(b, i);
+   nir_if *nif = nir_push_if(b, nir_ige(b, i_val,
+                                        nir_imm_int(b, trip_count)));
+   nir_jump(b, nir_jump_break);
+   nir_pop_if(b, nif);
+
+   nir_ssa_def *f = nir_i2f32(b, i_val);
+   for (unsigned j = 0; j < statements; j++) {
+      nir_variable *dst = vars[rand_below(NUM_VARS)];
+      nir_ssa_def *x = nir_load_var(b, vars[rand_below(NUM_VARS)]);
+      nir_ssa_def *y = nir_load_var(b, vars[rand_below(NUM_VARS)]);
+      nir_store_var(b, dst, nir_ffma(b, x, f, nir_fmul(b, y, x)), 0xf);
+   }
+
+   if (depth == 0 && rand_below(4) == 0)
+      build_loop(b, vars, depth + 1);
+
+   nir_store_var(b, i, nir_iadd(b, i_val, nir_imm_int(b, 1)), 0x1);
+   nir_pop_loop(b, loop);
+}
+
+static nir_shader *
+build_shader(const nir_shader_compiler_options *options, unsigned loops)
+{
+   nir_builder b;
+   nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_COMPUTE, options);
+
+   nir_variable *in =
+      nir_variable_create(b.shader, nir_var_uniform, glsl_vec4_type(), "in");
+   nir_variable *vars[NUM_VARS];
+   for (unsigned i = 0; i < NUM_VARS; i++) {
+      vars[i] = nir_local_variable_create(b.impl, glsl_vec4_type(), "v");
+      nir_store_var(&b, vars[i],
+                    nir_fadd(&b, nir_load_var(&b, in),
+                             nir_imm_vec4(&b, i, 0, 0, 1)), 0xf);
+   }
+
+   for (unsigned i = 0; i < loops; i++)
+      build_loop(&b, vars, 0);
+
+   nir_ssa_def *sum = nir_load_var(&b, vars[0]);
+   for (unsigned i = 1; i < NUM_VARS; i++)
+      sum = nir_fadd(&b, sum, nir_load_var(&b, vars[i]));
+   nir_variable *out =
+      nir_variable_create(b.shader, nir_var_shader_out, glsl_vec4_type(),
+                          "out");
+   nir_store_var(&b, out, sum, 0xf);
+
+   nir_lower_vars_to_ssa(b.shader);
+   nir_validate_shader(b.shader);
+
+   return b.shader;
+}
+
+static void
+optimize(nir_shader *shader)
+{
+   bool progress;
+
+   do {
+      progress = false;
+      progress |= nir_copy_prop(shader);
+      progress |= nir_opt_dce(shader);
+      progress |= nir_opt_cse(shader);
+      progress |= nir_opt_algebraic(shader);
+      progress |= nir_opt_constant_folding(shader);
+      progress |= nir_opt_dead_cf(shader);
+      progress |= nir_opt_remove_phis(shader);
+      progress |= nir_opt_loop_unroll(shader, 0);
+   } while (progress);
+}
+
+/* Unrolls completely what the default heuristic does as long as it unrolls
+ * into no more than 1024 instructions, and otherwise by up to 4 while the
+ * body stays within 64 instructions, like the i965 scalar backend does for
+ * compute shaders.
+ */
+static unsigned
+partial_factor(const nir_shader *shader, const nir_loop *loop)
+{
+   nir_loop_info *li = loop->info;
+
+   if (loop->partially_unrolled)
+      return 0;
+
+   unsigned factor = nir_loop_unroll_default_factor(shader, loop);
+
+   if (li->is_trip_count_known && !li->force_unroll &&
+       list_length(&li->loop_terminator_list) == 1 &&
+       (factor == 0 || li->num_instructions * li->trip_count > 1024)) {
+      for (factor = 4; factor >= 2; factor /= 2) {
+         if (factor < li->trip_count && li->num_instructions * factor <= 64)
+            break;
+      }
+   }
+
+   return factor;
+}
+
+struct stats {
+   int64_t time;
+   unsigned instrs, max_live;
+
+   /* Loops unrolled completely, unrolled partially and left alone */
+   unsigned full, partial, none;
+};
+
+static void
+count_loops(struct exec_list *cf_list, unsigned *loops, unsigned *partial)
+{
+   foreach_list_typed(nir_cf_node, node, node, cf_list) {
+      if (node->type == nir_cf_node_if) {
+         count_loops(&nir_cf_node_as_if(node)->then_list, loops, partial);
+         count_loops(&nir_cf_node_as_if(node)->else_list, loops, partial);
+      } else if (node->type == nir_cf_node_loop) {
+         nir_loop *loop = nir_cf_node_as_loop(node);
+
+         (*loops)++;
+         if (loop->partially_unrolled)
+            (*partial)++;
+         count_loops(&loop->body, loops, partial);
+      }
+   }
+}
+
+static bool
+max_live_index(nir_ssa_def *def, void *state)
+{
+   unsigned *max = state;
+   if (def->live_index > *max)
+      *max = def->live_index;
+   return true;
+}
+
+static void
+get_stats(nir_function_impl *impl, unsigned num_loops, struct stats *stats)
+{
+   unsigned num_live_indices = 0;
+
+   nir_metadata_require(impl, nir_metadata_live_ssa_defs);
+
+   stats->instrs = 0;
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block) {
+         stats->instrs++;
+         nir_foreach_ssa_def(instr, max_live_index, &num_live_indices);
+      }
+   }
+
+   stats->max_live = 0;
+   nir_foreach_block(block, impl) {
+      unsigned live = 0;
+      for (unsigned i = 0; i < BITSET_WORDS(num_live_indices + 1); i++)
+         live += __builtin_popcount(block->live_in[i]);
+      if (live > stats->max_live)
+         stats->max_live = live;
+   }
+
+   unsigned loops_left = 0;
+   stats->partial = 0;
+   count_loops(&impl->body, &loops_left, &stats->partial);
+   stats->full = num_loops - loops_left;
+   stats->none = loops_left - stats->partial;
+}
+
+static void
+run(nir_shader_compiler_options *options, nir_loop_unroll_factor_cb model,
+    unsigned loops, struct stats *stats)
+{
+   const unsigned shader_seed = seed;
+
+   options->loop_unroll_factor = model;
+   nir_shader *shader = build_shader(options, loops);
+   nir_function_impl *impl = nir_shader_get_entrypoint(shader);
+
+   unsigned num_loops = 0, partial = 0;
+   count_loops(&impl->body, &num_loops, &partial);
+
+   const int64_t start = now_nsec();
+   optimize(shader);
+   stats->time = now_nsec() - start;
+   nir_validate_shader(shader);
+
+   get_stats(impl, num_loops, stats);
+   ralloc_free(shader);
+
+   /* Build the same shader for the next model */
+   seed = shader_seed;
+}
+
+static void
+print_stats(const char *name, const struct stats *stats)
+{
+   printf(" | %s %8.2f ms %6u instrs %4u live %3u/%3u/%3u", name,
+          stats->time / 1e6, stats->instrs, stats->max_live,
+          stats->full, stats->partial, stats->none);
+}
+
+static void
+add_stats(struct stats *total, const struct stats *stats)
+{
+   total->time += stats->time;
+   total->instrs += stats->instrs;
+   if (stats->max_live > total->max_live)
+      total->max_live = stats->max_live;
+   total->full += stats->full;
+   total->partial += stats->partial;
+   total->none += stats->none;
+}
+
+int
+main(int argc, char **argv)
+{
+   static const unsigned default_sizes[] = { 4, 16, 64 };
+   nir_shader_compiler_options options = { 0 };
+   struct stats default_total = { 0 }, partial_total = { 0 };
+   unsigned num_shaders = 1;
+   int opt;
+
+   options.native_integers = true;
+   options.max_unroll_iterations = 32;
+
+   seed = 1;
+   while ((opt = getopt(argc, argv, "s:n:v")) != -1) {
+      switch (opt) {
+      case 's':
+         seed = atoi(optarg);
+         break;
+      case 'n':
+         num_shaders = atoi(optarg);
+         break;
+      case 'v':
+         setenv("NIR_PRINT_LOOP_UNROLL", "true", 1);
+         break;
+      default:
+         fprintf(stderr,
+                 "usage: %s [-s seed] [-n shaders] [-v] [loops...]\n",
+                 argv[0]);
+         return 1;
+      }
+   }
+
+   const unsigned num_sizes =
+      optind < argc ? argc - optind : ARRAY_SIZE(default_sizes);
+
+   for (unsigned i = 0; i < num_shaders; i++) {
+      for (unsigned j = 0; j < num_sizes; j++) {
+         const unsigned loops = optind < argc ? atoi(argv[optind + j]) :
+                                                default_sizes[j];
+         struct stats default_stats, partial_stats;
+
+         run(&options, NULL, loops, &default_stats);
+         run(&options, partial_factor, loops, &partial_stats);
+         add_stats(&default_total, &default_stats);
+         add_stats(&partial_total, &partial_stats);
+
+         /* Move on to another shader */
+         rand_below(1);
+
+         printf("%3u loops", loops);
+         print_stats("default", &default_stats);
+         print_stats("partial", &partial_stats);
+         printf("\n");
+      }
+   }
+
+   printf("total  ");
+   print_stats("default", &default_total);
+   print_stats("partial", &partial_total);
+   printf("\n");
+
+   return 0;
+}
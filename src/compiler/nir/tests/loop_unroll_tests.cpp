@@ -0,0 +1,191 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+
+class nir_loop_unroll_test : public ::testing::Test {
+protected:
+   nir_loop_unroll_test();
+   ~nir_loop_unroll_test();
+
+   void build_counted_loop(unsigned trip_count);
+   unsigned count_alu(nir_op op);
+   nir_loop *find_loop();
+
+   nir_builder b;
+   nir_shader_compiler_options options;
+};
+
+static unsigned unroll_factor;
+
+static unsigned
+fixed_unroll_factor(const nir_shader *shader, const nir_loop *loop)
+{
+   return unroll_factor;
+}
+
+nir_loop_unroll_test::nir_loop_unroll_test()
+{
+   memset(&options, 0, sizeof(options));
+   options.native_integers = true;
+   options.max_unroll_iterations = 32;
+
+   nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_COMPUTE, &options);
+}
+
+nir_loop_unroll_test::~nir_loop_unroll_test()
+{
+   ralloc_free(b.shader);
+}
+
+/* Builds
+ *
+ *    int s = 0;
+ *    for (int i = 0; i < trip_count; i++)
+ *       s = s * 3 + i;
+ *    out = s;
+ */
+void
+nir_loop_unroll_test::build_counted_loop(unsigned trip_count)
+{
+   nir_variable *i = nir_local_variable_create(b.impl, glsl_int_type(), "i");
+   nir_variable *s = nir_local_variable_create(b.impl, glsl_int_type(), "s");
+   nir_variable *out = nir_variable_create(b.shader, nir_var_shader_out,
+                                           glsl_int_type(), "out");
+
+   nir_store_var(&b, i, nir_imm_int(&b, 0), 0x1);
+   nir_store_var(&b, s, nir_imm_int(&b, 0), 0x1);
+
+   nir_loop *loop = nir_push_loop(&b);
+   nir_ssa_def *i_val = nir_load_var(&b, i);
+   nir_if *nif = nir_push_if(&b, nir_ige(&b, i_val,
+                                         nir_imm_int(&b, trip_count)));
+   nir_jump(&b, nir_jump_break);
+   nir_pop_if(&b, nif);
+   nir_store_var(&b, s, nir_iadd(&b, nir_imul(&b, nir_load_var(&b, s),
+                                              nir_imm_int(&b, 3)),
+                                 i_val), 0x1);
+   nir_store_var(&b, i, nir_iadd(&b, i_val, nir_imm_int(&b, 1)), 0x1);
+   nir_pop_loop(&b, loop);
+
+   nir_store_var(&b, out, nir_load_var(&b, s), 0x1);
+
+   nir_lower_vars_to_ssa(b.shader);
+   nir_copy_prop(b.shader);
+   nir_validate_shader(b.shader);
+}
+
+unsigned
+nir_loop_unroll_test::count_alu(nir_op op)
+{
+   unsigned count = 0;
+
+   nir_foreach_block(block, b.impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type == nir_instr_type_alu &&
+             nir_instr_as_alu(instr)->op == op)
+            count++;
+      }
+   }
+
+   return count;
+}
+
+nir_loop *
+nir_loop_unroll_test::find_loop()
+{
+   nir_foreach_block(block, b.impl) {
+      nir_cf_node *next = nir_cf_node_next(&block->cf_node);
+      if (next && next->type == nir_cf_node_loop)
+         return nir_cf_node_as_loop(next);
+   }
+
+   return NULL;
+}
+
+TEST_F(nir_loop_unroll_test, default_unrolls_completely)
+{
+   build_counted_loop(10);
+
+   EXPECT_TRUE(nir_opt_loop_unroll(b.shader, (nir_variable_mode)0));
+   nir_validate_shader(b.shader);
+
+   EXPECT_TRUE(find_loop() == NULL);
+   EXPECT_EQ(count_alu(nir_op_imul), 10u);
+}
+
+TEST_F(nir_loop_unroll_test, cost_model_declines)
+{
+   options.loop_unroll_factor = fixed_unroll_factor;
+   unroll_factor = 0;
+   build_counted_loop(10);
+
+   EXPECT_FALSE(nir_opt_loop_unroll(b.shader, (nir_variable_mode)0));
+   nir_validate_shader(b.shader);
+
+   EXPECT_TRUE(find_loop() != NULL);
+   EXPECT_EQ(count_alu(nir_op_imul), 1u);
+}
+
+TEST_F(nir_loop_unroll_test, partial)
+{
+   options.loop_unroll_factor = fixed_unroll_factor;
+   unroll_factor = 3;
+   build_counted_loop(10);
+
+   EXPECT_TRUE(nir_opt_loop_unroll(b.shader, (nir_variable_mode)0));
+   nir_validate_shader(b.shader);
+
+   /* One iteration is peeled off, and the loop runs three at a time. */
+   nir_loop *loop = find_loop();
+   ASSERT_TRUE(loop != NULL);
+   EXPECT_TRUE(loop->partially_unrolled);
+   EXPECT_EQ(count_alu(nir_op_imul), 4u);
+
+   unsigned loop_imuls = 0;
+   nir_foreach_block_in_cf_node(block, &loop->cf_node) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type == nir_instr_type_alu &&
+             nir_instr_as_alu(instr)->op == nir_op_imul)
+            loop_imuls++;
+      }
+   }
+   EXPECT_EQ(loop_imuls, 3u);
+
+   /* The loop isn't unrolled partially again. */
+   EXPECT_FALSE(nir_opt_loop_unroll(b.shader, (nir_variable_mode)0));
+}
+
+TEST_F(nir_loop_unroll_test, partial_without_remainder)
+{
+   options.loop_unroll_factor = fixed_unroll_factor;
+   unroll_factor = 4;
+   build_counted_loop(8);
+
+   EXPECT_TRUE(nir_opt_loop_unroll(b.shader, (nir_variable_mode)0));
+   nir_validate_shader(b.shader);
+
+   ASSERT_TRUE(find_loop() != NULL);
+   EXPECT_EQ(count_alu(nir_op_imul), 4u);
+}
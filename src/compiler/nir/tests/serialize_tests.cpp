@@ -0,0 +1,351 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "nir.h"
+#include "nir_builder.h"
+#include "nir_serialize.h"
+
+class nir_serialize_test : public ::testing::Test {
+protected:
+   nir_serialize_test();
+   ~nir_serialize_test();
+
+   void build_shader();
+   nir_shader *round_trip(struct blob *blob);
+   void expect_same(nir_shader *a, nir_shader *b);
+
+   nir_builder b;
+};
+
+static const nir_shader_compiler_options options = { };
+
+nir_serialize_test::nir_serialize_test()
+{
+   nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_FRAGMENT, &options);
+   b.shader->info.name = ralloc_strdup(b.shader, "serialize_test");
+}
+
+nir_serialize_test::~nir_serialize_test()
+{
+   ralloc_free(b.shader);
+}
+
+/* Builds a shader with a bit of everything:
+ *
+ *    uniform sampler2D tex;
+ *    uniform float scale[4];
+ *    in vec4 color;
+ *    out vec4 result;
+ *
+ *    vec4 v = color;
+ *    int i = 0;
+ *    while (true) {
+ *       if (i >= 4) break;
+ *       v = sat(-v * scale[i]) + texture(tex, v.xy);
+ *       i++;
+ *    }
+ *    if (v.x < 0.5) v = vec4(double-precision constant) else v = undef;
+ *    result = v;
+ */
+void
+nir_serialize_test::build_shader()
+{
+   nir_variable *tex =
+      nir_variable_create(b.shader, nir_var_uniform,
+                          glsl_sampler_type(GLSL_SAMPLER_DIM_2D, false, false,
+                                            GLSL_TYPE_FLOAT), "tex");
+   nir_variable *scale =
+      nir_variable_create(b.shader, nir_var_uniform,
+                          glsl_array_type(glsl_float_type(), 4), "scale");
+   nir_variable *color =
+      nir_variable_create(b.shader, nir_var_shader_in,
+                          glsl_vec4_type(), "color");
+   color->data.location = VARYING_SLOT_COL0;
+   nir_variable *result =
+      nir_variable_create(b.shader, nir_var_shader_out,
+                          glsl_vec4_type(), "result");
+   result->data.location = FRAG_RESULT_DATA0;
+
+   nir_variable *v = nir_local_variable_create(b.impl, glsl_vec4_type(), "v");
+   nir_variable *i = nir_local_variable_create(b.impl, glsl_int_type(), "i");
+
+   nir_store_var(&b, v, nir_load_var(&b, color), 0xf);
+   nir_store_var(&b, i, nir_imm_int(&b, 0), 0x1);
+
+   nir_loop *loop = nir_push_loop(&b);
+   {
+      nir_ssa_def *iv = nir_load_var(&b, i);
+      nir_if *nif = nir_push_if(&b, nir_ige(&b, iv, nir_imm_int(&b, 4)));
+      nir_jump(&b, nir_jump_break);
+      nir_pop_if(&b, nif);
+
+      nir_deref_var *elem = nir_deref_var_create(b.shader, scale);
+      nir_deref_array *arr = nir_deref_array_create(b.shader);
+      arr->deref_array_type = nir_deref_array_type_indirect;
+      arr->indirect = nir_src_for_ssa(iv);
+      arr->deref.type = glsl_float_type();
+      elem->deref.child = &arr->deref;
+      nir_ssa_def *s = nir_load_deref_var(&b, elem);
+
+      nir_ssa_def *vv = nir_load_var(&b, v);
+      nir_ssa_def *mul = nir_fmul(&b, vv, s);
+      nir_alu_instr *mul_alu = nir_instr_as_alu(mul->parent_instr);
+      mul_alu->src[0].negate = true;
+      mul_alu->src[1].swizzle[1] = mul_alu->src[1].swizzle[2] =
+         mul_alu->src[1].swizzle[3] = 0;
+      mul_alu->dest.saturate = true;
+      mul_alu->exact = true;
+
+      nir_tex_instr *t = nir_tex_instr_create(b.shader, 1);
+      t->sampler_dim = GLSL_SAMPLER_DIM_2D;
+      t->op = nir_texop_tex;
+      t->src[0].src_type = nir_tex_src_coord;
+      t->src[0].src = nir_src_for_ssa(nir_channels(&b, vv, 0x3));
+      t->dest_type = nir_type_float;
+      t->coord_components = 2;
+      t->texture = nir_deref_var_create(t, tex);
+      t->sampler = nir_deref_var_create(t, tex);
+      nir_ssa_dest_init(&t->instr, &t->dest, 4, 32, "texel");
+      nir_builder_instr_insert(&b, &t->instr);
+
+      nir_store_var(&b, v, nir_fadd(&b, mul, &t->dest.ssa), 0xf);
+      nir_store_var(&b, i, nir_iadd(&b, iv, nir_imm_int(&b, 1)), 0x1);
+   }
+   nir_pop_loop(&b, loop);
+
+   nir_ssa_def *vv = nir_load_var(&b, v);
+   nir_if *nif = nir_push_if(&b, nir_flt(&b, nir_channel(&b, vv, 0),
+                                         nir_imm_float(&b, 0.5)));
+   nir_ssa_def *d = nir_f2f32(&b, nir_imm_double(&b, 0.25));
+   nir_store_var(&b, v, nir_vec4(&b, d, d, d, d), 0xf);
+   nir_push_else(&b, nif);
+   nir_store_var(&b, v, nir_ssa_undef(&b, 4, 32), 0xf);
+   nir_pop_if(&b, nif);
+
+   nir_store_var(&b, result, nir_load_var(&b, v), 0xf);
+
+   nir_validate_shader(b.shader);
+}
+
+nir_shader *
+nir_serialize_test::round_trip(struct blob *blob)
+{
+   struct blob_reader reader;
+   blob_reader_init(&reader, blob->data, blob->size);
+   nir_shader *s = nir_deserialize(b.shader, &options, &reader);
+   if (s) {
+      EXPECT_EQ(reader.current, reader.end);
+      EXPECT_FALSE(reader.overrun);
+   }
+   return s;
+}
+
+static char *
+print_shader(nir_shader *s)
+{
+   char *str = NULL;
+   size_t size = 0;
+   FILE *fp = open_memstream(&str, &size);
+
+   nir_index_global_regs(s);
+   nir_foreach_function(func, s) {
+      if (func->impl) {
+         nir_index_ssa_defs(func->impl);
+         nir_index_local_regs(func->impl);
+      }
+   }
+   nir_print_shader(s, fp);
+   fclose(fp);
+
+   return str;
+}
+
+void
+nir_serialize_test::expect_same(nir_shader *a, nir_shader *b)
+{
+   char *str_a = print_shader(a);
+   char *str_b = print_shader(b);
+   EXPECT_STREQ(str_a, str_b);
+   free(str_a);
+   free(str_b);
+}
+
+TEST_F(nir_serialize_test, variables)
+{
+   build_shader();
+
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, b.shader);
+
+   nir_shader *s = round_trip(&blob);
+   ASSERT_TRUE(s != NULL);
+   nir_validate_shader(s);
+
+   EXPECT_STREQ(s->info.name, "serialize_test");
+   EXPECT_EQ(s->info.stage, MESA_SHADER_FRAGMENT);
+   EXPECT_EQ(exec_list_length(&s->uniforms), 2u);
+   ASSERT_EQ(exec_list_length(&s->inputs), 1u);
+   nir_variable *color =
+      exec_node_data(nir_variable, exec_list_get_head(&s->inputs), node);
+   EXPECT_STREQ(color->name, "color");
+   EXPECT_EQ(color->data.location, VARYING_SLOT_COL0);
+   EXPECT_EQ(color->type, glsl_vec4_type());
+
+   expect_same(b.shader, s);
+
+   blob_finish(&blob);
+}
+
+TEST_F(nir_serialize_test, ssa)
+{
+   build_shader();
+   nir_lower_vars_to_ssa(b.shader);
+
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, b.shader);
+
+   nir_shader *s = round_trip(&blob);
+   ASSERT_TRUE(s != NULL);
+   nir_validate_shader(s);
+   expect_same(b.shader, s);
+
+   blob_finish(&blob);
+}
+
+TEST_F(nir_serialize_test, registers)
+{
+   build_shader();
+   nir_lower_vars_to_ssa(b.shader);
+   nir_convert_from_ssa(b.shader, false);
+
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, b.shader);
+
+   nir_shader *s = round_trip(&blob);
+   ASSERT_TRUE(s != NULL);
+   nir_validate_shader(s);
+   expect_same(b.shader, s);
+
+   blob_finish(&blob);
+}
+
+TEST_F(nir_serialize_test, chunked_blob)
+{
+   build_shader();
+   nir_lower_vars_to_ssa(b.shader);
+
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, b.shader);
+
+   /* Write the shader behind varying amounts of padding, so that the words
+    * patched in after the fact for phi sources end up on either side of a
+    * chunk boundary.
+    */
+   for (size_t pad = 0; pad < blob.size; pad += sizeof(uint32_t)) {
+      struct blob chunked;
+      blob_init_chunked(&chunked);
+      blob_write_uint32(&chunked, 0);
+      size_t chunk_size = chunked.chunks->allocated;
+      ASSERT_GT(chunk_size, blob.size);
+      blob_reserve_bytes(&chunked, chunk_size - sizeof(uint32_t) - pad);
+
+      size_t start = chunked.size;
+      nir_serialize(&chunked, b.shader);
+      ASSERT_EQ(chunked.size - start, blob.size);
+
+      uint8_t *flat = (uint8_t *) malloc(chunked.size);
+      size_t offset = 0;
+      for (struct blob_chunk *c = chunked.chunks; c; c = c->next) {
+         memcpy(flat + offset, c->data, c->size);
+         offset += c->size;
+      }
+      EXPECT_EQ(offset, chunked.size);
+      EXPECT_EQ(memcmp(flat + start, blob.data, blob.size), 0);
+
+      free(flat);
+      blob_finish(&chunked);
+   }
+
+   blob_finish(&blob);
+}
+
+TEST_F(nir_serialize_test, truncated)
+{
+   build_shader();
+
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, b.shader);
+
+   struct blob_reader reader;
+   blob_reader_init(&reader, blob.data, blob.size - 4);
+   EXPECT_TRUE(nir_deserialize(b.shader, &options, &reader) == NULL);
+
+   /* An unknown version is rejected too. */
+   blob.data[0] ^= 0xff;
+   blob_reader_init(&reader, blob.data, blob.size);
+   EXPECT_TRUE(nir_deserialize(b.shader, &options, &reader) == NULL);
+
+   blob_finish(&blob);
+}
+
+static nir_loop *
+find_loop(nir_shader *s)
+{
+   nir_function_impl *impl = nir_shader_get_entrypoint(s);
+
+   foreach_list_typed(nir_cf_node, node, node, &impl->body) {
+      if (node->type == nir_cf_node_loop)
+         return nir_cf_node_as_loop(node);
+   }
+
+   return NULL;
+}
+
+TEST_F(nir_serialize_test, partially_unrolled_loop)
+{
+   build_shader();
+
+   for (unsigned partially_unrolled = 0; partially_unrolled < 2;
+        partially_unrolled++) {
+      find_loop(b.shader)->partially_unrolled = partially_unrolled;
+
+      struct blob blob;
+      blob_init(&blob);
+      nir_serialize(&blob, b.shader);
+
+      nir_shader *s = round_trip(&blob);
+      ASSERT_TRUE(s != NULL);
+      nir_loop *loop = find_loop(s);
+      ASSERT_TRUE(loop != NULL);
+      EXPECT_EQ(loop->partially_unrolled, (bool) partially_unrolled);
+
+      blob_finish(&blob);
+   }
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include "c11/threads.h"
+#include "pass_profile.h"
+
+static mtx_t profile_mutex = _MTX_INITIALIZER_NP;
+static once_flag profile_once = ONCE_FLAG_INIT;
+static FILE *profile_file;
+static bool profile_first_event;
+static int64_t profile_epoch;
+
+static int64_t
+profile_now(void)
+{
+#ifdef _WIN32
+   LARGE_INTEGER freq, counter;
+   QueryPerformanceFrequency(&freq);
+   QueryPerformanceCounter(&counter);
+   return (int64_t) (counter.QuadPart * (1000000000.0 / freq.QuadPart));
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static int
+profile_pid(void)
+{
+#ifdef _WIN32
+   return _getpid();
+#else
+   return getpid();
+#endif
+}
+
+static long
+profile_tid(void)
+{
+#if defined(__linux__) && defined(SYS_gettid)
+   return syscall(SYS_gettid);
+#else
+   return profile_pid();
+#endif
+}
+
+static void
+profile_open(void)
+{
+   const char *path = getenv("MESA_PASS_PROFILE");
+   if (path == NULL || path[0] == '\0')
+      return;
+
+   /* Substitute the pid for %p, so that every process of a shader-db run
+    * gets its own file.
+    */
+   char name[4096];
+   const char *p = strstr(path, "%p");
+   if (p != NULL) {
+      snprintf(name, sizeof(name), "%.*s%d%s",
+               (int) (p - path), path, profile_pid(), p + 2);
+   } else {
+      snprintf(name, sizeof(name), "%s", path);
+   }
+
+   profile_file = fopen(name, "w");
+   if (profile_file == NULL) {
+      fprintf(stderr, "MESA_PASS_PROFILE: can't open %s\n", name);
+      return;
+   }
+
+   /* The closing bracket is optional in the JSON array format, which means
+    * we don't need to do anything at exit.
+    */
+   fputs("[\n", profile_file);
+   profile_first_event = true;
+   profile_epoch = profile_now();
+}
+
+bool
+pass_profile_enabled(void)
+{
+   /* Passes may run on several threads at once, see link_foreach_stage(). */
+   call_once(&profile_once, profile_open);
+
+   return profile_file != NULL;
+}
+
+int64_t
+pass_profile_begin(void)
+{
+   return pass_profile_enabled() ? profile_now() : 0;
+}
+
+static void
+write_json_string(FILE *fp, const char *str)
+{
+   fputc('"', fp);
+   for (const char *c = str; *c; c++) {
+      if (*c == '"' || *c == '\\')
+         fprintf(fp, "\\%c", *c);
+      else if ((unsigned char) *c < 0x20)
+         fprintf(fp, "\\u%04x", (unsigned char) *c);
+      else
+         fputc(*c, fp);
+   }
+   fputc('"', fp);
+}
+
+void
+pass_profile_end(const char *category, const char *pass,
+                 const void *shader, const char *stage,
+                 const char *shader_name, int64_t start, int progress)
+{
+   if (start == 0)
+      return;
+
+   const int64_t end = profile_now();
+
+   mtx_lock(&profile_mutex);
+
+   FILE *fp = profile_file;
+   fprintf(fp, "%s{\"name\":", profile_first_event ? "" : ",\n");
+   write_json_string(fp, pass);
+   fprintf(fp, ",\"cat\":");
+   write_json_string(fp, category);
+   fprintf(fp, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld,"
+           "\"args\":{\"shader\":\"%p\"",
+           (start - profile_epoch) / 1000.0, (end - start) / 1000.0,
+           profile_pid(), profile_tid(), shader);
+   if (stage) {
+      fprintf(fp, ",\"stage\":");
+      write_json_string(fp, stage);
+   }
+   if (shader_name) {
+      fprintf(fp, ",\"shader_name\":");
+      write_json_string(fp, shader_name);
+   }
+   if (progress >= 0)
+      fprintf(fp, ",\"progress\":%s", progress ? "true" : "false");
+   fprintf(fp, "}}");
+   profile_first_event = false;
+
+   mtx_unlock(&profile_mutex);
+}
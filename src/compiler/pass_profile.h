@@ -0,0 +1,77 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Opt-in timing of compiler passes.
+ *
+ * If MESA_PASS_PROFILE is set to a file name, every run of a pass through
+ * NIR_PASS, NIR_PASS_V or do_common_optimization() is written to that file
+ * as an event in the Chrome trace event format, with the time it took,
+ * whether it made progress and the shader it ran on.  Any "%p" in the file
+ * name is replaced with the process id.  The result can be loaded in
+ * chrome://tracing or Perfetto, or summed up per pass with a script.
+ */
+
+#ifndef PASS_PROFILE_H
+#define PASS_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Returns whether MESA_PASS_PROFILE is set and its file could be opened.
+ */
+bool
+pass_profile_enabled(void);
+
+/**
+ * Returns the start time to give to pass_profile_end(), or 0 if profiling
+ * is disabled.
+ */
+int64_t
+pass_profile_begin(void);
+
+/**
+ * Records a run of \p pass that started at \p start.  Does nothing if
+ * \p start is 0.
+ *
+ * \param category     "nir" or "glsl", say
+ * \param shader       identifies the shader across passes
+ * \param stage        short stage name, or NULL if unknown
+ * \param shader_name  the shader's name, or NULL
+ * \param progress     1 or 0 if the pass returned whether it made progress,
+ *                     -1 if it doesn't say
+ */
+void
+pass_profile_end(const char *category, const char *pass,
+                 const void *shader, const char *stage,
+                 const char *shader_name, int64_t start, int progress);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PASS_PROFILE_H */
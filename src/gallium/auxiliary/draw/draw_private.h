@@ -212,6 +212,7 @@ struct draw_context
 
       boolean test_fse;         /* enable FSE even though its not correct (eg for softpipe) */
       boolean no_fse;           /* disable FSE even when it is correct */
+      unsigned vs_threads;      /* worker threads for the llvm vertex shader */
    } pt;
 
    struct {
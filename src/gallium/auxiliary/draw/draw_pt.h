@@ -47,6 +47,23 @@ struct draw_vertex_info;
 #define PT_MAX_MIDDLE 0x8
 
 
+/**
+ * With DRAW_VS_THREADS the llvm middle end hands each vertex shader thread
+ * ranges of at least this many vertices; smaller fetches aren't split.
+ */
+#define DRAW_PT_VS_MIN_CHUNK 256
+
+/** Upper bound for DRAW_VS_THREADS */
+#define DRAW_PT_MAX_VS_THREADS 32
+
+/**
+ * Number of vertices per fetch needed to give the calling thread and all
+ * vs_threads worker threads a range each.
+ */
+#define DRAW_PT_VS_FETCH_SIZE(vs_threads) \
+   (((vs_threads) + 1) * DRAW_PT_VS_MIN_CHUNK)
+
+
 /* The "front end" - prepare sets of fetch, draw elements for the
  * middle end.
  *
@@ -28,6 +28,7 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_queue.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_vbuf.h"
@@ -40,6 +41,23 @@
 #include "gallivm/lp_bld_debug.h"
 
 
+struct llvm_middle_end;
+
+/**
+ * A range of the fetched vertices run through the vertex shader on one
+ * of the worker threads.
+ */
+struct llvm_vs_job {
+   struct llvm_middle_end *fpme;
+   const struct draw_fetch_info *fetch_info;
+   struct vertex_header *verts;
+   unsigned first;
+   unsigned count;
+   boolean clipped;
+   struct util_queue_fence fence;
+};
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -57,6 +75,11 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /* Worker threads for the vertex shader, see DRAW_VS_THREADS */
+   unsigned num_vs_threads;
+   struct util_queue vs_queue;
+   struct llvm_vs_job *vs_jobs;
 };
 
 
@@ -158,6 +181,7 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
       u_assembled_prim(in_prim);
    unsigned point_clip = draw->rasterizer->fill_front == PIPE_POLYGON_MODE_POINT ||
                          out_prim == PIPE_PRIM_POINTS;
+   unsigned max_fetch;
    unsigned nr;
 
    fpme->input_prim = in_prim;
@@ -175,15 +199,20 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
 
    draw_pt_so_emit_prepare( fpme->so_emit, gs == NULL );
 
+   /* Fetches must be large enough to give all vertex shader threads some
+    * work.
+    */
+   max_fetch = MAX2(4096, DRAW_PT_VS_FETCH_SIZE(draw->pt.vs_threads));
+
    if (!(opt & PT_PIPELINE)) {
       draw_pt_emit_prepare( fpme->emit, out_prim,
                             max_vertices );
 
-      *max_vertices = MAX2( *max_vertices, 4096 );
+      *max_vertices = MAX2( *max_vertices, max_fetch );
    }
    else {
       /* limit max fetches by limiting max_vertices */
-      *max_vertices = 4096;
+      *max_vertices = max_fetch;
    }
 
    /* Get the number of float[4] attributes per vertex.
@@ -347,6 +376,115 @@ emit(struct pt_emit *emit,
 }
 
 
+/**
+ * Fetch and shade vertices [first, first + count) of the current fetch
+ * into verts.  Returns true if any of them needs clipping.
+ */
+static boolean
+run_vs_range(struct llvm_middle_end *fpme,
+             const struct draw_fetch_info *fetch_info,
+             struct vertex_header *verts,
+             unsigned first,
+             unsigned count)
+{
+   struct draw_context *draw = fpme->draw;
+   unsigned start_or_maxelt, vid_base;
+   const unsigned *elts;
+
+   if (fetch_info->linear) {
+      start_or_maxelt = fetch_info->start + first;
+      vid_base = draw->start_index;
+      elts = NULL;
+   }
+   else {
+      start_or_maxelt = draw->pt.user.eltMax;
+      vid_base = draw->pt.user.eltBias;
+      elts = fetch_info->elts + first;
+   }
+
+   return fpme->current_variant->jit_func(&fpme->llvm->jit_context,
+                                          (struct vertex_header *)
+                                          ((char *)verts +
+                                           first * fpme->vertex_size),
+                                          draw->pt.user.vbuffer,
+                                          count,
+                                          start_or_maxelt,
+                                          fpme->vertex_size,
+                                          draw->pt.vertex_buffer,
+                                          draw->instance_id,
+                                          vid_base,
+                                          draw->start_instance,
+                                          elts);
+}
+
+
+static void
+llvm_vs_job_execute(void *data, int thread_index)
+{
+   struct llvm_vs_job *job = (struct llvm_vs_job *)data;
+   unsigned fpstate = util_fpstate_get();
+
+   /* Same denorm handling as the application thread, see draw_vbo() */
+   util_fpstate_set_denorms_to_zero(fpstate);
+
+   job->clipped = run_vs_range(job->fpme, job->fetch_info, job->verts,
+                               job->first, job->count);
+
+   util_fpstate_set(fpstate);
+}
+
+
+/**
+ * Run the vertex shader over all fetched vertices.
+ *
+ * Large fetches are split into one contiguous range per worker thread plus
+ * one for the calling thread.  Each range writes only its own part of the
+ * output vertex array, so vertex and primitive order are unchanged and the
+ * rest of the pipeline (GS, clipping, emit) runs serially as before.
+ */
+static boolean
+run_vs(struct llvm_middle_end *fpme,
+       const struct draw_fetch_info *fetch_info,
+       struct vertex_header *verts)
+{
+   unsigned count = fetch_info->count;
+   unsigned chunk, first, num_jobs, i;
+   boolean clipped;
+
+   if (!fpme->num_vs_threads || count < 2 * DRAW_PT_VS_MIN_CHUNK)
+      return run_vs_range(fpme, fetch_info, verts, 0, count);
+
+   /* The generated code stores whole vectors, so ranges must start at a
+    * vector boundary to not overwrite each other.
+    */
+   chunk = DIV_ROUND_UP(count, fpme->num_vs_threads + 1);
+   chunk = align(MAX2(chunk, DRAW_PT_VS_MIN_CHUNK), lp_native_vector_width / 32);
+
+   num_jobs = 0;
+   for (first = chunk; first < count; first += chunk) {
+      struct llvm_vs_job *job = &fpme->vs_jobs[num_jobs++];
+
+      assert(num_jobs <= fpme->num_vs_threads);
+      job->fpme = fpme;
+      job->fetch_info = fetch_info;
+      job->verts = verts;
+      job->first = first;
+      job->count = MIN2(chunk, count - first);
+      util_queue_add_job(&fpme->vs_queue, job, &job->fence,
+                         llvm_vs_job_execute, NULL);
+   }
+
+   clipped = run_vs_range(fpme, fetch_info, verts, 0, chunk);
+
+   for (i = 0; i < num_jobs; i++) {
+      util_queue_fence_wait(&fpme->vs_jobs[i].fence);
+      clipped |= fpme->vs_jobs[i].clipped;
+   }
+
+   return clipped;
+}
+
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
@@ -365,8 +503,6 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
    boolean free_prim_info = FALSE;
    unsigned opt = fpme->opt;
    boolean clipped = 0;
-   unsigned start_or_maxelt, vid_base;
-   const unsigned *elts;
 
    llvm_vert_info.count = fetch_info->count;
    llvm_vert_info.vertex_size = fpme->vertex_size;
@@ -386,27 +522,7 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       draw->statistics.vs_invocations += fetch_info->count;
    }
 
-   if (fetch_info->linear) {
-      start_or_maxelt = fetch_info->start;
-      vid_base = draw->start_index;
-      elts = NULL;
-   }
-   else {
-      start_or_maxelt = draw->pt.user.eltMax;
-      vid_base = draw->pt.user.eltBias;
-      elts = fetch_info->elts;
-   }
-   clipped = fpme->current_variant->jit_func(&fpme->llvm->jit_context,
-                                             llvm_vert_info.verts,
-                                             draw->pt.user.vbuffer,
-                                             fetch_info->count,
-                                             start_or_maxelt,
-                                             fpme->vertex_size,
-                                             draw->pt.vertex_buffer,
-                                             draw->instance_id,
-                                             vid_base,
-                                             draw->start_instance,
-                                             elts);
+   clipped = run_vs(fpme, fetch_info, llvm_vert_info.verts);
 
    /* Finished with fetch and vs:
     */
@@ -609,6 +725,16 @@ llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
    if (fpme->post_vs)
       draw_pt_post_vs_destroy( fpme->post_vs );
 
+   if (fpme->vs_jobs) {
+      unsigned i;
+
+      if (util_queue_is_initialized(&fpme->vs_queue))
+         util_queue_destroy(&fpme->vs_queue);
+      for (i = 0; i < fpme->num_vs_threads; i++)
+         util_queue_fence_destroy(&fpme->vs_jobs[i].fence);
+      FREE(fpme->vs_jobs);
+   }
+
    FREE(middle);
 }
 
@@ -657,6 +783,27 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->current_variant = NULL;
 
+   fpme->num_vs_threads = draw->pt.vs_threads;
+   if (fpme->num_vs_threads) {
+      unsigned i;
+
+      fpme->vs_jobs = CALLOC(fpme->num_vs_threads, sizeof *fpme->vs_jobs);
+      if (!fpme->vs_jobs)
+         goto fail;
+      for (i = 0; i < fpme->num_vs_threads; i++)
+         util_queue_fence_init(&fpme->vs_jobs[i].fence);
+
+      if (!util_queue_init(&fpme->vs_queue, "draw_vs", fpme->num_vs_threads,
+                           fpme->num_vs_threads, 0)) {
+         /* fall back to running the vertex shader on this thread only */
+         for (i = 0; i < fpme->num_vs_threads; i++)
+            util_queue_fence_destroy(&fpme->vs_jobs[i].fence);
+         FREE(fpme->vs_jobs);
+         fpme->vs_jobs = NULL;
+         fpme->num_vs_threads = 0;
+      }
+   }
+
    return &fpme->base;
 
  fail:
@@ -46,11 +46,12 @@ struct vsplit_frontend {
 
    unsigned max_vertices;
    ushort segment_size;
+   ushort max_segment_size;
 
-   /* buffers for splitting */
-   unsigned fetch_elts[SEGMENT_SIZE];
-   ushort draw_elts[SEGMENT_SIZE];
-   ushort identity_draw_elts[SEGMENT_SIZE];
+   /* buffers for splitting, max_segment_size elements each */
+   unsigned *fetch_elts;
+   ushort *draw_elts;
+   ushort *identity_draw_elts;
 
    struct {
       /* map a fetch element to a draw element */
@@ -227,7 +228,7 @@ static void vsplit_prepare(struct draw_pt_front_end *frontend,
    vsplit->middle = middle;
    middle->prepare(middle, vsplit->prim, opt, &vsplit->max_vertices);
 
-   vsplit->segment_size = MIN2(SEGMENT_SIZE, vsplit->max_vertices);
+   vsplit->segment_size = MIN2(vsplit->max_segment_size, vsplit->max_vertices);
 }
 
 
@@ -244,6 +245,11 @@ static void vsplit_flush(struct draw_pt_front_end *frontend, unsigned flags)
 
 static void vsplit_destroy(struct draw_pt_front_end *frontend)
 {
+   struct vsplit_frontend *vsplit = (struct vsplit_frontend *) frontend;
+
+   FREE(vsplit->fetch_elts);
+   FREE(vsplit->draw_elts);
+   FREE(vsplit->identity_draw_elts);
    FREE(frontend);
 }
 
@@ -262,7 +268,25 @@ struct draw_pt_front_end *draw_pt_vsplit(struct draw_context *draw)
    vsplit->base.destroy = vsplit_destroy;
    vsplit->draw = draw;
 
-   for (i = 0; i < SEGMENT_SIZE; i++)
+   /* Segments must be large enough to be split among all the vertex shader
+    * threads, otherwise indexed draws could only keep a few of them busy.
+    */
+   vsplit->max_segment_size = MAX2(SEGMENT_SIZE,
+                                   DRAW_PT_VS_FETCH_SIZE(draw->pt.vs_threads));
+
+   vsplit->fetch_elts = MALLOC(vsplit->max_segment_size *
+                               sizeof(vsplit->fetch_elts[0]));
+   vsplit->draw_elts = MALLOC(vsplit->max_segment_size *
+                              sizeof(vsplit->draw_elts[0]));
+   vsplit->identity_draw_elts = MALLOC(vsplit->max_segment_size *
+                                       sizeof(vsplit->identity_draw_elts[0]));
+   if (!vsplit->fetch_elts || !vsplit->draw_elts ||
+       !vsplit->identity_draw_elts) {
+      vsplit_destroy(&vsplit->base);
+      return NULL;
+   }
+
+   for (i = 0; i < vsplit->max_segment_size; i++)
       vsplit->identity_draw_elts[i] = i;
 
    return &vsplit->base;
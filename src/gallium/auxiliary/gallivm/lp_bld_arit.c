@@ -102,7 +102,14 @@ lp_build_min_simple(struct lp_build_context *bld,
 
    /* TODO: optimize the constant case */
 
-   if (type.floating && util_cpu_caps.has_sse) {
+   if (type.floating && util_cpu_caps.has_avx512f &&
+       type.width * type.length == 512) {
+      /*
+       * Use the compare/select below, which llvm turns into a single 512bit
+       * vminps/pd rather than splitting into two 256bit intrinsics.
+       */
+   }
+   else if (type.floating && util_cpu_caps.has_sse) {
       if (type.width == 32) {
          if (type.length == 1) {
             intrinsic = "llvm.x86.sse.min.ss";
@@ -320,7 +327,14 @@ lp_build_max_simple(struct lp_build_context *bld,
 
    /* TODO: optimize the constant case */
 
-   if (type.floating && util_cpu_caps.has_sse) {
+   if (type.floating && util_cpu_caps.has_avx512f &&
+       type.width * type.length == 512) {
+      /*
+       * Use the compare/select below, which llvm turns into a single 512bit
+       * vmaxps/pd rather than splitting into two 256bit intrinsics.
+       */
+   }
+   else if (type.floating && util_cpu_caps.has_sse) {
       if (type.width == 32) {
          if (type.length == 1) {
             intrinsic = "llvm.x86.sse.max.ss";
@@ -1953,7 +1967,8 @@ arch_rounding_available(const struct lp_type type)
 {
    if ((util_cpu_caps.has_sse4_1 &&
        (type.length == 1 || type.width*type.length == 128)) ||
-       (util_cpu_caps.has_avx && type.width*type.length == 256))
+       (util_cpu_caps.has_avx && type.width*type.length == 256) ||
+       (util_cpu_caps.has_avx512f && type.width*type.length == 512))
       return TRUE;
    else if ((util_cpu_caps.has_altivec &&
             (type.width == 32 && type.length == 4)))
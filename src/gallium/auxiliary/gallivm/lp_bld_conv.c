@@ -491,6 +491,17 @@ int lp_build_conv_auto(struct gallivm_state *gallivm,
          lp_build_conv(gallivm, src_type, *dst_type, src, num_srcs, dst, num_dsts);
          return num_dsts;
       }
+
+      /* Special case 1x16x32 --> 1x16x8 */
+      if (src_type.length == 16 &&
+          util_cpu_caps.has_avx512f)
+      {
+         num_dsts = num_srcs;
+         dst_type->length = 16;
+
+         lp_build_conv(gallivm, src_type, *dst_type, src, num_srcs, dst, num_dsts);
+         return num_dsts;
+      }
    }
 
    /* lp_build_resize does not support M:N */
@@ -759,6 +770,75 @@ lp_build_conv(struct gallivm_state *gallivm,
       return;
    }
 
+   /* Special case 1x16x32 --> 1x16x8 (AVX-512)
+    */
+   else if (src_type.norm     == 0 &&
+       src_type.width    == 32 &&
+       src_type.length   == 16 &&
+       src_type.fixed    == 0 &&
+
+       dst_type.floating == 0 &&
+       dst_type.fixed    == 0 &&
+       dst_type.width    == 8 &&
+       dst_type.length   == 16 &&
+
+       ((src_type.floating == 1 && src_type.sign == 1 && dst_type.norm == 1) ||
+        (src_type.floating == 0 && dst_type.floating == 0 &&
+         src_type.sign == dst_type.sign && dst_type.norm == 0)) &&
+
+      num_dsts == num_srcs &&
+
+      util_cpu_caps.has_avx512f) {
+
+      struct lp_build_context bld;
+      struct lp_type int16_type, int32_type;
+      LLVMValueRef const_scale;
+      unsigned i, j;
+
+      lp_build_context_init(&bld, gallivm, src_type);
+
+      int16_type = int32_type = dst_type;
+
+      int16_type.width *= 2;
+      int16_type.length /= 2;
+      int16_type.sign = 1;
+
+      int32_type.width *= 4;
+      int32_type.length /= 4;
+      int32_type.sign = 1;
+
+      const_scale = lp_build_const_vec(gallivm, src_type, lp_const_scale(dst_type));
+
+      for (i = 0; i < num_dsts; ++i) {
+         LLVMValueRef a = src[i];
+         LLVMValueRef lo, hi;
+
+         /* do the arithmetic 16-wide, only the packing is split up */
+         if (src_type.floating) {
+            if (dst_type.sign) {
+               a = lp_build_min(&bld, bld.one, a);
+            }
+            a = LLVMBuildFMul(builder, a, const_scale, "");
+            a = lp_build_iround(&bld, a);
+         } else {
+            if (!dst_type.sign) {
+               LLVMValueRef const_max;
+               const_max = lp_build_const_int_vec(gallivm, src_type, 255);
+               a = lp_build_min(&bld, a, const_max);
+            }
+         }
+         for (j = 0; j < 4; j++) {
+            tmp[j] = lp_build_extract_range(gallivm, a, j * 4, 4);
+         }
+         /* relying on clamping behavior of sse2 intrinsics here */
+         lo = lp_build_pack2(gallivm, int32_type, int16_type, tmp[0], tmp[1]);
+         hi = lp_build_pack2(gallivm, int32_type, int16_type, tmp[2], tmp[3]);
+         dst[i] = lp_build_pack2(gallivm, int16_type, dst_type, lo, hi);
+      }
+
+      return;
+   }
+
    /* Special case -> 16bit half-float
     */
    else if (dst_type.floating && dst_type.width == 16)
@@ -275,6 +275,10 @@ lp_build_gather_elem_vec(struct gallivm_state *gallivm,
 
 
 
+/*
+ * Gathers with the AVX2 gather instructions, or the AVX-512 ones for
+ * 16 x 32bit.
+ */
 static LLVMValueRef
 lp_build_gather_avx2(struct gallivm_state *gallivm,
                      unsigned length,
@@ -343,7 +347,8 @@ lp_build_gather_avx2(struct gallivm_state *gallivm,
 
       assert(src_width == 32 || src_width == 64);
       if (src_width == 32) {
-         assert(length == 4 || length == 8);
+         assert(length == 4 || length == 8 ||
+                (length == 16 && util_cpu_caps.has_avx512f));
       } else {
          assert(length == 2 || length == 4);
       }
@@ -361,16 +366,26 @@ lp_build_gather_avx2(struct gallivm_state *gallivm,
            "llvm.x86.avx2.gather.d.pd.256"}},
       };
 
-      if ((src_width == 32 && length == 8) ||
-          (src_width == 64 && length == 4)) {
-         l_idx = 1;
-      }
-      intrinsic = intrinsics[dst_type.floating][src_width == 64][l_idx];
-
       LLVMValueRef passthru = LLVMGetUndef(src_vec_type);
-      LLVMValueRef mask = LLVMConstAllOnes(src_vec_type);
-      mask = LLVMConstBitCast(mask, src_vec_type);
-      LLVMValueRef scale = LLVMConstInt(i8_type, 1, 0);
+      LLVMValueRef mask, scale;
+
+      if (length == 16) {
+         /* The AVX-512 gathers take a bitmask and an i32 scale. */
+         intrinsic = dst_type.floating ? "llvm.x86.avx512.gather.dps.512" :
+                                         "llvm.x86.avx512.gather.dpi.512";
+         mask = LLVMConstAllOnes(LLVMInt16TypeInContext(gallivm->context));
+         scale = LLVMConstInt(LLVMInt32TypeInContext(gallivm->context), 1, 0);
+      } else {
+         if ((src_width == 32 && length == 8) ||
+             (src_width == 64 && length == 4)) {
+            l_idx = 1;
+         }
+         intrinsic = intrinsics[dst_type.floating][src_width == 64][l_idx];
+
+         mask = LLVMConstAllOnes(src_vec_type);
+         mask = LLVMConstBitCast(mask, src_vec_type);
+         scale = LLVMConstInt(i8_type, 1, 0);
+      }
 
       LLVMValueRef args[] = { passthru, base_ptr, offsets, mask, scale };
 
@@ -492,6 +507,10 @@ lp_build_gather(struct gallivm_state *gallivm,
               src_width == 32 && (length == 4 || length == 8)) {
       return lp_build_gather_avx2(gallivm, length, src_width, dst_type,
                                   base_ptr, offsets);
+   } else if (util_cpu_caps.has_avx512f && !need_expansion &&
+              src_width == 32 && length == 16) {
+      return lp_build_gather_avx2(gallivm, length, src_width, dst_type,
+                                  base_ptr, offsets);
    /*
     * This looks bad on paper wrt throughtput/latency on Haswell.
     * Even on Broadwell it doesn't look stellar.
@@ -36,6 +36,7 @@
 #include "lp_bld.h"
 #include "lp_bld_debug.h"
 #include "lp_bld_misc.h"
+#include "lp_bld_type.h"
 #include "lp_bld_init.h"
 
 #include <llvm-c/Analysis.h>
@@ -377,6 +378,21 @@ fail:
 }
 
 
+static void
+hide_avx512(void)
+{
+   util_cpu_caps.has_avx512f = 0;
+   util_cpu_caps.has_avx512dq = 0;
+   util_cpu_caps.has_avx512ifma = 0;
+   util_cpu_caps.has_avx512pf = 0;
+   util_cpu_caps.has_avx512er = 0;
+   util_cpu_caps.has_avx512cd = 0;
+   util_cpu_caps.has_avx512bw = 0;
+   util_cpu_caps.has_avx512vl = 0;
+   util_cpu_caps.has_avx512vbmi = 0;
+}
+
+
 boolean
 lp_build_init(void)
 {
@@ -420,6 +436,7 @@ lp_build_init(void)
       util_cpu_caps.has_avx2 = 0;
       util_cpu_caps.has_f16c = 0;
       util_cpu_caps.has_fma = 0;
+      hide_avx512();
    }
 #endif
 
@@ -440,9 +457,25 @@ lp_build_init(void)
       lp_native_vector_width = 128;
    }
  
+   /* 512bit vectors (AVX-512) must be asked for explicitly, as the wider
+    * vectors lower the clock on current cpus and it's not always a win.
+    */
    lp_native_vector_width = debug_get_num_option("LP_NATIVE_VECTOR_WIDTH",
                                                  lp_native_vector_width);
 
+   if (lp_native_vector_width > 256 &&
+       !util_cpu_caps.has_avx512f) {
+      lp_native_vector_width = 256;
+   }
+   lp_native_vector_width = MIN2(lp_native_vector_width, LP_MAX_VECTOR_WIDTH);
+
+   if (lp_native_vector_width <= 256) {
+      /* As below for AVX, make sure the avx512 paths aren't taken
+       * (and llvm doesn't generate 512bit code) when not asked for.
+       */
+      hide_avx512();
+   }
+
    if (lp_native_vector_width <= 128) {
       /* Hide AVX support, as often LLVM AVX intrinsics are only guarded by
        * "util_cpu_caps.has_avx" predicate, and lack the
@@ -461,6 +494,12 @@ lp_build_init(void)
        * MCJIT. */
       util_cpu_caps.has_avx2 = 0;
    }
+   if (HAVE_LLVM < 0x0400 && lp_native_vector_width > 256) {
+      /* Older llvm versions don't get the avx512 target features passed
+       * (see lp_build_create_jit_compiler_for_module), stay at 256 bits. */
+      lp_native_vector_width = 256;
+      hide_avx512();
+   }
 
 #ifdef PIPE_ARCH_PPC_64
    /* Set the NJ bit in VSCR to 0 so denormalized values are handled as
@@ -570,6 +570,32 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
         ++f) {
       MAttrs.push_back(((*f).second ? "+" : "-") + (*f).first().str());
    }
+
+#if defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64)
+   /*
+    * util_cpu_caps may have been restricted below what the host supports
+    * (LP_NATIVE_VECTOR_WIDTH, lp_test -isa), so make sure code generation
+    * honours that.  Later attributes override earlier ones.
+    */
+   if (!util_cpu_caps.has_sse3)
+      MAttrs.push_back("-sse3");
+   if (!util_cpu_caps.has_ssse3)
+      MAttrs.push_back("-ssse3");
+   if (!util_cpu_caps.has_sse4_1)
+      MAttrs.push_back("-sse4.1");
+   if (!util_cpu_caps.has_sse4_2)
+      MAttrs.push_back("-sse4.2");
+   if (!util_cpu_caps.has_avx)
+      MAttrs.push_back("-avx");
+   if (!util_cpu_caps.has_f16c)
+      MAttrs.push_back("-f16c");
+   if (!util_cpu_caps.has_fma)
+      MAttrs.push_back("-fma");
+   if (!util_cpu_caps.has_avx2)
+      MAttrs.push_back("-avx2");
+   if (!util_cpu_caps.has_avx512f)
+      MAttrs.push_back("-avx512f");
+#endif
 #else
    /*
     * We need to unset attributes because sometimes LLVM mistakenly assumes
@@ -511,6 +511,193 @@ lp_build_occlusion_count(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Position within the 4x4 block of element i of a 16-wide vector of
+ * four 2x2 quads (quad order 0,1 in the top half and 2,3 in the bottom
+ * half).  This simply swaps bits 1 and 2 of the index, so it is its own
+ * inverse and also maps linear positions back to vector elements.
+ * The first 8 entries match the 2x4 swizzle used for 8-wide vectors.
+ */
+static inline unsigned
+quad_4x4_index(unsigned i)
+{
+   return (i & 9) | ((i & 2) << 1) | ((i & 4) >> 1);
+}
+
+
+/**
+ * Load depth/stencil values for a full 4x4 block into a 16-wide vector.
+ * There is only one iteration per block, so no loop counter is needed.
+ */
+static void
+lp_build_depth_stencil_load_swizzled_4x4(struct gallivm_state *gallivm,
+                                         struct lp_type z_src_type,
+                                         const struct util_format_description *format_desc,
+                                         boolean is_1d,
+                                         LLVMValueRef depth_ptr,
+                                         LLVMValueRef depth_stride,
+                                         LLVMValueRef *z_fb,
+                                         LLVMValueRef *s_fb)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type zs_type = lp_depth_type(format_desc, z_src_type.length);
+   struct lp_type zs_row_type = zs_type;
+   LLVMTypeRef row_ptr_type;
+   LLVMValueRef rows[4], halves[2];
+   LLVMValueRef shuffles[LP_MAX_VECTOR_LENGTH / 4];
+   LLVMValueRef offset = lp_build_const_int32(gallivm, 0);
+   unsigned i;
+
+   assert(z_src_type.length == 16);
+
+   zs_row_type.length = 4;
+   row_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, zs_row_type), 0);
+
+   for (i = 0; i < 4; i++) {
+      if (i == 0 || !is_1d) {
+         LLVMValueRef ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+         ptr = LLVMBuildBitCast(builder, ptr, row_ptr_type, "");
+         rows[i] = LLVMBuildLoad(builder, ptr, "");
+      }
+      else {
+         rows[i] = lp_build_undef(gallivm, zs_row_type);
+      }
+      offset = LLVMBuildAdd(builder, offset, depth_stride, "");
+   }
+
+   halves[0] = lp_build_concat(gallivm, &rows[0], zs_row_type, 2);
+   halves[1] = lp_build_concat(gallivm, &rows[2], zs_row_type, 2);
+
+   for (i = 0; i < 16; i++) {
+      shuffles[i] = lp_build_const_int32(gallivm, quad_4x4_index(i));
+   }
+   *z_fb = LLVMBuildShuffleVector(builder, halves[0], halves[1],
+                                  LLVMConstVector(shuffles, 16), "");
+   *s_fb = *z_fb;
+
+   if (format_desc->block.bits < z_src_type.width) {
+      /* Extend destination ZS values (e.g., when reading from Z16_UNORM) */
+      *z_fb = LLVMBuildZExt(builder, *z_fb,
+                            lp_build_int_vec_type(gallivm, z_src_type), "");
+   }
+   else if (format_desc->block.bits > 32) {
+      /* split the 64 bit values into z and s */
+      struct lp_type typex2 = zs_type;
+      struct lp_type s_type = zs_type;
+      LLVMValueRef shuffles1[LP_MAX_VECTOR_LENGTH / 4];
+      LLVMValueRef shuffles2[LP_MAX_VECTOR_LENGTH / 4];
+      LLVMValueRef tmp;
+
+      typex2.width = typex2.width / 2;
+      typex2.length = typex2.length * 2;
+      s_type.width = s_type.width / 2;
+      s_type.floating = 0;
+
+      tmp = LLVMBuildBitCast(builder, *z_fb,
+                             lp_build_vec_type(gallivm, typex2), "");
+
+      for (i = 0; i < zs_type.length; i++) {
+         shuffles1[i] = lp_build_const_int32(gallivm, i * 2);
+         shuffles2[i] = lp_build_const_int32(gallivm, i * 2 + 1);
+      }
+      *z_fb = LLVMBuildShuffleVector(builder, tmp, tmp,
+                                     LLVMConstVector(shuffles1, zs_type.length), "");
+      *s_fb = LLVMBuildShuffleVector(builder, tmp, tmp,
+                                     LLVMConstVector(shuffles2, zs_type.length), "");
+      *s_fb = LLVMBuildBitCast(builder, *s_fb,
+                               lp_build_vec_type(gallivm, s_type), "");
+   }
+
+   lp_build_name(*z_fb, "z_dst");
+   lp_build_name(*s_fb, "s_dst");
+}
+
+
+/**
+ * Store depth/stencil values of a 16-wide vector to a full 4x4 block.
+ */
+static void
+lp_build_depth_stencil_write_swizzled_4x4(struct gallivm_state *gallivm,
+                                          struct lp_type z_src_type,
+                                          const struct util_format_description *format_desc,
+                                          boolean is_1d,
+                                          struct lp_build_mask_context *mask,
+                                          LLVMValueRef z_fb,
+                                          LLVMValueRef s_fb,
+                                          LLVMValueRef depth_ptr,
+                                          LLVMValueRef depth_stride,
+                                          LLVMValueRef z_value,
+                                          LLVMValueRef s_value)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context z_bld;
+   struct lp_type zs_type = lp_depth_type(format_desc, z_src_type.length);
+   struct lp_type z_type = zs_type;
+   struct lp_type zs_row_type = zs_type;
+   LLVMTypeRef row_ptr_type;
+   LLVMValueRef shuffles[LP_MAX_VECTOR_LENGTH / 2];
+   LLVMValueRef offset = lp_build_const_int32(gallivm, 0);
+   LLVMValueRef zs_linear;
+   unsigned num_rows = is_1d ? 1 : 4;
+   unsigned i;
+
+   assert(z_src_type.length == 16);
+
+   zs_row_type.length = 4;
+   row_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, zs_row_type), 0);
+
+   z_type.width = z_src_type.width;
+   lp_build_context_init(&z_bld, gallivm, z_type);
+
+   if (format_desc->block.bits > 32) {
+      s_value = LLVMBuildBitCast(builder, s_value, z_bld.vec_type, "");
+   }
+
+   if (mask) {
+      LLVMValueRef mask_value = lp_build_mask_value(mask);
+      z_value = lp_build_select(&z_bld, mask_value, z_value, z_fb);
+      if (format_desc->block.bits > 32) {
+         s_fb = LLVMBuildBitCast(builder, s_fb, z_bld.vec_type, "");
+         s_value = lp_build_select(&z_bld, mask_value, s_value, s_fb);
+      }
+   }
+
+   if (zs_type.width < z_src_type.width) {
+      /* Truncate ZS values (e.g., when writing to Z16_UNORM) */
+      z_value = LLVMBuildTrunc(builder, z_value,
+                               lp_build_int_vec_type(gallivm, zs_type), "");
+   }
+
+   /* Unswizzle the quads into 4 linear rows */
+   if (format_desc->block.bits <= 32) {
+      for (i = 0; i < 16; i++) {
+         shuffles[i] = lp_build_const_int32(gallivm, quad_4x4_index(i));
+      }
+      zs_linear = LLVMBuildShuffleVector(builder, z_value, z_value,
+                                         LLVMConstVector(shuffles, 16), "");
+   }
+   else {
+      /* interleave z and s into 64 bit values */
+      for (i = 0; i < 16; i++) {
+         shuffles[i*2] = lp_build_const_int32(gallivm, quad_4x4_index(i));
+         shuffles[i*2+1] = lp_build_const_int32(gallivm, quad_4x4_index(i) + 16);
+      }
+      zs_linear = LLVMBuildShuffleVector(builder, z_value, s_value,
+                                         LLVMConstVector(shuffles, 32), "");
+      zs_linear = LLVMBuildBitCast(builder, zs_linear,
+                                   lp_build_vec_type(gallivm, zs_type), "");
+   }
+
+   for (i = 0; i < num_rows; i++) {
+      LLVMValueRef ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+      LLVMValueRef row = lp_build_extract_range(gallivm, zs_linear, i * 4, 4);
+      ptr = LLVMBuildBitCast(builder, ptr, row_ptr_type, "");
+      LLVMBuildStore(builder, row, ptr);
+      offset = LLVMBuildAdd(builder, offset, depth_stride, "");
+   }
+}
+
+
 /**
  * Load depth/stencil values.
  * The stored values are linear, swizzle them.
@@ -545,6 +732,14 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
    struct lp_type zs_type = lp_depth_type(format_desc, z_src_type.length);
    struct lp_type zs_load_type = zs_type;
 
+   if (z_src_type.length == 16) {
+      lp_build_depth_stencil_load_swizzled_4x4(gallivm, z_src_type,
+                                               format_desc, is_1d,
+                                               depth_ptr, depth_stride,
+                                               z_fb, s_fb);
+      return;
+   }
+
    zs_load_type.length = zs_load_type.length / 2;
    load_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, zs_load_type), 0);
 
@@ -684,6 +879,15 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
    struct lp_type z_type = zs_type;
    struct lp_type zs_load_type = zs_type;
 
+   if (z_src_type.length == 16) {
+      lp_build_depth_stencil_write_swizzled_4x4(gallivm, z_src_type,
+                                                format_desc, is_1d, mask,
+                                                z_fb, s_fb,
+                                                depth_ptr, depth_stride,
+                                                z_value, s_value);
+      return;
+   }
+
    zs_load_type.length = zs_load_type.length / 2;
    load_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, zs_load_type), 0);
 
@@ -61,7 +61,12 @@
 #define LP_MAX_WIDTH  (1 << (LP_MAX_TEXTURE_LEVELS - 1))
 
 
-#define LP_MAX_THREADS 16
+/**
+ * Upper bound on the number of rasterizer threads.  Per-thread state is
+ * allocated at runtime from the actual thread count, so this is only a
+ * sanity limit for LP_NUM_THREADS.
+ */
+#define LP_MAX_THREADS 256
 
 
 /**
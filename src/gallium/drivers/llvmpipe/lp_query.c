@@ -53,6 +53,7 @@ llvmpipe_create_query(struct pipe_context *pipe,
                       unsigned type,
                       unsigned index)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct llvmpipe_query *pq;
 
    assert(type < PIPE_QUERY_TYPES);
@@ -61,6 +62,15 @@ llvmpipe_create_query(struct pipe_context *pipe,
 
    if (pq) {
       pq->type = type;
+      pq->num_threads = MAX2(1, screen->num_threads);
+      pq->start = CALLOC(pq->num_threads, sizeof *pq->start);
+      pq->end = CALLOC(pq->num_threads, sizeof *pq->end);
+      if (!pq->start || !pq->end) {
+         FREE(pq->start);
+         FREE(pq->end);
+         FREE(pq);
+         return NULL;
+      }
    }
 
    return (struct pipe_query *) pq;
@@ -85,6 +95,8 @@ llvmpipe_destroy_query(struct pipe_context *pipe, struct pipe_query *q)
       lp_fence_reference(&pq->fence, NULL);
    }
 
+   FREE(pq->start);
+   FREE(pq->end);
    FREE(pq);
 }
 
@@ -95,9 +107,8 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
                           boolean wait,
                           union pipe_query_result *vresult)
 {
-   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
-   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq = llvmpipe_query(q);
+   unsigned num_threads = pq->num_threads;
    uint64_t *result = (uint64_t *)vresult;
    int i;
 
@@ -201,8 +212,8 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
    }
 
 
-   memset(pq->start, 0, sizeof(pq->start));
-   memset(pq->end, 0, sizeof(pq->end));
+   memset(pq->start, 0, pq->num_threads * sizeof(*pq->start));
+   memset(pq->end, 0, pq->num_threads * sizeof(*pq->end));
    lp_setup_begin_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
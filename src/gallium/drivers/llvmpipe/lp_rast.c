@@ -26,12 +26,15 @@
  **************************************************************************/
 
 #include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_rect.h"
 #include "util/u_surface.h"
 #include "util/u_pack_color.h"
 #include "util/u_string.h"
+#include "util/u_cpu_detect.h"
 
 #include "os/os_time.h"
 
@@ -108,6 +111,9 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
    task->thread_data.vis_counter = 0;
    task->ps_invocations = 0;
 
+   /* nothing is known about the depth of a tile until it gets cleared */
+   task->hiz_active = FALSE;
+
    for (i = 0; i < task->scene->fb.nr_cbufs; i++) {
       if (task->scene->fb.cbufs[i]) {
          task->color_tiles[i] = scene->cbufs[i].map +
@@ -169,6 +175,55 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Reset the tile's hi-z buffer after a depth clear.
+ */
+static void
+hiz_clear(struct lp_rasterizer_task *task,
+          enum pipe_format format,
+          uint64_t clear_value,
+          uint64_t clear_mask)
+{
+   const struct util_format_description *desc = util_format_description(format);
+   const uint64_t zmask = util_pack64_mask_z(format, ~0);
+   union {
+      uint16_t u16;
+      uint32_t u32;
+      uint64_t u64;
+   } packed;
+   float depth = 0.0f;
+   unsigned i;
+
+   if ((clear_mask & zmask) != zmask) {
+      /* depth values untouched, hi-z stays valid (or invalid) */
+      return;
+   }
+
+   switch (desc->block.bits) {
+   case 16:
+      packed.u16 = (uint16_t) clear_value;
+      break;
+   case 32:
+      packed.u32 = (uint32_t) clear_value;
+      break;
+   default:
+      packed.u64 = clear_value;
+      break;
+   }
+   desc->unpack_z_float(&depth, 0, (const uint8_t *) &packed, 0, 1, 1);
+
+   for (i = 0; i < ARRAY_SIZE(task->hiz_zmax); i++)
+      task->hiz_zmax[i] = depth;
+
+   /*
+    * The bound only holds as long as the current state doesn't raise
+    * depth values; if it does, leave hi-z off until the next clear.
+    */
+   task->hiz_active = !(task->state && task->state->variant &&
+                        task->state->variant->hiz_invalidate);
+}
+
+
 /**
  * Clear the rasterizer's current z/stencil tile.
  * This is a bin command called during bin processing.
@@ -280,6 +335,11 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
          }
          dst_layer += scene->zsbuf.layer_stride;
       }
+
+      if (scene->hiz_enabled) {
+         hiz_clear(task, scene->fb.zsbuf->format,
+                   clear_value64, clear_mask64);
+      }
    }
 }
 
@@ -324,6 +384,11 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
          unsigned depth_stride = 0;
          unsigned i;
 
+         if (lp_rast_hiz_reject(task, inputs, tile_x + x, tile_y + y, 4)) {
+            LP_COUNT(nr_hiz_rejected_4);
+            continue;
+         }
+
          /* color buffer */
          for (i = 0; i < scene->fb.nr_cbufs; i++){
             if (scene->fb.cbufs[i]) {
@@ -364,6 +429,13 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
          END_JIT_CALL();
       }
    }
+
+   /* the whole tile is covered, so all hi-z blocks can be tightened */
+   for (y = 0; y < task->height; y += LP_HIZ_BLOCK_SIZE) {
+      for (x = 0; x < task->width; x += LP_HIZ_BLOCK_SIZE) {
+         lp_rast_hiz_update(task, inputs, tile_x + x, tile_y + y);
+      }
+   }
 }
 
 
@@ -419,6 +491,11 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
    assert((x % 4) == 0);
    assert((y % 4) == 0);
 
+   if (lp_rast_hiz_reject(task, inputs, x, y, 4)) {
+      LP_COUNT(nr_hiz_rejected_4);
+      return;
+   }
+
    /* color buffer */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
@@ -538,6 +615,10 @@ lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg)
 {
    task->state = arg.state;
+
+   if (task->state->variant && task->state->variant->hiz_invalidate) {
+      task->hiz_active = FALSE;
+   }
 }
 
 
@@ -795,6 +876,17 @@ thread_function(void *init_data)
    util_snprintf(thread_name, sizeof thread_name, "llvmpipe-%u", task->thread_index);
    u_thread_setname(thread_name);
 
+   if (task->num_cpus &&
+       !u_thread_set_affinity(task->cpus, task->num_cpus)) {
+      debug_printf("llvmpipe: failed to set affinity of thread %u\n",
+                   task->thread_index);
+   }
+
+   /* Touch the per-thread data from the (possibly pinned) thread itself so
+    * that a first-touch NUMA policy places it on this thread's node.
+    */
+   memset(task->thread_data.cache, 0, sizeof *task->thread_data.cache);
+
    /* Make sure that denorms are treated like zeros. This is 
     * the behavior required by D3D10. OpenGL doesn't care.
     */
@@ -855,6 +947,165 @@ thread_function(void *init_data)
 }
 
 
+/**
+ * Parse a Linux sysfs cpu list such as "0-7,16-23" into \p cpus.
+ * \return number of entries written
+ */
+static unsigned
+parse_cpu_list(const char *str, unsigned *cpus, unsigned max_cpus)
+{
+   unsigned n = 0;
+
+   while (*str && n < max_cpus) {
+      char *end;
+      unsigned first, last, cpu;
+
+      first = last = strtoul(str, &end, 10);
+      if (end == str)
+         break;
+      if (*end == '-') {
+         str = end + 1;
+         last = strtoul(str, &end, 10);
+         if (end == str)
+            break;
+      }
+      for (cpu = first; cpu <= last && n < max_cpus; cpu++)
+         cpus[n++] = cpu;
+
+      str = end;
+      if (*str != ',')
+         break;
+      str++;
+   }
+
+   return n;
+}
+
+
+static unsigned
+read_cpu_list(const char *path, unsigned *cpus, unsigned max_cpus)
+{
+   char buf[1024];
+   unsigned n = 0;
+   FILE *f;
+
+   f = fopen(path, "r");
+   if (!f)
+      return 0;
+   if (fgets(buf, sizeof buf, f))
+      n = parse_cpu_list(buf, cpus, max_cpus);
+   fclose(f);
+
+   return n;
+}
+
+
+/**
+ * Decide which CPUs each rasterizer thread may run on, according to the
+ * LP_THREAD_AFFINITY environment variable:
+ *
+ *   none  - let the OS scheduler place threads (default)
+ *   core  - pin each thread to a single logical CPU
+ *   node  - pin each thread to all CPUs of one NUMA node
+ *
+ * Threads are spread round-robin over the NUMA nodes, so that every node's
+ * memory bandwidth is used even when there are fewer threads than CPUs.
+ */
+static void
+assign_thread_cpus(struct lp_rasterizer *rast)
+{
+   const char *mode = debug_get_option("LP_THREAD_AFFINITY", "none");
+   unsigned nr_cpus = MAX2(1, util_cpu_caps.nr_cpus);
+   unsigned *node_ids, *node_cpus, *node_first, *node_count, *order;
+   unsigned num_nodes = 0, num_node_cpus = 0;
+   unsigned i, j, k;
+   boolean per_node;
+
+   if (!strcmp(mode, "core"))
+      per_node = FALSE;
+   else if (!strcmp(mode, "node"))
+      per_node = TRUE;
+   else
+      return;
+
+   node_ids = MALLOC(nr_cpus * sizeof *node_ids);
+   node_cpus = MALLOC(nr_cpus * sizeof *node_cpus);
+   node_first = MALLOC(nr_cpus * sizeof *node_first);
+   node_count = MALLOC(nr_cpus * sizeof *node_count);
+   order = MALLOC(nr_cpus * sizeof *order);
+   if (!node_ids || !node_cpus || !node_first || !node_count || !order)
+      goto out;
+
+#if defined(PIPE_OS_LINUX)
+   {
+      unsigned num_ids = read_cpu_list("/sys/devices/system/node/online",
+                                       node_ids, nr_cpus);
+      for (i = 0; i < num_ids && num_node_cpus < nr_cpus; i++) {
+         char path[64];
+         unsigned n;
+
+         util_snprintf(path, sizeof path,
+                       "/sys/devices/system/node/node%u/cpulist", node_ids[i]);
+         n = read_cpu_list(path, node_cpus + num_node_cpus,
+                           nr_cpus - num_node_cpus);
+         if (n) {
+            node_first[num_nodes] = num_node_cpus;
+            node_count[num_nodes] = n;
+            num_node_cpus += n;
+            num_nodes++;
+         }
+      }
+   }
+#endif
+
+   if (num_nodes == 0) {
+      /* No topology information: treat the machine as a single node. */
+      for (i = 0; i < nr_cpus; i++)
+         node_cpus[i] = i;
+      node_first[0] = 0;
+      node_count[0] = nr_cpus;
+      num_node_cpus = nr_cpus;
+      num_nodes = 1;
+   }
+
+   /* Interleave the CPUs of all nodes: node0[0], node1[0], node0[1], ... */
+   for (k = 0, j = 0; k < num_node_cpus; j++) {
+      for (i = 0; i < num_nodes; i++) {
+         if (j < node_count[i])
+            order[k++] = node_cpus[node_first[i] + j];
+      }
+   }
+
+   for (i = 0; i < rast->num_threads; i++) {
+      struct lp_rasterizer_task *task = &rast->tasks[i];
+
+      if (per_node) {
+         unsigned node = i % num_nodes;
+         task->cpus = MALLOC(node_count[node] * sizeof *task->cpus);
+         if (!task->cpus)
+            continue;
+         memcpy(task->cpus, node_cpus + node_first[node],
+                node_count[node] * sizeof *task->cpus);
+         task->num_cpus = node_count[node];
+      }
+      else {
+         task->cpus = MALLOC(sizeof *task->cpus);
+         if (!task->cpus)
+            continue;
+         task->cpus[0] = order[i % num_node_cpus];
+         task->num_cpus = 1;
+      }
+   }
+
+out:
+   FREE(node_ids);
+   FREE(node_cpus);
+   FREE(node_first);
+   FREE(node_count);
+   FREE(order);
+}
+
+
 /**
  * Initialize semaphores and spawn the threads.
  */
@@ -863,6 +1114,8 @@ create_rast_threads(struct lp_rasterizer *rast)
 {
    unsigned i;
 
+   assign_thread_cpus(rast);
+
    /* NOTE: if num_threads is zero, we won't use any threads */
    for (i = 0; i < rast->num_threads; i++) {
       pipe_semaphore_init(&rast->tasks[i].work_ready, 0);
@@ -895,6 +1148,12 @@ lp_rast_create( unsigned num_threads )
       goto no_full_scenes;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof *rast->tasks);
+   rast->threads = CALLOC(MAX2(1, num_threads), sizeof *rast->threads);
+   if (!rast->tasks || !rast->threads) {
+      goto no_tasks;
+   }
+
    for (i = 0; i < MAX2(1, num_threads); i++) {
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
@@ -922,12 +1181,14 @@ lp_rast_create( unsigned num_threads )
    return rast;
 
 no_thread_data_cache:
-   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
+   for (i = 0; i < MAX2(1, num_threads); i++) {
       if (rast->tasks[i].thread_data.cache) {
          align_free(rast->tasks[i].thread_data.cache);
       }
    }
-
+no_tasks:
+   FREE(rast->tasks);
+   FREE(rast->threads);
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
    FREE(rast);
@@ -969,6 +1230,7 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
    }
    for (i = 0; i < MAX2(1, rast->num_threads); i++) {
       align_free(rast->tasks[i].thread_data.cache);
+      FREE(rast->tasks[i].cpus);
    }
 
    /* for synchronizing rasterization threads */
@@ -978,6 +1240,8 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->tasks);
+   FREE(rast->threads);
    FREE(rast);
 }
 
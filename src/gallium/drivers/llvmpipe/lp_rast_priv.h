@@ -30,8 +30,10 @@
 
 #include "os/os_thread.h"
 #include "util/u_format.h"
+#include "util/u_math.h"
 #include "gallivm/lp_bld_debug.h"
 #include "lp_memory.h"
+#include "lp_perf.h"
 #include "lp_rast.h"
 #include "lp_scene.h"
 #include "lp_state.h"
@@ -42,6 +44,10 @@
 #define TILE_VECTOR_HEIGHT 4
 #define TILE_VECTOR_WIDTH 4
 
+/* Granularity of the per-tile coarse depth (hi-z) buffer */
+#define LP_HIZ_BLOCK_SIZE 16
+#define LP_HIZ_BLOCKS_X (TILE_SIZE / LP_HIZ_BLOCK_SIZE)
+
 /* If we crash in a jitted function, we can examine jit_line and jit_state
  * to get some info.  This is not thread-safe, however.
  */
@@ -97,6 +103,18 @@ struct lp_rasterizer_task
    /** "my" index */
    unsigned thread_index;
 
+   /** CPUs this thread is pinned to (see LP_THREAD_AFFINITY) */
+   unsigned *cpus;
+   unsigned num_cpus;
+
+   /**
+    * Conservative maximum depth of each 16x16 block of the current tile
+    * (first layer only).  Only meaningful while hiz_active is set, which
+    * happens when the tile's depth gets cleared.
+    */
+   float hiz_zmax[LP_HIZ_BLOCKS_X * LP_HIZ_BLOCKS_X];
+   boolean hiz_active;
+
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
    uint64_t ps_invocations;
@@ -123,11 +141,11 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
-   /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   /** A task object for each rasterization thread, MAX2(1, num_threads) */
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
 
    /** For synchronizing the rasterization threads */
    pipe_barrier barrier;
@@ -217,6 +235,92 @@ lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
 
 
 
+/**
+ * Get the hi-z entry covering the pixel at x, y (window coords).
+ */
+static inline float *
+lp_rast_get_hiz_block(struct lp_rasterizer_task *task,
+                      unsigned x, unsigned y)
+{
+   unsigned bx = (x % TILE_SIZE) / LP_HIZ_BLOCK_SIZE;
+   unsigned by = (y % TILE_SIZE) / LP_HIZ_BLOCK_SIZE;
+
+   return &task->hiz_zmax[by * LP_HIZ_BLOCKS_X + bx];
+}
+
+
+/**
+ * Compute conservative bounds of the triangle's interpolated depth over
+ * the size x size pixel block at x, y (window coords).
+ */
+static inline void
+lp_rast_get_depth_range(const struct lp_rast_shader_inputs *inputs,
+                        unsigned x, unsigned y, unsigned size,
+                        float *zmin, float *zmax)
+{
+   const float a0 = GET_A0(inputs)[0][2];
+   const float dzdx = GET_DADX(inputs)[0][2];
+   const float dzdy = GET_DADY(inputs)[0][2];
+   const float z = a0 + dzdx * (float)x + dzdy * (float)y;
+   const float ex = dzdx * (float)(size - 1);
+   const float ey = dzdy * (float)(size - 1);
+   /* the jit code evaluates the plane differently, allow for rounding */
+   const float eps = 8.0f * FLT_EPSILON *
+                     (fabsf(a0) + fabsf(dzdx * (float)x) +
+                      fabsf(dzdy * (float)y) + fabsf(ex) + fabsf(ey));
+
+   *zmin = z + MIN2(ex, 0.0f) + MIN2(ey, 0.0f) - eps;
+   *zmax = z + MAX2(ex, 0.0f) + MAX2(ey, 0.0f) + eps;
+}
+
+
+/**
+ * Whether all fragments of the triangle within the size x size block at
+ * x, y are known to fail the depth test, so shading them can be skipped.
+ */
+static inline boolean
+lp_rast_hiz_reject(struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   unsigned x, unsigned y, unsigned size)
+{
+   float zmin, zmax;
+
+   if (!task->hiz_active || !task->state->variant->hiz_test ||
+       inputs->layer)
+      return FALSE;
+
+   lp_rast_get_depth_range(inputs, x, y, size, &zmin, &zmax);
+
+   return zmin > *lp_rast_get_hiz_block(task, x, y) + task->scene->hiz_bias;
+}
+
+
+/**
+ * Lower the hi-z maximum of the 16x16 block at x, y after it was fully
+ * covered by the triangle.
+ */
+static inline void
+lp_rast_hiz_update(struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   unsigned x, unsigned y)
+{
+   float zmin, zmax;
+   float *block;
+
+   if (!task->hiz_active || !task->state->variant->hiz_write ||
+       inputs->layer)
+      return;
+
+   lp_rast_get_depth_range(inputs, x, y, LP_HIZ_BLOCK_SIZE, &zmin, &zmax);
+
+   /* negative depth may get clamped to zero when written */
+   zmax = MAX2(zmax, 0.0f) + task->scene->hiz_bias;
+
+   block = lp_rast_get_hiz_block(task, x, y);
+   *block = MIN2(*block, zmax);
+}
+
+
 /**
  * Shade all pixels in a 4x4 block.  The fragment code omits the
  * triangle in/out tests.
@@ -236,6 +340,11 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
    unsigned depth_stride = 0;
    unsigned i;
 
+   if (lp_rast_hiz_reject(task, inputs, x, y, 4)) {
+      LP_COUNT(nr_hiz_rejected_4);
+      return;
+   }
+
    /* color buffer */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
@@ -294,14 +294,20 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       int py = y + iy;
       int64_t cx[NR_PLANES];
 
+      partial_mask &= ~(1 << i);
+
+      LP_COUNT(nr_partially_covered_16);
+
+      if (lp_rast_hiz_reject(task, &tri->inputs, px, py, 16)) {
+         LP_COUNT(nr_hiz_rejected_16);
+         continue;
+      }
+
       for (j = 0; j < NR_PLANES; j++)
          cx[j] = (c[j]
                   - IMUL64(plane[j].dcdx, ix)
                   + IMUL64(plane[j].dcdy, iy));
 
-      partial_mask &= ~(1 << i);
-
-      LP_COUNT(nr_partially_covered_16);
       TAG(do_block_16)(task, tri, plane, px, py, cx);
    }
 
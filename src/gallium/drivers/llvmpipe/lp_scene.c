@@ -150,6 +150,7 @@ void
 lp_scene_begin_rasterization(struct lp_scene *scene)
 {
    const struct pipe_framebuffer_state *fb = &scene->fb;
+   const struct util_format_description *zs_desc;
    int i;
 
    //LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
@@ -197,6 +198,26 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
                                                zsbuf->u.tex.first_layer,
                                                LP_TEX_USAGE_READ_WRITE);
       scene->zsbuf.format_bytes = util_format_get_blocksize(zsbuf->format);
+
+      zs_desc = util_format_description(zsbuf->format);
+      scene->hiz_enabled = FALSE;
+      if (util_format_has_depth(zs_desc) && !(LP_PERF & PERF_NO_HIZ)) {
+         const struct util_format_channel_description *chan =
+            &zs_desc->channel[zs_desc->swizzle[0]];
+
+         /*
+          * Fragment depth gets converted to the buffer format before the
+          * test, so unorm formats need a full step of slack on top of the
+          * float rounding.
+          */
+         scene->hiz_bias = 2.0f * FLT_EPSILON;
+         if (chan->normalized)
+            scene->hiz_bias += (float)(1.0 / (double)((1ULL << chan->size) - 1));
+         scene->hiz_enabled = TRUE;
+      }
+   }
+   else {
+      scene->hiz_enabled = FALSE;
    }
 }
 
@@ -148,6 +148,11 @@ struct lp_scene {
    /* The amount of layers in the fb (minimum of all attachments) */
    unsigned fb_max_layer;
 
+   /* Coarse depth rejection (hi-z) is usable with the bound zsbuf */
+   boolean hiz_enabled;
+   /* Depth quantization slack of the zsbuf format for hi-z comparisons */
+   float hiz_bias;
+
    /** the framebuffer to render the scene into */
    struct pipe_framebuffer_state fb;
 
@@ -1819,7 +1819,9 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
    undef_src_val = lp_build_undef(gallivm, fs_type);
 
    row_type.length = fs_type.length;
-   vector_width    = dst_type.floating ? lp_native_vector_width : lp_integer_vector_width;
+   /* Rows are at most 256 bits, see generate_fragment() */
+   vector_width    = dst_type.floating ? MIN2(lp_native_vector_width, 256)
+                                       : lp_integer_vector_width;
 
    /* Compute correct swizzle and count channels */
    memset(swizzle, LP_BLD_SWIZZLE_DONTCARE, TGSI_NUM_CHANNELS);
@@ -2407,6 +2409,7 @@ generate_fragment(struct llvmpipe_context *lp,
    struct lp_shader_input inputs[PIPE_MAX_SHADER_INPUTS];
    char func_name[64];
    struct lp_type fs_type;
+   struct lp_type blend_fs_type;
    struct lp_type blend_type;
    LLVMTypeRef fs_elem_type;
    LLVMTypeRef blend_vec_type;
@@ -2435,6 +2438,7 @@ generate_fragment(struct llvmpipe_context *lp,
    LLVMValueRef function;
    LLVMValueRef facing;
    unsigned num_fs;
+   unsigned num_blend_fs;
    unsigned i;
    unsigned chan;
    unsigned cbuf;
@@ -2469,6 +2473,9 @@ generate_fragment(struct llvmpipe_context *lp,
    fs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
    fs_type.width = 32;           /* 32-bit float */
    fs_type.length = MIN2(lp_native_vector_width / 32, 16); /* n*4 elements per vector */
+   /* 1d resources only have the upper half (4x2) of the stamp */
+   if (key->resource_1d)
+      fs_type.length = MIN2(fs_type.length, 8);
 
    memset(&blend_type, 0, sizeof blend_type);
    blend_type.floating = FALSE; /* values are integers */
@@ -2602,6 +2609,8 @@ generate_fragment(struct llvmpipe_context *lp,
          LLVMBuildStore(builder, mask, mask_ptr);
       }
 
+      memset(color_store, 0, sizeof color_store);
+
       generate_fs_loop(gallivm,
                        shader, key,
                        builder,
@@ -2617,7 +2626,35 @@ generate_fragment(struct llvmpipe_context *lp,
                        facing,
                        thread_data_ptr);
 
-      for (i = 0; i < num_fs; i++) {
+      /*
+       * Blending works on at most 8 pixels at a time, so with 16-wide
+       * shading hand the results over as the two 4x2 halves of the stamp
+       * (quads 0-1 and 2-3), which is what the 8-wide loop produces.
+       */
+      blend_fs_type = fs_type;
+      blend_fs_type.length = MIN2(fs_type.length, 8);
+      num_blend_fs = num_fs * (fs_type.length / blend_fs_type.length);
+
+      {
+         LLVMTypeRef blend_vec_ptr_type =
+            LLVMPointerType(lp_build_vec_type(gallivm, blend_fs_type), 0);
+         LLVMTypeRef blend_mask_ptr_type =
+            LLVMPointerType(lp_build_int_vec_type(gallivm, blend_fs_type), 0);
+
+         mask_store = LLVMBuildBitCast(builder, mask_store,
+                                       blend_mask_ptr_type, "");
+         for (cbuf = 0; cbuf < PIPE_MAX_COLOR_BUFS; cbuf++) {
+            for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
+               if (color_store[cbuf][chan]) {
+                  color_store[cbuf][chan] =
+                     LLVMBuildBitCast(builder, color_store[cbuf][chan],
+                                      blend_vec_ptr_type, "");
+               }
+            }
+         }
+      }
+
+      for (i = 0; i < num_blend_fs; i++) {
          LLVMValueRef indexi = lp_build_const_int32(gallivm, i);
          LLVMValueRef ptr = LLVMBuildGEP(builder, mask_store,
                                          &indexi, 1, "");
@@ -2671,7 +2708,8 @@ generate_fragment(struct llvmpipe_context *lp,
 
          generate_unswizzled_blend(gallivm, cbuf, variant,
                                    key->cbuf_format[cbuf],
-                                   num_fs, fs_type, fs_mask, fs_out_color,
+                                   num_blend_fs, blend_fs_type,
+                                   fs_mask, fs_out_color,
                                    context_ptr, color_ptr, stride,
                                    partial_mask, do_branch);
       }
@@ -2784,6 +2822,8 @@ lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant)
    tgsi_dump(variant->shader->base.tokens, 0);
    dump_fs_variant_key(&variant->key);
    debug_printf("variant->opaque = %u\n", variant->opaque);
+   debug_printf("variant->hiz_test = %u\n", variant->hiz_test);
+   debug_printf("variant->hiz_write = %u\n", variant->hiz_write);
    debug_printf("\n");
 }
 
@@ -2850,6 +2890,44 @@ generate_variant(struct llvmpipe_context *lp,
       variant->ps_inv_multiplier = 1;
    }
 
+   /*
+    * Coarse depth rejection only tracks an upper bound of the stored depth,
+    * which only LESS/LEQUAL/EQUAL tests can reject against and which only
+    * those funcs are guaranteed not to raise when writing.  Skipping
+    * fragments is fine as long as a failing depth test has no side effects
+    * (no stencil writes) and the tested depth is the interpolated one.
+    */
+   if (key->depth.enabled &&
+       (key->depth.func == PIPE_FUNC_LESS ||
+        key->depth.func == PIPE_FUNC_LEQUAL ||
+        key->depth.func == PIPE_FUNC_EQUAL)) {
+      boolean stencil_writes =
+         (key->stencil[0].enabled && key->stencil[0].writemask) ||
+         (key->stencil[1].enabled && key->stencil[1].writemask);
+
+      variant->hiz_test = !shader->info.base.writes_z &&
+                          !key->depth_clamp &&
+                          !stencil_writes;
+
+      /*
+       * Every pixel of a fully covered block gets written (or already was
+       * closer) only if nothing else can discard fragments.
+       */
+      variant->hiz_write = variant->hiz_test &&
+                           key->depth.writemask &&
+                           key->depth.func != PIPE_FUNC_EQUAL &&
+                           !key->stencil[0].enabled &&
+                           !key->alpha.enabled &&
+                           !key->blend.alpha_to_coverage &&
+                           !shader->info.base.uses_kill &&
+                           !shader->info.base.writes_samplemask;
+   }
+   else {
+      variant->hiz_invalidate = key->depth.enabled &&
+                                key->depth.writemask &&
+                                key->depth.func != PIPE_FUNC_NEVER;
+   }
+
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       lp_debug_fs_variant(variant);
    }
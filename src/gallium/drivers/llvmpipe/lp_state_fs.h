@@ -100,6 +100,11 @@ struct lp_fragment_shader_variant
    boolean opaque;
    uint8_t ps_inv_multiplier;
 
+   /* How the rasterizer's coarse depth buffer interacts with this variant */
+   boolean hiz_test;        /**< blocks failing the hi-z test may be skipped */
+   boolean hiz_write;       /**< covered blocks end up below the tri's zmax */
+   boolean hiz_invalidate;  /**< depth writes may increase stored depth */
+
    struct gallivm_state *gallivm;
 
    LLVMTypeRef jit_context_ptr_type;
@@ -362,6 +362,68 @@ dump_vec(FILE *fp, struct lp_type type, const void *src)
 }
 
 
+/**
+ * Hide CPU features above the given ISA level, so that the code paths for
+ * older CPUs can be measured and tested on newer ones.
+ */
+static boolean
+restrict_isa(const char *isa)
+{
+   if (!isa)
+      return FALSE;
+
+   if (strcmp(isa, "sse2") == 0) {
+      if (!util_cpu_caps.has_sse2)
+         return FALSE;
+      util_cpu_caps.has_sse3 = 0;
+      util_cpu_caps.has_ssse3 = 0;
+      util_cpu_caps.has_sse4_1 = 0;
+      util_cpu_caps.has_sse4_2 = 0;
+      util_cpu_caps.has_avx = 0;
+      util_cpu_caps.has_avx2 = 0;
+      util_cpu_caps.has_f16c = 0;
+      util_cpu_caps.has_fma = 0;
+   }
+   else if (strcmp(isa, "sse4.1") == 0) {
+      if (!util_cpu_caps.has_sse4_1)
+         return FALSE;
+      util_cpu_caps.has_avx = 0;
+      util_cpu_caps.has_avx2 = 0;
+      util_cpu_caps.has_f16c = 0;
+      util_cpu_caps.has_fma = 0;
+   }
+   else if (strcmp(isa, "avx") == 0) {
+      if (!util_cpu_caps.has_avx)
+         return FALSE;
+      util_cpu_caps.has_avx2 = 0;
+      util_cpu_caps.has_fma = 0;
+   }
+   else if (strcmp(isa, "avx2") == 0) {
+      if (!util_cpu_caps.has_avx2)
+         return FALSE;
+   }
+   else if (strcmp(isa, "avx512") == 0) {
+      /* 512bit vectors also need LP_NATIVE_VECTOR_WIDTH=512 */
+      return util_cpu_caps.has_avx512f;
+   }
+   else {
+      return FALSE;
+   }
+
+   util_cpu_caps.has_avx512f = 0;
+   util_cpu_caps.has_avx512dq = 0;
+   util_cpu_caps.has_avx512ifma = 0;
+   util_cpu_caps.has_avx512pf = 0;
+   util_cpu_caps.has_avx512er = 0;
+   util_cpu_caps.has_avx512cd = 0;
+   util_cpu_caps.has_avx512bw = 0;
+   util_cpu_caps.has_avx512vl = 0;
+   util_cpu_caps.has_avx512vbmi = 0;
+
+   return TRUE;
+}
+
+
 int main(int argc, char **argv)
 {
    unsigned verbose = 0;
@@ -376,9 +438,6 @@ int main(int argc, char **argv)
    fpstate = util_fpstate_get();
    util_fpstate_set_denorms_to_zero(fpstate);
 
-   if (!lp_build_init())
-      return 1;
-
    for(i = 1; i < argc; ++i) {
       if(strcmp(argv[i], "-v") == 0)
          ++verbose;
@@ -386,10 +445,20 @@ int main(int argc, char **argv)
          single = TRUE;
       else if(strcmp(argv[i], "-o") == 0)
          fp = fopen(argv[++i], "wt");
+      else if(strcmp(argv[i], "-isa") == 0) {
+         if (!restrict_isa(argv[++i])) {
+            fprintf(stderr, "ISA %s is not supported on this CPU\n", argv[i]);
+            return 1;
+         }
+      }
       else
          n = atoi(argv[i]);
    }
 
+   /* Must come after -isa, as it picks the native vector width. */
+   if (!lp_build_init())
+      return 1;
+
 #ifdef DEBUG
    if (verbose >= 2) {
       gallivm_debug |= GALLIVM_DEBUG_IR;
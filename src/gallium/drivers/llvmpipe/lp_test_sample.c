@@ -0,0 +1,720 @@
+/**************************************************************************
+ *
+ * Copyright 2017 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Unit tests and benchmark for texture sampling LLVM IR generation.
+ *
+ * JIT-compiles a loop which samples a 2D mipmapped texture through
+ * lp_build_sample_soa() (which in turn uses the AoS path for suitable
+ * formats) for a matrix of formats, filters and vector widths.  The
+ * coordinates hit texel centers with a 1:1 pixel/texel mapping, so every
+ * filter must return the level 0 texel, which is checked against
+ * util_format.
+ *
+ * With "-o file" a TSV with the cycles spent per pixel is written.  Use
+ * "-isa sse4.1|avx|avx2|avx512" (see lp_test_main.c) to measure the
+ * different code paths on the same machine; 512bit vectors additionally
+ * need LP_NATIVE_VECTOR_WIDTH=512.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/u_memory.h"
+#include "util/u_cpu_detect.h"
+
+#include "gallivm/lp_bld.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_struct.h"
+#include "gallivm/lp_bld_sample.h"
+#include "lp_jit.h"
+#include "lp_test.h"
+
+
+#define TEX_SIZE 256
+#define TEX_LEVELS 9         /* 256x256 down to 1x1 */
+#define NUM_PIXELS 4096
+
+
+/**
+ * State passed to the generated function.  Reuses llvmpipe's texture and
+ * sampler layout so the generated code matches what the rasterizer runs.
+ */
+struct sample_test_context
+{
+   struct lp_jit_texture texture;
+   struct lp_jit_sampler sampler;
+};
+
+
+enum {
+   SAMPLE_TEST_CTX_TEXTURE,
+   SAMPLE_TEST_CTX_SAMPLER,
+   SAMPLE_TEST_CTX_COUNT
+};
+
+
+typedef void (*sample_test_ptr_t)(const struct sample_test_context *ctx,
+                                  const float *s, const float *t,
+                                  float *texels, int32_t num_vecs);
+
+
+struct sample_test_filter
+{
+   const char *name;
+   unsigned img_filter;
+   unsigned mip_filter;
+};
+
+
+static const struct sample_test_filter
+sample_test_filters[] = {
+   { "nearest",        PIPE_TEX_FILTER_NEAREST, PIPE_TEX_MIPFILTER_NONE },
+   { "linear",         PIPE_TEX_FILTER_LINEAR,  PIPE_TEX_MIPFILTER_NONE },
+   { "linear_mip_nearest", PIPE_TEX_FILTER_LINEAR, PIPE_TEX_MIPFILTER_NEAREST },
+   { "trilinear",      PIPE_TEX_FILTER_LINEAR,  PIPE_TEX_MIPFILTER_LINEAR },
+};
+
+
+static const enum pipe_format
+sample_test_formats[] = {
+   PIPE_FORMAT_B8G8R8A8_UNORM,
+   PIPE_FORMAT_R8G8B8A8_UNORM,
+   PIPE_FORMAT_B5G6R5_UNORM,
+   PIPE_FORMAT_R8_UNORM,
+   PIPE_FORMAT_R16G16B16A16_FLOAT,
+   PIPE_FORMAT_R32_FLOAT,
+   PIPE_FORMAT_R32G32B32A32_FLOAT,
+};
+
+
+static const char *
+isa_name(void)
+{
+   if (util_cpu_caps.has_avx512f)
+      return "avx512";
+   if (util_cpu_caps.has_avx2)
+      return "avx2";
+   if (util_cpu_caps.has_avx)
+      return "avx";
+   if (util_cpu_caps.has_sse4_1)
+      return "sse4.1";
+   if (util_cpu_caps.has_sse2)
+      return "sse2";
+   return "generic";
+}
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "cycles_per_pixel\t"
+           "isa\t"
+           "type\t"
+           "format\t"
+           "filter\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp,
+              struct lp_type type,
+              const struct util_format_description *desc,
+              const struct sample_test_filter *filter,
+              double cycles,
+              boolean success)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+
+   fprintf(fp, "%.1f\t", cycles);
+
+   fprintf(fp, "%s\t", isa_name());
+
+   dump_type(fp, type);
+   fprintf(fp, "\t");
+
+   fprintf(fp, "%s\t%s\n", desc->short_name, filter->name);
+
+   fflush(fp);
+}
+
+
+static void
+dump_test(struct lp_type type,
+          const struct util_format_description *desc,
+          const struct sample_test_filter *filter)
+{
+   printf("  type=");
+   dump_type(stdout, type);
+   printf(" format=%s filter=%s ...\n", desc->short_name, filter->name);
+   fflush(stdout);
+}
+
+
+/*
+ * Dynamic state callbacks: load the texture and sampler parameters from
+ * struct sample_test_context at runtime, like lp_tex_sample.c does for
+ * lp_jit_context.
+ */
+
+static LLVMValueRef
+sample_test_member(struct gallivm_state *gallivm,
+                   LLVMValueRef context_ptr,
+                   unsigned ctx_member,
+                   unsigned member_index,
+                   boolean emit_load)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef indices[3];
+   LLVMValueRef ptr;
+
+   indices[0] = lp_build_const_int32(gallivm, 0);
+   indices[1] = lp_build_const_int32(gallivm, ctx_member);
+   indices[2] = lp_build_const_int32(gallivm, member_index);
+
+   ptr = LLVMBuildGEP(builder, context_ptr, indices, ARRAY_SIZE(indices), "");
+
+   return emit_load ? LLVMBuildLoad(builder, ptr, "") : ptr;
+}
+
+
+#define SAMPLE_TEST_MEMBER(_name, _ctx_member, _index, _emit_load) \
+   static LLVMValueRef \
+   sample_test_##_name(const struct lp_sampler_dynamic_state *state, \
+                       struct gallivm_state *gallivm, \
+                       LLVMValueRef context_ptr, \
+                       unsigned unit) \
+   { \
+      assert(unit == 0); \
+      return sample_test_member(gallivm, context_ptr, _ctx_member, \
+                                _index, _emit_load); \
+   }
+
+
+SAMPLE_TEST_MEMBER(width,       SAMPLE_TEST_CTX_TEXTURE, LP_JIT_TEXTURE_WIDTH, TRUE)
+SAMPLE_TEST_MEMBER(height,      SAMPLE_TEST_CTX_TEXTURE, LP_JIT_TEXTURE_HEIGHT, TRUE)
+SAMPLE_TEST_MEMBER(depth,       SAMPLE_TEST_CTX_TEXTURE, LP_JIT_TEXTURE_DEPTH, TRUE)
+SAMPLE_TEST_MEMBER(first_level, SAMPLE_TEST_CTX_TEXTURE, LP_JIT_TEXTURE_FIRST_LEVEL, TRUE)
+SAMPLE_TEST_MEMBER(last_level,  SAMPLE_TEST_CTX_TEXTURE, LP_JIT_TEXTURE_LAST_LEVEL, TRUE)
+SAMPLE_TEST_MEMBER(base_ptr,    SAMPLE_TEST_CTX_TEXTURE, LP_JIT_TEXTURE_BASE, TRUE)
+SAMPLE_TEST_MEMBER(row_stride,  SAMPLE_TEST_CTX_TEXTURE, LP_JIT_TEXTURE_ROW_STRIDE, FALSE)
+SAMPLE_TEST_MEMBER(img_stride,  SAMPLE_TEST_CTX_TEXTURE, LP_JIT_TEXTURE_IMG_STRIDE, FALSE)
+SAMPLE_TEST_MEMBER(mip_offsets, SAMPLE_TEST_CTX_TEXTURE, LP_JIT_TEXTURE_MIP_OFFSETS, FALSE)
+SAMPLE_TEST_MEMBER(min_lod,     SAMPLE_TEST_CTX_SAMPLER, LP_JIT_SAMPLER_MIN_LOD, TRUE)
+SAMPLE_TEST_MEMBER(max_lod,     SAMPLE_TEST_CTX_SAMPLER, LP_JIT_SAMPLER_MAX_LOD, TRUE)
+SAMPLE_TEST_MEMBER(lod_bias,    SAMPLE_TEST_CTX_SAMPLER, LP_JIT_SAMPLER_LOD_BIAS, TRUE)
+SAMPLE_TEST_MEMBER(border_color, SAMPLE_TEST_CTX_SAMPLER, LP_JIT_SAMPLER_BORDER_COLOR, FALSE)
+
+
+static void
+init_dynamic_state(struct lp_sampler_dynamic_state *state)
+{
+   memset(state, 0, sizeof *state);
+   state->width = sample_test_width;
+   state->height = sample_test_height;
+   state->depth = sample_test_depth;
+   state->first_level = sample_test_first_level;
+   state->last_level = sample_test_last_level;
+   state->base_ptr = sample_test_base_ptr;
+   state->row_stride = sample_test_row_stride;
+   state->img_stride = sample_test_img_stride;
+   state->mip_offsets = sample_test_mip_offsets;
+   state->min_lod = sample_test_min_lod;
+   state->max_lod = sample_test_max_lod;
+   state->lod_bias = sample_test_lod_bias;
+   state->border_color = sample_test_border_color;
+}
+
+
+static LLVMTypeRef
+create_context_type(struct gallivm_state *gallivm)
+{
+   LLVMContextRef lc = gallivm->context;
+   LLVMTypeRef texture_type, sampler_type, context_type;
+   LLVMTypeRef elem_types[LP_JIT_TEXTURE_NUM_FIELDS];
+   LLVMTypeRef ctx_types[SAMPLE_TEST_CTX_COUNT];
+
+   elem_types[LP_JIT_TEXTURE_WIDTH]  =
+   elem_types[LP_JIT_TEXTURE_HEIGHT] =
+   elem_types[LP_JIT_TEXTURE_DEPTH] =
+   elem_types[LP_JIT_TEXTURE_FIRST_LEVEL] =
+   elem_types[LP_JIT_TEXTURE_LAST_LEVEL] = LLVMInt32TypeInContext(lc);
+   elem_types[LP_JIT_TEXTURE_BASE] = LLVMPointerType(LLVMInt8TypeInContext(lc), 0);
+   elem_types[LP_JIT_TEXTURE_ROW_STRIDE] =
+   elem_types[LP_JIT_TEXTURE_IMG_STRIDE] =
+   elem_types[LP_JIT_TEXTURE_MIP_OFFSETS] =
+      LLVMArrayType(LLVMInt32TypeInContext(lc), LP_MAX_TEXTURE_LEVELS);
+   texture_type = LLVMStructTypeInContext(lc, elem_types,
+                                          LP_JIT_TEXTURE_NUM_FIELDS, 0);
+   LP_CHECK_STRUCT_SIZE(struct lp_jit_texture,
+                        gallivm->target, texture_type);
+
+   elem_types[LP_JIT_SAMPLER_MIN_LOD] =
+   elem_types[LP_JIT_SAMPLER_MAX_LOD] =
+   elem_types[LP_JIT_SAMPLER_LOD_BIAS] = LLVMFloatTypeInContext(lc);
+   elem_types[LP_JIT_SAMPLER_BORDER_COLOR] =
+      LLVMArrayType(LLVMFloatTypeInContext(lc), 4);
+   sampler_type = LLVMStructTypeInContext(lc, elem_types,
+                                          LP_JIT_SAMPLER_NUM_FIELDS, 0);
+   LP_CHECK_STRUCT_SIZE(struct lp_jit_sampler,
+                        gallivm->target, sampler_type);
+
+   ctx_types[SAMPLE_TEST_CTX_TEXTURE] = texture_type;
+   ctx_types[SAMPLE_TEST_CTX_SAMPLER] = sampler_type;
+   context_type = LLVMStructTypeInContext(lc, ctx_types,
+                                          ARRAY_SIZE(ctx_types), 0);
+   LP_CHECK_MEMBER_OFFSET(struct sample_test_context, sampler,
+                          gallivm->target, context_type,
+                          SAMPLE_TEST_CTX_SAMPLER);
+   LP_CHECK_STRUCT_SIZE(struct sample_test_context,
+                        gallivm->target, context_type);
+
+   return context_type;
+}
+
+
+static LLVMValueRef
+add_sample_test(struct gallivm_state *gallivm,
+                struct lp_type type,
+                const struct lp_static_texture_state *texture_state,
+                const struct lp_static_sampler_state *sampler_state,
+                struct lp_sampler_dynamic_state *dynamic_state)
+{
+   LLVMContextRef context = gallivm->context;
+   LLVMModuleRef module = gallivm->module;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef vec_type = lp_build_vec_type(gallivm, type);
+   LLVMTypeRef args[5];
+   LLVMValueRef func, context_ptr, s_ptr, t_ptr, texels_ptr, num_vecs;
+   LLVMBasicBlockRef block;
+   struct lp_build_context bld;
+   struct lp_build_loop_state loop;
+
+   args[0] = LLVMPointerType(create_context_type(gallivm), 0);
+   args[1] = args[2] = args[3] = LLVMPointerType(vec_type, 0);
+   args[4] = LLVMInt32TypeInContext(context);
+
+   func = LLVMAddFunction(module, "test",
+                          LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                           args, ARRAY_SIZE(args), 0));
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+   context_ptr = LLVMGetParam(func, 0);
+   s_ptr = LLVMGetParam(func, 1);
+   t_ptr = LLVMGetParam(func, 2);
+   texels_ptr = LLVMGetParam(func, 3);
+   num_vecs = LLVMGetParam(func, 4);
+
+   block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   lp_build_context_init(&bld, gallivm, type);
+
+   lp_build_loop_begin(&loop, gallivm, lp_build_const_int32(gallivm, 0));
+   {
+      struct lp_sampler_params params;
+      LLVMValueRef coords[5];
+      LLVMValueRef offsets[3] = { NULL };
+      LLVMValueRef texel[4];
+      LLVMValueRef index;
+      unsigned chan;
+
+      coords[0] = LLVMBuildLoad(builder,
+                                LLVMBuildGEP(builder, s_ptr, &loop.counter, 1, ""),
+                                "s");
+      coords[1] = LLVMBuildLoad(builder,
+                                LLVMBuildGEP(builder, t_ptr, &loop.counter, 1, ""),
+                                "t");
+      coords[2] = coords[3] = coords[4] = bld.undef;
+
+      memset(&params, 0, sizeof params);
+      params.type = type;
+      params.texture_index = 0;
+      params.sampler_index = 0;
+      params.sample_key =
+         (LP_SAMPLER_OP_TEXTURE << LP_SAMPLER_OP_TYPE_SHIFT) |
+         (LP_SAMPLER_LOD_IMPLICIT << LP_SAMPLER_LOD_CONTROL_SHIFT) |
+         (LP_SAMPLER_LOD_PER_QUAD << LP_SAMPLER_LOD_PROPERTY_SHIFT);
+      params.context_ptr = context_ptr;
+      params.coords = coords;
+      params.offsets = offsets;
+      params.texel = texel;
+
+      lp_build_sample_soa(texture_state, sampler_state, dynamic_state,
+                          gallivm, &params);
+
+      index = LLVMBuildMul(builder, loop.counter,
+                           lp_build_const_int32(gallivm, 4), "");
+      for (chan = 0; chan < 4; ++chan) {
+         LLVMValueRef chan_index =
+            LLVMBuildAdd(builder, index,
+                         lp_build_const_int32(gallivm, chan), "");
+         LLVMBuildStore(builder, texel[chan],
+                        LLVMBuildGEP(builder, texels_ptr, &chan_index, 1, ""));
+      }
+   }
+   lp_build_loop_end_cond(&loop, num_vecs, NULL, LLVMIntUGE);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+/**
+ * Create a TEX_SIZE x TEX_SIZE mipmapped texture with random contents.
+ */
+static uint8_t *
+create_texture(const struct util_format_description *desc,
+               struct lp_jit_texture *texture)
+{
+   unsigned block_bytes = desc->block.bits / 8;
+   unsigned total = 0;
+   unsigned level;
+   float *rgba;
+   uint8_t *data;
+
+   memset(texture, 0, sizeof *texture);
+   texture->width = TEX_SIZE;
+   texture->height = TEX_SIZE;
+   texture->depth = 1;
+   texture->first_level = 0;
+   texture->last_level = TEX_LEVELS - 1;
+
+   for (level = 0; level < TEX_LEVELS; ++level) {
+      unsigned size = u_minify(TEX_SIZE, level);
+      texture->mip_offsets[level] = total;
+      texture->row_stride[level] = align(size * block_bytes, 16);
+      texture->img_stride[level] = texture->row_stride[level] * size;
+      total += align(texture->img_stride[level], 64);
+   }
+
+   data = align_malloc(total, 64);
+   rgba = MALLOC(TEX_SIZE * 4 * sizeof *rgba);
+
+   for (level = 0; level < TEX_LEVELS; ++level) {
+      unsigned size = u_minify(TEX_SIZE, level);
+      unsigned x, y;
+
+      for (y = 0; y < size; ++y) {
+         for (x = 0; x < size * 4; ++x)
+            rgba[x] = random_float();
+         desc->pack_rgba_float(data + texture->mip_offsets[level] +
+                               y * texture->row_stride[level], 0,
+                               rgba, 0, size, 1);
+      }
+   }
+
+   FREE(rgba);
+
+   texture->base = data;
+
+   return data;
+}
+
+
+/**
+ * Lay out the pixels as 2x2 quads (matching the fragment shader) covering
+ * a band of the texture, with each pixel hitting a texel center.
+ */
+static void
+init_coords(float *s, float *t)
+{
+   const unsigned quads_per_row = TEX_SIZE / 2;
+   unsigned i;
+
+   for (i = 0; i < NUM_PIXELS; ++i) {
+      unsigned quad = i / 4;
+      unsigned x = (quad % quads_per_row) * 2 + (i & 1);
+      unsigned y = ((quad / quads_per_row) * 2 + ((i >> 1) & 1)) % TEX_SIZE;
+
+      s[i] = (x + 0.5f) / TEX_SIZE;
+      t[i] = (y + 0.5f) / TEX_SIZE;
+   }
+}
+
+
+PIPE_ALIGN_STACK
+static boolean
+test_one(unsigned verbose,
+         FILE *fp,
+         struct lp_type type,
+         enum pipe_format format,
+         const struct sample_test_filter *filter)
+{
+   const struct util_format_description *desc = util_format_description(format);
+   const unsigned num_vecs = NUM_PIXELS / type.length;
+   LLVMContextRef context;
+   struct gallivm_state *gallivm;
+   struct pipe_resource resource;
+   struct pipe_sampler_view view;
+   struct pipe_sampler_state sampler;
+   struct lp_static_texture_state texture_state;
+   struct lp_static_sampler_state sampler_state;
+   struct lp_sampler_dynamic_state dynamic_state;
+   struct sample_test_context *ctx;
+   sample_test_ptr_t sample_test_ptr;
+   LLVMValueRef func;
+   uint8_t *data;
+   float *s, *t, *texels;
+   int64_t cycles[LP_TEST_NUM_SAMPLES];
+   double cycles_avg = 0.0;
+   boolean success = TRUE;
+   unsigned i, j, chan;
+
+   if (verbose >= 1)
+      dump_test(type, desc, filter);
+
+   /* Static state, derived from gallium state like llvmpipe does */
+   memset(&resource, 0, sizeof resource);
+   resource.target = PIPE_TEXTURE_2D;
+   resource.format = format;
+   resource.width0 = TEX_SIZE;
+   resource.height0 = TEX_SIZE;
+   resource.depth0 = 1;
+   resource.array_size = 1;
+   resource.last_level = TEX_LEVELS - 1;
+
+   memset(&view, 0, sizeof view);
+   view.format = format;
+   view.target = PIPE_TEXTURE_2D;
+   view.texture = &resource;
+   view.swizzle_r = PIPE_SWIZZLE_X;
+   view.swizzle_g = PIPE_SWIZZLE_Y;
+   view.swizzle_b = PIPE_SWIZZLE_Z;
+   view.swizzle_a = PIPE_SWIZZLE_W;
+   view.u.tex.first_level = 0;
+   view.u.tex.last_level =
+      filter->mip_filter == PIPE_TEX_MIPFILTER_NONE ? 0 : TEX_LEVELS - 1;
+
+   memset(&sampler, 0, sizeof sampler);
+   sampler.wrap_s = PIPE_TEX_WRAP_REPEAT;
+   sampler.wrap_t = PIPE_TEX_WRAP_REPEAT;
+   sampler.wrap_r = PIPE_TEX_WRAP_REPEAT;
+   sampler.min_img_filter = filter->img_filter;
+   sampler.mag_img_filter = filter->img_filter;
+   sampler.min_mip_filter = filter->mip_filter;
+   sampler.normalized_coords = 1;
+   sampler.min_lod = 0.0f;
+   sampler.max_lod = (float)view.u.tex.last_level;
+
+   lp_sampler_static_texture_state(&texture_state, &view);
+   lp_sampler_static_sampler_state(&sampler_state, &sampler);
+   init_dynamic_state(&dynamic_state);
+
+   context = LLVMContextCreate();
+   gallivm = gallivm_create("test_module", context);
+
+   func = add_sample_test(gallivm, type, &texture_state, &sampler_state,
+                          &dynamic_state);
+
+   gallivm_compile_module(gallivm);
+
+   sample_test_ptr = (sample_test_ptr_t)gallivm_jit_function(gallivm, func);
+
+   gallivm_free_ir(gallivm);
+
+   /* Runtime state */
+   ctx = align_malloc(sizeof *ctx, 16);
+   memset(ctx, 0, sizeof *ctx);
+   data = create_texture(desc, &ctx->texture);
+   ctx->texture.last_level = view.u.tex.last_level;
+   ctx->sampler.min_lod = sampler.min_lod;
+   ctx->sampler.max_lod = sampler.max_lod;
+   ctx->sampler.lod_bias = 0.0f;
+
+   s = align_malloc(NUM_PIXELS * sizeof *s, 64);
+   t = align_malloc(NUM_PIXELS * sizeof *t, 64);
+   texels = align_malloc(NUM_PIXELS * 4 * sizeof *texels, 64);
+   init_coords(s, t);
+
+   for (i = 0; i < LP_TEST_NUM_SAMPLES; ++i) {
+      int64_t start_counter = rdtsc();
+      sample_test_ptr(ctx, s, t, texels, num_vecs);
+      cycles[i] = rdtsc() - start_counter;
+   }
+
+   /* Every pixel hits a level 0 texel center, whatever the filter. */
+   for (i = 0; i < num_vecs && success; ++i) {
+      for (j = 0; j < type.length; ++j) {
+         unsigned pixel = i * type.length + j;
+         unsigned x = (unsigned)(s[pixel] * TEX_SIZE);
+         unsigned y = (unsigned)(t[pixel] * TEX_SIZE);
+         const uint8_t *src = data + y * ctx->texture.row_stride[0] +
+                              x * (desc->block.bits / 8);
+         float ref[4];
+
+         desc->fetch_rgba_float(ref, src, 0, 0);
+
+         for (chan = 0; chan < 4; ++chan) {
+            float res = texels[(i * 4 + chan) * type.length + j];
+            if (fabs(res - ref[chan]) > 1.0 / 128) {
+               success = FALSE;
+               if (verbose < 1)
+                  dump_test(type, desc, filter);
+               printf("    pixel (%u, %u) chan %u: res %f ref %f\n",
+                      x, y, chan, res, ref[chan]);
+               break;
+            }
+         }
+         if (!success)
+            break;
+      }
+   }
+
+   /*
+    * Unfortunately the output of cycle counter is not very reliable as it comes
+    * -- sometimes we get outliers (due IRQs perhaps?) which are
+    * better removed to avoid random or biased data.
+    */
+   {
+      double sum = 0.0, sum2 = 0.0;
+      double avg, std;
+      unsigned m, n = LP_TEST_NUM_SAMPLES;
+
+      for (i = 0; i < n; ++i) {
+         sum += cycles[i];
+         sum2 += cycles[i]*cycles[i];
+      }
+
+      avg = sum/n;
+      std = sqrtf((sum2 - n*avg*avg)/n);
+
+      m = 0;
+      sum = 0.0;
+      for (i = 0; i < n; ++i) {
+         if (fabs(cycles[i] - avg) <= 4.0*std) {
+            sum += cycles[i];
+            ++m;
+         }
+      }
+
+      cycles_avg = sum/m/NUM_PIXELS;
+   }
+
+   if (verbose >= 1)
+      printf("    %.1f cycles/pixel\n", cycles_avg);
+
+   if (fp)
+      write_tsv_row(fp, type, desc, filter, cycles_avg, success);
+
+   align_free(texels);
+   align_free(t);
+   align_free(s);
+   align_free(data);
+   align_free(ctx);
+
+   gallivm_destroy(gallivm);
+   LLVMContextDispose(context);
+
+   return success;
+}
+
+
+/**
+ * Float SoA types the fragment shader may be compiled for: 4-wide up to the
+ * native vector width.
+ */
+static unsigned
+get_test_types(struct lp_type *types)
+{
+   unsigned n = 0;
+   unsigned width;
+
+   for (width = 128; width <= lp_native_vector_width; width *= 2)
+      types[n++] = lp_type_float_vec(32, width);
+
+   return n;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   struct lp_type types[3];
+   unsigned num_types = get_test_types(types);
+   unsigned i, j, k;
+   boolean success = TRUE;
+
+   for (i = 0; i < num_types; ++i) {
+      for (j = 0; j < ARRAY_SIZE(sample_test_formats); ++j) {
+         for (k = 0; k < ARRAY_SIZE(sample_test_filters); ++k) {
+            if (!test_one(verbose, fp, types[i], sample_test_formats[j],
+                          &sample_test_filters[k]))
+               success = FALSE;
+         }
+      }
+   }
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   struct lp_type types[3];
+   unsigned num_types = get_test_types(types);
+   unsigned long i;
+   boolean success = TRUE;
+
+   for (i = 0; i < n; ++i) {
+      struct lp_type type = types[rand() % num_types];
+      enum pipe_format format =
+         sample_test_formats[rand() % ARRAY_SIZE(sample_test_formats)];
+      const struct sample_test_filter *filter =
+         &sample_test_filters[rand() % ARRAY_SIZE(sample_test_filters)];
+
+      if (!test_one(verbose, fp, type, format, filter))
+         success = FALSE;
+   }
+
+   return success;
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   struct lp_type types[3];
+   unsigned num_types = get_test_types(types);
+
+   return test_one(verbose, fp, types[num_types - 1],
+                   PIPE_FORMAT_B8G8R8A8_UNORM, &sample_test_filters[3]);
+}
@@ -0,0 +1,317 @@
+/**************************************************************************
+ *
+ * Copyright © 2010 Jakob Bornecrantz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Rasterizer thread scaling benchmark.
+ *
+ * Renders the same batch of overlapping triangles into a large offscreen
+ * target with LP_NUM_THREADS set to 1, 2, ... up to the requested maximum
+ * and prints frame time and speedup for each thread count.  Intended for
+ * llvmpipe, but works with any software driver picked by the pipe loader.
+ *
+ * Usage: tri-scaling [max_threads [frames]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WIDTH 2048
+#define HEIGHT 2048
+#define NUM_TRIS 4096
+
+/* pipe_*_state structs */
+#include "pipe/p_state.h"
+/* pipe_context */
+#include "pipe/p_context.h"
+/* pipe_screen */
+#include "pipe/p_screen.h"
+/* PIPE_* */
+#include "pipe/p_defines.h"
+/* TGSI_SEMANTIC_{POSITION|GENERIC} */
+#include "pipe/p_shader_tokens.h"
+/* pipe_buffer_* helpers */
+#include "util/u_inlines.h"
+
+/* constant state object helper */
+#include "cso_cache/cso_context.h"
+
+/* util_draw_vertex_buffer helper */
+#include "util/u_draw_quad.h"
+/* FREE & CALLOC_STRUCT */
+#include "util/u_memory.h"
+/* util_snprintf */
+#include "util/u_string.h"
+/* util_make_[fragment|vertex]_passthrough_shader */
+#include "util/u_simple_shaders.h"
+/* util_cpu_caps */
+#include "util/u_cpu_detect.h"
+/* os_time_get_nano */
+#include "os/os_time.h"
+/* to get a hardware pipe driver */
+#include "pipe-loader/pipe_loader.h"
+
+struct program
+{
+	struct pipe_loader_device *dev;
+	struct pipe_screen *screen;
+	struct pipe_context *pipe;
+	struct cso_context *cso;
+
+	struct pipe_blend_state blend;
+	struct pipe_depth_stencil_alpha_state depthstencil;
+	struct pipe_rasterizer_state rasterizer;
+	struct pipe_viewport_state viewport;
+	struct pipe_framebuffer_state framebuffer;
+	struct pipe_vertex_element velem[2];
+
+	void *vs;
+	void *fs;
+
+	union pipe_color_union clear_color;
+
+	struct pipe_resource *vbuf;
+	struct pipe_resource *target;
+};
+
+static void init_prog(struct program *p)
+{
+	struct pipe_surface surf_tmpl;
+	int ret;
+
+	ret = pipe_loader_probe(&p->dev, 1);
+	assert(ret);
+
+	p->screen = pipe_loader_create_screen(p->dev);
+	assert(p->screen);
+
+	p->pipe = p->screen->context_create(p->screen, NULL, 0);
+	p->cso = cso_create_context(p->pipe, 0);
+
+	p->clear_color.f[0] = 0.0;
+	p->clear_color.f[1] = 0.0;
+	p->clear_color.f[2] = 0.0;
+	p->clear_color.f[3] = 1.0;
+
+	/* vertex buffer: many medium sized, overlapping triangles */
+	{
+		float (*vertices)[2][4] = MALLOC(NUM_TRIS * 3 * sizeof(*vertices));
+		unsigned i, j;
+
+		srand(1);
+		for (i = 0; i < NUM_TRIS * 3; i += 3) {
+			float cx = (rand() / (float)RAND_MAX) * 1.6f - 0.8f;
+			float cy = (rand() / (float)RAND_MAX) * 1.6f - 0.8f;
+			for (j = 0; j < 3; j++) {
+				vertices[i + j][0][0] = cx + (rand() / (float)RAND_MAX) * 0.4f - 0.2f;
+				vertices[i + j][0][1] = cy + (rand() / (float)RAND_MAX) * 0.4f - 0.2f;
+				vertices[i + j][0][2] = 0.0f;
+				vertices[i + j][0][3] = 1.0f;
+				vertices[i + j][1][0] = rand() / (float)RAND_MAX;
+				vertices[i + j][1][1] = rand() / (float)RAND_MAX;
+				vertices[i + j][1][2] = rand() / (float)RAND_MAX;
+				vertices[i + j][1][3] = 1.0f;
+			}
+		}
+
+		p->vbuf = pipe_buffer_create(p->screen, PIPE_BIND_VERTEX_BUFFER,
+					     PIPE_USAGE_DEFAULT,
+					     NUM_TRIS * 3 * sizeof(*vertices));
+		pipe_buffer_write(p->pipe, p->vbuf, 0,
+				  NUM_TRIS * 3 * sizeof(*vertices), vertices);
+		FREE(vertices);
+	}
+
+	/* render target texture */
+	{
+		struct pipe_resource tmplt;
+		memset(&tmplt, 0, sizeof(tmplt));
+		tmplt.target = PIPE_TEXTURE_2D;
+		tmplt.format = PIPE_FORMAT_B8G8R8A8_UNORM; /* All drivers support this */
+		tmplt.width0 = WIDTH;
+		tmplt.height0 = HEIGHT;
+		tmplt.depth0 = 1;
+		tmplt.array_size = 1;
+		tmplt.last_level = 0;
+		tmplt.bind = PIPE_BIND_RENDER_TARGET;
+
+		p->target = p->screen->resource_create(p->screen, &tmplt);
+	}
+
+	/* additive blending so every fragment does some work */
+	memset(&p->blend, 0, sizeof(p->blend));
+	p->blend.rt[0].blend_enable = 1;
+	p->blend.rt[0].rgb_func = PIPE_BLEND_ADD;
+	p->blend.rt[0].rgb_src_factor = PIPE_BLENDFACTOR_ONE;
+	p->blend.rt[0].rgb_dst_factor = PIPE_BLENDFACTOR_ONE;
+	p->blend.rt[0].alpha_func = PIPE_BLEND_ADD;
+	p->blend.rt[0].alpha_src_factor = PIPE_BLENDFACTOR_ONE;
+	p->blend.rt[0].alpha_dst_factor = PIPE_BLENDFACTOR_ONE;
+	p->blend.rt[0].colormask = PIPE_MASK_RGBA;
+
+	memset(&p->depthstencil, 0, sizeof(p->depthstencil));
+
+	memset(&p->rasterizer, 0, sizeof(p->rasterizer));
+	p->rasterizer.cull_face = PIPE_FACE_NONE;
+	p->rasterizer.half_pixel_center = 1;
+	p->rasterizer.bottom_edge_rule = 1;
+	p->rasterizer.depth_clip = 1;
+
+	surf_tmpl.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+	surf_tmpl.u.tex.level = 0;
+	surf_tmpl.u.tex.first_layer = 0;
+	surf_tmpl.u.tex.last_layer = 0;
+	memset(&p->framebuffer, 0, sizeof(p->framebuffer));
+	p->framebuffer.width = WIDTH;
+	p->framebuffer.height = HEIGHT;
+	p->framebuffer.nr_cbufs = 1;
+	p->framebuffer.cbufs[0] = p->pipe->create_surface(p->pipe, p->target, &surf_tmpl);
+
+	p->viewport.scale[0] = WIDTH / 2.0f;
+	p->viewport.scale[1] = HEIGHT / 2.0f;
+	p->viewport.scale[2] = 1.0f;
+	p->viewport.translate[0] = WIDTH / 2.0f;
+	p->viewport.translate[1] = HEIGHT / 2.0f;
+	p->viewport.translate[2] = 0.0f;
+
+	memset(p->velem, 0, sizeof(p->velem));
+	p->velem[0].src_offset = 0 * 4 * sizeof(float);
+	p->velem[0].vertex_buffer_index = 0;
+	p->velem[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+	p->velem[1].src_offset = 1 * 4 * sizeof(float);
+	p->velem[1].vertex_buffer_index = 0;
+	p->velem[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+
+	{
+		const uint semantic_names[] = { TGSI_SEMANTIC_POSITION,
+						TGSI_SEMANTIC_COLOR };
+		const uint semantic_indexes[] = { 0, 0 };
+		p->vs = util_make_vertex_passthrough_shader(p->pipe, 2, semantic_names, semantic_indexes, FALSE);
+	}
+
+	p->fs = util_make_fragment_passthrough_shader(p->pipe,
+		    TGSI_SEMANTIC_COLOR, TGSI_INTERPOLATE_PERSPECTIVE, TRUE);
+}
+
+static void close_prog(struct program *p)
+{
+	cso_destroy_context(p->cso);
+
+	p->pipe->delete_vs_state(p->pipe, p->vs);
+	p->pipe->delete_fs_state(p->pipe, p->fs);
+
+	pipe_surface_reference(&p->framebuffer.cbufs[0], NULL);
+	pipe_resource_reference(&p->target, NULL);
+	pipe_resource_reference(&p->vbuf, NULL);
+
+	p->pipe->destroy(p->pipe);
+	p->screen->destroy(p->screen);
+	pipe_loader_release(&p->dev, 1);
+
+	FREE(p);
+}
+
+static void draw(struct program *p)
+{
+	struct pipe_fence_handle *fence = NULL;
+
+	cso_set_framebuffer(p->cso, &p->framebuffer);
+
+	p->pipe->clear(p->pipe, PIPE_CLEAR_COLOR, &p->clear_color, 0, 0);
+
+	cso_set_blend(p->cso, &p->blend);
+	cso_set_depth_stencil_alpha(p->cso, &p->depthstencil);
+	cso_set_rasterizer(p->cso, &p->rasterizer);
+	cso_set_viewport(p->cso, &p->viewport);
+
+	cso_set_fragment_shader_handle(p->cso, p->fs);
+	cso_set_vertex_shader_handle(p->cso, p->vs);
+
+	cso_set_vertex_elements(p->cso, 2, p->velem);
+
+	util_draw_vertex_buffer(p->pipe, p->cso,
+	                        p->vbuf, 0, 0,
+	                        PIPE_PRIM_TRIANGLES,
+	                        NUM_TRIS * 3, /* verts */
+	                        2);           /* attribs/vert */
+
+	p->pipe->flush(p->pipe, &fence, 0);
+	p->screen->fence_finish(p->screen, NULL, fence, PIPE_TIMEOUT_INFINITE);
+	p->screen->fence_reference(p->screen, &fence, NULL);
+}
+
+static double run(unsigned num_threads, unsigned frames)
+{
+	struct program *p = CALLOC_STRUCT(program);
+	char value[16];
+	int64_t start, end;
+	unsigned i;
+
+	util_snprintf(value, sizeof(value), "%u", num_threads);
+	setenv("LP_NUM_THREADS", value, 1);
+
+	init_prog(p);
+
+	/* warm up: compile shaders and fault in the render target */
+	draw(p);
+
+	start = os_time_get_nano();
+	for (i = 0; i < frames; i++)
+		draw(p);
+	end = os_time_get_nano();
+
+	close_prog(p);
+
+	return (end - start) / 1e6 / frames;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned max_threads, frames, n, next;
+	double base = 0.0;
+
+	util_cpu_detect();
+
+	max_threads = argc > 1 ? atoi(argv[1]) : util_cpu_caps.nr_cpus;
+	frames = argc > 2 ? atoi(argv[2]) : 10;
+	max_threads = MAX2(1, max_threads);
+	frames = MAX2(1, frames);
+
+	printf("threads  ms/frame  speedup\n");
+	for (n = 1; n <= max_threads; n = next) {
+		double ms = run(n, frames);
+
+		if (n == 1)
+			base = ms;
+		printf("%7u  %8.2f  %7.2f\n", n, ms, base / ms);
+
+		/* 1, 2, 3, 4, 8, 16, ... and always the top thread count */
+		next = n < 4 ? n + 1 : n * 2;
+		if (n < max_threads && next > max_threads)
+			next = max_threads;
+	}
+
+	return 0;
+}
@@ -22,6 +22,7 @@
  */
 
 #include "brw_compiler.h"
+#include "brw_nir.h"
 #include "brw_shader.h"
 #include "brw_eu.h"
 #include "common/gen_debug.h"
@@ -60,6 +61,7 @@ static const struct nir_shader_compiler_options scalar_nir_options = {
    .lower_subgroup_masks = true,
    .max_subgroup_size = 32,
    .max_unroll_iterations = 32,
+   .loop_unroll_factor = brw_nir_loop_unroll_factor,
 };
 
 static const struct nir_shader_compiler_options vector_nir_options = {
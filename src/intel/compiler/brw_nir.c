@@ -513,6 +513,55 @@ brw_nir_lower_cs_shared(nir_shader *nir)
    nir_lower_io(nir, nir_var_shared, type_size_scalar_bytes, 0);
 }
 
+/* Loop bodies that get unrolled partially are kept within this many
+ * instructions.
+ */
+#define PARTIAL_UNROLL_LIMIT 64
+
+/* Compute shaders run at SIMD16 or SIMD32 where they can, where each value
+ * takes two or four registers, and tend to keep many values live through
+ * their loops, so completely unrolling a loop larger than this in them often
+ * means spilling.
+ */
+#define CS_LOOP_UNROLL_LIMIT 1024
+
+/* Cost model for loop unrolling in the scalar backend.  Compute shader loops
+ * that would unroll into too much code, and loops that are too large to
+ * unroll completely but have a small body, are unrolled partially instead,
+ * which still saves most of the branching and gives the scheduler more to
+ * work with.
+ */
+unsigned
+brw_nir_loop_unroll_factor(const nir_shader *nir, const nir_loop *loop)
+{
+   nir_loop_info *li = loop->info;
+
+   /* The loop has been cut down to size already.  Its trip count may be
+    * known again, but unrolling it completely would undo that.
+    */
+   if (loop->partially_unrolled)
+      return 0;
+
+   unsigned factor = nir_loop_unroll_default_factor(nir, loop);
+
+   if (!li->is_trip_count_known || li->force_unroll ||
+       list_length(&li->loop_terminator_list) != 1)
+      return factor;
+
+   if (factor != 0 && (nir->info.stage != MESA_SHADER_COMPUTE ||
+                       li->num_instructions * li->trip_count <=
+                       CS_LOOP_UNROLL_LIMIT))
+      return factor;
+
+   for (factor = 4; factor >= 2; factor /= 2) {
+      if (factor < li->trip_count &&
+          li->num_instructions * factor <= PARTIAL_UNROLL_LIMIT)
+         return factor;
+   }
+
+   return 0;
+}
+
 #define OPT(pass, ...) ({                                  \
    bool this_progress = false;                             \
    NIR_PASS(this_progress, nir, pass, ##__VA_ARGS__);      \
@@ -562,7 +611,7 @@ brw_nir_optimize(nir_shader *nir, const struct brw_compiler *compiler,
 
       OPT(nir_copy_prop);
       OPT(nir_opt_dce);
-      OPT(nir_opt_cse);
+      OPT(nir_opt_gvn);
       OPT(nir_opt_peephole_select, 0);
       OPT(nir_opt_intrinsics);
       OPT(nir_opt_algebraic);
@@ -157,6 +157,9 @@ nir_shader *brw_nir_optimize(nir_shader *nir,
                              const struct brw_compiler *compiler,
                              bool is_scalar);
 
+unsigned brw_nir_loop_unroll_factor(const nir_shader *nir,
+                                    const nir_loop *loop);
+
 #define BRW_NIR_FRAG_OUTPUT_INDEX_SHIFT 0
 #define BRW_NIR_FRAG_OUTPUT_INDEX_MASK INTEL_MASK(0, 0)
 #define BRW_NIR_FRAG_OUTPUT_LOCATION_SHIFT 1
@@ -5010,6 +5010,12 @@ struct gl_context
 
    struct disk_cache *Cache;
 
+   /**
+    * Preprocessor states saved after prefixes that the GLSL sources of this
+    * context share, see glcpp_preprocess().
+    */
+   struct glcpp_prefix_cache *PreprocessorCache;
+
    /**
     * \name GL_ARB_bindless_texture
     */
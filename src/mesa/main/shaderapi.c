@@ -163,6 +163,9 @@ _mesa_free_shader_state(struct gl_context *ctx)
    _mesa_reference_pipeline_object(ctx, &ctx->_Shader, NULL);
 
    assert(ctx->Shader.RefCount == 1);
+
+   ralloc_free(ctx->PreprocessorCache);
+   ctx->PreprocessorCache = NULL;
 }
 
 
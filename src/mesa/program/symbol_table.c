@@ -29,6 +29,9 @@ struct symbol {
    /** Symbol name. */
    char *name;
 
+   /** _mesa_hash_string() of the name. */
+   uint32_t hash;
+
     /**
      * Link to the next symbol in the table with the same name
      *
@@ -94,8 +97,9 @@ _mesa_symbol_table_pop_scope(struct _mesa_symbol_table *table)
 
     while (sym != NULL) {
         struct symbol *const next = sym->next_with_same_scope;
-        struct hash_entry *hte = _mesa_hash_table_search(table->ht,
-                                                         sym->name);
+        struct hash_entry *hte =
+           _mesa_hash_table_search_pre_hashed(table->ht, sym->hash,
+                                              sym->name);
         if (sym->next_with_same_name) {
            /* If there is a symbol with this name in an outer scope update
             * the hash table to point to it.
@@ -129,13 +133,22 @@ _mesa_symbol_table_push_scope(struct _mesa_symbol_table *table)
 
 
 static struct symbol *
-find_symbol(struct _mesa_symbol_table *table, const char *name)
+find_symbol_pre_hashed(struct _mesa_symbol_table *table, uint32_t hash,
+                       const char *name)
 {
-   struct hash_entry *entry = _mesa_hash_table_search(table->ht, name);
+   struct hash_entry *entry =
+      _mesa_hash_table_search_pre_hashed(table->ht, hash, name);
    return entry ? (struct symbol *) entry->data : NULL;
 }
 
 
+static struct symbol *
+find_symbol(struct _mesa_symbol_table *table, const char *name)
+{
+   return find_symbol_pre_hashed(table, _mesa_hash_string(name), name);
+}
+
+
 /**
  * Determine the scope "distance" of a symbol from the current scope
  *
@@ -176,7 +189,8 @@ _mesa_symbol_table_add_symbol(struct _mesa_symbol_table *table,
                               const char *name, void *declaration)
 {
    struct symbol *new_sym;
-   struct symbol *sym = find_symbol(table, name);
+   const uint32_t hash = _mesa_hash_string(name);
+   struct symbol *sym = find_symbol_pre_hashed(table, hash, name);
 
    if (sym && sym->depth == table->depth)
       return -1;
@@ -191,8 +205,10 @@ _mesa_symbol_table_add_symbol(struct _mesa_symbol_table *table,
       /* Store link to symbol in outer scope with the same name */
       new_sym->next_with_same_name = sym;
       new_sym->name = sym->name;
+      new_sym->hash = sym->hash;
    } else {
       new_sym->name = strdup(name);
+      new_sym->hash = hash;
       if (new_sym->name == NULL) {
          free(new_sym);
          _mesa_error_no_memory(__func__);
@@ -206,7 +222,7 @@ _mesa_symbol_table_add_symbol(struct _mesa_symbol_table *table,
 
    table->current_scope->symbols = new_sym;
 
-   _mesa_hash_table_insert(table->ht, new_sym->name, new_sym);
+   _mesa_hash_table_insert_pre_hashed(table->ht, hash, new_sym->name, new_sym);
 
    return 0;
 }
@@ -232,7 +248,8 @@ _mesa_symbol_table_add_global_symbol(struct _mesa_symbol_table *table,
 {
    struct scope_level *top_scope;
    struct symbol *inner_sym = NULL;
-   struct symbol *sym = find_symbol(table, name);
+   const uint32_t hash = _mesa_hash_string(name);
+   struct symbol *sym = find_symbol_pre_hashed(table, hash, name);
 
    while (sym) {
       if (sym->depth == 0)
@@ -263,8 +280,10 @@ _mesa_symbol_table_add_global_symbol(struct _mesa_symbol_table *table,
       inner_sym->next_with_same_name = sym;
 
       sym->name = inner_sym->name;
+      sym->hash = inner_sym->hash;
    } else {
       sym->name = strdup(name);
+      sym->hash = hash;
       if (sym->name == NULL) {
          free(sym);
          _mesa_error_no_memory(__func__);
@@ -277,7 +296,7 @@ _mesa_symbol_table_add_global_symbol(struct _mesa_symbol_table *table,
 
    top_scope->symbols = sym;
 
-   _mesa_hash_table_insert(table->ht, sym->name, sym);
+   _mesa_hash_table_insert_pre_hashed(table->ht, hash, sym->name, sym);
 
    return 0;
 }
@@ -38,6 +38,7 @@
 
 #include "st_context.h"
 #include "st_program.h"
+#include "st_shader_cache.h"
 
 #include "compiler/nir/nir.h"
 #include "compiler/glsl_types.h"
@@ -287,6 +288,8 @@ st_glsl_to_nir(struct st_context *st, struct gl_program *prog,
 
    prog->nir = nir;
 
+   st_store_nir_in_disk_cache(st, prog, nir);
+
    return nir;
 }
 
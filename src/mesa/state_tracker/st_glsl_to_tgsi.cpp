@@ -6822,6 +6822,132 @@ has_unsupported_control_flow(exec_list *ir,
    return visitor.unsupported;
 }
 
+/**
+ * Lowers and optimizes the GLSL IR of a linked shader for the driver.
+ *
+ * This is called through link_foreach_stage(), which may run it on several
+ * stages at once.
+ */
+static void
+st_lower_linked_shader(struct gl_context *ctx, struct gl_linked_shader *shader,
+                       void *data)
+{
+   struct pipe_screen *pscreen = ctx->st->pipe->screen;
+   exec_list *ir = shader->ir;
+   gl_shader_stage stage = shader->Stage;
+   const struct gl_shader_compiler_options *options =
+         &ctx->Const.ShaderCompilerOptions[stage];
+   enum pipe_shader_type ptarget = pipe_shader_type_from_mesa(stage);
+   bool have_dround = pscreen->get_shader_param(pscreen, ptarget,
+                                                PIPE_SHADER_CAP_TGSI_DROUND_SUPPORTED);
+   bool have_dfrexp = pscreen->get_shader_param(pscreen, ptarget,
+                                                PIPE_SHADER_CAP_TGSI_DFRACEXP_DLDEXP_SUPPORTED);
+   bool have_ldexp = pscreen->get_shader_param(pscreen, ptarget,
+                                               PIPE_SHADER_CAP_TGSI_LDEXP_SUPPORTED);
+   unsigned if_threshold = pscreen->get_shader_param(pscreen, ptarget,
+                                                     PIPE_SHADER_CAP_LOWER_IF_THRESHOLD);
+
+   /* If there are forms of indirect addressing that the driver
+    * cannot handle, perform the lowering pass.
+    */
+   if (options->EmitNoIndirectInput || options->EmitNoIndirectOutput ||
+       options->EmitNoIndirectTemp || options->EmitNoIndirectUniform) {
+      lower_variable_index_to_cond_assign(stage, ir,
+                                          options->EmitNoIndirectInput,
+                                          options->EmitNoIndirectOutput,
+                                          options->EmitNoIndirectTemp,
+                                          options->EmitNoIndirectUniform);
+   }
+
+   if (!pscreen->get_param(pscreen, PIPE_CAP_INT64_DIVMOD))
+      lower_64bit_integer_instructions(ir, DIV64 | MOD64);
+
+   if (ctx->Extensions.ARB_shading_language_packing) {
+      unsigned lower_inst = LOWER_PACK_SNORM_2x16 |
+                            LOWER_UNPACK_SNORM_2x16 |
+                            LOWER_PACK_UNORM_2x16 |
+                            LOWER_UNPACK_UNORM_2x16 |
+                            LOWER_PACK_SNORM_4x8 |
+                            LOWER_UNPACK_SNORM_4x8 |
+                            LOWER_UNPACK_UNORM_4x8 |
+                            LOWER_PACK_UNORM_4x8;
+
+      if (ctx->Extensions.ARB_gpu_shader5)
+         lower_inst |= LOWER_PACK_USE_BFI |
+                       LOWER_PACK_USE_BFE;
+      if (!ctx->st->has_half_float_packing)
+         lower_inst |= LOWER_PACK_HALF_2x16 |
+                       LOWER_UNPACK_HALF_2x16;
+
+      lower_packing_builtins(ir, lower_inst);
+   }
+
+   if (!pscreen->get_param(pscreen, PIPE_CAP_TEXTURE_GATHER_OFFSETS))
+      lower_offset_arrays(ir);
+   do_mat_op_to_vec(ir);
+
+   if (stage == MESA_SHADER_FRAGMENT)
+      lower_blend_equation_advanced(shader);
+
+   lower_instructions(ir,
+                      MOD_TO_FLOOR |
+                      FDIV_TO_MUL_RCP |
+                      EXP_TO_EXP2 |
+                      LOG_TO_LOG2 |
+                      (have_ldexp ? 0 : LDEXP_TO_ARITH) |
+                      (have_dfrexp ? 0 : DFREXP_DLDEXP_TO_ARITH) |
+                      CARRY_TO_ARITH |
+                      BORROW_TO_ARITH |
+                      (have_dround ? 0 : DOPS_TO_DFRAC) |
+                      (options->EmitNoPow ? POW_TO_EXP2 : 0) |
+                      (!ctx->Const.NativeIntegers ? INT_DIV_TO_MUL_RCP : 0) |
+                      (options->EmitNoSat ? SAT_TO_CLAMP : 0) |
+                      (ctx->Const.ForceGLSLAbsSqrt ? SQRT_TO_ABS_SQRT : 0) |
+                      /* Assume that if ARB_gpu_shader5 is not supported
+                       * then all of the extended integer functions need
+                       * lowering.  It may be necessary to add some caps
+                       * for individual instructions.
+                       */
+                      (!ctx->Extensions.ARB_gpu_shader5
+                       ? BIT_COUNT_TO_MATH |
+                         EXTRACT_TO_SHIFTS |
+                         INSERT_TO_SHIFTS |
+                         REVERSE_TO_SHIFTS |
+                         FIND_LSB_TO_FLOAT_CAST |
+                         FIND_MSB_TO_FLOAT_CAST |
+                         IMUL_HIGH_TO_MUL
+                       : 0));
+
+   do_vec_index_to_cond_assign(ir);
+   lower_vector_insert(ir, true);
+   lower_quadop_vector(ir, false);
+   lower_noise(ir);
+   if (options->MaxIfDepth == 0) {
+      lower_discard(ir);
+   }
+
+   if (ctx->Const.GLSLOptimizeConservatively) {
+      /* Do it once and repeat only if there's unsupported control flow. */
+      do {
+         do_common_optimization(ir, true, true, options,
+                                ctx->Const.NativeIntegers);
+         lower_if_to_cond_assign(stage, ir, options->MaxIfDepth,
+                                 if_threshold);
+      } while (has_unsupported_control_flow(ir, options));
+   } else {
+      /* Repeat it until it stops making changes. */
+      bool progress;
+      do {
+         progress = do_common_optimization(ir, true, true, options,
+                                           ctx->Const.NativeIntegers);
+         progress |= lower_if_to_cond_assign(stage, ir, options->MaxIfDepth,
+                                             if_threshold);
+      } while (progress);
+   }
+
+   validate_ir_tree(ir);
+}
+
 extern "C" {
 
 /**
@@ -6841,125 +6967,7 @@ st_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
    struct pipe_screen *pscreen = ctx->st->pipe->screen;
    assert(prog->data->LinkStatus);
 
-   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
-      if (prog->_LinkedShaders[i] == NULL)
-         continue;
-
-      struct gl_linked_shader *shader = prog->_LinkedShaders[i];
-      exec_list *ir = shader->ir;
-      gl_shader_stage stage = shader->Stage;
-      const struct gl_shader_compiler_options *options =
-            &ctx->Const.ShaderCompilerOptions[stage];
-      enum pipe_shader_type ptarget = pipe_shader_type_from_mesa(stage);
-      bool have_dround = pscreen->get_shader_param(pscreen, ptarget,
-                                                   PIPE_SHADER_CAP_TGSI_DROUND_SUPPORTED);
-      bool have_dfrexp = pscreen->get_shader_param(pscreen, ptarget,
-                                                   PIPE_SHADER_CAP_TGSI_DFRACEXP_DLDEXP_SUPPORTED);
-      bool have_ldexp = pscreen->get_shader_param(pscreen, ptarget,
-                                                  PIPE_SHADER_CAP_TGSI_LDEXP_SUPPORTED);
-      unsigned if_threshold = pscreen->get_shader_param(pscreen, ptarget,
-                                                        PIPE_SHADER_CAP_LOWER_IF_THRESHOLD);
-
-      /* If there are forms of indirect addressing that the driver
-       * cannot handle, perform the lowering pass.
-       */
-      if (options->EmitNoIndirectInput || options->EmitNoIndirectOutput ||
-          options->EmitNoIndirectTemp || options->EmitNoIndirectUniform) {
-         lower_variable_index_to_cond_assign(stage, ir,
-                                             options->EmitNoIndirectInput,
-                                             options->EmitNoIndirectOutput,
-                                             options->EmitNoIndirectTemp,
-                                             options->EmitNoIndirectUniform);
-      }
-
-      if (!pscreen->get_param(pscreen, PIPE_CAP_INT64_DIVMOD))
-         lower_64bit_integer_instructions(ir, DIV64 | MOD64);
-
-      if (ctx->Extensions.ARB_shading_language_packing) {
-         unsigned lower_inst = LOWER_PACK_SNORM_2x16 |
-                               LOWER_UNPACK_SNORM_2x16 |
-                               LOWER_PACK_UNORM_2x16 |
-                               LOWER_UNPACK_UNORM_2x16 |
-                               LOWER_PACK_SNORM_4x8 |
-                               LOWER_UNPACK_SNORM_4x8 |
-                               LOWER_UNPACK_UNORM_4x8 |
-                               LOWER_PACK_UNORM_4x8;
-
-         if (ctx->Extensions.ARB_gpu_shader5)
-            lower_inst |= LOWER_PACK_USE_BFI |
-                          LOWER_PACK_USE_BFE;
-         if (!ctx->st->has_half_float_packing)
-            lower_inst |= LOWER_PACK_HALF_2x16 |
-                          LOWER_UNPACK_HALF_2x16;
-
-         lower_packing_builtins(ir, lower_inst);
-      }
-
-      if (!pscreen->get_param(pscreen, PIPE_CAP_TEXTURE_GATHER_OFFSETS))
-         lower_offset_arrays(ir);
-      do_mat_op_to_vec(ir);
-
-      if (stage == MESA_SHADER_FRAGMENT)
-         lower_blend_equation_advanced(shader);
-
-      lower_instructions(ir,
-                         MOD_TO_FLOOR |
-                         FDIV_TO_MUL_RCP |
-                         EXP_TO_EXP2 |
-                         LOG_TO_LOG2 |
-                         (have_ldexp ? 0 : LDEXP_TO_ARITH) |
-                         (have_dfrexp ? 0 : DFREXP_DLDEXP_TO_ARITH) |
-                         CARRY_TO_ARITH |
-                         BORROW_TO_ARITH |
-                         (have_dround ? 0 : DOPS_TO_DFRAC) |
-                         (options->EmitNoPow ? POW_TO_EXP2 : 0) |
-                         (!ctx->Const.NativeIntegers ? INT_DIV_TO_MUL_RCP : 0) |
-                         (options->EmitNoSat ? SAT_TO_CLAMP : 0) |
-                         (ctx->Const.ForceGLSLAbsSqrt ? SQRT_TO_ABS_SQRT : 0) |
-                         /* Assume that if ARB_gpu_shader5 is not supported
-                          * then all of the extended integer functions need
-                          * lowering.  It may be necessary to add some caps
-                          * for individual instructions.
-                          */
-                         (!ctx->Extensions.ARB_gpu_shader5
-                          ? BIT_COUNT_TO_MATH |
-                            EXTRACT_TO_SHIFTS |
-                            INSERT_TO_SHIFTS |
-                            REVERSE_TO_SHIFTS |
-                            FIND_LSB_TO_FLOAT_CAST |
-                            FIND_MSB_TO_FLOAT_CAST |
-                            IMUL_HIGH_TO_MUL
-                          : 0));
-
-      do_vec_index_to_cond_assign(ir);
-      lower_vector_insert(ir, true);
-      lower_quadop_vector(ir, false);
-      lower_noise(ir);
-      if (options->MaxIfDepth == 0) {
-         lower_discard(ir);
-      }
-
-      if (ctx->Const.GLSLOptimizeConservatively) {
-         /* Do it once and repeat only if there's unsupported control flow. */
-         do {
-            do_common_optimization(ir, true, true, options,
-                                   ctx->Const.NativeIntegers);
-            lower_if_to_cond_assign((gl_shader_stage)i, ir,
-                                    options->MaxIfDepth, if_threshold);
-         } while (has_unsupported_control_flow(ir, options));
-      } else {
-         /* Repeat it until it stops making changes. */
-         bool progress;
-         do {
-            progress = do_common_optimization(ir, true, true, options,
-                                              ctx->Const.NativeIntegers);
-            progress |= lower_if_to_cond_assign((gl_shader_stage)i, ir,
-                                                options->MaxIfDepth, if_threshold);
-         } while (progress);
-      }
-
-      validate_ir_tree(ir);
-   }
+   link_foreach_stage(ctx, prog, st_lower_linked_shader, NULL);
 
    build_program_resource_list(ctx, prog);
 
@@ -26,10 +26,34 @@
 #include "st_program.h"
 #include "st_shader_cache.h"
 #include "compiler/glsl/program.h"
+#include "compiler/nir/nir_serialize.h"
 #include "pipe/p_shader_tokens.h"
 #include "program/ir_to_mesa.h"
+#include "tgsi/tgsi_from_mesa.h"
 #include "util/u_memory.h"
 
+/**
+ * Whether \p stage is handed to the driver as NIR rather than TGSI, in which
+ * case the cache holds the NIR.  This has to agree with st_link_shader().
+ */
+static bool
+stage_uses_nir(struct st_context *st, gl_shader_stage stage)
+{
+   struct pipe_screen *screen = st->pipe->screen;
+
+   switch (stage) {
+   case MESA_SHADER_VERTEX:
+   case MESA_SHADER_FRAGMENT:
+   case MESA_SHADER_COMPUTE:
+      return screen->get_shader_param(screen,
+                                      pipe_shader_type_from_mesa(stage),
+                                      PIPE_SHADER_CAP_PREFERRED_IR) ==
+             PIPE_SHADER_IR_NIR;
+   default:
+      return false;
+   }
+}
+
 static void
 write_stream_out_to_cache(struct blob *blob,
                           struct pipe_shader_state *tgsi)
@@ -38,6 +62,48 @@ write_stream_out_to_cache(struct blob *blob,
                     sizeof(tgsi->stream_output));
 }
 
+static void
+release_blob_chunks(void *chunks)
+{
+   blob_free_chunks(chunks);
+}
+
+static void
+put_blob_in_cache(struct blob *blob, struct st_context *st,
+                  unsigned char *sha1)
+{
+   struct disk_cache_segment *segments;
+   struct blob_chunk *chunks, *chunk;
+   unsigned num_segments = 0;
+
+   if (blob->out_of_memory)
+      return;
+
+   /* Hand the chunks over to the cache rather than having it copy them
+    * once more; it frees them when it is done compressing and writing.
+    */
+   chunks = blob_steal_chunks(blob);
+   for (chunk = chunks; chunk; chunk = chunk->next)
+      num_segments++;
+
+   segments = malloc(num_segments * sizeof(*segments));
+   if (!segments) {
+      blob_free_chunks(chunks);
+      return;
+   }
+
+   num_segments = 0;
+   for (chunk = chunks; chunk; chunk = chunk->next) {
+      segments[num_segments].data = chunk->data;
+      segments[num_segments].size = chunk->size;
+      num_segments++;
+   }
+
+   disk_cache_put_segments(st->ctx->Cache, sha1, segments, num_segments,
+                           release_blob_chunks, chunks, NULL);
+   free(segments);
+}
+
 static void
 write_tgsi_to_cache(struct blob *blob, struct pipe_shader_state *tgsi,
                     struct st_context *st, unsigned char *sha1,
@@ -47,7 +113,7 @@ write_tgsi_to_cache(struct blob *blob, struct pipe_shader_state *tgsi,
    blob_write_bytes(blob, tgsi->tokens,
                     num_tokens * sizeof(struct tgsi_token));
 
-   disk_cache_put(st->ctx->Cache, sha1, blob->data, blob->size, NULL);
+   put_blob_in_cache(blob, st, sha1);
 }
 
 /**
@@ -70,7 +136,7 @@ st_store_tgsi_in_disk_cache(struct st_context *st, struct gl_program *prog,
 
    unsigned char *sha1;
    struct blob blob;
-   blob_init(&blob);
+   blob_init_chunked(&blob);
 
    switch (prog->info.stage) {
    case MESA_SHADER_VERTEX: {
@@ -125,6 +191,93 @@ st_store_tgsi_in_disk_cache(struct st_context *st, struct gl_program *prog,
    blob_finish(&blob);
 }
 
+/**
+ * Store the NIR of a GLSL program, as it comes out of st_glsl_to_nir(), in
+ * the on-disk shader cache.
+ */
+void
+st_store_nir_in_disk_cache(struct st_context *st, struct gl_program *prog,
+                           struct nir_shader *nir)
+{
+   if (!st->ctx->Cache)
+      return;
+
+   static const char zero[sizeof(prog->sh.data->sha1)] = {0};
+   if (memcmp(prog->sh.data->sha1, zero, sizeof(prog->sh.data->sha1)) == 0)
+      return;
+
+   unsigned char *sha1;
+   switch (prog->info.stage) {
+   case MESA_SHADER_VERTEX:
+      sha1 = ((struct st_vertex_program *) prog)->sha1;
+      break;
+   case MESA_SHADER_FRAGMENT:
+      sha1 = ((struct st_fragment_program *) prog)->sha1;
+      break;
+   case MESA_SHADER_COMPUTE:
+      sha1 = ((struct st_compute_program *) prog)->sha1;
+      break;
+   default:
+      unreachable("Unsupported stage");
+   }
+
+   struct blob blob;
+   blob_init_chunked(&blob);
+   nir_serialize(&blob, nir);
+   put_blob_in_cache(&blob, st, sha1);
+
+   if (st->ctx->_Shader->Flags & GLSL_CACHE_INFO) {
+      char sha1_buf[41];
+      _mesa_sha1_format(sha1_buf, sha1);
+      fprintf(stderr, "putting %s nir in cache: %s\n",
+              _mesa_shader_stage_to_string(prog->info.stage), sha1_buf);
+   }
+
+   blob_finish(&blob);
+}
+
+/**
+ * Make \p glprog a NIR program from the cached \p nir, the way
+ * st_nir_get_mesa_program() sets up a freshly linked one.
+ */
+static void
+read_nir_from_cache(struct st_context *st, struct gl_shader_program *prog,
+                    struct gl_program *glprog,
+                    struct blob_reader *blob_reader)
+{
+   struct pipe_screen *screen = st->pipe->screen;
+   enum pipe_shader_type ptarget =
+      pipe_shader_type_from_mesa(glprog->info.stage);
+   const nir_shader_compiler_options *options =
+      screen->get_compiler_options(screen, PIPE_SHADER_IR_NIR, ptarget);
+
+   switch (glprog->info.stage) {
+   case MESA_SHADER_VERTEX: {
+      struct st_vertex_program *stvp = (struct st_vertex_program *) glprog;
+      st_release_vp_variants(st, stvp);
+      stvp->shader_program = prog;
+      break;
+   }
+   case MESA_SHADER_FRAGMENT: {
+      struct st_fragment_program *stfp = (struct st_fragment_program *) glprog;
+      st_release_fp_variants(st, stfp);
+      stfp->shader_program = prog;
+      break;
+   }
+   case MESA_SHADER_COMPUTE: {
+      struct st_compute_program *stcp = (struct st_compute_program *) glprog;
+      st_release_cp_variants(st, stcp);
+      stcp->shader_program = prog;
+      break;
+   }
+   default:
+      unreachable("Unsupported stage");
+   }
+
+   ralloc_free(glprog->nir);
+   glprog->nir = nir_deserialize(NULL, options, blob_reader);
+}
+
 static void
 read_stream_out_from_cache(struct blob_reader *blob_reader,
                            struct pipe_shader_state *tgsi)
@@ -143,6 +296,109 @@ read_tgsi_from_cache(struct blob_reader *blob_reader,
    blob_copy_bytes(blob_reader, (uint8_t *) *tokens, tokens_size);
 }
 
+static void
+read_tgsi_stage_from_cache(struct st_context *st, struct gl_program *glprog,
+                           struct blob_reader *blob_reader)
+{
+   switch (glprog->info.stage) {
+   case MESA_SHADER_VERTEX: {
+      struct st_vertex_program *stvp =
+         (struct st_vertex_program *) glprog;
+
+      st_release_vp_variants(st, stvp);
+
+      stvp->num_inputs = blob_read_uint32(blob_reader);
+      blob_copy_bytes(blob_reader, (uint8_t *) stvp->index_to_input,
+                      sizeof(stvp->index_to_input));
+      blob_copy_bytes(blob_reader, (uint8_t *) stvp->result_to_output,
+                      sizeof(stvp->result_to_output));
+
+      read_stream_out_from_cache(blob_reader, &stvp->tgsi);
+      read_tgsi_from_cache(blob_reader, &stvp->tgsi.tokens);
+
+      if (st->vp == stvp)
+         st->dirty |= ST_NEW_VERTEX_PROGRAM(st, stvp);
+
+      break;
+   }
+   case MESA_SHADER_TESS_CTRL: {
+      struct st_common_program *sttcp = st_common_program(glprog);
+
+      st_release_basic_variants(st, sttcp->Base.Target,
+                                &sttcp->variants, &sttcp->tgsi);
+
+      read_stream_out_from_cache(blob_reader, &sttcp->tgsi);
+      read_tgsi_from_cache(blob_reader, &sttcp->tgsi.tokens);
+
+      if (st->tcp == sttcp)
+         st->dirty |= sttcp->affected_states;
+
+      break;
+   }
+   case MESA_SHADER_TESS_EVAL: {
+      struct st_common_program *sttep = st_common_program(glprog);
+
+      st_release_basic_variants(st, sttep->Base.Target,
+                                &sttep->variants, &sttep->tgsi);
+
+      read_stream_out_from_cache(blob_reader, &sttep->tgsi);
+      read_tgsi_from_cache(blob_reader, &sttep->tgsi.tokens);
+
+      if (st->tep == sttep)
+         st->dirty |= sttep->affected_states;
+
+      break;
+   }
+   case MESA_SHADER_GEOMETRY: {
+      struct st_common_program *stgp = st_common_program(glprog);
+
+      st_release_basic_variants(st, stgp->Base.Target, &stgp->variants,
+                                &stgp->tgsi);
+
+      read_stream_out_from_cache(blob_reader, &stgp->tgsi);
+      read_tgsi_from_cache(blob_reader, &stgp->tgsi.tokens);
+
+      if (st->gp == stgp)
+         st->dirty |= stgp->affected_states;
+
+      break;
+   }
+   case MESA_SHADER_FRAGMENT: {
+      struct st_fragment_program *stfp =
+         (struct st_fragment_program *) glprog;
+
+      st_release_fp_variants(st, stfp);
+
+      read_tgsi_from_cache(blob_reader, &stfp->tgsi.tokens);
+
+      if (st->fp == stfp)
+         st->dirty |= stfp->affected_states;
+
+      break;
+   }
+   case MESA_SHADER_COMPUTE: {
+      struct st_compute_program *stcp =
+         (struct st_compute_program *) glprog;
+
+      st_release_cp_variants(st, stcp);
+
+      read_tgsi_from_cache(blob_reader,
+                           (const struct tgsi_token**) &stcp->tgsi.prog);
+
+      stcp->tgsi.req_local_mem = stcp->Base.info.cs.shared_size;
+      stcp->tgsi.req_private_mem = 0;
+      stcp->tgsi.req_input_mem = 0;
+
+      if (st->cp == stcp)
+          st->dirty |= stcp->affected_states;
+
+      break;
+   }
+   default:
+      unreachable("Unsupported stage");
+   }
+}
+
 bool
 st_load_tgsi_from_disk_cache(struct gl_context *ctx,
                              struct gl_shader_program *prog)
@@ -150,6 +406,7 @@ st_load_tgsi_from_disk_cache(struct gl_context *ctx,
    if (!ctx->Cache)
       return false;
 
+   struct st_context *st = st_context(ctx);
    unsigned char *stage_sha1[MESA_SHADER_STAGES];
    char sha1_buf[41];
 
@@ -160,7 +417,8 @@ st_load_tgsi_from_disk_cache(struct gl_context *ctx,
       if (prog->_LinkedShaders[i] == NULL)
          continue;
 
-      char *buf = ralloc_strdup(NULL, "tgsi_tokens ");
+      char *buf = ralloc_strdup(NULL, stage_uses_nir(st, i) ? "nir " :
+                                                              "tgsi_tokens ");
       _mesa_sha1_format(sha1_buf,
                         prog->_LinkedShaders[i]->Program->sh.data->sha1);
       ralloc_strcat(&buf, sha1_buf);
@@ -227,122 +485,44 @@ st_load_tgsi_from_disk_cache(struct gl_context *ctx,
       return false;
 
    uint8_t *buffer = NULL;
+   struct disk_cache_get_request requests[MESA_SHADER_STAGES];
+   unsigned num_requests = 0, next_request = 0;
    if (ctx->_Shader->Flags & GLSL_CACHE_FALLBACK) {
       goto fallback_recompile;
    }
 
-   struct st_context *st = st_context(ctx);
+   /* Fetch all stages at once so they are read and decompressed in
+    * parallel.
+    */
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (prog->_LinkedShaders[i] == NULL)
+         continue;
+
+      memcpy(requests[num_requests++].key, stage_sha1[i], sizeof(cache_key));
+   }
+   disk_cache_get_batch(ctx->Cache, requests, num_requests);
+
    for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
       if (prog->_LinkedShaders[i] == NULL)
          continue;
 
       unsigned char *sha1 = stage_sha1[i];
       size_t size;
-      buffer = (uint8_t *) disk_cache_get(ctx->Cache, sha1, &size);
+      buffer = (uint8_t *) disk_cache_get_finish(&requests[next_request++],
+                                                 &size);
       if (buffer) {
          struct blob_reader blob_reader;
          blob_reader_init(&blob_reader, buffer, size);
 
          struct gl_program *glprog = prog->_LinkedShaders[i]->Program;
-         switch (glprog->info.stage) {
-         case MESA_SHADER_VERTEX: {
-            struct st_vertex_program *stvp =
-               (struct st_vertex_program *) glprog;
-
-            st_release_vp_variants(st, stvp);
-
-            stvp->num_inputs = blob_read_uint32(&blob_reader);
-            blob_copy_bytes(&blob_reader, (uint8_t *) stvp->index_to_input,
-                            sizeof(stvp->index_to_input));
-            blob_copy_bytes(&blob_reader, (uint8_t *) stvp->result_to_output,
-                            sizeof(stvp->result_to_output));
-
-            read_stream_out_from_cache(&blob_reader, &stvp->tgsi);
-            read_tgsi_from_cache(&blob_reader, &stvp->tgsi.tokens);
-
-            if (st->vp == stvp)
-               st->dirty |= ST_NEW_VERTEX_PROGRAM(st, stvp);
-
-            break;
-         }
-         case MESA_SHADER_TESS_CTRL: {
-            struct st_common_program *sttcp = st_common_program(glprog);
-
-            st_release_basic_variants(st, sttcp->Base.Target,
-                                      &sttcp->variants, &sttcp->tgsi);
-
-            read_stream_out_from_cache(&blob_reader, &sttcp->tgsi);
-            read_tgsi_from_cache(&blob_reader, &sttcp->tgsi.tokens);
-
-            if (st->tcp == sttcp)
-               st->dirty |= sttcp->affected_states;
-
-            break;
-         }
-         case MESA_SHADER_TESS_EVAL: {
-            struct st_common_program *sttep = st_common_program(glprog);
-
-            st_release_basic_variants(st, sttep->Base.Target,
-                                      &sttep->variants, &sttep->tgsi);
-
-            read_stream_out_from_cache(&blob_reader, &sttep->tgsi);
-            read_tgsi_from_cache(&blob_reader, &sttep->tgsi.tokens);
-
-            if (st->tep == sttep)
-               st->dirty |= sttep->affected_states;
-
-            break;
-         }
-         case MESA_SHADER_GEOMETRY: {
-            struct st_common_program *stgp = st_common_program(glprog);
-
-            st_release_basic_variants(st, stgp->Base.Target, &stgp->variants,
-                                      &stgp->tgsi);
-
-            read_stream_out_from_cache(&blob_reader, &stgp->tgsi);
-            read_tgsi_from_cache(&blob_reader, &stgp->tgsi.tokens);
-
-            if (st->gp == stgp)
-               st->dirty |= stgp->affected_states;
-
-            break;
-         }
-         case MESA_SHADER_FRAGMENT: {
-            struct st_fragment_program *stfp =
-               (struct st_fragment_program *) glprog;
-
-            st_release_fp_variants(st, stfp);
-
-            read_tgsi_from_cache(&blob_reader, &stfp->tgsi.tokens);
-
-            if (st->fp == stfp)
-               st->dirty |= stfp->affected_states;
-
-            break;
-         }
-         case MESA_SHADER_COMPUTE: {
-            struct st_compute_program *stcp =
-               (struct st_compute_program *) glprog;
-
-            st_release_cp_variants(st, stcp);
-
-            read_tgsi_from_cache(&blob_reader,
-                                 (const struct tgsi_token**) &stcp->tgsi.prog);
-
-            stcp->tgsi.req_local_mem = stcp->Base.info.cs.shared_size;
-            stcp->tgsi.req_private_mem = 0;
-            stcp->tgsi.req_input_mem = 0;
-
-            if (st->cp == stcp)
-                st->dirty |= stcp->affected_states;
-
-            break;
-         }
-         default:
-            unreachable("Unsupported stage");
-         }
-
-         if (blob_reader.current != blob_reader.end || blob_reader.overrun) {
+         bool use_nir = stage_uses_nir(st, glprog->info.stage);
+         if (use_nir)
+            read_nir_from_cache(st, prog, glprog, &blob_reader);
+         else
+            read_tgsi_stage_from_cache(st, glprog, &blob_reader);
+
+         if (blob_reader.current != blob_reader.end || blob_reader.overrun ||
+             (use_nir && !glprog->nir)) {
             /* Something very bad has gone wrong discard the item from the
              * cache and rebuild/link from source.
              */
@@ -350,7 +530,7 @@ st_load_tgsi_from_disk_cache(struct gl_context *ctx,
 
             if (ctx->_Shader->Flags & GLSL_CACHE_INFO) {
                fprintf(stderr, "Error reading program from cache (invalid "
-                       "TGSI cache item)\n");
+                       "%s cache item)\n", use_nir ? "NIR" : "TGSI");
             }
 
             disk_cache_remove(ctx->Cache, sha1);
@@ -360,13 +540,23 @@ st_load_tgsi_from_disk_cache(struct gl_context *ctx,
 
          if (ctx->_Shader->Flags & GLSL_CACHE_INFO) {
             _mesa_sha1_format(sha1_buf, sha1);
-            fprintf(stderr, "%s tgsi_tokens retrieved from cache: %s\n",
-                    _mesa_shader_stage_to_string(i), sha1_buf);
+            fprintf(stderr, "%s %s retrieved from cache: %s\n",
+                    _mesa_shader_stage_to_string(i),
+                    use_nir ? "nir" : "tgsi_tokens", sha1_buf);
          }
 
          st_set_prog_affected_state_flags(glprog);
          _mesa_associate_uniform_storage(ctx, prog, glprog, false);
 
+         /* This finishes setting up a NIR program, as after linking; with
+          * glprog->nir already there it doesn't go back to GLSL IR.
+          */
+         if (use_nir &&
+             !ctx->Driver.ProgramStringNotify(ctx,
+                                              _mesa_shader_stage_to_program(i),
+                                              glprog))
+            goto fallback_recompile;
+
          /* Create Gallium shaders now instead of on demand. */
          if (ST_DEBUG & DEBUG_PRECOMPILE ||
              st->shader_has_one_variant[glprog->info.stage])
@@ -389,6 +579,9 @@ st_load_tgsi_from_disk_cache(struct gl_context *ctx,
 fallback_recompile:
    free(buffer);
 
+   while (next_request < num_requests)
+      free(disk_cache_get_finish(&requests[next_request++], NULL));
+
    if (ctx->_Shader->Flags & GLSL_CACHE_INFO)
       fprintf(stderr, "TGSI cache falling back to recompile.\n");
 
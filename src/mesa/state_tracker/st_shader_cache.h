@@ -32,6 +32,8 @@
 extern "C" {
 #endif
 
+struct nir_shader;
+
 bool
 st_load_tgsi_from_disk_cache(struct gl_context *ctx,
                              struct gl_shader_program *prog);
@@ -41,6 +43,10 @@ st_store_tgsi_in_disk_cache(struct st_context *st, struct gl_program *prog,
                             struct pipe_shader_state *out_state,
                             unsigned num_tokens);
 
+void
+st_store_nir_in_disk_cache(struct st_context *st, struct gl_program *prog,
+                           struct nir_shader *nir);
+
 #ifdef __cplusplus
 }
 #endif
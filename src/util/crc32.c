@@ -33,8 +33,22 @@
  */
 
 
+#include <stdbool.h>
+
 #include "crc32.h"
 
+/* Carry-less multiplication needs GCC 4.9 or a clang that allows enabling
+ * it per function.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || \
+     (defined(__GNUC__) && \
+      (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define HAVE_CRC32_PCLMUL
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 
 static const uint32_t 
 util_crc32_table[256] = {
@@ -105,17 +119,125 @@ util_crc32_table[256] = {
 };
 
 
+static uint32_t
+crc32_update_c(uint32_t crc, const uint8_t *p, size_t size)
+{
+   while (size--)
+      crc = util_crc32_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+   return crc;
+}
+
+
+#ifdef HAVE_CRC32_PCLMUL
+
+/**
+ * Folds 64 bytes at a time into four 128-bit remainders with carry-less
+ * multiplications by x^(512+64) and x^512 mod P, and then those into one
+ * 32-bit CRC, as described in Intel's "Fast CRC Computation for Generic
+ * Polynomials Using PCLMULQDQ Instruction".  The constants are bit-reflected
+ * like the polynomial.
+ *
+ * \p size must be a multiple of 16 and at least 64.
+ */
+static uint32_t __attribute__((target("pclmul,sse4.1")))
+crc32_update_pclmul(uint32_t crc, const uint8_t *p, size_t size)
+{
+   const __m128i *data = (const __m128i *)p;
+   const __m128i k1k2 = _mm_set_epi64x(0x1c6e41596ull, 0x154442bd4ull);
+   const __m128i k3k4 = _mm_set_epi64x(0x0ccaa009eull, 0x1751997d0ull);
+   const __m128i k5 = _mm_set_epi64x(0, 0x163cd6124ull);
+   const __m128i poly = _mm_set_epi64x(0x1f7011641ull, 0x1db710641ull);
+   const __m128i mask32 = _mm_set_epi32(0, 0, 0, ~0);
+   __m128i x0, x1, x2, x3, t;
+
+   x0 = _mm_xor_si128(_mm_loadu_si128(data), _mm_cvtsi32_si128(crc));
+   x1 = _mm_loadu_si128(data + 1);
+   x2 = _mm_loadu_si128(data + 2);
+   x3 = _mm_loadu_si128(data + 3);
+   data += 4;
+   size -= 64;
+
+#define CRC32_FOLD(x, k, next) do {                            \
+   t = _mm_clmulepi64_si128(x, k, 0x11);                       \
+   x = _mm_clmulepi64_si128(x, k, 0x00);                       \
+   x = _mm_xor_si128(_mm_xor_si128(x, t), next);               \
+} while (0)
+
+   for (; size >= 64; size -= 64, data += 4) {
+      CRC32_FOLD(x0, k1k2, _mm_loadu_si128(data));
+      CRC32_FOLD(x1, k1k2, _mm_loadu_si128(data + 1));
+      CRC32_FOLD(x2, k1k2, _mm_loadu_si128(data + 2));
+      CRC32_FOLD(x3, k1k2, _mm_loadu_si128(data + 3));
+   }
+
+   CRC32_FOLD(x0, k3k4, x1);
+   CRC32_FOLD(x0, k3k4, x2);
+   CRC32_FOLD(x0, k3k4, x3);
+
+   for (; size >= 16; size -= 16, data++)
+      CRC32_FOLD(x0, k3k4, _mm_loadu_si128(data));
+
+#undef CRC32_FOLD
+
+   /* 128 to 64 bits. */
+   x0 = _mm_xor_si128(_mm_clmulepi64_si128(x0, k3k4, 0x10),
+                      _mm_srli_si128(x0, 8));
+
+   /* 64 to 32 bits. */
+   x0 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x0, mask32), k5, 0x00),
+                      _mm_srli_si128(x0, 4));
+
+   /* Barrett reduction of the remaining 64 bits. */
+   t = _mm_clmulepi64_si128(_mm_and_si128(x0, mask32), poly, 0x10);
+   t = _mm_clmulepi64_si128(_mm_and_si128(t, mask32), poly, 0x00);
+
+   return _mm_extract_epi32(_mm_xor_si128(x0, t), 1);
+}
+
+static bool
+crc32_has_pclmul(void)
+{
+   static int has_pclmul = -1;
+
+   /* PCLMULQDQ is CPUID.1:ECX[1], SSE4.1 is CPUID.1:ECX[19]. */
+   if (has_pclmul < 0) {
+      unsigned eax, ebx, ecx, edx;
+
+      has_pclmul = __get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+                   (ecx & (1 << 1)) && (ecx & (1 << 19));
+   }
+
+   return has_pclmul;
+}
+
+#endif /* HAVE_CRC32_PCLMUL */
+
+
 /**
  * @sa http://www.w3.org/TR/PNG/#D-CRCAppendix
  */
 uint32_t
 util_hash_crc32(const void *data, size_t size)
 {
-   uint8_t *p = (uint8_t *)data;
-   uint32_t crc = 0xffffffff;
- 
-   while (size--)
-      crc = util_crc32_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
-   
-   return crc;
+   return util_crc32_update(0xffffffff, data, size);
+}
+
+
+uint32_t
+util_crc32_update(uint32_t crc, const void *data, size_t size)
+{
+   const uint8_t *p = (const uint8_t *)data;
+
+#ifdef HAVE_CRC32_PCLMUL
+   if (size >= 64 && crc32_has_pclmul()) {
+      size_t folded = size & ~(size_t)15;
+
+      crc = crc32_update_pclmul(crc, p, folded);
+      p += folded;
+      size -= folded;
+   }
+#endif
+
+   return crc32_update_c(crc, p, size);
 }
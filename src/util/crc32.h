@@ -47,6 +47,13 @@ extern "C" {
 uint32_t
 util_hash_crc32(const void *data, size_t size);
 
+/**
+ * Continue the CRC \p crc of some data, as returned by util_hash_crc32(),
+ * with \p size more bytes at \p data.
+ */
+uint32_t
+util_crc32_update(uint32_t crc, const void *data, size_t size);
+
 
 #ifdef __cplusplus
 }
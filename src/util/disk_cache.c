@@ -37,7 +37,6 @@
 #include <pwd.h>
 #include <errno.h>
 #include <dirent.h>
-#include "zlib.h"
 
 #include "util/crc32.h"
 #include "util/debug.h"
@@ -49,6 +48,8 @@
 #include "main/errors.h"
 
 #include "disk_cache.h"
+#include "disk_cache_codec.h"
+#include "disk_cache_pack.h"
 
 /* Number of bits to mask off from a cache key to get an index. */
 #define CACHE_INDEX_KEY_BITS 16
@@ -99,6 +100,18 @@ struct disk_cache {
    /* Driver cache keys. */
    uint8_t *driver_keys_blob;
    size_t driver_keys_blob_size;
+
+   /* Single file storage used instead of one file per entry, if enabled. */
+   struct disk_cache_pack *pack;
+
+   /* Compression codec used for new entries. */
+   enum disk_cache_codec codec;
+
+   /* Threads running disk_cache_get_batch() lookups, started on first use
+    * as most caches never see one.
+    */
+   struct util_queue get_queue;
+   mtx_t get_queue_mutex;
 };
 
 struct disk_cache_put_job {
@@ -108,12 +121,19 @@ struct disk_cache_put_job {
 
    cache_key key;
 
-   /* Copy of cache data to be compressed and written. */
-   void *data;
+   /* Cache data to be compressed and written: a copy made by
+    * disk_cache_put(), or the caller's data for disk_cache_put_segments().
+    */
+   struct disk_cache_segment *segments;
+   unsigned num_segments;
 
-   /* Size of data to be compressed and written. */
+   /* Total size of the segments. */
    size_t size;
 
+   /* Called once the caller's segments aren't needed anymore. */
+   void (*release)(void *release_data);
+   void *release_data;
+
    struct cache_item_metadata cache_item_metadata;
 };
 
@@ -272,10 +292,12 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
          goto fail;
    }
 
-   cache = ralloc(NULL, struct disk_cache);
+   cache = rzalloc(NULL, struct disk_cache);
    if (cache == NULL)
       goto fail;
 
+   cache->codec = disk_cache_codec_default();
+
    cache->path = ralloc_strdup(cache, path);
    if (cache->path == NULL)
       goto fail;
@@ -359,6 +381,12 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
 
    cache->max_size = max_size;
 
+   /* At user request, keep all entries in a single pack file. Fall back to
+    * one file per entry if the pack can't be used.
+    */
+   if (env_var_as_boolean("MESA_GLSL_CACHE_PACK", false))
+      cache->pack = disk_cache_pack_create(cache, cache->path, max_size);
+
    /* 1 thread was chosen because we don't really care about getting things
     * to disk quickly just that it's not blocking other tasks.
     *
@@ -404,6 +432,8 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
    /* Seed our rand function */
    s_rand_xorshift128plus(cache->seed_xorshift128plus, true);
 
+   (void) mtx_init(&cache->get_queue_mutex, mtx_plain);
+
    ralloc_free(local);
 
    return cache;
@@ -411,8 +441,10 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
  fail:
    if (fd != -1)
       close(fd);
-   if (cache)
+   if (cache) {
+      disk_cache_pack_destroy(cache->pack);
       ralloc_free(cache);
+   }
    ralloc_free(local);
 
    return NULL;
@@ -423,6 +455,10 @@ disk_cache_destroy(struct disk_cache *cache)
 {
    if (cache) {
       util_queue_destroy(&cache->cache_queue);
+      if (util_queue_is_initialized(&cache->get_queue))
+         util_queue_destroy(&cache->get_queue);
+      mtx_destroy(&cache->get_queue_mutex);
+      disk_cache_pack_destroy(cache->pack);
       munmap(cache->index_mmap, cache->index_mmap_size);
    }
 
@@ -655,6 +691,11 @@ disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
    struct stat sb;
 
+   if (cache->pack) {
+      disk_cache_pack_remove(cache->pack, key);
+      return;
+   }
+
    char *filename = get_cache_file(cache, key);
    if (filename == NULL) {
       return;
@@ -672,21 +713,6 @@ disk_cache_remove(struct disk_cache *cache, const cache_key key)
       p_atomic_add(cache->size, - (uint64_t)sb.st_blocks * 512);
 }
 
-static ssize_t
-read_all(int fd, void *buf, size_t count)
-{
-   char *in = buf;
-   ssize_t read_ret;
-   size_t done;
-
-   for (done = 0; done < count; done += read_ret) {
-      read_ret = read(fd, in + done, count - done);
-      if (read_ret == -1 || read_ret == 0)
-         return -1;
-   }
-   return done;
-}
-
 static ssize_t
 write_all(int fd, const void *buf, size_t count)
 {
@@ -702,89 +728,48 @@ write_all(int fd, const void *buf, size_t count)
    return done;
 }
 
-/* From the zlib docs:
- *    "If the memory is available, buffers sizes on the order of 128K or 256K
- *    bytes should be used."
- */
-#define BUFSIZE 256 * 1024
-
 /**
- * Compresses cache entry in memory and writes it to disk. Returns the size
- * of the data written to disk.
+ * Creates the job for writing out the concatenation of \p segments. The
+ * segment array is always copied into the job, and the data itself too if
+ * \p copy_data is set.
  */
-static size_t
-deflate_and_write_to_disk(const void *in_data, size_t in_data_size, int dest,
-                          const char *filename)
-{
-   unsigned char out[BUFSIZE];
-
-   /* allocate deflate state */
-   z_stream strm;
-   strm.zalloc = Z_NULL;
-   strm.zfree = Z_NULL;
-   strm.opaque = Z_NULL;
-   strm.next_in = (uint8_t *) in_data;
-   strm.avail_in = in_data_size;
-
-   int ret = deflateInit(&strm, Z_BEST_COMPRESSION);
-   if (ret != Z_OK)
-       return 0;
-
-   /* compress until end of in_data */
-   size_t compressed_size = 0;
-   int flush;
-   do {
-      int remaining = in_data_size - BUFSIZE;
-      flush = remaining > 0 ? Z_NO_FLUSH : Z_FINISH;
-      in_data_size -= BUFSIZE;
-
-      /* Run deflate() on input until the output buffer is not full (which
-       * means there is no more data to deflate).
-       */
-      do {
-         strm.avail_out = BUFSIZE;
-         strm.next_out = out;
-
-         ret = deflate(&strm, flush);    /* no bad return value */
-         assert(ret != Z_STREAM_ERROR);  /* state not clobbered */
-
-         size_t have = BUFSIZE - strm.avail_out;
-         compressed_size += have;
-
-         ssize_t written = write_all(dest, out, have);
-         if (written == -1) {
-            (void)deflateEnd(&strm);
-            return 0;
-         }
-      } while (strm.avail_out == 0);
-
-      /* all input should be used */
-      assert(strm.avail_in == 0);
-
-   } while (flush != Z_FINISH);
-
-   /* stream should be complete */
-   assert(ret == Z_STREAM_END);
-
-   /* clean up and return */
-   (void)deflateEnd(&strm);
-   return compressed_size;
-}
-
 static struct disk_cache_put_job *
 create_put_job(struct disk_cache *cache, const cache_key key,
-               const void *data, size_t size,
+               const struct disk_cache_segment *segments,
+               unsigned num_segments, bool copy_data,
                struct cache_item_metadata *cache_item_metadata)
 {
+   size_t size = 0;
+   for (unsigned i = 0; i < num_segments; i++)
+      size += segments[i].size;
+
    struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *)
-      malloc(sizeof(struct disk_cache_put_job) + size);
+      malloc(sizeof(struct disk_cache_put_job) +
+             num_segments * sizeof(struct disk_cache_segment) +
+             (copy_data ? size : 0));
 
    if (dc_job) {
       dc_job->cache = cache;
       memcpy(dc_job->key, key, sizeof(cache_key));
-      dc_job->data = dc_job + 1;
-      memcpy(dc_job->data, data, size);
+      dc_job->segments = (struct disk_cache_segment *) (dc_job + 1);
+      dc_job->num_segments = num_segments;
       dc_job->size = size;
+      dc_job->release = NULL;
+      dc_job->release_data = NULL;
+
+      if (copy_data) {
+         uint8_t *copy = (uint8_t *) (dc_job->segments + num_segments);
+
+         for (unsigned i = 0; i < num_segments; i++) {
+            memcpy(copy, segments[i].data, segments[i].size);
+            dc_job->segments[i].data = copy;
+            dc_job->segments[i].size = segments[i].size;
+            copy += segments[i].size;
+         }
+      } else {
+         memcpy(dc_job->segments, segments,
+                num_segments * sizeof(struct disk_cache_segment));
+      }
 
       /* Copy the cache item metadata */
       if (cache_item_metadata) {
@@ -824,6 +809,9 @@ destroy_put_job(void *job, int thread_index)
       struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *) job;
       free(dc_job->cache_item_metadata.keys);
 
+      if (dc_job->release)
+         dc_job->release(dc_job->release_data);
+
       free(job);
    }
 }
@@ -833,6 +821,79 @@ struct cache_entry_file_data {
    uint32_t uncompressed_size;
 };
 
+/**
+ * Serializes a cache entry as it is stored on disk: the driver keys blob,
+ * the cache item metadata, the CRC of the data, the codec tag and finally
+ * the compressed data itself. Returns a malloc'ed buffer, or NULL on any error.
+ */
+static uint8_t *
+create_cache_item(struct disk_cache_put_job *dc_job, size_t *item_size)
+{
+   struct disk_cache *cache = dc_job->cache;
+   const struct cache_item_metadata *md = &dc_job->cache_item_metadata;
+   size_t md_size = sizeof(uint32_t);
+
+   if (md->type == CACHE_ITEM_TYPE_GLSL)
+      md_size += sizeof(uint32_t) + md->num_keys * sizeof(cache_key);
+
+   size_t header_size = cache->driver_keys_blob_size + md_size +
+                        sizeof(struct cache_entry_file_data) + 1;
+   size_t bound = disk_cache_codec_bound(cache->codec, dc_job->size);
+   uint8_t *item = malloc(header_size + bound);
+   if (!item)
+      return NULL;
+
+   /* Write the driver_keys_blob, this can be used find information about the
+    * mesa version that produced the entry or deal with hash collisions,
+    * should that ever become a real problem.
+    */
+   uint8_t *ptr = item;
+   memcpy(ptr, cache->driver_keys_blob, cache->driver_keys_blob_size);
+   ptr += cache->driver_keys_blob_size;
+
+   /* Write the cache item metadata. This data can be used to deal with
+    * hash collisions, as well as providing useful information to 3rd party
+    * tools reading the cache files.
+    */
+   memcpy(ptr, &md->type, sizeof(uint32_t));
+   ptr += sizeof(uint32_t);
+   if (md->type == CACHE_ITEM_TYPE_GLSL) {
+      memcpy(ptr, &md->num_keys, sizeof(uint32_t));
+      ptr += sizeof(uint32_t);
+      memcpy(ptr, md->keys[0], md->num_keys * sizeof(cache_key));
+      ptr += md->num_keys * sizeof(cache_key);
+   }
+
+   /* Create CRC of the data. We will read this when restoring the cache and
+    * use it to check for corruption.
+    */
+   struct cache_entry_file_data cf_data;
+   cf_data.crc32 = 0xffffffff;
+   for (unsigned i = 0; i < dc_job->num_segments; i++) {
+      cf_data.crc32 = util_crc32_update(cf_data.crc32,
+                                        dc_job->segments[i].data,
+                                        dc_job->segments[i].size);
+   }
+   cf_data.uncompressed_size = dc_job->size;
+   memcpy(ptr, &cf_data, sizeof(cf_data));
+   ptr += sizeof(cf_data);
+
+   /* Tag the compressed data with the codec, see disk_cache_codec.h. */
+   *ptr++ = cache->codec;
+
+   size_t compressed_size =
+      disk_cache_compress_segments(cache->codec, dc_job->segments,
+                                   dc_job->num_segments, dc_job->size,
+                                   ptr, bound);
+   if (compressed_size == 0) {
+      free(item);
+      return NULL;
+   }
+
+   *item_size = header_size + compressed_size;
+   return item;
+}
+
 static void
 cache_put(void *job, int thread_index)
 {
@@ -841,8 +902,20 @@ cache_put(void *job, int thread_index)
    int fd = -1, fd_final = -1, err, ret;
    unsigned i = 0;
    char *filename = NULL, *filename_tmp = NULL;
+   uint8_t *item = NULL;
+   size_t item_size;
    struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *) job;
 
+   if (dc_job->cache->pack) {
+      /* The pack does its own locking and eviction. */
+      item = create_cache_item(dc_job, &item_size);
+      if (item)
+         disk_cache_pack_put(dc_job->cache->pack, dc_job->key,
+                             item, item_size);
+      free(item);
+      return;
+   }
+
    filename = get_cache_file(dc_job->cache, dc_job->key);
    if (filename == NULL)
       goto done;
@@ -900,56 +973,8 @@ cache_put(void *job, int thread_index)
     * not in the cache, and is also not being written out to the cache
     * by some other process.
     */
-
-   /* Write the driver_keys_blob, this can be used find information about the
-    * mesa version that produced the entry or deal with hash collisions,
-    * should that ever become a real problem.
-    */
-   ret = write_all(fd, dc_job->cache->driver_keys_blob,
-                   dc_job->cache->driver_keys_blob_size);
-   if (ret == -1) {
-      unlink(filename_tmp);
-      goto done;
-   }
-
-   /* Write the cache item metadata. This data can be used to deal with
-    * hash collisions, as well as providing useful information to 3rd party
-    * tools reading the cache files.
-    */
-   ret = write_all(fd, &dc_job->cache_item_metadata.type,
-                   sizeof(uint32_t));
-   if (ret == -1) {
-      unlink(filename_tmp);
-      goto done;
-   }
-
-   if (dc_job->cache_item_metadata.type == CACHE_ITEM_TYPE_GLSL) {
-      ret = write_all(fd, &dc_job->cache_item_metadata.num_keys,
-                      sizeof(uint32_t));
-      if (ret == -1) {
-         unlink(filename_tmp);
-         goto done;
-      }
-
-      ret = write_all(fd, dc_job->cache_item_metadata.keys[0],
-                      dc_job->cache_item_metadata.num_keys *
-                      sizeof(cache_key));
-      if (ret == -1) {
-         unlink(filename_tmp);
-         goto done;
-      }
-   }
-
-   /* Create CRC of the data. We will read this when restoring the cache and
-    * use it to check for corruption.
-    */
-   struct cache_entry_file_data cf_data;
-   cf_data.crc32 = util_hash_crc32(dc_job->data, dc_job->size);
-   cf_data.uncompressed_size = dc_job->size;
-
-   size_t cf_data_size = sizeof(cf_data);
-   ret = write_all(fd, &cf_data, cf_data_size);
-   if (ret == -1) {
+   item = create_cache_item(dc_job, &item_size);
+   if (item == NULL) {
       unlink(filename_tmp);
       goto done;
    }
@@ -958,9 +983,8 @@ cache_put(void *job, int thread_index)
     * rename them atomically to the destination filename, and also
     * perform an atomic increment of the total cache size.
     */
-   size_t file_size = deflate_and_write_to_disk(dc_job->data, dc_job->size,
-                                                fd, filename_tmp);
-   if (file_size == 0) {
+   ret = write_all(fd, item, item_size);
+   if (ret == -1) {
       unlink(filename_tmp);
       goto done;
    }
@@ -987,6 +1011,7 @@ cache_put(void *job, int thread_index)
     */
    if (fd != -1)
       close(fd);
+   free(item);
    free(filename_tmp);
    free(filename);
 }
@@ -996,8 +1021,9 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
                const void *data, size_t size,
                struct cache_item_metadata *cache_item_metadata)
 {
+   struct disk_cache_segment segment = { data, size };
    struct disk_cache_put_job *dc_job =
-      create_put_job(cache, key, data, size, cache_item_metadata);
+      create_put_job(cache, key, &segment, 1, true, cache_item_metadata);
 
    if (dc_job) {
       util_queue_fence_init(&dc_job->fence);
@@ -1006,103 +1032,66 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
    }
 }
 
-/**
- * Decompresses cache entry, returns true if successful.
- */
-static bool
-inflate_cache_data(uint8_t *in_data, size_t in_data_size,
-                   uint8_t *out_data, size_t out_data_size)
+void
+disk_cache_put_segments(struct disk_cache *cache, const cache_key key,
+                        const struct disk_cache_segment *segments,
+                        unsigned num_segments,
+                        void (*release)(void *release_data),
+                        void *release_data,
+                        struct cache_item_metadata *cache_item_metadata)
 {
-   z_stream strm;
-
-   /* allocate inflate state */
-   strm.zalloc = Z_NULL;
-   strm.zfree = Z_NULL;
-   strm.opaque = Z_NULL;
-   strm.next_in = in_data;
-   strm.avail_in = in_data_size;
-   strm.next_out = out_data;
-   strm.avail_out = out_data_size;
-
-   int ret = inflateInit(&strm);
-   if (ret != Z_OK)
-      return false;
-
-   ret = inflate(&strm, Z_NO_FLUSH);
-   assert(ret != Z_STREAM_ERROR);  /* state not clobbered */
+   struct disk_cache_put_job *dc_job =
+      create_put_job(cache, key, segments, num_segments, false,
+                     cache_item_metadata);
 
-   /* Unless there was an error we should have decompressed everything in one
-    * go as we know the uncompressed file size.
-    */
-   if (ret != Z_STREAM_END) {
-      (void)inflateEnd(&strm);
-      return false;
+   if (!dc_job) {
+      release(release_data);
+      return;
    }
-   assert(strm.avail_out == 0);
 
-   /* clean up and return */
-   (void)inflateEnd(&strm);
-   return true;
+   dc_job->release = release;
+   dc_job->release_data = release_data;
+
+   util_queue_fence_init(&dc_job->fence);
+   util_queue_add_job(&cache->cache_queue, dc_job, &dc_job->fence,
+                      cache_put, destroy_put_job);
 }
 
-void *
-disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+/**
+ * Checks and decompresses a serialized cache entry (see create_cache_item).
+ * Returns the malloc'ed uncompressed data, or NULL on any error.
+ */
+static void *
+parse_cache_item(struct disk_cache *cache, const uint8_t *item,
+                 size_t item_size, size_t *size)
 {
-   int fd = -1, ret;
-   struct stat sb;
-   char *filename = NULL;
-   uint8_t *data = NULL;
+   const uint8_t *ptr = item;
+   const uint8_t *end = item + item_size;
    uint8_t *uncompressed_data = NULL;
-   uint8_t *file_header = NULL;
-
-   if (size)
-      *size = 0;
-
-   filename = get_cache_file(cache, key);
-   if (filename == NULL)
-      goto fail;
-
-   fd = open(filename, O_RDONLY | O_CLOEXEC);
-   if (fd == -1)
-      goto fail;
-
-   if (fstat(fd, &sb) == -1)
-      goto fail;
-
-   data = malloc(sb.st_size);
-   if (data == NULL)
-      goto fail;
 
    size_t ck_size = cache->driver_keys_blob_size;
-   file_header = malloc(ck_size);
-   if (!file_header)
-      goto fail;
-
-   if (sb.st_size < ck_size)
-      goto fail;
-
-   ret = read_all(fd, file_header, ck_size);
-   if (ret == -1)
-      goto fail;
+   if (item_size < ck_size)
+      return NULL;
 
    /* Check for extremely unlikely hash collisions */
-   if (memcmp(cache->driver_keys_blob, file_header, ck_size) != 0) {
+   if (memcmp(cache->driver_keys_blob, ptr, ck_size) != 0) {
       assert(!"Mesa cache keys mismatch!");
-      goto fail;
+      return NULL;
    }
+   ptr += ck_size;
 
-   size_t cache_item_md_size = sizeof(uint32_t);
    uint32_t md_type;
-   ret = read_all(fd, &md_type, cache_item_md_size);
-   if (ret == -1)
-      goto fail;
+   if (end - ptr < sizeof(md_type))
+      return NULL;
+   memcpy(&md_type, ptr, sizeof(md_type));
+   ptr += sizeof(md_type);
 
    if (md_type == CACHE_ITEM_TYPE_GLSL) {
       uint32_t num_keys;
-      cache_item_md_size += sizeof(uint32_t);
-      ret = read_all(fd, &num_keys, sizeof(uint32_t));
-      if (ret == -1)
-         goto fail;
+      if (end - ptr < sizeof(num_keys))
+         return NULL;
+      memcpy(&num_keys, ptr, sizeof(num_keys));
+      ptr += sizeof(num_keys);
 
       /* The cache item metadata is currently just used for distributing
        * precompiled shaders, they are not used by Mesa so just skip them for
@@ -1110,30 +1099,32 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
        * TODO: pass the metadata back to the caller and do some basic
        * validation.
        */
-      cache_item_md_size += num_keys * sizeof(cache_key);
-      ret = lseek(fd, num_keys * sizeof(cache_key), SEEK_CUR);
-      if (ret == -1)
-         goto fail;
+      if (end - ptr < num_keys * sizeof(cache_key))
+         return NULL;
+      ptr += num_keys * sizeof(cache_key);
    }
 
    /* Load the CRC that was created when the file was written. */
    struct cache_entry_file_data cf_data;
-   size_t cf_data_size = sizeof(cf_data);
-   ret = read_all(fd, &cf_data, cf_data_size);
-   if (ret == -1)
-      goto fail;
+   if (end - ptr < sizeof(cf_data))
+      return NULL;
+   memcpy(&cf_data, ptr, sizeof(cf_data));
+   ptr += sizeof(cf_data);
 
-   /* Load the actual cache data. */
-   size_t cache_data_size =
-      sb.st_size - cf_data_size - ck_size - cache_item_md_size;
-   ret = read_all(fd, data, cache_data_size);
-   if (ret == -1)
-      goto fail;
+   if (ptr == end)
+      return NULL;
+
+   size_t tag_size;
+   enum disk_cache_codec codec = disk_cache_codec_detect(ptr, &tag_size);
+   ptr += tag_size;
 
    /* Uncompress the cache data */
    uncompressed_data = malloc(cf_data.uncompressed_size);
-   if (!inflate_cache_data(data, cache_data_size, uncompressed_data,
-                           cf_data.uncompressed_size))
+   if (!uncompressed_data)
+      return NULL;
+
+   if (!disk_cache_decompress(codec, ptr, end - ptr, uncompressed_data,
+                              cf_data.uncompressed_size))
       goto fail;
 
    /* Check the data for corruption */
@@ -1141,29 +1132,143 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
                                         cf_data.uncompressed_size))
       goto fail;
 
-   free(data);
-   free(filename);
-   free(file_header);
-   close(fd);
-
    if (size)
       *size = cf_data.uncompressed_size;
 
    return uncompressed_data;
 
  fail:
-   if (data)
+   free(uncompressed_data);
+   return NULL;
+}
+
+void *
+disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   int fd = -1;
+   struct stat sb;
+   char *filename = NULL;
+   uint8_t *data = NULL;
+   size_t data_size = 0;
+   bool mapped = false;
+   void *uncompressed_data = NULL;
+
+   if (size)
+      *size = 0;
+
+   if (cache->pack) {
+      data = disk_cache_pack_get(cache->pack, key, &data_size);
+      if (data == NULL)
+         return NULL;
+   } else {
+      filename = get_cache_file(cache, key);
+      if (filename == NULL)
+         goto fail;
+
+      fd = open(filename, O_RDONLY | O_CLOEXEC);
+      if (fd == -1)
+         goto fail;
+
+      if (fstat(fd, &sb) == -1)
+         goto fail;
+
+      /* Decompress straight out of the page cache rather than reading the
+       * file into a buffer first. Files are renamed into place once fully
+       * written and never modified afterwards, so the mapping stays valid.
+       */
+      data_size = sb.st_size;
+      if (data_size == 0)
+         goto fail;
+
+      data = mmap(NULL, data_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+         data = NULL;
+         goto fail;
+      }
+      mapped = true;
+   }
+
+   uncompressed_data = parse_cache_item(cache, data, data_size, size);
+
+ fail:
+   if (mapped)
+      munmap(data, data_size);
+   else if (data)
       free(data);
-   if (uncompressed_data)
-      free(uncompressed_data);
    if (filename)
       free(filename);
-   if (file_header)
-      free(file_header);
    if (fd != -1)
       close(fd);
 
-   return NULL;
+   return uncompressed_data;
+}
+
+static bool
+start_get_queue(struct disk_cache *cache)
+{
+   bool ok = true;
+
+   mtx_lock(&cache->get_queue_mutex);
+   if (!util_queue_is_initialized(&cache->get_queue)) {
+      /* Lookups are mostly spent in read() and inflating, so a few threads
+       * are enough to keep the disk busy. Batches come in bursts at program
+       * start-up, so only keep the extra threads around while busy.
+       */
+      long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+      unsigned num_threads = CLAMP(num_cpus, 1, 4);
+
+      ok = util_queue_init(&cache->get_queue, "disk_cache_get", 32,
+                           num_threads,
+                           UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                           UTIL_QUEUE_INIT_SCALE_THREADS);
+   }
+   mtx_unlock(&cache->get_queue_mutex);
+
+   return ok;
+}
+
+static void
+cache_get(void *job, int thread_index)
+{
+   struct disk_cache_get_request *request = job;
+
+   request->data = disk_cache_get(request->cache, request->key,
+                                  &request->size);
+}
+
+void
+disk_cache_get_batch(struct disk_cache *cache,
+                     struct disk_cache_get_request *requests, unsigned count)
+{
+   bool async = start_get_queue(cache);
+
+   for (unsigned i = 0; i < count; i++) {
+      struct disk_cache_get_request *request = &requests[i];
+
+      request->cache = cache;
+      request->data = NULL;
+      request->size = 0;
+      util_queue_fence_init(&request->fence);
+
+      if (async) {
+         util_queue_add_job(&cache->get_queue, request, &request->fence,
+                            cache_get, NULL);
+      } else {
+         cache_get(request, 0);
+      }
+   }
+}
+
+void *
+disk_cache_get_finish(struct disk_cache_get_request *request, size_t *size)
+{
+   util_queue_fence_wait(&request->fence);
+   util_queue_fence_destroy(&request->fence);
+
+   if (size)
+      *size = request->size;
+
+   return request->data;
 }
 
 void
@@ -32,6 +32,8 @@
 #include <stdbool.h>
 #include <sys/stat.h>
 
+#include "util/u_queue.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -65,6 +67,28 @@ struct cache_item_metadata {
 
 struct disk_cache;
 
+/**
+ * One piece of an item stored with disk_cache_put_segments().
+ */
+struct disk_cache_segment {
+   const void *data;
+   size_t size;
+};
+
+/**
+ * An item looked up by disk_cache_get_batch().
+ */
+struct disk_cache_get_request {
+   /** Set by the caller. */
+   cache_key key;
+
+   /** Private to disk_cache, use disk_cache_get_finish() to get the item. */
+   struct disk_cache *cache;
+   void *data;
+   size_t size;
+   struct util_queue_fence fence;
+};
+
 static inline char *
 disk_cache_format_hex_id(char *buf, const uint8_t *hex_id, unsigned size)
 {
@@ -159,6 +183,23 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
                const void *data, size_t size,
                struct cache_item_metadata *cache_item_metadata);
 
+/**
+ * Store an item made of \p num_segments pieces of data in the cache, like
+ * disk_cache_put() does with the concatenation of the pieces.
+ *
+ * Unlike disk_cache_put(), the data isn't copied: the cache keeps using the
+ * segments after this returns, and calls \p release with \p release_data
+ * once it is done with them (which may be before this returns, e.g. on
+ * failure). \p segments itself is copied.
+ */
+void
+disk_cache_put_segments(struct disk_cache *cache, const cache_key key,
+                        const struct disk_cache_segment *segments,
+                        unsigned num_segments,
+                        void (*release)(void *release_data),
+                        void *release_data,
+                        struct cache_item_metadata *cache_item_metadata);
+
 /**
  * Retrieve an item previously stored in the cache with the name <key>.
  *
@@ -175,6 +216,27 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
 void *
 disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size);
 
+/**
+ * Start retrieving the items named by the keys of \p requests.
+ *
+ * The items are read and decompressed in parallel on the cache's worker
+ * threads, so callers which know several keys ahead of time don't have to
+ * wait for each one in turn. Every request must be completed with
+ * disk_cache_get_finish() before it is freed, and before the cache is
+ * destroyed.
+ */
+void
+disk_cache_get_batch(struct disk_cache *cache,
+                     struct disk_cache_get_request *requests, unsigned count);
+
+/**
+ * Wait for a request started by disk_cache_get_batch() to complete.
+ *
+ * \return The same as disk_cache_get() for the key of \p request.
+ */
+void *
+disk_cache_get_finish(struct disk_cache_get_request *request, size_t *size);
+
 /**
  * Store the name \key within the cache, (without any associated data).
  *
@@ -229,6 +291,17 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
    return;
 }
 
+static inline void
+disk_cache_put_segments(struct disk_cache *cache, const cache_key key,
+                        const struct disk_cache_segment *segments,
+                        unsigned num_segments,
+                        void (*release)(void *release_data),
+                        void *release_data,
+                        struct cache_item_metadata *cache_item_metadata)
+{
+   release(release_data);
+}
+
 static inline void
 disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
@@ -241,6 +314,19 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    return NULL;
 }
 
+static inline void
+disk_cache_get_batch(struct disk_cache *cache,
+                     struct disk_cache_get_request *requests, unsigned count)
+{
+   return;
+}
+
+static inline void *
+disk_cache_get_finish(struct disk_cache_get_request *request, size_t *size)
+{
+   return NULL;
+}
+
 static inline void
 disk_cache_put_key(struct disk_cache *cache, const cache_key key)
 {
@@ -0,0 +1,294 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zlib.h"
+
+#ifdef HAVE_ZSTD
+#include "zstd.h"
+#endif
+
+#include "disk_cache.h"
+#include "disk_cache_codec.h"
+
+/* Cache entries are compressed once on a background thread but
+ * decompressed on every hit, and the decompression speed of zstd hardly
+ * depends on the level, so trade some compression time for size.
+ */
+#define ZSTD_COMPRESSION_LEVEL 3
+
+static size_t
+zlib_bound(size_t size)
+{
+   return compressBound(size);
+}
+
+static size_t
+zlib_compress(const struct disk_cache_segment *segments,
+              unsigned num_segments, size_t in_data_size,
+              void *out_data, size_t out_data_size)
+{
+   /* allocate deflate state */
+   z_stream strm;
+   strm.zalloc = Z_NULL;
+   strm.zfree = Z_NULL;
+   strm.opaque = Z_NULL;
+   strm.next_out = out_data;
+   strm.avail_out = out_data_size;
+
+   int ret = deflateInit(&strm, Z_BEST_COMPRESSION);
+   if (ret != Z_OK)
+       return 0;
+
+   /* The output buffer is sized with compressBound(), so each segment gets
+    * consumed in one go.
+    */
+   for (unsigned i = 0; i < num_segments; i++) {
+      strm.next_in = (uint8_t *) segments[i].data;
+      strm.avail_in = segments[i].size;
+
+      ret = deflate(&strm, i + 1 < num_segments ? Z_NO_FLUSH : Z_FINISH);
+      assert(ret != Z_STREAM_ERROR);  /* state not clobbered */
+      if (strm.avail_in)
+         break;
+   }
+
+   size_t compressed_size = out_data_size - strm.avail_out;
+
+   /* clean up and return */
+   (void)deflateEnd(&strm);
+   return ret == Z_STREAM_END ? compressed_size : 0;
+}
+
+static bool
+zlib_decompress(const void *in_data, size_t in_data_size,
+                void *out_data, size_t out_data_size)
+{
+   z_stream strm;
+
+   /* allocate inflate state */
+   strm.zalloc = Z_NULL;
+   strm.zfree = Z_NULL;
+   strm.opaque = Z_NULL;
+   strm.next_in = (uint8_t *) in_data;
+   strm.avail_in = in_data_size;
+   strm.next_out = out_data;
+   strm.avail_out = out_data_size;
+
+   int ret = inflateInit(&strm);
+   if (ret != Z_OK)
+      return false;
+
+   ret = inflate(&strm, Z_NO_FLUSH);
+   assert(ret != Z_STREAM_ERROR);  /* state not clobbered */
+
+   /* Unless there was an error we should have decompressed everything in one
+    * go as we know the uncompressed file size.
+    */
+   if (ret != Z_STREAM_END) {
+      (void)inflateEnd(&strm);
+      return false;
+   }
+   assert(strm.avail_out == 0);
+
+   /* clean up and return */
+   (void)inflateEnd(&strm);
+   return true;
+}
+
+#ifdef HAVE_ZSTD
+static size_t
+zstd_bound(size_t size)
+{
+   return ZSTD_compressBound(size);
+}
+
+static size_t
+zstd_compress(const struct disk_cache_segment *segments,
+              unsigned num_segments, size_t in_data_size,
+              void *out_data, size_t out_data_size)
+{
+   ZSTD_outBuffer out = { out_data, out_data_size, 0 };
+   ZSTD_CStream *stream;
+   size_t ret;
+
+   if (num_segments == 1) {
+      ret = ZSTD_compress(out_data, out_data_size,
+                          segments[0].data, segments[0].size,
+                          ZSTD_COMPRESSION_LEVEL);
+      return ZSTD_isError(ret) ? 0 : ret;
+   }
+
+   stream = ZSTD_createCStream();
+   if (!stream)
+      return 0;
+
+   ret = ZSTD_initCStream(stream, ZSTD_COMPRESSION_LEVEL);
+   if (ZSTD_isError(ret))
+      goto fail;
+
+   for (unsigned i = 0; i < num_segments; i++) {
+      ZSTD_inBuffer in = { segments[i].data, segments[i].size, 0 };
+
+      while (in.pos < in.size) {
+         ret = ZSTD_compressStream(stream, &out, &in);
+         if (ZSTD_isError(ret) || out.pos == out.size)
+            goto fail;
+      }
+   }
+
+   /* Returns how much is left to flush, or 0 once done. */
+   do {
+      ret = ZSTD_endStream(stream, &out);
+   } while (ret && !ZSTD_isError(ret) && out.pos < out.size);
+   if (ret)
+      goto fail;
+
+   ZSTD_freeCStream(stream);
+   return out.pos;
+
+fail:
+   ZSTD_freeCStream(stream);
+   return 0;
+}
+
+static bool
+zstd_decompress(const void *in_data, size_t in_data_size,
+                void *out_data, size_t out_data_size)
+{
+   size_t ret = ZSTD_decompress(out_data, out_data_size,
+                                in_data, in_data_size);
+   return !ZSTD_isError(ret) && ret == out_data_size;
+}
+#endif
+
+static const struct {
+   const char *name;
+   size_t (*bound)(size_t size);
+   size_t (*compress)(const struct disk_cache_segment *segments,
+                      unsigned num_segments, size_t in_data_size,
+                      void *out_data, size_t out_data_size);
+   bool (*decompress)(const void *in_data, size_t in_data_size,
+                      void *out_data, size_t out_data_size);
+} codecs[DISK_CACHE_CODEC_COUNT] = {
+   [DISK_CACHE_CODEC_ZLIB] = {
+      "zlib", zlib_bound, zlib_compress, zlib_decompress
+   },
+#ifdef HAVE_ZSTD
+   [DISK_CACHE_CODEC_ZSTD] = {
+      "zstd", zstd_bound, zstd_compress, zstd_decompress
+   },
+#else
+   [DISK_CACHE_CODEC_ZSTD] = { "zstd" },
+#endif
+};
+
+bool
+disk_cache_codec_supported(enum disk_cache_codec codec)
+{
+   return codec < DISK_CACHE_CODEC_COUNT && codecs[codec].compress;
+}
+
+const char *
+disk_cache_codec_name(enum disk_cache_codec codec)
+{
+   return codec < DISK_CACHE_CODEC_COUNT ? codecs[codec].name : "unknown";
+}
+
+enum disk_cache_codec
+disk_cache_codec_default(void)
+{
+   const char *name = getenv("MESA_GLSL_CACHE_CODEC");
+
+   if (name) {
+      for (unsigned i = 0; i < DISK_CACHE_CODEC_COUNT; i++) {
+         if (strcmp(name, codecs[i].name) == 0 &&
+             disk_cache_codec_supported(i))
+            return i;
+      }
+   }
+
+#ifdef HAVE_ZSTD
+   return DISK_CACHE_CODEC_ZSTD;
+#else
+   return DISK_CACHE_CODEC_ZLIB;
+#endif
+}
+
+enum disk_cache_codec
+disk_cache_codec_detect(const uint8_t *data, size_t *tag_size)
+{
+   /* Untagged, zlib compressed data from before there were codecs. */
+   if ((data[0] & 0xf) == Z_DEFLATED) {
+      *tag_size = 0;
+      return DISK_CACHE_CODEC_ZLIB;
+   }
+
+   *tag_size = 1;
+   return data[0];
+}
+
+size_t
+disk_cache_codec_bound(enum disk_cache_codec codec, size_t size)
+{
+   assert(disk_cache_codec_supported(codec));
+   return codecs[codec].bound(size);
+}
+
+size_t
+disk_cache_compress(enum disk_cache_codec codec,
+                    const void *in_data, size_t in_data_size,
+                    void *out_data, size_t out_data_size)
+{
+   struct disk_cache_segment segment = { in_data, in_data_size };
+
+   return disk_cache_compress_segments(codec, &segment, 1, in_data_size,
+                                       out_data, out_data_size);
+}
+
+size_t
+disk_cache_compress_segments(enum disk_cache_codec codec,
+                             const struct disk_cache_segment *segments,
+                             unsigned num_segments, size_t in_data_size,
+                             void *out_data, size_t out_data_size)
+{
+   if (!disk_cache_codec_supported(codec))
+      return 0;
+
+   return codecs[codec].compress(segments, num_segments, in_data_size,
+                                 out_data, out_data_size);
+}
+
+bool
+disk_cache_decompress(enum disk_cache_codec codec,
+                      const void *in_data, size_t in_data_size,
+                      void *out_data, size_t out_data_size)
+{
+   if (!disk_cache_codec_supported(codec))
+      return false;
+
+   return codecs[codec].decompress(in_data, in_data_size,
+                                   out_data, out_data_size);
+}
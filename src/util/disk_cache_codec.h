@@ -0,0 +1,119 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Compression codecs for disk_cache entries.
+ *
+ * Every entry records the codec it was compressed with, so the default
+ * codec can change without invalidating existing caches. zlib is always
+ * available, zstd only if Mesa was built with it.
+ */
+
+#ifndef DISK_CACHE_CODEC_H
+#define DISK_CACHE_CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct disk_cache_segment;
+
+/* WARNING: these values are stored on disk, only ever append new ones.
+ *
+ * Each value is also the tag byte written in front of the compressed data.
+ * Entries written before codecs were tagged start directly with a zlib
+ * stream, whose first byte always has the deflate method (8) in its low
+ * nibble, so tags must never have that.
+ */
+enum disk_cache_codec {
+   DISK_CACHE_CODEC_ZLIB = 0,
+   DISK_CACHE_CODEC_ZSTD = 1,
+   DISK_CACHE_CODEC_COUNT
+};
+
+/**
+ * Returns whether \p codec was enabled at build time.
+ */
+bool
+disk_cache_codec_supported(enum disk_cache_codec codec);
+
+const char *
+disk_cache_codec_name(enum disk_cache_codec codec);
+
+/**
+ * Returns the codec for new entries: the one named by MESA_GLSL_CACHE_CODEC
+ * if set and supported, otherwise the fastest supported one.
+ */
+enum disk_cache_codec
+disk_cache_codec_default(void);
+
+/**
+ * Returns the codec of the tagged compressed data at \p data, and in
+ * \p tag_size the number of bytes to skip to get to the compressed data.
+ */
+enum disk_cache_codec
+disk_cache_codec_detect(const uint8_t *data, size_t *tag_size);
+
+/**
+ * Returns the maximum compressed size of \p size bytes of input.
+ */
+size_t
+disk_cache_codec_bound(enum disk_cache_codec codec, size_t size);
+
+/**
+ * Compresses \p in_data into \p out_data, which must be at least
+ * disk_cache_codec_bound() bytes. Returns the compressed size, or 0 on any
+ * error.
+ */
+size_t
+disk_cache_compress(enum disk_cache_codec codec,
+                    const void *in_data, size_t in_data_size,
+                    void *out_data, size_t out_data_size);
+
+/**
+ * Same as disk_cache_compress(), but compresses the concatenation of
+ * \p num_segments pieces of data, whose total size is \p in_data_size.
+ */
+size_t
+disk_cache_compress_segments(enum disk_cache_codec codec,
+                             const struct disk_cache_segment *segments,
+                             unsigned num_segments, size_t in_data_size,
+                             void *out_data, size_t out_data_size);
+
+/**
+ * Decompresses \p in_data, which must decompress to exactly
+ * \p out_data_size bytes.
+ */
+bool
+disk_cache_decompress(enum disk_cache_codec codec,
+                      const void *in_data, size_t in_data_size,
+                      void *out_data, size_t out_data_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DISK_CACHE_CODEC_H */
@@ -0,0 +1,842 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifdef ENABLE_SHADER_CACHE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "c11/threads.h"
+#include "util/hash_table.h"
+#include "util/macros.h"
+#include "util/rand_xor.h"
+#include "util/ralloc.h"
+
+#include "disk_cache_pack.h"
+
+/* Bump whenever the layout of the pack or index files changes. Files with
+ * another version are discarded.
+ */
+#define PACK_VERSION 1
+
+/* Don't bother compacting away removed entries below this many bytes. */
+#define PACK_MIN_GARBAGE (1024 * 1024)
+
+/* Access times are only written back to the index when they moved by more
+ * than this (in microseconds), so hot entries don't keep dirtying pages.
+ */
+#define PACK_ACCESS_GRANULARITY 1000000
+
+#define PACK_ALIGN(x) (((x) + 7) & ~(uint64_t)7)
+
+static const char pack_magic[8] = { 'M', 'E', 'S', 'A', 'P', 'A', 'C', 'K' };
+static const char index_magic[8] = { 'M', 'E', 'S', 'A', 'P', 'I', 'D', 'X' };
+
+/* Header at the start of both the pack and the index file. */
+struct pack_file_header {
+   char magic[8];
+   uint32_t version;
+   /* Size of struct pack_record_header or pack_index_entry respectively. */
+   uint32_t item_size;
+   /* Random id shared by a pack and its index, changes on every rewrite. */
+   uint64_t uuid;
+};
+
+/* Header in front of each entry in the pack file. Entries are padded to a
+ * multiple of 8 bytes.
+ */
+struct pack_record_header {
+   uint8_t key[CACHE_KEY_SIZE];
+   uint32_t size;
+};
+
+/* Entry of the index file. Index entries are only ever appended, a removed
+ * key is recorded as a new entry with size 0.
+ */
+struct pack_index_entry {
+   uint8_t key[CACHE_KEY_SIZE];
+   uint32_t size;
+   uint64_t offset;
+   /* Microseconds since the epoch */
+   uint64_t last_access;
+};
+
+/* In-memory copy of the live index entries. */
+struct pack_entry {
+   cache_key key;
+   uint32_t size;
+   uint32_t slot;
+   uint64_t offset;
+   uint64_t last_access;
+};
+
+struct disk_cache_pack {
+   char *pack_path;
+   char *index_path;
+   char *lock_path;
+
+   /* Maximum size of all records in the pack (in bytes). */
+   uint64_t max_size;
+
+   /* Protects everything below against concurrent gets and puts. */
+   mtx_t mutex;
+
+   /* flock'ed by writers, the pack and index get replaced on compaction so
+    * they can't be used for locking themselves.
+    */
+   int lock_fd;
+
+   int pack_fd;
+   int index_fd;
+   ino_t index_ino;
+   dev_t index_dev;
+
+   uint8_t *pack_map;
+   size_t pack_map_size;
+   uint8_t *index_map;
+   size_t index_map_size;
+
+   /* Number of index file entries loaded into the hash table. */
+   uint32_t num_slots;
+
+   /* cache_key -> struct pack_entry, allocated out of entries_ctx. */
+   struct hash_table *entries;
+   void *entries_ctx;
+
+   /* Sum of the record sizes of all live entries. */
+   uint64_t live_size;
+
+   uint64_t seed_xorshift128plus[2];
+};
+
+static uint32_t
+key_hash(const void *key)
+{
+   uint32_t hash;
+
+   /* Keys are SHA-1 digests, any part of them is a fine hash. */
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+static bool
+key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, CACHE_KEY_SIZE) == 0;
+}
+
+static uint64_t
+pack_now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_REALTIME, &ts);
+   return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t
+record_size(uint32_t size)
+{
+   return PACK_ALIGN(sizeof(struct pack_record_header) + size);
+}
+
+static size_t
+slot_offset(uint32_t slot)
+{
+   return sizeof(struct pack_file_header) +
+          (size_t)slot * sizeof(struct pack_index_entry);
+}
+
+static ssize_t
+pwrite_all(int fd, const void *buf, size_t count, off_t offset)
+{
+   const char *out = buf;
+   ssize_t written;
+   size_t done;
+
+   for (done = 0; done < count; done += written) {
+      written = pwrite(fd, out + done, count - done, offset + done);
+      if (written == -1)
+         return -1;
+   }
+   return done;
+}
+
+/* Map the first \p size bytes of \p fd, replacing the mapping in \p map. */
+static bool
+remap(int fd, size_t size, int prot, uint8_t **map, size_t *map_size)
+{
+   if (*map)
+      munmap(*map, *map_size);
+
+   *map = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+   if (*map == MAP_FAILED) {
+      *map = NULL;
+      *map_size = 0;
+      return false;
+   }
+
+   *map_size = size;
+   return true;
+}
+
+static void
+reset_entries(struct disk_cache_pack *pack)
+{
+   if (pack->entries)
+      _mesa_hash_table_clear(pack->entries, NULL);
+   ralloc_free(pack->entries_ctx);
+   pack->entries_ctx = ralloc_context(pack);
+   pack->num_slots = 0;
+   pack->live_size = 0;
+}
+
+static void
+close_files(struct disk_cache_pack *pack)
+{
+   if (pack->pack_map)
+      munmap(pack->pack_map, pack->pack_map_size);
+   if (pack->index_map)
+      munmap(pack->index_map, pack->index_map_size);
+   if (pack->pack_fd != -1)
+      close(pack->pack_fd);
+   if (pack->index_fd != -1)
+      close(pack->index_fd);
+
+   pack->pack_map = NULL;
+   pack->pack_map_size = 0;
+   pack->index_map = NULL;
+   pack->index_map_size = 0;
+   pack->pack_fd = -1;
+   pack->index_fd = -1;
+
+   reset_entries(pack);
+}
+
+static bool
+read_header(int fd, const char *magic, uint32_t item_size, uint64_t *uuid)
+{
+   struct pack_file_header header;
+
+   if (pread(fd, &header, sizeof(header), 0) != sizeof(header))
+      return false;
+
+   if (memcmp(header.magic, magic, sizeof(header.magic)) != 0 ||
+       header.version != PACK_VERSION ||
+       header.item_size != item_size)
+      return false;
+
+   *uuid = header.uuid;
+   return true;
+}
+
+/* Load the index entries appended since the last call into the hash table.
+ * A partially written entry at the end of the file is ignored.
+ */
+static bool
+load_index(struct disk_cache_pack *pack, size_t file_size)
+{
+   uint32_t num_slots, slot;
+
+   if (file_size < slot_offset(0))
+      return false;
+
+   num_slots = (file_size - slot_offset(0)) / sizeof(struct pack_index_entry);
+   if (num_slots <= pack->num_slots)
+      return true;
+
+   if (slot_offset(num_slots) > pack->index_map_size &&
+       !remap(pack->index_fd, slot_offset(num_slots), PROT_READ | PROT_WRITE,
+              &pack->index_map, &pack->index_map_size))
+      return false;
+
+   for (slot = pack->num_slots; slot < num_slots; slot++) {
+      const struct pack_index_entry *ie = (const struct pack_index_entry *)
+         (pack->index_map + slot_offset(slot));
+      struct hash_entry *he = _mesa_hash_table_search(pack->entries, ie->key);
+      struct pack_entry *entry = he ? he->data : NULL;
+
+      if (entry) {
+         pack->live_size -= record_size(entry->size);
+
+         if (ie->size == 0) {
+            _mesa_hash_table_remove(pack->entries, he);
+            ralloc_free(entry);
+            continue;
+         }
+      } else {
+         if (ie->size == 0)
+            continue;
+
+         entry = ralloc(pack->entries_ctx, struct pack_entry);
+         if (!entry)
+            return false;
+
+         memcpy(entry->key, ie->key, CACHE_KEY_SIZE);
+         _mesa_hash_table_insert(pack->entries, entry->key, entry);
+      }
+
+      entry->size = ie->size;
+      entry->slot = slot;
+      entry->offset = ie->offset;
+      entry->last_access = ie->last_access;
+      pack->live_size += record_size(entry->size);
+   }
+
+   pack->num_slots = num_slots;
+   return true;
+}
+
+/* Open the current pack/index pair. The caller must hold at least a shared
+ * lock so the pair can't be replaced while we look at it.
+ */
+static bool
+open_files(struct disk_cache_pack *pack)
+{
+   uint64_t pack_uuid, index_uuid;
+   struct stat sb;
+
+   close_files(pack);
+
+   pack->pack_fd = open(pack->pack_path, O_RDWR | O_CLOEXEC);
+   pack->index_fd = open(pack->index_path, O_RDWR | O_CLOEXEC);
+   if (pack->pack_fd == -1 || pack->index_fd == -1)
+      goto fail;
+
+   if (!read_header(pack->pack_fd, pack_magic,
+                    sizeof(struct pack_record_header), &pack_uuid) ||
+       !read_header(pack->index_fd, index_magic,
+                    sizeof(struct pack_index_entry), &index_uuid) ||
+       pack_uuid != index_uuid)
+      goto fail;
+
+   if (fstat(pack->index_fd, &sb) == -1)
+      goto fail;
+
+   pack->index_ino = sb.st_ino;
+   pack->index_dev = sb.st_dev;
+
+   if (!load_index(pack, sb.st_size))
+      goto fail;
+
+   return true;
+
+ fail:
+   close_files(pack);
+   return false;
+}
+
+/* Write a new pack/index pair holding \p entries (in that order) and make
+ * it the current one. The caller must hold the exclusive lock.
+ */
+static bool
+write_generation(struct disk_cache_pack *pack,
+                 struct pack_entry **entries, unsigned num_entries)
+{
+   struct pack_file_header header;
+   char *pack_tmp, *index_tmp;
+   int pack_fd = -1, index_fd = -1;
+   uint64_t pack_offset = sizeof(header);
+   uint64_t now = pack_now();
+   unsigned i;
+   bool ok = false;
+
+   pack_tmp = ralloc_asprintf(NULL, "%s.tmp", pack->pack_path);
+   index_tmp = ralloc_asprintf(pack_tmp, "%s.tmp", pack->index_path);
+   if (!pack_tmp || !index_tmp)
+      goto done;
+
+   pack_fd = open(pack_tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   index_fd = open(index_tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (pack_fd == -1 || index_fd == -1)
+      goto done;
+
+   memset(&header, 0, sizeof(header));
+   header.version = PACK_VERSION;
+   header.uuid = rand_xorshift128plus(pack->seed_xorshift128plus);
+
+   memcpy(header.magic, pack_magic, sizeof(header.magic));
+   header.item_size = sizeof(struct pack_record_header);
+   if (pwrite_all(pack_fd, &header, sizeof(header), 0) == -1)
+      goto done;
+
+   memcpy(header.magic, index_magic, sizeof(header.magic));
+   header.item_size = sizeof(struct pack_index_entry);
+   if (pwrite_all(index_fd, &header, sizeof(header), 0) == -1)
+      goto done;
+
+   for (i = 0; i < num_entries; i++) {
+      const struct pack_entry *entry = entries[i];
+      struct pack_index_entry ie;
+      uint64_t size = record_size(entry->size);
+
+      /* The old pack is mapped up to the end of every loaded entry. */
+      if (pwrite_all(pack_fd, pack->pack_map + entry->offset, size,
+                     pack_offset) == -1)
+         goto done;
+
+      memcpy(ie.key, entry->key, CACHE_KEY_SIZE);
+      ie.size = entry->size;
+      ie.offset = pack_offset;
+      ie.last_access = entry->last_access ? entry->last_access : now;
+      if (pwrite_all(index_fd, &ie, sizeof(ie), slot_offset(i)) == -1)
+         goto done;
+
+      pack_offset += size;
+   }
+
+   /* Readers verify that both headers carry the same uuid, so a reader
+    * opening the files in between the two renames just retries later.
+    */
+   if (rename(pack_tmp, pack->pack_path) == -1)
+      goto done;
+   if (rename(index_tmp, pack->index_path) == -1)
+      goto done;
+
+   ok = true;
+
+ done:
+   if (pack_fd != -1)
+      close(pack_fd);
+   if (index_fd != -1)
+      close(index_fd);
+   if (!ok && pack_tmp) {
+      unlink(pack_tmp);
+      if (index_tmp)
+         unlink(index_tmp);
+   }
+   ralloc_free(pack_tmp);
+
+   return ok && open_files(pack);
+}
+
+/* Make sure the whole of every loaded entry is mapped. */
+static bool
+map_pack(struct disk_cache_pack *pack, uint64_t end)
+{
+   struct stat sb;
+
+   if (end <= pack->pack_map_size)
+      return true;
+
+   if (fstat(pack->pack_fd, &sb) == -1 || sb.st_size < end)
+      return false;
+
+   return remap(pack->pack_fd, sb.st_size, PROT_READ,
+                &pack->pack_map, &pack->pack_map_size);
+}
+
+/* Check that the record an entry points at is really there. */
+static bool
+record_valid(struct disk_cache_pack *pack, const struct pack_entry *entry)
+{
+   const struct pack_record_header *rh;
+
+   if (!map_pack(pack, entry->offset + record_size(entry->size)))
+      return false;
+
+   rh = (const struct pack_record_header *) (pack->pack_map + entry->offset);
+   return memcmp(rh->key, entry->key, CACHE_KEY_SIZE) == 0 &&
+          rh->size == entry->size;
+}
+
+/* Look up \p key, returning NULL unless its record is intact. */
+static struct pack_entry *
+lookup(struct disk_cache_pack *pack, const cache_key key)
+{
+   struct hash_entry *he = _mesa_hash_table_search(pack->entries, key);
+   const struct pack_index_entry *ie;
+   struct pack_entry *entry;
+
+   if (!he)
+      return NULL;
+
+   entry = he->data;
+   if (record_valid(pack, entry))
+      return entry;
+
+   /* Without the lock we may have loaded the index entry while it was
+    * still being written, so take another look at it.
+    */
+   ie = (const struct pack_index_entry *)
+      (pack->index_map + slot_offset(entry->slot));
+   if (ie->size != 0 && memcmp(ie->key, key, CACHE_KEY_SIZE) == 0) {
+      pack->live_size -= record_size(entry->size);
+      entry->size = ie->size;
+      entry->offset = ie->offset;
+      pack->live_size += record_size(entry->size);
+
+      if (record_valid(pack, entry))
+         return entry;
+   }
+
+   /* Broken beyond repair, forget about it. */
+   pack->live_size -= record_size(entry->size);
+   _mesa_hash_table_remove(pack->entries, he);
+   ralloc_free(entry);
+
+   return NULL;
+}
+
+/* Pick up entries appended or a rewrite done by other processes.
+ * \param locked  whether the caller holds the exclusive lock
+ */
+static bool
+sync_index(struct disk_cache_pack *pack, bool locked)
+{
+   struct stat sb;
+   bool ok;
+
+   if (pack->index_fd != -1 &&
+       stat(pack->index_path, &sb) == 0 &&
+       sb.st_ino == pack->index_ino && sb.st_dev == pack->index_dev)
+      return load_index(pack, sb.st_size);
+
+   /* The pack was rewritten (or never opened), start from scratch. */
+   if (!locked && flock(pack->lock_fd, LOCK_SH) == -1)
+      return false;
+
+   ok = open_files(pack);
+   if (!ok && locked)
+      ok = write_generation(pack, NULL, 0);
+
+   if (!locked)
+      flock(pack->lock_fd, LOCK_UN);
+
+   return ok;
+}
+
+static int
+compare_entry_access(const void *a, const void *b)
+{
+   const struct pack_entry *ea = *(const struct pack_entry **) a;
+   const struct pack_entry *eb = *(const struct pack_entry **) b;
+
+   /* Most recently used first. */
+   if (ea->last_access != eb->last_access)
+      return ea->last_access < eb->last_access ? 1 : -1;
+   return ea->offset < eb->offset ? 1 : -1;
+}
+
+/* Rewrite the pack keeping only the most recently used entries that fit in
+ * \p target_size bytes. The caller must hold the exclusive lock.
+ */
+static bool
+compact(struct disk_cache_pack *pack, uint64_t target_size)
+{
+   struct pack_entry **entries;
+   struct hash_entry *he;
+   uint64_t kept_size = 0;
+   unsigned num_entries = 0, num_kept = 0;
+   bool ok;
+
+   entries = malloc(pack->entries->entries * sizeof(*entries));
+   if (!entries && pack->entries->entries)
+      return false;
+
+   /* Only carry over entries whose records are intact. */
+   hash_table_foreach(pack->entries, he) {
+      struct pack_entry *entry = he->data;
+
+      if (record_valid(pack, entry))
+         entries[num_entries++] = entry;
+   }
+
+   qsort(entries, num_entries, sizeof(*entries), compare_entry_access);
+
+   for (num_kept = 0; num_kept < num_entries; num_kept++) {
+      uint64_t size = record_size(entries[num_kept]->size);
+
+      if (kept_size + size > target_size)
+         break;
+      kept_size += size;
+   }
+
+   ok = write_generation(pack, entries, num_kept);
+   free(entries);
+
+   return ok;
+}
+
+struct disk_cache_pack *
+disk_cache_pack_create(void *mem_ctx, const char *path, uint64_t max_size)
+{
+   struct disk_cache_pack *pack;
+   bool ok;
+
+   pack = rzalloc(mem_ctx, struct disk_cache_pack);
+   if (!pack)
+      return NULL;
+
+   pack->lock_fd = -1;
+   pack->pack_fd = -1;
+   pack->index_fd = -1;
+   pack->max_size = max_size;
+
+   pack->pack_path = ralloc_asprintf(pack, "%s/pack", path);
+   pack->index_path = ralloc_asprintf(pack, "%s/pack.idx", path);
+   pack->lock_path = ralloc_asprintf(pack, "%s/pack.lock", path);
+   pack->entries_ctx = ralloc_context(pack);
+   pack->entries = _mesa_hash_table_create(pack, key_hash, key_equal);
+   if (!pack->pack_path || !pack->index_path || !pack->lock_path ||
+       !pack->entries_ctx || !pack->entries)
+      goto fail;
+
+   s_rand_xorshift128plus(pack->seed_xorshift128plus, true);
+
+   pack->lock_fd = open(pack->lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (pack->lock_fd == -1)
+      goto fail;
+
+   /* Create the files under the exclusive lock if they are missing or
+    * unusable, so concurrently starting processes agree on one pair.
+    */
+   if (flock(pack->lock_fd, LOCK_EX) == -1)
+      goto fail;
+   ok = sync_index(pack, true);
+   flock(pack->lock_fd, LOCK_UN);
+   if (!ok)
+      goto fail;
+
+   mtx_init(&pack->mutex, mtx_plain);
+
+   return pack;
+
+ fail:
+   close_files(pack);
+   if (pack->lock_fd != -1)
+      close(pack->lock_fd);
+   ralloc_free(pack);
+
+   return NULL;
+}
+
+void
+disk_cache_pack_destroy(struct disk_cache_pack *pack)
+{
+   if (!pack)
+      return;
+
+   close_files(pack);
+   close(pack->lock_fd);
+   mtx_destroy(&pack->mutex);
+   ralloc_free(pack);
+}
+
+bool
+disk_cache_pack_put(struct disk_cache_pack *pack, const cache_key key,
+                    const void *data, size_t size)
+{
+   struct pack_record_header rh;
+   struct pack_index_entry ie;
+   struct pack_entry *entry;
+   struct stat sb;
+   uint64_t rec_size = record_size(size);
+   uint64_t offset;
+   bool ok = false;
+
+   if (rec_size > pack->max_size || size > UINT32_MAX)
+      return false;
+
+   mtx_lock(&pack->mutex);
+
+   if (flock(pack->lock_fd, LOCK_EX) == -1) {
+      mtx_unlock(&pack->mutex);
+      return false;
+   }
+
+   if (!sync_index(pack, true))
+      goto done;
+
+   /* Another process may have won the race to write the same entry. */
+   if (lookup(pack, key)) {
+      ok = true;
+      goto done;
+   }
+
+   if (pack->live_size + rec_size > pack->max_size) {
+      /* Evict down to 3/4 of the maximum so we don't rewrite the whole
+       * pack for every new entry once it is full.
+       */
+      uint64_t target = pack->max_size / 4 * 3;
+
+      if (!compact(pack, target > rec_size ? target - rec_size : 0))
+         goto done;
+   }
+
+   if (fstat(pack->pack_fd, &sb) == -1)
+      goto done;
+
+   /* Get rid of removed and replaced entries once they take up more space
+    * than the live ones.
+    */
+   if (sb.st_size - pack->live_size > MAX2(pack->live_size, PACK_MIN_GARBAGE)) {
+      if (!compact(pack, pack->live_size) ||
+          fstat(pack->pack_fd, &sb) == -1)
+         goto done;
+   }
+
+   /* Append the record, then publish it in the index. A crash in between
+    * only leaves some unreferenced bytes behind.
+    */
+   offset = PACK_ALIGN(sb.st_size);
+
+   memcpy(rh.key, key, CACHE_KEY_SIZE);
+   rh.size = size;
+   if (pwrite_all(pack->pack_fd, &rh, sizeof(rh), offset) == -1 ||
+       pwrite_all(pack->pack_fd, data, size, offset + sizeof(rh)) == -1)
+      goto done;
+
+   /* Pad the record so the next one stays aligned. */
+   if (rec_size > sizeof(rh) + size) {
+      static const uint8_t zeros[8];
+
+      if (pwrite_all(pack->pack_fd, zeros, rec_size - sizeof(rh) - size,
+                     offset + sizeof(rh) + size) == -1)
+         goto done;
+   }
+
+   memcpy(ie.key, key, CACHE_KEY_SIZE);
+   ie.size = size;
+   ie.offset = offset;
+   ie.last_access = pack_now();
+   if (pwrite_all(pack->index_fd, &ie, sizeof(ie),
+                  slot_offset(pack->num_slots)) == -1)
+      goto done;
+
+   entry = ralloc(pack->entries_ctx, struct pack_entry);
+   if (entry) {
+      memcpy(entry->key, key, CACHE_KEY_SIZE);
+      entry->size = size;
+      entry->slot = pack->num_slots;
+      entry->offset = offset;
+      entry->last_access = ie.last_access;
+      _mesa_hash_table_insert(pack->entries, entry->key, entry);
+      pack->live_size += rec_size;
+   }
+   pack->num_slots++;
+
+   ok = true;
+
+ done:
+   flock(pack->lock_fd, LOCK_UN);
+   mtx_unlock(&pack->mutex);
+
+   return ok;
+}
+
+void *
+disk_cache_pack_get(struct disk_cache_pack *pack, const cache_key key,
+                    size_t *size)
+{
+   struct pack_entry *entry;
+   uint8_t *data = NULL;
+   uint64_t now;
+
+   mtx_lock(&pack->mutex);
+
+   entry = lookup(pack, key);
+   if (!entry) {
+      /* Maybe someone else wrote it since we last looked. */
+      if (!sync_index(pack, false))
+         goto done;
+
+      entry = lookup(pack, key);
+      if (!entry)
+         goto done;
+   }
+
+   data = malloc(entry->size);
+   if (!data)
+      goto done;
+
+   memcpy(data, pack->pack_map + entry->offset +
+                sizeof(struct pack_record_header), entry->size);
+   if (size)
+      *size = entry->size;
+
+   /* Record the access for LRU eviction, in this process right away and
+    * for everyone else through the shared index mapping.
+    */
+   now = pack_now();
+   entry->last_access = now;
+   if (slot_offset(entry->slot + 1) <= pack->index_map_size) {
+      struct pack_index_entry *ie = (struct pack_index_entry *)
+         (pack->index_map + slot_offset(entry->slot));
+
+      if (now - ie->last_access > PACK_ACCESS_GRANULARITY)
+         ie->last_access = now;
+   }
+
+ done:
+   mtx_unlock(&pack->mutex);
+
+   return data;
+}
+
+void
+disk_cache_pack_remove(struct disk_cache_pack *pack, const cache_key key)
+{
+   struct pack_index_entry ie;
+   struct hash_entry *he;
+
+   mtx_lock(&pack->mutex);
+
+   if (flock(pack->lock_fd, LOCK_EX) == -1) {
+      mtx_unlock(&pack->mutex);
+      return;
+   }
+
+   if (!sync_index(pack, true))
+      goto done;
+
+   he = _mesa_hash_table_search(pack->entries, key);
+   if (!he)
+      goto done;
+
+   /* Append a tombstone so other processes drop the entry as well. */
+   memset(&ie, 0, sizeof(ie));
+   memcpy(ie.key, key, CACHE_KEY_SIZE);
+   if (pwrite_all(pack->index_fd, &ie, sizeof(ie),
+                  slot_offset(pack->num_slots)) == -1)
+      goto done;
+
+   pack->live_size -= record_size(((struct pack_entry *)he->data)->size);
+   ralloc_free(he->data);
+   _mesa_hash_table_remove(pack->entries, he);
+   pack->num_slots++;
+
+ done:
+   flock(pack->lock_fd, LOCK_UN);
+   mtx_unlock(&pack->mutex);
+}
+
+#endif /* ENABLE_SHADER_CACHE */
@@ -0,0 +1,92 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Single file storage backend for disk_cache.
+ *
+ * All cache entries live in one append-only "pack" file, next to an index
+ * file listing the key, location and last access time of every entry. Both
+ * files are mmapped, and the index is additionally kept in a hash table so a
+ * lookup costs no syscalls at all.
+ *
+ * Writers serialize through an flock on a separate lock file, so several
+ * processes can append to the same pack. Eviction rewrites the live, most
+ * recently used entries into a fresh pack/index pair which is renamed over
+ * the old one; processes still mapping the old files keep working and pick
+ * up the new generation on their next miss.
+ */
+
+#ifndef DISK_CACHE_PACK_H
+#define DISK_CACHE_PACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/disk_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef ENABLE_SHADER_CACHE
+
+struct disk_cache_pack;
+
+/**
+ * Open (creating if needed) the pack stored in the directory \p path.
+ * The pack is allocated as a ralloc child of \p mem_ctx.
+ *
+ * Returns NULL on any error.
+ */
+struct disk_cache_pack *
+disk_cache_pack_create(void *mem_ctx, const char *path, uint64_t max_size);
+
+void
+disk_cache_pack_destroy(struct disk_cache_pack *pack);
+
+/**
+ * Append an entry, evicting the least recently used entries first if that
+ * would grow the pack beyond its maximum size. Nothing is written if the
+ * key is already present.
+ */
+bool
+disk_cache_pack_put(struct disk_cache_pack *pack, const cache_key key,
+                    const void *data, size_t size);
+
+/**
+ * Return a malloc'ed copy of the entry stored for \p key, or NULL.
+ */
+void *
+disk_cache_pack_get(struct disk_cache_pack *pack, const cache_key key,
+                    size_t *size);
+
+void
+disk_cache_pack_remove(struct disk_cache_pack *pack, const cache_key key);
+
+#endif /* ENABLE_SHADER_CACHE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DISK_CACHE_PACK_H */
@@ -33,81 +33,157 @@
  */
 
 /**
- * Implements an open-addressing, linear-reprobing hash table.
+ * Implements an open-addressing, linear-probing hash table.
  *
- * For more information, see:
+ * The table has a power-of-two number of home slots. Next to the entries,
+ * a control byte per slot holds either EMPTY or 7 bits of the entry's hash,
+ * so a probe compares a whole group of control bytes at once (with SSE2
+ * where available) and only looks at the entries whose bits match.
  *
- * http://cgit.freedesktop.org/~anholt/hash_table/tree/README
+ * Probe sequences never wrap around: an entry whose probe runs past the
+ * last home slot goes into overflow slots after it, which get allocated
+ * as needed. Removal shifts the following entries of the probe sequence
+ * back instead of leaving a tombstone, so lookups never slow down as
+ * entries get removed, and entries only ever move to lower slots, which
+ * is what makes removal during iteration safe.
  */
 
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "hash_table.h"
 #include "ralloc.h"
 #include "macros.h"
+#include "bitscan.h"
 #include "main/hash.h"
 
 static const uint32_t deleted_key_value;
 
-/**
- * From Knuth -- a good choice for hash/rehash values is p, p-2 where
- * p and p-2 are both prime.  These tables are sized to have an extra 10%
- * free to avoid exponential performance degradation as the hash table fills
+#define CTRL_EMPTY 0x80
+
+/* Keep the probe sequences short: a linear probe slows down a lot more than
+ * a double hashing one as the table fills up.
  */
-static const struct {
-   uint32_t max_entries, size, rehash;
-} hash_sizes[] = {
-   { 2,			5,		3	  },
-   { 4,			7,		5	  },
-   { 8,			13,		11	  },
-   { 16,		19,		17	  },
-   { 32,		43,		41        },
-   { 64,		73,		71        },
-   { 128,		151,		149       },
-   { 256,		283,		281       },
-   { 512,		571,		569       },
-   { 1024,		1153,		1151      },
-   { 2048,		2269,		2267      },
-   { 4096,		4519,		4517      },
-   { 8192,		9013,		9011      },
-   { 16384,		18043,		18041     },
-   { 32768,		36109,		36107     },
-   { 65536,		72091,		72089     },
-   { 131072,		144409,		144407    },
-   { 262144,		288361,		288359    },
-   { 524288,		576883,		576881    },
-   { 1048576,		1153459,	1153457   },
-   { 2097152,		2307163,	2307161   },
-   { 4194304,		4613893,	4613891   },
-   { 8388608,		9227641,	9227639   },
-   { 16777216,		18455029,	18455027  },
-   { 33554432,		36911011,	36911009  },
-   { 67108864,		73819861,	73819859  },
-   { 134217728,		147639589,	147639587 },
-   { 268435456,		295279081,	295279079 },
-   { 536870912,		590559793,	590559791 },
-   { 1073741824,	1181116273,	1181116271},
-   { 2147483648ul,	2362232233ul,	2362232231ul}
-};
+#define MIN_SIZE_SHIFT 3
+#define MAX_LOAD_NUM 3
+#define MAX_LOAD_DEN 4
+
+#ifdef __SSE2__
+#define GROUP_WIDTH 16
+
+/* Returns a mask with bit i set if ctrl[i] == byte, for a group of
+ * GROUP_WIDTH control bytes.
+ */
+static inline unsigned
+group_match(const uint8_t *ctrl, uint8_t byte)
+{
+   __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(byte)));
+}
 
-static int
-entry_is_free(const struct hash_entry *entry)
+static inline unsigned
+group_match_empty(const uint8_t *ctrl)
 {
-   return entry->key == NULL;
+   /* EMPTY is the only control byte with the top bit set. */
+   return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
 }
+#else
+#define GROUP_WIDTH 8
 
-static int
-entry_is_deleted(const struct hash_table *ht, struct hash_entry *entry)
+static inline unsigned
+group_match(const uint8_t *ctrl, uint8_t byte)
 {
-   return entry->key == ht->deleted_key;
+   unsigned mask = 0;
+
+   for (unsigned i = 0; i < GROUP_WIDTH; i++)
+      mask |= (unsigned)(ctrl[i] == byte) << i;
+   return mask;
+}
+
+static inline unsigned
+group_match_empty(const uint8_t *ctrl)
+{
+   return group_match(ctrl, CTRL_EMPTY);
+}
+#endif
+
+static inline uint32_t
+home_slot(const struct hash_table *ht, uint32_t hash)
+{
+   /* Fibonacci hashing, so that weak hash functions like
+    * _mesa_hash_pointer() still spread over the whole table.
+    */
+   return (hash * 0x9e3779b1u) >> ht->size_shift;
+}
+
+static inline uint8_t
+hash_ctrl(uint32_t hash)
+{
+   return hash & 0x7f;
+}
+
+/* Allocates num_slots empty slots, plus a group of control bytes past the
+ * end so that probes can load whole groups anywhere before num_slots.
+ */
+static bool
+alloc_slots(struct hash_table *ht, uint32_t size_shift, uint32_t num_slots)
+{
+   struct hash_entry *table = rzalloc_array(ht, struct hash_entry, num_slots);
+   uint8_t *ctrl = ralloc_array(ht, uint8_t, num_slots + GROUP_WIDTH);
+
+   if (table == NULL || ctrl == NULL) {
+      ralloc_free(table);
+      ralloc_free(ctrl);
+      return false;
+   }
+
+   memset(ctrl, CTRL_EMPTY, num_slots + GROUP_WIDTH);
+
+   ht->table = table;
+   ht->ctrl = ctrl;
+   ht->size_shift = size_shift;
+   ht->size = 1u << (32 - size_shift);
+   ht->num_slots = num_slots;
+   ht->max_entries = ht->size / MAX_LOAD_DEN * MAX_LOAD_NUM;
+   return true;
 }
 
-static int
-entry_is_present(const struct hash_table *ht, struct hash_entry *entry)
+/* Adds overflow slots at the end so that slot \p slot exists.  The table is
+ * left untouched if this fails.
+ */
+static bool
+grow_overflow(struct hash_table *ht, uint32_t slot)
 {
-   return entry->key != NULL && entry->key != ht->deleted_key;
+   uint32_t overflow = ht->num_slots - ht->size;
+   uint32_t num_slots =
+      MAX2(slot + 1, ht->num_slots + MAX2(overflow, GROUP_WIDTH / 2));
+   struct hash_entry *table = ralloc_array(ht, struct hash_entry, num_slots);
+   uint8_t *ctrl = ralloc_array(ht, uint8_t, num_slots + GROUP_WIDTH);
+
+   if (table == NULL || ctrl == NULL) {
+      ralloc_free(table);
+      ralloc_free(ctrl);
+      return false;
+   }
+
+   memcpy(table, ht->table, ht->num_slots * sizeof(*table));
+   memset(table + ht->num_slots, 0,
+          (num_slots - ht->num_slots) * sizeof(*table));
+   memcpy(ctrl, ht->ctrl, ht->num_slots + GROUP_WIDTH);
+   memset(ctrl + ht->num_slots + GROUP_WIDTH, CTRL_EMPTY,
+          num_slots - ht->num_slots);
+
+   ralloc_free(ht->table);
+   ralloc_free(ht->ctrl);
+   ht->table = table;
+   ht->ctrl = ctrl;
+   ht->num_slots = num_slots;
+   return true;
 }
 
 struct hash_table *
@@ -122,18 +198,12 @@ _mesa_hash_table_create(void *mem_ctx,
    if (ht == NULL)
       return NULL;
 
-   ht->size_index = 0;
-   ht->size = hash_sizes[ht->size_index].size;
-   ht->rehash = hash_sizes[ht->size_index].rehash;
-   ht->max_entries = hash_sizes[ht->size_index].max_entries;
    ht->key_hash_function = key_hash_function;
    ht->key_equals_function = key_equals_function;
-   ht->table = rzalloc_array(ht, struct hash_entry, ht->size);
    ht->entries = 0;
-   ht->deleted_entries = 0;
    ht->deleted_key = &deleted_key_value;
 
-   if (ht->table == NULL) {
+   if (!alloc_slots(ht, 32 - MIN_SIZE_SHIFT, 1 << MIN_SIZE_SHIFT)) {
       ralloc_free(ht);
       return NULL;
    }
@@ -174,31 +244,25 @@ void
 _mesa_hash_table_clear(struct hash_table *ht,
                        void (*delete_function)(struct hash_entry *entry))
 {
-   struct hash_entry *entry;
-
-   for (entry = ht->table; entry != ht->table + ht->size; entry++) {
-      if (entry->key == NULL)
+   for (uint32_t i = 0; i < ht->num_slots; i++) {
+      if (ht->ctrl[i] == CTRL_EMPTY)
          continue;
 
-      if (delete_function != NULL && entry->key != ht->deleted_key)
-         delete_function(entry);
+      if (delete_function != NULL)
+         delete_function(&ht->table[i]);
 
-      entry->key = NULL;
+      ht->table[i].key = NULL;
+      ht->ctrl[i] = CTRL_EMPTY;
    }
 
    ht->entries = 0;
-   ht->deleted_entries = 0;
 }
 
 /** Sets the value of the key pointer used for deleted entries in the table.
  *
- * The assumption is that usually keys are actual pointers, so we use a
- * default value of a pointer to an arbitrary piece of storage in the library.
- * But in some cases a consumer wants to store some other sort of value in the
- * table, like a uint32_t, in which case that pointer may conflict with one of
- * their valid keys.  This lets that user select a safe value.
- *
- * This must be called before any keys are actually deleted from the table.
+ * Removed entries don't leave anything behind in the table anymore, so any
+ * key value can be stored and this is only kept for the callers that want
+ * to reserve a key of their own, like hash_table_u64.
  */
 void
 _mesa_hash_table_set_deleted_key(struct hash_table *ht, const void *deleted_key)
@@ -206,31 +270,46 @@ _mesa_hash_table_set_deleted_key(struct hash_table *ht, const void *deleted_key)
    ht->deleted_key = deleted_key;
 }
 
+/* Walks the probe sequence of \p hash. Returns the entry with \p key, or
+ * NULL and the first empty slot, where the key would go, in \p empty_slot.
+ */
 static struct hash_entry *
-hash_table_search(struct hash_table *ht, uint32_t hash, const void *key)
+hash_table_probe(struct hash_table *ht, uint32_t hash, const void *key,
+                 uint32_t *empty_slot)
 {
-   uint32_t start_hash_address = hash % ht->size;
-   uint32_t hash_address = start_hash_address;
+   uint32_t slot = home_slot(ht, hash);
+   uint8_t byte = hash_ctrl(hash);
 
-   do {
-      uint32_t double_hash;
+   /* The empty control bytes after the last slot end every probe. */
+   while (1) {
+      const uint8_t *ctrl = ht->ctrl + slot;
+      unsigned match = group_match(ctrl, byte);
+      unsigned empty;
 
-      struct hash_entry *entry = ht->table + hash_address;
+      while (match) {
+         struct hash_entry *entry = ht->table + slot + u_bit_scan(&match);
 
-      if (entry_is_free(entry)) {
-         return NULL;
-      } else if (entry_is_present(ht, entry) && entry->hash == hash) {
-         if (ht->key_equals_function(key, entry->key)) {
+         if (entry->hash == hash &&
+             ht->key_equals_function(key, entry->key))
             return entry;
-         }
       }
 
-      double_hash = 1 + hash % ht->rehash;
+      empty = group_match_empty(ctrl);
+      if (empty) {
+         *empty_slot = slot + ffs(empty) - 1;
+         return NULL;
+      }
 
-      hash_address = (hash_address + double_hash) % ht->size;
-   } while (hash_address != start_hash_address);
+      slot += GROUP_WIDTH;
+   }
+}
 
-   return NULL;
+static struct hash_entry *
+hash_table_search(struct hash_table *ht, uint32_t hash, const void *key)
+{
+   uint32_t empty_slot;
+
+   return hash_table_probe(ht, hash, key, &empty_slot);
 }
 
 /**
@@ -254,109 +333,112 @@ _mesa_hash_table_search_pre_hashed(struct hash_table *ht, uint32_t hash,
    return hash_table_search(ht, hash, key);
 }
 
+/* Fills the empty \p slot, growing the overflow slots if it is past them. */
 static struct hash_entry *
-hash_table_insert(struct hash_table *ht, uint32_t hash,
-                  const void *key, void *data);
-
-static void
-_mesa_hash_table_rehash(struct hash_table *ht, unsigned new_size_index)
+hash_table_fill_slot(struct hash_table *ht, uint32_t slot, uint32_t hash,
+                     const void *key, void *data)
 {
-   struct hash_table old_ht;
-   struct hash_entry *table, *entry;
+   struct hash_entry *entry;
 
-   if (new_size_index >= ARRAY_SIZE(hash_sizes))
-      return;
+   if (slot >= ht->num_slots && !grow_overflow(ht, slot))
+      return NULL;
 
-   table = rzalloc_array(ht, struct hash_entry,
-                         hash_sizes[new_size_index].size);
-   if (table == NULL)
-      return;
+   entry = ht->table + slot;
+   entry->hash = hash;
+   entry->key = key;
+   entry->data = data;
+   ht->ctrl[slot] = hash_ctrl(hash);
+   ht->entries++;
+   return entry;
+}
+
+/* Moves the entries to a table of 2^(32 - new_size_shift) slots.  If that
+ * fails, the table is left as it was and false is returned.
+ */
+static bool
+_mesa_hash_table_rehash(struct hash_table *ht, uint32_t new_size_shift)
+{
+   struct hash_table old_ht;
 
    old_ht = *ht;
 
-   ht->table = table;
-   ht->size_index = new_size_index;
-   ht->size = hash_sizes[ht->size_index].size;
-   ht->rehash = hash_sizes[ht->size_index].rehash;
-   ht->max_entries = hash_sizes[ht->size_index].max_entries;
+   if (!alloc_slots(ht, new_size_shift, 1u << (32 - new_size_shift)))
+      return false;
+
    ht->entries = 0;
-   ht->deleted_entries = 0;
 
-   hash_table_foreach(&old_ht, entry) {
-      hash_table_insert(ht, entry->hash, entry->key, entry->data);
+   for (uint32_t i = 0; i < old_ht.num_slots; i++) {
+      struct hash_entry *entry = old_ht.table + i;
+      uint32_t slot;
+
+      if (old_ht.ctrl[i] == CTRL_EMPTY)
+         continue;
+
+      /* The keys are known to be distinct, so just find the first empty
+       * slot.
+       */
+      slot = home_slot(ht, entry->hash);
+      while (1) {
+         unsigned empty = group_match_empty(ht->ctrl + slot);
+
+         if (empty) {
+            slot += ffs(empty) - 1;
+            break;
+         }
+         slot += GROUP_WIDTH;
+      }
+
+      if (!hash_table_fill_slot(ht, slot, entry->hash, entry->key,
+                                entry->data)) {
+         ralloc_free(ht->table);
+         ralloc_free(ht->ctrl);
+         *ht = old_ht;
+         return false;
+      }
    }
 
    ralloc_free(old_ht.table);
+   ralloc_free(old_ht.ctrl);
+   return true;
 }
 
 static struct hash_entry *
 hash_table_insert(struct hash_table *ht, uint32_t hash,
                   const void *key, void *data)
 {
-   uint32_t start_hash_address, hash_address;
-   struct hash_entry *available_entry = NULL;
+   struct hash_entry *entry;
+   uint32_t empty_slot;
 
    assert(key != NULL);
 
-   if (ht->entries >= ht->max_entries) {
-      _mesa_hash_table_rehash(ht, ht->size_index + 1);
-   } else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
-      _mesa_hash_table_rehash(ht, ht->size_index);
-   }
-
-   start_hash_address = hash % ht->size;
-   hash_address = start_hash_address;
-   do {
-      struct hash_entry *entry = ht->table + hash_address;
-      uint32_t double_hash;
-
-      if (!entry_is_present(ht, entry)) {
-         /* Stash the first available entry we find */
-         if (available_entry == NULL)
-            available_entry = entry;
-         if (entry_is_free(entry))
-            break;
-      }
-
-      /* Implement replacement when another insert happens
-       * with a matching key.  This is a relatively common
-       * feature of hash tables, with the alternative
-       * generally being "insert the new value as well, and
-       * return it first when the key is searched for".
-       *
-       * Note that the hash table doesn't have a delete
-       * callback.  If freeing of old data pointers is
-       * required to avoid memory leaks, perform a search
-       * before inserting.
-       */
-      if (!entry_is_deleted(ht, entry) &&
-          entry->hash == hash &&
-          ht->key_equals_function(key, entry->key)) {
-         entry->key = key;
-         entry->data = data;
-         return entry;
-      }
-
-
-      double_hash = 1 + hash % ht->rehash;
-
-      hash_address = (hash_address + double_hash) % ht->size;
-   } while (hash_address != start_hash_address);
-
-   if (available_entry) {
-      if (entry_is_deleted(ht, available_entry))
-         ht->deleted_entries--;
-      available_entry->hash = hash;
-      available_entry->key = key;
-      available_entry->data = data;
-      ht->entries++;
-      return available_entry;
+   /* If growing fails, the old table still has room for the entry, just
+    * with longer probes.
+    */
+   if (ht->entries >= ht->max_entries && ht->size_shift > 1)
+      _mesa_hash_table_rehash(ht, ht->size_shift - 1);
+
+   /* Implement replacement when another insert happens
+    * with a matching key.  This is a relatively common
+    * feature of hash tables, with the alternative
+    * generally being "insert the new value as well, and
+    * return it first when the key is searched for".
+    *
+    * Note that the hash table doesn't have a delete
+    * callback.  If freeing of old data pointers is
+    * required to avoid memory leaks, perform a search
+    * before inserting.
+    */
+   entry = hash_table_probe(ht, hash, key, &empty_slot);
+   if (entry) {
+      entry->key = key;
+      entry->data = data;
+      return entry;
    }
 
-   /* We could hit here if a required resize failed. An unchecked-malloc
-    * application could ignore this result.
+   /* We could return NULL here if a required resize failed. An
+    * unchecked-malloc application could ignore this result.
     */
-   return NULL;
+   return hash_table_fill_slot(ht, empty_slot, hash, key, data);
 }
 
 /**
@@ -383,19 +465,39 @@ _mesa_hash_table_insert_pre_hashed(struct hash_table *ht, uint32_t hash,
 /**
  * This function deletes the given hash table entry.
  *
- * Note that deletion doesn't otherwise modify the table, so an iteration over
- * the table deleting entries is safe.
+ * The entries following it in its probe sequence are moved back to fill the
+ * gap, so other previously found hash_entries may point to a different
+ * entry afterwards. Entries only move to lower slots though, which the
+ * iterator walks last, so deleting the current entry while iterating over
+ * the table is safe.
  */
 void
 _mesa_hash_table_remove(struct hash_table *ht,
                         struct hash_entry *entry)
 {
+   uint32_t slot;
+
    if (!entry)
       return;
 
-   entry->key = ht->deleted_key;
+   slot = entry - ht->table;
+   assert(ht->ctrl[slot] != CTRL_EMPTY);
+
+   /* Backward shift: an entry can move into the gap if the gap is not
+    * before its home slot. Every probe sequence ends at an empty slot,
+    * at the latest in the control bytes past the end.
+    */
+   for (uint32_t next = slot + 1; ht->ctrl[next] != CTRL_EMPTY; next++) {
+      if (home_slot(ht, ht->table[next].hash) <= slot) {
+         ht->table[slot] = ht->table[next];
+         ht->ctrl[slot] = ht->ctrl[next];
+         slot = next;
+      }
+   }
+
+   ht->table[slot].key = NULL;
+   ht->ctrl[slot] = CTRL_EMPTY;
    ht->entries--;
-   ht->deleted_entries++;
 }
 
 /**
@@ -403,20 +505,19 @@ _mesa_hash_table_remove(struct hash_table *ht,
  *
  * Pass in NULL for the first entry, as in the start of a for loop.  Note that
  * an iteration over the table is O(table_size) not O(entries).
+ *
+ * The table is walked from the last slot to the first, see
+ * _mesa_hash_table_remove().
  */
 struct hash_entry *
 _mesa_hash_table_next_entry(struct hash_table *ht,
                             struct hash_entry *entry)
 {
-   if (entry == NULL)
-      entry = ht->table;
-   else
-      entry = entry + 1;
+   uint32_t slot = entry ? entry - ht->table : ht->num_slots;
 
-   for (; entry != ht->table + ht->size; entry++) {
-      if (entry_is_present(ht, entry)) {
-         return entry;
-      }
+   while (slot-- > 0) {
+      if (ht->ctrl[slot] != CTRL_EMPTY)
+         return ht->table + slot;
    }
 
    return NULL;
@@ -434,21 +535,16 @@ struct hash_entry *
 _mesa_hash_table_random_entry(struct hash_table *ht,
                               bool (*predicate)(struct hash_entry *entry))
 {
-   struct hash_entry *entry;
-   uint32_t i = rand() % ht->size;
+   uint32_t start = rand() % ht->num_slots;
 
    if (ht->entries == 0)
       return NULL;
 
-   for (entry = ht->table + i; entry != ht->table + ht->size; entry++) {
-      if (entry_is_present(ht, entry) &&
-          (!predicate || predicate(entry))) {
-         return entry;
-      }
-   }
+   for (uint32_t n = 0; n < ht->num_slots; n++) {
+      uint32_t slot = (start + n) % ht->num_slots;
+      struct hash_entry *entry = ht->table + slot;
 
-   for (entry = ht->table; entry != ht->table + i; entry++) {
-      if (entry_is_present(ht, entry) &&
+      if (ht->ctrl[slot] != CTRL_EMPTY &&
           (!predicate || predicate(entry))) {
          return entry;
       }
@@ -46,15 +46,15 @@ struct hash_entry {
 
 struct hash_table {
    struct hash_entry *table;
+   uint8_t *ctrl; /* per slot, the low hash bits of its entry or empty */
    uint32_t (*key_hash_function)(const void *key);
    bool (*key_equals_function)(const void *a, const void *b);
    const void *deleted_key;
-   uint32_t size;
-   uint32_t rehash;
+   uint32_t size; /* number of home slots, a power of two */
+   uint32_t size_shift; /* 32 - log2(size) */
+   uint32_t num_slots; /* home slots plus overflow slots */
    uint32_t max_entries;
-   uint32_t size_index;
    uint32_t entries;
-   uint32_t deleted_entries;
 };
 
 struct hash_table *
@@ -131,8 +131,8 @@ _mesa_fnv32_1a_accumulate_block(uint32_t hash, const void *data, size_t size)
    _mesa_fnv32_1a_accumulate_block(hash, &(expr), sizeof(expr))
 
 /**
- * This foreach function is safe against deletion (which just replaces
- * an entry's data with the deleted marker), but not against insertion
+ * This foreach function is safe against deletion of the current entry (which
+ * only moves entries that were already visited), but not against insertion
  * (which may rehash the table, making entry a dangling pointer).
  */
 #define hash_table_foreach(ht, entry)                   \
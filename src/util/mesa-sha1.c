@@ -24,9 +24,212 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <string.h>
+#include "macros.h"
 #include "sha1/sha1.h"
 #include "mesa-sha1.h"
 
+/* The SHA extensions need GCC 5 or a clang that allows enabling them per
+ * function.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define HAVE_SHA1_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+typedef void (*sha1_blocks_func)(uint32_t state[5], const uint8_t *data,
+                                 size_t count);
+
+static void
+sha1_blocks_c(uint32_t state[5], const uint8_t *data, size_t count)
+{
+   for (; count; count--, data += SHA1_BLOCK_LENGTH)
+      SHA1Transform(state, data);
+}
+
+#ifdef HAVE_SHA1_SHANI
+
+/* Each sha1rnds4 does four rounds, taking the message words, already added
+ * to e, from sha1nexte.  sha1msg1, xor and sha1msg2 compute the next four
+ * message words from the previous sixteen.
+ */
+#define SHA1_ROUNDS4(e, e_next, msg, f) do {       \
+   e = _mm_sha1nexte_epu32(e, msg);                \
+   e_next = abcd;                                  \
+   abcd = _mm_sha1rnds4_epu32(abcd, e, f);         \
+} while (0)
+
+static void __attribute__((target("sha,sse4.1")))
+sha1_blocks_shani(uint32_t state[5], const uint8_t *data, size_t count)
+{
+   const __m128i bswap = _mm_set_epi64x(0x0001020304050607ull,
+                                        0x08090a0b0c0d0e0full);
+   __m128i abcd, e0, e1, msg0, msg1, msg2, msg3;
+
+   abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1b);
+   e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+   for (; count; count--, data += SHA1_BLOCK_LENGTH) {
+      const __m128i abcd_save = abcd;
+      const __m128i e_save = e0;
+
+      msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), bswap);
+      msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data + 1), bswap);
+      msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data + 2), bswap);
+      msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data + 3), bswap);
+
+      /* Rounds 0-15 use the message words as they are. */
+      e0 = _mm_add_epi32(e0, msg0);
+      e1 = abcd;
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+      SHA1_ROUNDS4(e1, e0, msg1, 0);
+      msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+      SHA1_ROUNDS4(e0, e1, msg2, 0);
+      msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+      msg0 = _mm_xor_si128(msg0, msg2);
+
+      SHA1_ROUNDS4(e1, e0, msg3, 0);
+      msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+      msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+      msg1 = _mm_xor_si128(msg1, msg3);
+
+      /* Rounds 16-79 each use the words computed four rounds before. */
+#define SHA1_SCHEDULE4(e, e_next, m0, m1, m2, m3, f) do { \
+      SHA1_ROUNDS4(e, e_next, m0, f);                    \
+      m1 = _mm_sha1msg2_epu32(m1, m0);                   \
+      m3 = _mm_sha1msg1_epu32(m3, m0);                   \
+      m2 = _mm_xor_si128(m2, m0);                        \
+} while (0)
+
+      SHA1_SCHEDULE4(e0, e1, msg0, msg1, msg2, msg3, 0);
+      SHA1_SCHEDULE4(e1, e0, msg1, msg2, msg3, msg0, 1);
+      SHA1_SCHEDULE4(e0, e1, msg2, msg3, msg0, msg1, 1);
+      SHA1_SCHEDULE4(e1, e0, msg3, msg0, msg1, msg2, 1);
+      SHA1_SCHEDULE4(e0, e1, msg0, msg1, msg2, msg3, 1);
+      SHA1_SCHEDULE4(e1, e0, msg1, msg2, msg3, msg0, 1);
+      SHA1_SCHEDULE4(e0, e1, msg2, msg3, msg0, msg1, 2);
+      SHA1_SCHEDULE4(e1, e0, msg3, msg0, msg1, msg2, 2);
+      SHA1_SCHEDULE4(e0, e1, msg0, msg1, msg2, msg3, 2);
+      SHA1_SCHEDULE4(e1, e0, msg1, msg2, msg3, msg0, 2);
+      SHA1_SCHEDULE4(e0, e1, msg2, msg3, msg0, msg1, 2);
+      SHA1_SCHEDULE4(e1, e0, msg3, msg0, msg1, msg2, 3);
+      SHA1_SCHEDULE4(e0, e1, msg0, msg1, msg2, msg3, 3);
+#undef SHA1_SCHEDULE4
+
+      /* The last rounds don't need any more message words. */
+      SHA1_ROUNDS4(e1, e0, msg1, 3);
+      msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+      msg3 = _mm_xor_si128(msg3, msg1);
+
+      SHA1_ROUNDS4(e0, e1, msg2, 3);
+      msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+
+      SHA1_ROUNDS4(e1, e0, msg3, 3);
+
+      e0 = _mm_sha1nexte_epu32(e0, e_save);
+      abcd = _mm_add_epi32(abcd, abcd_save);
+   }
+
+   _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1b));
+   state[4] = _mm_extract_epi32(e0, 3);
+}
+
+#undef SHA1_ROUNDS4
+
+#endif /* HAVE_SHA1_SHANI */
+
+static sha1_blocks_func
+sha1_select_blocks(void)
+{
+#ifdef HAVE_SHA1_SHANI
+   unsigned eax, ebx, ecx, edx;
+
+   /* SHA is CPUID.(EAX=7,ECX=0):EBX[29], SSE4.1 is CPUID.1:ECX[19]. */
+   if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 19)) &&
+       __get_cpuid_max(0, NULL) >= 7) {
+      __cpuid_count(7, 0, eax, ebx, ecx, edx);
+      if (ebx & (1 << 29))
+         return sha1_blocks_shani;
+   }
+#endif
+
+   return sha1_blocks_c;
+}
+
+static void
+sha1_blocks_init(uint32_t state[5], const uint8_t *data, size_t count);
+
+/* Every thread that races on the first update selects the same function. */
+static sha1_blocks_func sha1_blocks = sha1_blocks_init;
+
+static void
+sha1_blocks_init(uint32_t state[5], const uint8_t *data, size_t count)
+{
+   sha1_blocks = sha1_select_blocks();
+   sha1_blocks(state, data, count);
+}
+
+/**
+ * Same as SHA1Update(), but hashes whole blocks with the fastest
+ * implementation the CPU supports.
+ */
+void
+_mesa_sha1_update(struct mesa_sha1 *ctx, const void *data, size_t size)
+{
+   const uint8_t *p = data;
+   size_t used = (ctx->count >> 3) & (SHA1_BLOCK_LENGTH - 1);
+
+   ctx->count += (uint64_t)size << 3;
+
+   if (used) {
+      size_t n = MIN2(size, SHA1_BLOCK_LENGTH - used);
+
+      memcpy(&ctx->buffer[used], p, n);
+      p += n;
+      size -= n;
+      if (used + n < SHA1_BLOCK_LENGTH)
+         return;
+
+      sha1_blocks(ctx->state, ctx->buffer, 1);
+   }
+
+   if (size >= SHA1_BLOCK_LENGTH) {
+      sha1_blocks(ctx->state, p, size / SHA1_BLOCK_LENGTH);
+      p += size & ~(size_t)(SHA1_BLOCK_LENGTH - 1);
+      size &= SHA1_BLOCK_LENGTH - 1;
+   }
+
+   memcpy(ctx->buffer, p, size);
+}
+
+/**
+ * Same as SHA1Final(), but pads through _mesa_sha1_update().
+ */
+void
+_mesa_sha1_final(struct mesa_sha1 *ctx, unsigned char result[20])
+{
+   static const uint8_t padding[SHA1_BLOCK_LENGTH] = { 0x80 };
+   size_t used = (ctx->count >> 3) & (SHA1_BLOCK_LENGTH - 1);
+   uint8_t count[8];
+   unsigned i;
+
+   for (i = 0; i < 8; i++)
+      count[i] = ctx->count >> ((7 - i) * 8);
+
+   /* Pad to 8 bytes short of a block, then append the bit count. */
+   _mesa_sha1_update(ctx, padding, ((55 - used) & (SHA1_BLOCK_LENGTH - 1)) + 1);
+   _mesa_sha1_update(ctx, count, sizeof(count));
+
+   for (i = 0; i < SHA1_DIGEST_LENGTH; i++)
+      result[i] = ctx->state[i >> 2] >> ((3 - (i & 3)) * 8);
+
+   memset(ctx, 0, sizeof(*ctx));
+}
+
 void
 _mesa_sha1_compute(const void *data, size_t size, unsigned char result[20])
 {
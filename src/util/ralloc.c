@@ -44,7 +44,17 @@ _CRTIMP int _vscprintf(const char *format, va_list argptr);
 #endif
 #endif
 
-#define CANARY 0x5A1106
+#define ALIGN_POT(x, y) (((x) + (y) - 1) & ~((y) - 1))
+
+/* Every ralloc'd pointer is preceded by a tag word, which tells what kind of
+ * header it has: RALLOC_TAG for a ralloc_header, RALLOC_ARENA_TAG for the
+ * ralloc_header of an arena context, and the address of the arena with the
+ * low bit set for an arena_header.  The tags also serve as a canary to check
+ * that a pointer is ralloc'd.
+ */
+#define RALLOC_TAG 0x5A1106
+#define RALLOC_ARENA_TAG 0xA7E7A
+#define ARENA_ALLOCATION_BIT 1
 
 /* Align the header's size so that ralloc() allocations will return with the
  * same alignment as a libc malloc would have (8 on 32-bit GLIBC, 16 on
@@ -61,11 +71,6 @@ struct
 #endif
    ralloc_header
 {
-#ifdef DEBUG
-   /* A canary value used to determine whether a pointer is ralloc'd. */
-   unsigned canary;
-#endif
-
    struct ralloc_header *parent;
 
    /* The first child (head of a linked list) */
@@ -76,26 +81,375 @@ struct
    struct ralloc_header *next;
 
    void (*destructor)(void *);
+
+   /* Six words fill the alignment exactly, so this is the last word before
+    * the allocation.
+    */
+   uintptr_t tag;
 };
 
 typedef struct ralloc_header ralloc_header;
 
+/***************************************************************************
+ * Arenas
+ ***************************************************************************
+ *
+ * An arena context is a ralloc context whose memory is carved out of large
+ * chunks by bumping a pointer.  Its allocations have a two word
+ * arena_header instead of a ralloc_header: there are no parent, child and
+ * sibling links, so freeing the arena gives all of its memory back without
+ * visiting the allocations, but single allocations can't be freed or moved
+ * out of the arena either.
+ *
+ * The ralloc_header of the arena context is followed by its ralloc_arena.
+ */
+
+/* Arena allocations keep the alignment of ralloc_header. */
+#define ARENA_ALIGNMENT (2 * sizeof(uintptr_t))
+
+/* Allocations bigger than this get a chunk of their own, which is freed by
+ * ralloc_free() and resized with realloc().
+ */
+#define ARENA_MAX_SHARED_SIZE 2048
+
+/* Chunks stay below the default mmap threshold of glibc, so that malloc()
+ * recycles them rather than mapping and unmapping them for every arena.
+ */
+#define ARENA_MIN_CHUNK_SIZE 4096
+#define ARENA_MAX_CHUNK_SIZE (64 * 1024)
+
+struct arena_header {
+   size_t size;
+   uintptr_t tag;
+};
+
+struct arena_chunk {
+   struct arena_chunk *prev;
+   struct arena_chunk *next;
+};
+
+struct arena_destructor {
+   struct arena_destructor *next;
+   const void *ptr;
+   void (*destructor)(void *);
+};
+
+struct ralloc_arena {
+   char *next; /* first free byte of the current chunk */
+   char *end;  /* end of the current chunk */
+   size_t chunk_size; /* size of the next chunk */
+   struct arena_chunk *chunks;
+
+   /* Destructors set on allocations of the arena, the latest first.  They
+    * are rare enough that a list will do.
+    */
+   struct arena_destructor *destructors;
+};
+
+typedef struct arena_header arena_header;
+typedef struct ralloc_arena ralloc_arena;
+
 static void unlink_block(ralloc_header *info);
 static void unsafe_free(ralloc_header *info);
 
+static uintptr_t
+get_tag(const void *ptr)
+{
+   STATIC_ASSERT(sizeof(ralloc_header) ==
+                 offsetof(ralloc_header, tag) + sizeof(uintptr_t));
+   STATIC_ASSERT(sizeof(arena_header) == ARENA_ALIGNMENT);
+   STATIC_ASSERT(sizeof(struct arena_chunk) == ARENA_ALIGNMENT);
+
+   return ((const uintptr_t *) ptr)[-1];
+}
+
+static bool
+is_arena_allocation(const void *ptr)
+{
+   return get_tag(ptr) & ARENA_ALLOCATION_BIT;
+}
+
 static ralloc_header *
 get_header(const void *ptr)
 {
    ralloc_header *info = (ralloc_header *) (((char *) ptr) -
 					    sizeof(ralloc_header));
-#ifdef DEBUG
-   assert(info->canary == CANARY);
-#endif
+   assert(info->tag == RALLOC_TAG || info->tag == RALLOC_ARENA_TAG);
    return info;
 }
 
 #define PTR_FROM_HEADER(info) (((char *) info) + sizeof(ralloc_header))
 
+static arena_header *
+get_arena_header(const void *ptr)
+{
+   assert(is_arena_allocation(ptr));
+   return (arena_header *) ptr - 1;
+}
+
+/**
+ * Returns the arena \p ctx allocates from, or NULL if it isn't an arena
+ * context or allocated out of one.
+ */
+static ralloc_arena *
+get_arena(const void *ctx)
+{
+   uintptr_t tag = get_tag(ctx);
+
+   if (tag & ARENA_ALLOCATION_BIT)
+      return (ralloc_arena *) (tag & ~(uintptr_t) ARENA_ALLOCATION_BIT);
+
+   assert(tag == RALLOC_TAG || tag == RALLOC_ARENA_TAG);
+   return tag == RALLOC_ARENA_TAG ? (ralloc_arena *) ctx : NULL;
+}
+
+/**
+ * Returns the header of the block that owns the children of \p ctx: the
+ * arena context itself for anything allocated out of an arena.
+ */
+static ralloc_header *
+get_parent_header(const void *ctx)
+{
+   if (ctx == NULL)
+      return NULL;
+
+   if (is_arena_allocation(ctx))
+      return get_header(get_arena(ctx));
+
+   return get_header(ctx);
+}
+
+static bool
+arena_is_dedicated(const arena_header *info)
+{
+   return info->size > ARENA_MAX_SHARED_SIZE;
+}
+
+static struct arena_chunk *
+arena_add_chunk(ralloc_arena *arena, size_t size)
+{
+   struct arena_chunk *chunk = malloc(sizeof(struct arena_chunk) + size);
+
+   if (unlikely(chunk == NULL))
+      return NULL;
+
+   chunk->prev = NULL;
+   chunk->next = arena->chunks;
+   if (chunk->next != NULL)
+      chunk->next->prev = chunk;
+   arena->chunks = chunk;
+
+   return chunk;
+}
+
+static void
+arena_unlink_chunk(ralloc_arena *arena, struct arena_chunk *chunk)
+{
+   if (chunk->prev != NULL)
+      chunk->prev->next = chunk->next;
+   else
+      arena->chunks = chunk->next;
+
+   if (chunk->next != NULL)
+      chunk->next->prev = chunk->prev;
+}
+
+static void *
+arena_alloc(ralloc_arena *arena, size_t size)
+{
+   arena_header *info;
+
+   if (unlikely(size > ARENA_MAX_SHARED_SIZE)) {
+      struct arena_chunk *chunk;
+
+      if (size > SIZE_MAX - sizeof(struct arena_chunk) - sizeof(arena_header))
+         return NULL;
+
+      chunk = arena_add_chunk(arena, sizeof(arena_header) + size);
+      if (unlikely(chunk == NULL))
+         return NULL;
+
+      info = (arena_header *) (chunk + 1);
+   } else {
+      size_t full_size = sizeof(arena_header) +
+                         ALIGN_POT(size, ARENA_ALIGNMENT);
+
+      if (unlikely((size_t) (arena->end - arena->next) < full_size)) {
+         struct arena_chunk *chunk = arena_add_chunk(arena, arena->chunk_size);
+
+         if (unlikely(chunk == NULL))
+            return NULL;
+
+         arena->next = (char *) (chunk + 1);
+         arena->end = arena->next + arena->chunk_size;
+         if (arena->chunk_size < ARENA_MAX_CHUNK_SIZE)
+            arena->chunk_size *= 2;
+      }
+
+      info = (arena_header *) arena->next;
+      arena->next += full_size;
+   }
+
+   info->size = size;
+   info->tag = (uintptr_t) arena | ARENA_ALLOCATION_BIT;
+
+   return info + 1;
+}
+
+static void
+arena_call_destructor(ralloc_arena *arena, const void *ptr)
+{
+   struct arena_destructor **link;
+
+   for (link = &arena->destructors; *link != NULL; link = &(*link)->next) {
+      struct arena_destructor *entry = *link;
+
+      if (entry->ptr == ptr) {
+         *link = entry->next;
+         entry->destructor((void *) ptr);
+         return;
+      }
+   }
+}
+
+static void
+arena_free(void *ptr)
+{
+   ralloc_arena *arena = get_arena(ptr);
+   arena_header *info = get_arena_header(ptr);
+
+   if (unlikely(arena->destructors != NULL))
+      arena_call_destructor(arena, ptr);
+
+   /* Memory shared with other allocations is only given back with the whole
+    * arena.
+    */
+   if (arena_is_dedicated(info)) {
+      struct arena_chunk *chunk = (struct arena_chunk *) info - 1;
+
+      arena_unlink_chunk(arena, chunk);
+      free(chunk);
+   }
+}
+
+static void *
+arena_resize(void *ptr, size_t size)
+{
+   ralloc_arena *arena = get_arena(ptr);
+   arena_header *info = get_arena_header(ptr);
+   size_t old_full_size = ALIGN_POT(info->size, ARENA_ALIGNMENT);
+   void *new_ptr;
+
+   if (arena_is_dedicated(info) && size > ARENA_MAX_SHARED_SIZE) {
+      struct arena_chunk *chunk = (struct arena_chunk *) info - 1;
+      struct arena_chunk *new_chunk;
+
+      if (size > SIZE_MAX - sizeof(struct arena_chunk) - sizeof(arena_header))
+         return NULL;
+
+      new_chunk = realloc(chunk, sizeof(struct arena_chunk) +
+                                 sizeof(arena_header) + size);
+      if (unlikely(new_chunk == NULL))
+         return NULL;
+
+      if (new_chunk->prev != NULL)
+         new_chunk->prev->next = new_chunk;
+      else
+         arena->chunks = new_chunk;
+      if (new_chunk->next != NULL)
+         new_chunk->next->prev = new_chunk;
+
+      info = (arena_header *) (new_chunk + 1);
+      info->size = size;
+      return info + 1;
+   }
+
+   /* The latest allocation can grow in place if there is room left. */
+   if (!arena_is_dedicated(info) && size <= ARENA_MAX_SHARED_SIZE &&
+       (char *) ptr + old_full_size == arena->next &&
+       (size_t) (arena->end - (char *) ptr) >= ALIGN_POT(size, ARENA_ALIGNMENT)) {
+      arena->next = (char *) ptr + ALIGN_POT(size, ARENA_ALIGNMENT);
+      info->size = size;
+      return ptr;
+   }
+
+   new_ptr = arena_alloc(arena, size);
+   if (unlikely(new_ptr == NULL))
+      return NULL;
+
+   memcpy(new_ptr, ptr, MIN2(info->size, size));
+
+   /* Move the destructor along, if any. */
+   if (unlikely(arena->destructors != NULL)) {
+      struct arena_destructor *entry;
+
+      for (entry = arena->destructors; entry != NULL; entry = entry->next) {
+         if (entry->ptr == ptr)
+            entry->ptr = new_ptr;
+      }
+   }
+
+   if (arena_is_dedicated(info)) {
+      struct arena_chunk *chunk = (struct arena_chunk *) info - 1;
+
+      arena_unlink_chunk(arena, chunk);
+      free(chunk);
+   }
+
+   return new_ptr;
+}
+
+static void
+arena_set_destructor(const void *ptr, void (*destructor)(void *))
+{
+   ralloc_arena *arena = get_arena(ptr);
+   struct arena_destructor **link, *entry;
+
+   for (link = &arena->destructors; *link != NULL; link = &(*link)->next) {
+      entry = *link;
+
+      if (entry->ptr == ptr) {
+         if (destructor != NULL) {
+            entry->destructor = destructor;
+         } else {
+            *link = entry->next;
+         }
+         return;
+      }
+   }
+
+   if (destructor == NULL)
+      return;
+
+   entry = arena_alloc(arena, sizeof(*entry));
+   if (unlikely(entry == NULL))
+      return;
+
+   entry->ptr = ptr;
+   entry->destructor = destructor;
+   entry->next = arena->destructors;
+   arena->destructors = entry;
+}
+
+/* Called when the arena context is freed. */
+static void
+arena_release(ralloc_arena *arena)
+{
+   while (arena->destructors != NULL) {
+      struct arena_destructor *entry = arena->destructors;
+
+      arena->destructors = entry->next;
+      entry->destructor((void *) entry->ptr);
+   }
+
+   while (arena->chunks != NULL) {
+      struct arena_chunk *chunk = arena->chunks;
+
+      arena->chunks = chunk->next;
+      free(chunk);
+   }
+}
+
 static void
 add_child(ralloc_header *parent, ralloc_header *info)
 {
@@ -115,12 +469,11 @@ ralloc_context(const void *ctx)
    return ralloc_size(ctx, 0);
 }
 
-void *
-ralloc_size(const void *ctx, size_t size)
+static ralloc_header *
+alloc_block(ralloc_header *parent, size_t size)
 {
    void *block = malloc(size + sizeof(ralloc_header));
    ralloc_header *info;
-   ralloc_header *parent;
 
    if (unlikely(block == NULL))
       return NULL;
@@ -135,18 +488,54 @@ ralloc_size(const void *ctx, size_t size)
    info->prev = NULL;
    info->next = NULL;
    info->destructor = NULL;
-
-   parent = ctx != NULL ? get_header(ctx) : NULL;
+   info->tag = RALLOC_TAG;
 
    add_child(parent, info);
 
-#ifdef DEBUG
-   info->canary = CANARY;
-#endif
+   return info;
+}
+
+void *
+ralloc_size(const void *ctx, size_t size)
+{
+   ralloc_header *info;
+
+   if (ctx != NULL) {
+      ralloc_arena *arena = get_arena(ctx);
+
+      if (arena != NULL)
+         return arena_alloc(arena, size);
+   }
+
+   info = alloc_block(ctx != NULL ? get_header(ctx) : NULL, size);
+   if (unlikely(info == NULL))
+      return NULL;
 
    return PTR_FROM_HEADER(info);
 }
 
+void *
+ralloc_arena_context(const void *ctx)
+{
+   ralloc_header *info = alloc_block(get_parent_header(ctx),
+                                     sizeof(ralloc_arena));
+   ralloc_arena *arena;
+
+   if (unlikely(info == NULL))
+      return NULL;
+
+   info->tag = RALLOC_ARENA_TAG;
+
+   arena = (ralloc_arena *) PTR_FROM_HEADER(info);
+   arena->next = NULL;
+   arena->end = NULL;
+   arena->chunk_size = ARENA_MIN_CHUNK_SIZE;
+   arena->chunks = NULL;
+   arena->destructors = NULL;
+
+   return arena;
+}
+
 void *
 rzalloc_size(const void *ctx, size_t size)
 {
@@ -164,6 +553,9 @@ resize(void *ptr, size_t size)
 {
    ralloc_header *child, *old, *info;
 
+   if (is_arena_allocation(ptr))
+      return arena_resize(ptr, size);
+
    old = get_header(ptr);
    info = realloc(old, size + sizeof(ralloc_header));
 
@@ -195,7 +587,7 @@ reralloc_size(const void *ctx, void *ptr, size_t size)
    if (unlikely(ptr == NULL))
       return ralloc_size(ctx, size);
 
-   assert(ralloc_parent(ptr) == ctx);
+   assert(get_parent_header(ralloc_parent(ptr)) == get_parent_header(ctx));
    return resize(ptr, size);
 }
 
@@ -234,6 +626,11 @@ ralloc_free(void *ptr)
    if (ptr == NULL)
       return;
 
+   if (is_arena_allocation(ptr)) {
+      arena_free(ptr);
+      return;
+   }
+
    info = get_header(ptr);
    unlink_block(info);
    unsafe_free(info);
@@ -269,6 +666,9 @@ unsafe_free(ralloc_header *info)
       unsafe_free(temp);
    }
 
+   if (info->tag == RALLOC_ARENA_TAG)
+      arena_release((ralloc_arena *) PTR_FROM_HEADER(info));
+
    /* Free the block itself.  Call the destructor first, if any. */
    if (info->destructor != NULL)
       info->destructor(PTR_FROM_HEADER(info));
@@ -276,6 +676,24 @@ unsafe_free(ralloc_header *info)
    free(info);
 }
 
+/**
+ * Aborts unless \p new_ctx allocates from the same arena as \p ptr.
+ *
+ * An arena allocation is only released along with its arena, whatever its
+ * parent, so moving it to a context outside the arena would leave that
+ * context with a dangling pointer.  That is a bug in the caller, which is
+ * caught in release builds too rather than turned into a use after free.
+ */
+static void
+check_same_arena(const void *new_ctx, const void *ptr)
+{
+   if (new_ctx == NULL || get_arena(new_ctx) != get_arena(ptr)) {
+      fprintf(stderr, "ralloc: can't move an arena allocation out of its "
+              "arena\n");
+      abort();
+   }
+}
+
 void
 ralloc_steal(const void *new_ctx, void *ptr)
 {
@@ -284,8 +702,16 @@ ralloc_steal(const void *new_ctx, void *ptr)
    if (unlikely(ptr == NULL))
       return;
 
+   /* Allocations can't leave their arena, but they belong to any context
+    * allocated out of it just as much.
+    */
+   if (is_arena_allocation(ptr)) {
+      check_same_arena(new_ctx, ptr);
+      return;
+   }
+
    info = get_header(ptr);
-   parent = new_ctx ? get_header(new_ctx) : NULL;
+   parent = get_parent_header(new_ctx);
 
    unlink_block(info);
 
@@ -300,8 +726,14 @@ ralloc_adopt(const void *new_ctx, void *old_ctx)
    if (unlikely(old_ctx == NULL))
       return;
 
+   /* Allocations can't leave their arena, see ralloc_steal(). */
+   if (get_arena(old_ctx) != NULL) {
+      check_same_arena(new_ctx, old_ctx);
+      return;
+   }
+
    old_info = get_header(old_ctx);
-   new_info = get_header(new_ctx);
+   new_info = get_parent_header(new_ctx);
 
    /* If there are no children, bail. */
    if (unlikely(old_info->child == NULL))
@@ -329,6 +761,9 @@ ralloc_parent(const void *ptr)
    if (unlikely(ptr == NULL))
       return NULL;
 
+   if (is_arena_allocation(ptr))
+      return get_arena(ptr);
+
    info = get_header(ptr);
    return info->parent ? PTR_FROM_HEADER(info->parent) : NULL;
 }
@@ -336,7 +771,14 @@ ralloc_parent(const void *ptr)
 void
 ralloc_set_destructor(const void *ptr, void(*destructor)(void *))
 {
-   ralloc_header *info = get_header(ptr);
+   ralloc_header *info;
+
+   if (is_arena_allocation(ptr)) {
+      arena_set_destructor(ptr, destructor);
+      return;
+   }
+
+   info = get_header(ptr);
    info->destructor = destructor;
 }
 
@@ -553,8 +995,6 @@ ralloc_vasprintf_rewrite_tail(char **str, size_t *start, const char *fmt,
  * other buffers.
  */
 
-#define ALIGN_POT(x, y) (((x) + (y) - 1) & ~((y) - 1))
-
 #define MIN_LINEAR_BUFSIZE 2048
 #define SUBALLOC_ALIGNMENT sizeof(uintptr_t)
 #define LMAGIC 0x87b9c7d3
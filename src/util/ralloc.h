@@ -91,6 +91,27 @@ extern "C" {
  */
 void *ralloc_context(const void *ctx);
 
+/**
+ * Allocate a new arena context.
+ *
+ * Anything allocated out of an arena context, or out of anything allocated
+ * out of it, comes from large chunks of memory owned by the arena instead of
+ * a malloc() of its own, and without the parent, child and sibling links.
+ * This makes allocations cheap and freeing the arena with ralloc_free() give
+ * all of its memory back at once, which suits temporary memory that is
+ * thrown away as a whole, like that of a compiler pass.
+ *
+ * The usual ralloc functions work on arena allocations, with these
+ * differences:
+ * - ralloc_free() only gives memory back when the arena is freed, except for
+ *   big allocations, and doesn't free the children of the allocation.
+ * - Arena allocations can't be moved out of their arena by ralloc_steal()
+ *   or ralloc_adopt(); trying to aborts.  Other memory can be stolen into
+ *   the arena; it is then freed along with the arena.
+ * - ralloc_parent() returns the arena context.
+ */
+void *ralloc_arena_context(const void *ctx);
+
 /**
  * Allocate memory chained off of the given context.
  *
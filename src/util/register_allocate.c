@@ -71,6 +71,7 @@
  */
 
 #include <stdbool.h>
+#include <stdio.h>
 
 #include "ralloc.h"
 #include "main/imports.h"
@@ -81,6 +82,13 @@
 
 #define NO_REG ~0U
 
+/* Graphs whose per-node adjacency bitsets would take more memory than this
+ * keep their edges in a hash set instead, since the bitsets take O(n^2)
+ * memory.  The bitsets are faster to build, so graphs up to about 23000
+ * nodes, which is as big as most shaders get, still use them.
+ */
+#define RA_MAX_DENSE_ADJACENCY_BYTES (64 << 20)
+
 struct ra_reg {
    BITSET_WORD *conflicts;
    unsigned int *conflict_list;
@@ -126,6 +134,8 @@ struct ra_node {
     *
     * List of which nodes this node interferes with.  This should be
     * symmetric with the other node.
+    *
+    * The adjacency bitset is NULL for large graphs, see ra_graph::edges.
     */
    BITSET_WORD *adjacency;
    unsigned int *adjacency_list;
@@ -166,6 +176,15 @@ struct ra_graph {
    struct ra_node *nodes;
    unsigned int count; /**< count of nodes. */
 
+   /**
+    * Open addressed set of the edges of large graphs, keyed by
+    * ra_edge_key(), instead of the per-node adjacency bitsets.  0 marks an
+    * empty slot, which no edge can have as its key.
+    */
+   uint64_t *edges;
+   unsigned int edges_size; /**< number of slots, a power of two */
+   unsigned int edges_count;
+
    unsigned int *stack;
    unsigned int stack_count;
 
@@ -391,10 +410,70 @@ ra_set_finalize(struct ra_regs *regs, unsigned int **q_values)
    }
 }
 
+static uint64_t
+ra_edge_key(unsigned int n1, unsigned int n2)
+{
+   return n1 < n2 ? ((uint64_t)n1 << 32) | n2 : ((uint64_t)n2 << 32) | n1;
+}
+
+static unsigned int
+ra_edge_hash(uint64_t key)
+{
+   return (key * 0x9e3779b97f4a7c15ull) >> 32;
+}
+
+static void
+ra_edges_grow(struct ra_graph *g)
+{
+   uint64_t *old_edges = g->edges;
+   unsigned int old_size = g->edges_size;
+
+   g->edges_size = old_size ? old_size * 2 : 1024;
+   g->edges = rzalloc_array(g, uint64_t, g->edges_size);
+
+   for (unsigned int i = 0; i < old_size; i++) {
+      if (!old_edges[i])
+         continue;
+
+      unsigned int slot = ra_edge_hash(old_edges[i]) & (g->edges_size - 1);
+      while (g->edges[slot])
+         slot = (slot + 1) & (g->edges_size - 1);
+      g->edges[slot] = old_edges[i];
+   }
+
+   ralloc_free(old_edges);
+}
+
+/**
+ * Adds the edge between \p n1 and \p n2 to ra_graph::edges, returning false
+ * if it was already there.
+ */
+static bool
+ra_edges_add(struct ra_graph *g, unsigned int n1, unsigned int n2)
+{
+   uint64_t key = ra_edge_key(n1, n2);
+
+   /* Keep the load factor under 1/2. */
+   if ((g->edges_count + 1) * 2 > g->edges_size)
+      ra_edges_grow(g);
+
+   unsigned int slot = ra_edge_hash(key) & (g->edges_size - 1);
+   while (g->edges[slot]) {
+      if (g->edges[slot] == key)
+         return false;
+      slot = (slot + 1) & (g->edges_size - 1);
+   }
+
+   g->edges[slot] = key;
+   g->edges_count++;
+   return true;
+}
+
 static void
 ra_add_node_adjacency(struct ra_graph *g, unsigned int n1, unsigned int n2)
 {
-   BITSET_SET(g->nodes[n1].adjacency, n2);
+   if (!g->edges)
+      BITSET_SET(g->nodes[n1].adjacency, n2);
 
    assert(n1 != n2);
 
@@ -427,9 +506,15 @@ ra_alloc_interference_graph(struct ra_regs *regs, unsigned int count)
 
    g->stack = rzalloc_array(g, unsigned int, count);
 
+   if ((uint64_t) count * BITSET_WORDS(count) * sizeof(BITSET_WORD) >
+       RA_MAX_DENSE_ADJACENCY_BYTES)
+      ra_edges_grow(g);
+
    for (i = 0; i < count; i++) {
-      int bitset_count = BITSET_WORDS(count);
-      g->nodes[i].adjacency = rzalloc_array(g, BITSET_WORD, bitset_count);
+      if (!g->edges) {
+         int bitset_count = BITSET_WORDS(count);
+         g->nodes[i].adjacency = rzalloc_array(g, BITSET_WORD, bitset_count);
+      }
 
       g->nodes[i].adjacency_list_size = 4;
       g->nodes[i].adjacency_list =
@@ -464,7 +549,11 @@ void
 ra_add_node_interference(struct ra_graph *g,
                          unsigned int n1, unsigned int n2)
 {
-   if (n1 != n2 && !BITSET_TEST(g->nodes[n1].adjacency, n2)) {
+   if (n1 == n2)
+      return;
+
+   if (g->edges ? ra_edges_add(g, n1, n2)
+                : !BITSET_TEST(g->nodes[n1].adjacency, n2)) {
       ra_add_node_adjacency(g, n1, n2);
       ra_add_node_adjacency(g, n2, n1);
    }
@@ -478,23 +567,202 @@ pq_test(struct ra_graph *g, unsigned int n)
    return g->nodes[n].q_total < g->regs->classes[n_class]->p;
 }
 
+/* The order in which the original scan over all nodes picked the
+ * optimistic node: lowest q total, highest index for equal q totals.
+ */
+static bool
+ra_node_more_optimistic(struct ra_graph *g, unsigned int a, unsigned int b)
+{
+   if (g->nodes[a].q_total != g->nodes[b].q_total)
+      return g->nodes[a].q_total < g->nodes[b].q_total;
+
+   return a > b;
+}
+
+/**
+ * Binary heap of node indices, used by ra_simplify() to pick optimistic
+ * nodes.
+ *
+ * The node on top is the most optimistic one.  pos tracks where each node
+ * is in the heap so that it can be found again to be moved or removed.
+ */
+struct ra_heap {
+   unsigned int *nodes;
+   unsigned int count;
+   unsigned int *pos;
+};
+
+static void
+ra_heap_set(struct ra_heap *heap, unsigned int i, unsigned int n)
+{
+   heap->nodes[i] = n;
+   heap->pos[n] = i;
+}
+
+static void
+ra_heap_sift_up(struct ra_graph *g, struct ra_heap *heap, unsigned int i)
+{
+   unsigned int n = heap->nodes[i];
+
+   while (i > 0) {
+      unsigned int parent = (i - 1) / 2;
+
+      if (!ra_node_more_optimistic(g, n, heap->nodes[parent]))
+         break;
+
+      ra_heap_set(heap, i, heap->nodes[parent]);
+      i = parent;
+   }
+   ra_heap_set(heap, i, n);
+}
+
+static void
+ra_heap_sift_down(struct ra_graph *g, struct ra_heap *heap, unsigned int i)
+{
+   unsigned int n = heap->nodes[i];
+
+   while (2 * i + 1 < heap->count) {
+      unsigned int child = 2 * i + 1;
+
+      if (child + 1 < heap->count &&
+          ra_node_more_optimistic(g, heap->nodes[child + 1],
+                                  heap->nodes[child]))
+         child++;
+
+      if (!ra_node_more_optimistic(g, heap->nodes[child], n))
+         break;
+
+      ra_heap_set(heap, i, heap->nodes[child]);
+      i = child;
+   }
+   ra_heap_set(heap, i, n);
+}
+
+static void
+ra_heap_push(struct ra_graph *g, struct ra_heap *heap, unsigned int n)
+{
+   ra_heap_set(heap, heap->count++, n);
+   ra_heap_sift_up(g, heap, heap->count - 1);
+}
+
+static void
+ra_heap_remove_at(struct ra_graph *g, struct ra_heap *heap, unsigned int i)
+{
+   unsigned int last = heap->nodes[--heap->count];
+
+   if (i == heap->count)
+      return;
+
+   ra_heap_set(heap, i, last);
+   ra_heap_sift_down(g, heap, i);
+   ra_heap_sift_up(g, heap, heap->pos[last]);
+}
+
+/**
+ * Returns the highest bit below \p end that is set in \p set, or -1.
+ */
+static int
+ra_bitset_prev(const BITSET_WORD *set, int end)
+{
+   BITSET_WORD bits;
+   int w;
+
+   if (end <= 0)
+      return -1;
+
+   w = BITSET_BITWORD(end - 1);
+   bits = set[w] & (~0u >> (BITSET_WORDBITS - 1 - (end - 1) % BITSET_WORDBITS));
+   while (!bits) {
+      if (w == 0)
+         return -1;
+      bits = set[--w];
+   }
+
+   return w * BITSET_WORDBITS + util_last_bit(bits) - 1;
+}
+
+/**
+ * State of ra_simplify().
+ *
+ * Simplify used to scan all nodes from the highest index to the lowest,
+ * pushing every trivially colorable one, until a whole scan didn't push
+ * anything.  This keeps the exact same order, so that allocations don't
+ * change, while only visiting the trivially colorable nodes.  A node that
+ * becomes trivially colorable would have been seen later in the current
+ * scan if it is below the last pushed node, and only in the next scan
+ * otherwise.
+ */
+struct ra_simplify_state {
+   /** Trivially colorable nodes left for the current scan. */
+   BITSET_WORD *current;
+
+   /** Trivially colorable nodes for the next scan. */
+   BITSET_WORD *next;
+   bool next_empty;
+
+   /**
+    * All nodes not pushed yet, for picking an optimistic node.  This is
+    * only built once one is needed, as graphs that are trivially colorable
+    * all the way don't need it.
+    */
+   struct ra_heap remaining;
+   bool remaining_built;
+
+   /** Number of nodes not pushed yet. */
+   unsigned int remaining_count;
+
+   /** Index of the last node pushed in the current scan. */
+   unsigned int scan_pos;
+};
+
 static void
-decrement_q(struct ra_graph *g, unsigned int n)
+decrement_q(struct ra_graph *g, unsigned int n, struct ra_simplify_state *s)
 {
    unsigned int i;
    int n_class = g->nodes[n].class;
 
    for (i = 0; i < g->nodes[n].adjacency_count; i++) {
       unsigned int n2 = g->nodes[n].adjacency_list[i];
-      unsigned int n2_class = g->nodes[n2].class;
+      struct ra_class *n2_class = g->regs->classes[g->nodes[n2].class];
 
       if (!g->nodes[n2].in_stack) {
-         assert(g->nodes[n2].q_total >= g->regs->classes[n2_class]->q[n_class]);
-         g->nodes[n2].q_total -= g->regs->classes[n2_class]->q[n_class];
+         unsigned int q_total = g->nodes[n2].q_total;
+
+         assert(q_total >= n2_class->q[n_class]);
+         g->nodes[n2].q_total = q_total - n2_class->q[n_class];
+
+         if (g->nodes[n2].reg != NO_REG)
+            continue;
+
+         if (s->remaining_built)
+            ra_heap_sift_up(g, &s->remaining, s->remaining.pos[n2]);
+
+         /* Whether it just became trivially colorable, see pq_test(). */
+         if (q_total >= n2_class->p && g->nodes[n2].q_total < n2_class->p) {
+            if (n2 < s->scan_pos) {
+               BITSET_SET(s->current, n2);
+            } else {
+               BITSET_SET(s->next, n2);
+               s->next_empty = false;
+            }
+         }
       }
    }
 }
 
+static void
+ra_simplify_push(struct ra_graph *g, unsigned int n,
+                 struct ra_simplify_state *s)
+{
+   if (s->remaining_built)
+      ra_heap_remove_at(g, &s->remaining, s->remaining.pos[n]);
+   s->remaining_count--;
+   decrement_q(g, n, s);
+   g->stack[g->stack_count] = n;
+   g->stack_count++;
+   g->nodes[n].in_stack = true;
+}
+
 /**
  * Simplifies the interference graph by pushing all
  * trivially-colorable nodes into a stack of nodes to be colored,
@@ -508,48 +776,76 @@ decrement_q(struct ra_graph *g, unsigned int n)
 static void
 ra_simplify(struct ra_graph *g)
 {
-   bool progress = true;
    unsigned int stack_optimistic_start = UINT_MAX;
+   struct ra_simplify_state s;
+   unsigned int *storage;
+   BITSET_WORD *tmp;
    int i;
 
-   while (progress) {
-      unsigned int best_optimistic_node = ~0;
-      unsigned int lowest_q_total = ~0;
-
-      progress = false;
-
-      for (i = g->count - 1; i >= 0; i--) {
-	 if (g->nodes[i].in_stack || g->nodes[i].reg != NO_REG)
-	    continue;
-
-	 if (pq_test(g, i)) {
-	    decrement_q(g, i);
-	    g->stack[g->stack_count] = i;
-	    g->stack_count++;
-	    g->nodes[i].in_stack = true;
-	    progress = true;
-	 } else {
-	    unsigned int new_q_total = g->nodes[i].q_total;
-	    if (new_q_total < lowest_q_total) {
-	       best_optimistic_node = i;
-	       lowest_q_total = new_q_total;
-	    }
-	 }
+   storage = ralloc_array(g, unsigned int, 2 * g->count);
+   s.current = rzalloc_array(storage, BITSET_WORD, BITSET_WORDS(g->count));
+   s.next = rzalloc_array(storage, BITSET_WORD, BITSET_WORDS(g->count));
+   s.next_empty = true;
+   s.remaining = (struct ra_heap) {
+      storage, 0, storage + g->count
+   };
+   s.remaining_built = false;
+   s.remaining_count = 0;
+   s.scan_pos = UINT_MAX;
+
+   for (i = g->count - 1; i >= 0; i--) {
+      if (g->nodes[i].in_stack || g->nodes[i].reg != NO_REG)
+         continue;
+
+      s.remaining_count++;
+      if (pq_test(g, i))
+         BITSET_SET(s.current, i);
+   }
+
+   while (true) {
+      /* One scan.  Nodes are only added to the current one below the last
+       * pushed node, so it never needs to look back up.
+       */
+      for (i = ra_bitset_prev(s.current, g->count); i >= 0;
+           i = ra_bitset_prev(s.current, i)) {
+         BITSET_CLEAR(s.current, i);
+         s.scan_pos = i;
+         ra_simplify_push(g, i, &s);
       }
 
-      if (!progress && best_optimistic_node != ~0U) {
+      if (s.next_empty) {
+         if (!s.remaining_count)
+            break;
+
          if (stack_optimistic_start == UINT_MAX)
             stack_optimistic_start = g->stack_count;
 
-	 decrement_q(g, best_optimistic_node);
-	 g->stack[g->stack_count] = best_optimistic_node;
-	 g->stack_count++;
-	 g->nodes[best_optimistic_node].in_stack = true;
-	 progress = true;
+         if (!s.remaining_built) {
+            for (i = g->count - 1; i >= 0; i--) {
+               if (!g->nodes[i].in_stack && g->nodes[i].reg == NO_REG)
+                  ra_heap_push(g, &s.remaining, i);
+            }
+            s.remaining_built = true;
+         }
+
+         /* Nothing is trivially colorable anymore, so the next scan starts
+          * after an optimistic push.
+          */
+         s.scan_pos = 0;
+         ra_simplify_push(g, s.remaining.nodes[0], &s);
       }
+
+      /* The current scan left its set empty, so it can be the next one's. */
+      tmp = s.current;
+      s.current = s.next;
+      s.next = tmp;
+      s.next_empty = true;
+      s.scan_pos = UINT_MAX;
    }
 
    g->stack_optimistic_start = stack_optimistic_start;
+
+   ralloc_free(storage);
 }
 
 static bool
@@ -677,9 +973,95 @@ ra_select(struct ra_graph *g)
    return true;
 }
 
+/**
+ * Writes the register set and the interference graph, before allocation,
+ * in the text format read by src/util/tests/register_allocate/ra_bench.
+ *
+ * Only what affects the allocation is written: register conflicts, classes
+ * and their q values, node classes, fixed registers and interferences.  A
+ * select_reg_callback can't be recorded, so replays use the default
+ * register choice.
+ */
+void
+ra_dump_graph(struct ra_graph *g, FILE *fp)
+{
+   struct ra_regs *regs = g->regs;
+   unsigned int i, j;
+
+   fprintf(fp, "ra_graph\n");
+   fprintf(fp, "regs %u %u\n", regs->count, regs->round_robin);
+
+   for (i = 0; i < regs->count; i++) {
+      unsigned int count = 0;
+
+      for (j = i + 1; j < regs->count; j++) {
+         if (BITSET_TEST(regs->regs[i].conflicts, j))
+            count++;
+      }
+      if (count == 0)
+         continue;
+
+      fprintf(fp, "conflicts %u %u", i, count);
+      for (j = i + 1; j < regs->count; j++) {
+         if (BITSET_TEST(regs->regs[i].conflicts, j))
+            fprintf(fp, " %u", j);
+      }
+      fprintf(fp, "\n");
+   }
+
+   fprintf(fp, "classes %u\n", regs->class_count);
+   for (i = 0; i < regs->class_count; i++) {
+      struct ra_class *class = regs->classes[i];
+
+      fprintf(fp, "class %u %u", i, class->p);
+      for (j = 0; j < regs->count; j++) {
+         if (reg_belongs_to_class(j, class))
+            fprintf(fp, " %u", j);
+      }
+      fprintf(fp, "\nq");
+      for (j = 0; j < regs->class_count; j++)
+         fprintf(fp, " %u", class->q[j]);
+      fprintf(fp, "\n");
+   }
+
+   fprintf(fp, "nodes %u\n", g->count);
+   for (i = 0; i < g->count; i++) {
+      struct ra_node *node = &g->nodes[i];
+      unsigned int count = 0;
+
+      for (j = 0; j < node->adjacency_count; j++)
+         count += node->adjacency_list[j] > i;
+
+      fprintf(fp, "node %u %d %u", node->class,
+              node->reg == NO_REG ? -1 : (int)node->reg, count);
+      for (j = 0; j < node->adjacency_count; j++) {
+         if (node->adjacency_list[j] > i)
+            fprintf(fp, " %u", node->adjacency_list[j]);
+      }
+      fprintf(fp, "\n");
+   }
+
+   fprintf(fp, "end\n");
+}
+
 bool
 ra_allocate(struct ra_graph *g)
 {
+   static mtx_t dump_mutex = _MTX_INITIALIZER_NP;
+   const char *dump_path = getenv("MESA_RA_DUMP_GRAPHS");
+
+   if (dump_path) {
+      FILE *fp;
+
+      mtx_lock(&dump_mutex);
+      fp = fopen(dump_path, "a");
+      if (fp) {
+         ra_dump_graph(g, fp);
+         fclose(fp);
+      }
+      mtx_unlock(&dump_mutex);
+   }
+
    ra_simplify(g);
    return ra_select(g);
 }
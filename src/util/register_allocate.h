@@ -29,6 +29,7 @@
 #define REGISTER_ALLOCATE_H
 
 #include <stdbool.h>
+#include <stdio.h>
 #include "util/bitset.h"
 
 #ifdef __cplusplus
@@ -93,6 +94,9 @@ void ra_set_node_spill_cost(struct ra_graph *g, unsigned int n, float cost);
 int ra_get_best_spill_node(struct ra_graph *g);
 /** @} */
 
+/** Writes the graph for replaying, see also MESA_RA_DUMP_GRAPHS. */
+void ra_dump_graph(struct ra_graph *g, FILE *fp);
+
 
 #ifdef __cplusplus
 }  // extern "C"
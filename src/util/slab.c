@@ -97,6 +97,21 @@ slab_free_orphaned(struct slab_element_header *elt)
       free(page);
 }
 
+/* Take all elements that were freed to the pool from other threads. */
+static struct slab_element_header *
+slab_take_migrated(struct slab_child_pool *pool)
+{
+   struct slab_element_header *list;
+
+   do {
+      list = p_atomic_read(&pool->migrated);
+      if (!list)
+         return NULL;
+   } while (p_atomic_cmpxchg(&pool->migrated, list, NULL) != list);
+
+   return list;
+}
+
 /**
  * Create a parent pool for the allocation of same-sized objects.
  *
@@ -108,16 +123,16 @@ slab_create_parent(struct slab_parent_pool *parent,
                    unsigned item_size,
                    unsigned num_items)
 {
-   mtx_init(&parent->mutex, mtx_plain);
    parent->element_size = ALIGN(sizeof(struct slab_element_header) + item_size,
                                 sizeof(intptr_t));
    parent->num_elements = num_items;
+   parent->migrating = 0;
 }
 
 void
 slab_destroy_parent(struct slab_parent_pool *parent)
 {
-   mtx_destroy(&parent->mutex);
+   assert(!p_atomic_read(&parent->migrating));
 }
 
 /**
@@ -140,11 +155,11 @@ void slab_create_child(struct slab_child_pool *pool,
  */
 void slab_destroy_child(struct slab_child_pool *pool)
 {
+   struct slab_element_header *migrated;
+
    if (!pool->parent)
       return; /* the slab probably wasn't even created */
 
-   mtx_lock(&pool->parent->mutex);
-
    while (pool->pages) {
       struct slab_page_header *page = pool->pages;
       pool->pages = page->u.next;
@@ -156,14 +171,21 @@ void slab_destroy_child(struct slab_child_pool *pool)
       }
    }
 
-   while (pool->migrated) {
-      struct slab_element_header *elt = pool->migrated;
-      pool->migrated = elt->next;
+   /* slab_free calls that read the owner of an element before it was
+    * orphaned may still be pushing onto our migrated list, wait for them.
+    * This has to be an atomic read-modify-write, so that it is ordered
+    * against their increment of the counter.
+    */
+   while (p_atomic_cmpxchg(&pool->parent->migrating, 0, 0))
+      thrd_yield();
+
+   migrated = slab_take_migrated(pool);
+   while (migrated) {
+      struct slab_element_header *elt = migrated;
+      migrated = elt->next;
       slab_free_orphaned(elt);
    }
 
-   mtx_unlock(&pool->parent->mutex);
-
    while (pool->free) {
       struct slab_element_header *elt = pool->free;
       pool->free = elt->next;
@@ -213,10 +235,7 @@ slab_alloc(struct slab_child_pool *pool)
       /* First, collect elements that belong to us but were freed from a
        * different child pool.
        */
-      mtx_lock(&pool->parent->mutex);
-      pool->free = pool->migrated;
-      pool->migrated = NULL;
-      mtx_unlock(&pool->parent->mutex);
+      pool->free = slab_take_migrated(pool);
 
       /* Now allocate a new page. */
       if (!pool->free && !slab_add_new_page(pool))
@@ -258,21 +277,28 @@ void slab_free(struct slab_child_pool *pool, void *ptr)
       return;
    }
 
-   /* The slow case: migration or an orphaned page. */
-   mtx_lock(&pool->parent->mutex);
-
-   /* Note: we _must_ re-read elt->owner here because the owning child pool
-    * may have been destroyed by another thread in the meantime.
+   /* The slow case: migration or an orphaned page.
+    *
+    * Note: we _must_ re-read elt->owner here because the owning child pool
+    * may have been destroyed by another thread in the meantime. Counting
+    * ourselves in parent->migrating first keeps slab_destroy_child from
+    * returning until we're done with the owner.
     */
+   p_atomic_inc(&pool->parent->migrating);
    owner_int = p_atomic_read(&elt->owner);
 
    if (!(owner_int & 1)) {
       struct slab_child_pool *owner = (struct slab_child_pool *)owner_int;
-      elt->next = owner->migrated;
-      owner->migrated = elt;
-      mtx_unlock(&pool->parent->mutex);
+      struct slab_element_header *head;
+
+      do {
+         head = p_atomic_read(&owner->migrated);
+         elt->next = head;
+      } while (p_atomic_cmpxchg(&owner->migrated, head, elt) != head);
+
+      p_atomic_dec(&pool->parent->migrating);
    } else {
-      mtx_unlock(&pool->parent->mutex);
+      p_atomic_dec(&pool->parent->migrating);
 
       slab_free_orphaned(elt);
    }
@@ -32,8 +32,8 @@
  *
  * Allocations obtained from one child pool should usually be freed in the
  * same child pool. Freeing an allocation in a different child pool associated
- * to the same parent is allowed (and requires no locking by the caller), but
- * it is discouraged because it implies a performance penalty.
+ * to the same parent is allowed (and requires no locking by the caller). It
+ * is lock-free, but slower because of the atomic operations involved.
  *
  * For convenience and to ease the transition, there is also a set of wrapper
  * functions around a single parent-child pair.
@@ -48,9 +48,13 @@ struct slab_element_header;
 struct slab_page_header;
 
 struct slab_parent_pool {
-   mtx_t mutex;
    unsigned element_size;
    unsigned num_elements;
+
+   /* Number of slab_free calls that are pushing an element onto the migrated
+    * list of another child pool, which must not be destroyed meanwhile.
+    */
+   unsigned migrating;
 };
 
 struct slab_child_pool {
@@ -64,7 +68,8 @@ struct slab_child_pool {
    /* Elements that are owned by this pool but were freed with a different
     * pool as the argument to slab_free.
     *
-    * This list is protected by the parent mutex.
+    * Other threads push onto this list atomically, and slab_alloc takes the
+    * whole list at once.
     */
    struct slab_element_header *migrated;
 };
@@ -0,0 +1,233 @@
+/*
+ * Copyright 2017 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHOR(S) AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+/* Tests for the slab allocator, with elements allocated on one thread and
+ * freed on another. Run with "bench" as argument to measure the throughput
+ * of such producer/consumer pairs instead.
+ */
+
+/* Force assertions, even on release builds. */
+#undef NDEBUG
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "macros.h"
+#include "slab.h"
+#include "u_atomic.h"
+#include "u_thread.h"
+
+#define ITEM_SIZE 48
+#define RING_SIZE 256
+
+/* A single producer, single consumer ring of allocated elements. */
+struct ring {
+   void *items[RING_SIZE];
+   unsigned head, tail;
+};
+
+struct pair {
+   struct slab_parent_pool *parent;
+   struct slab_child_pool producer_pool;
+   struct ring ring;
+   unsigned count;
+
+   /* Replace the producer pool with a new one after this many elements,
+    * while the consumer still has to free elements of the orphaned pages.
+    */
+   unsigned destroy_after;
+};
+
+static void
+ring_push(struct ring *ring, void *item)
+{
+   while (p_atomic_read(&ring->head) - p_atomic_read(&ring->tail) == RING_SIZE)
+      thrd_yield();
+
+   ring->items[ring->head % RING_SIZE] = item;
+   p_atomic_set(&ring->head, ring->head + 1);
+}
+
+static void *
+ring_pop(struct ring *ring)
+{
+   void *item;
+
+   while (p_atomic_read(&ring->head) == p_atomic_read(&ring->tail))
+      thrd_yield();
+
+   item = ring->items[ring->tail % RING_SIZE];
+   p_atomic_set(&ring->tail, ring->tail + 1);
+   return item;
+}
+
+static int
+producer(void *data)
+{
+   struct pair *pair = data;
+
+   slab_create_child(&pair->producer_pool, pair->parent);
+
+   for (unsigned i = 0; i < pair->count; i++) {
+      unsigned *item = slab_alloc(&pair->producer_pool);
+
+      assert(item);
+      for (unsigned j = 0; j < ITEM_SIZE / sizeof(unsigned); j++)
+         item[j] = i + j;
+      ring_push(&pair->ring, item);
+
+      if (i + 1 == pair->destroy_after) {
+         slab_destroy_child(&pair->producer_pool);
+         slab_create_child(&pair->producer_pool, pair->parent);
+      }
+   }
+
+   slab_destroy_child(&pair->producer_pool);
+   return 0;
+}
+
+static int
+consumer(void *data)
+{
+   struct pair *pair = data;
+   struct slab_child_pool pool;
+
+   slab_create_child(&pool, pair->parent);
+
+   for (unsigned i = 0; i < pair->count; i++) {
+      unsigned *item = ring_pop(&pair->ring);
+
+      for (unsigned j = 0; j < ITEM_SIZE / sizeof(unsigned); j++)
+         assert(item[j] == i + j);
+
+      /* Keep the consumer's own pool busy as well. */
+      slab_free(&pool, slab_alloc(&pool));
+      slab_free(&pool, item);
+   }
+
+   slab_destroy_child(&pool);
+   return 0;
+}
+
+/* Runs producer/consumer pairs sharing one parent pool. */
+static void
+run_pairs(unsigned num_pairs, unsigned count, unsigned destroy_after)
+{
+   struct slab_parent_pool parent;
+   struct pair *pairs = calloc(num_pairs, sizeof(*pairs));
+   thrd_t *threads = calloc(num_pairs * 2, sizeof(*threads));
+
+   slab_create_parent(&parent, ITEM_SIZE, 64);
+
+   for (unsigned i = 0; i < num_pairs; i++) {
+      pairs[i].parent = &parent;
+      pairs[i].count = count;
+      pairs[i].destroy_after = destroy_after;
+      threads[i * 2] = u_thread_create(producer, &pairs[i]);
+      threads[i * 2 + 1] = u_thread_create(consumer, &pairs[i]);
+   }
+
+   for (unsigned i = 0; i < num_pairs * 2; i++)
+      thrd_join(threads[i], NULL);
+
+   slab_destroy_parent(&parent);
+   free(threads);
+   free(pairs);
+}
+
+static void
+test_single_thread(void)
+{
+   struct slab_mempool pool;
+   unsigned *items[1000];
+
+   slab_create(&pool, ITEM_SIZE, 16);
+
+   for (unsigned round = 0; round < 3; round++) {
+      for (unsigned i = 0; i < ARRAY_SIZE(items); i++) {
+         items[i] = slab_alloc_st(&pool);
+         memset(items[i], i & 0xff, ITEM_SIZE);
+      }
+      for (unsigned i = 0; i < ARRAY_SIZE(items); i++) {
+         for (unsigned j = 0; j < ITEM_SIZE; j++)
+            assert(((uint8_t *)items[i])[j] == (i & 0xff));
+      }
+      /* Free in a different order than allocated. */
+      for (unsigned i = 0; i < ARRAY_SIZE(items); i += 2)
+         slab_free_st(&pool, items[i]);
+      for (unsigned i = 1; i < ARRAY_SIZE(items); i += 2)
+         slab_free_st(&pool, items[i]);
+   }
+
+   slab_destroy(&pool);
+}
+
+static int64_t
+now_nsec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static void
+bench(void)
+{
+   static const unsigned num_pairs[] = { 1, 2, 4 };
+   const unsigned count = 1000000;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(num_pairs); i++) {
+      int64_t start = now_nsec();
+
+      run_pairs(num_pairs[i], count, ~0u);
+      printf("%u pairs: %.1f M cross-thread alloc/free per second\n",
+             num_pairs[i],
+             num_pairs[i] * count * 1000.0 / (now_nsec() - start));
+   }
+}
+
+int
+main(int argc, char **argv)
+{
+   if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+      bench();
+      return 0;
+   }
+
+   test_single_thread();
+
+   /* Elements migrate back to the producer pool. */
+   run_pairs(1, 100000, ~0u);
+   run_pairs(4, 50000, ~0u);
+
+   /* The producer pool is destroyed while the consumer is still freeing its
+    * elements, at various points.
+    */
+   for (unsigned i = 0; i < 20; i++)
+      run_pairs(2, 5000, 1000 + i * 173);
+
+   return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "hash_table.h"
+#include "ralloc.h"
+#include "set.h"
+#include "string_intern.h"
+
+struct _mesa_string_intern {
+   /** Set of the interned copies, hashed and compared as strings. */
+   struct set *strings;
+
+   /** Linear allocator the copies are carved out of. */
+   void *lin_ctx;
+};
+
+struct _mesa_string_intern *
+_mesa_string_intern_create(void *mem_ctx)
+{
+   struct _mesa_string_intern *si = ralloc(mem_ctx, struct _mesa_string_intern);
+   if (si == NULL)
+      return NULL;
+
+   si->strings = _mesa_set_create(si, _mesa_key_hash_string,
+                                  _mesa_key_string_equal);
+   si->lin_ctx = linear_alloc_parent(si, 0);
+   if (si->strings == NULL || si->lin_ctx == NULL) {
+      ralloc_free(si);
+      return NULL;
+   }
+
+   return si;
+}
+
+const char *
+_mesa_string_intern_pre_hashed(struct _mesa_string_intern *si,
+                               uint32_t hash, const char *str, size_t len)
+{
+   assert(str[len] == '\0');
+
+   struct set_entry *entry =
+      _mesa_set_search_pre_hashed(si->strings, hash, str);
+   if (entry)
+      return (const char *) entry->key;
+
+   char *copy = (char *) linear_alloc_child(si->lin_ctx, len + 1);
+   if (copy == NULL)
+      return NULL;
+
+   memcpy(copy, str, len + 1);
+   _mesa_set_add_pre_hashed(si->strings, hash, copy);
+
+   return copy;
+}
+
+const char *
+_mesa_string_intern_len(struct _mesa_string_intern *si,
+                        const char *str, size_t len)
+{
+   /* _mesa_hash_data() over the characters gives the same FNV-1a value as
+    * _mesa_hash_string(), without walking the string a second time.
+    */
+   return _mesa_string_intern_pre_hashed(si, _mesa_hash_data(str, len),
+                                         str, len);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _STRING_INTERN_H
+#define _STRING_INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A table of unique copies of strings.
+ *
+ * Interning a string returns a copy owned by the table, and interning an
+ * equal string again returns the same copy, so many references to the same
+ * identifier share a single allocation. The copies live until the table is
+ * freed with ralloc_free().
+ */
+struct _mesa_string_intern;
+
+struct _mesa_string_intern *
+_mesa_string_intern_create(void *mem_ctx);
+
+/**
+ * Return the table's copy of the \p len bytes at \p str, adding one if
+ * needed. \p str[len] must be the terminating NUL, which lets callers that
+ * already know the length (such as a flex scanner) skip a strlen().
+ */
+const char *
+_mesa_string_intern_len(struct _mesa_string_intern *si,
+                        const char *str, size_t len);
+
+/**
+ * Like _mesa_string_intern_len(), for callers that have already computed
+ * _mesa_hash_string(str).
+ */
+const char *
+_mesa_string_intern_pre_hashed(struct _mesa_string_intern *si,
+                               uint32_t hash, const char *str, size_t len);
+
+static inline const char *
+_mesa_string_intern(struct _mesa_string_intern *si, const char *str)
+{
+   size_t len = 0;
+
+   while (str[len] != '\0')
+      len++;
+
+   return _mesa_string_intern_len(si, str, len);
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _STRING_INTERN_H */
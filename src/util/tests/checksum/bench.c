@@ -0,0 +1,115 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Measures the throughput of _mesa_sha1_compute() and util_hash_crc32(),
+ * and of the portable SHA-1 for comparison, on buffers of a few sizes.
+ *
+ * Usage: bench [size...]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "crc32.h"
+#include "macros.h"
+#include "mesa-sha1.h"
+
+#define BYTES_PER_RUN (256 << 20)
+
+static int64_t
+now_nsec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static uint32_t
+hash_sha1(const void *data, size_t size)
+{
+   unsigned char sha1[20];
+
+   _mesa_sha1_compute(data, size, sha1);
+   return sha1[0];
+}
+
+static uint32_t
+hash_sha1_portable(const void *data, size_t size)
+{
+   unsigned char sha1[20];
+   SHA1_CTX ctx;
+
+   SHA1Init(&ctx);
+   SHA1Update(&ctx, data, size);
+   SHA1Final(sha1, &ctx);
+   return sha1[0];
+}
+
+static uint32_t
+hash_crc32(const void *data, size_t size)
+{
+   return util_hash_crc32(data, size);
+}
+
+static const struct {
+   const char *name;
+   uint32_t (*hash)(const void *data, size_t size);
+} hashes[] = {
+   { "sha1", hash_sha1 },
+   { "sha1-c", hash_sha1_portable },
+   { "crc32", hash_crc32 },
+};
+
+int
+main(int argc, char **argv)
+{
+   static const unsigned default_sizes[] = { 64, 1024, 16384, 1 << 20 };
+   unsigned num_sizes = argc > 1 ? argc - 1 : ARRAY_SIZE(default_sizes);
+   uint32_t sink = 0;
+
+   printf("%-8s %8s %8s\n", "MB/s", "size", "");
+
+   for (unsigned s = 0; s < num_sizes; s++) {
+      unsigned size = argc > 1 ? atoi(argv[s + 1]) : default_sizes[s];
+      unsigned runs = MAX2(BYTES_PER_RUN / MAX2(size, 1), 1);
+      uint8_t *data = malloc(MAX2(size, 1));
+
+      for (unsigned i = 0; i < size; i++)
+         data[i] = i * 7;
+
+      for (unsigned h = 0; h < ARRAY_SIZE(hashes); h++) {
+         int64_t start = now_nsec();
+
+         for (unsigned i = 0; i < runs; i++)
+            sink += hashes[h].hash(data, size);
+
+         printf("%-8s %8u %8.0f\n", hashes[h].name, size,
+                (double)size * runs * 1000.0 / (now_nsec() - start));
+      }
+
+      free(data);
+   }
+
+   return sink == 1 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Checks _mesa_sha1_*() and util_hash_crc32() against known answers, and
+ * against the portable implementations for every length up to a few blocks
+ * at every alignment, so whatever the CPU selects gets covered.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "crc32.h"
+#include "mesa-sha1.h"
+
+#define MAX_SIZE 1100
+
+static int failures;
+
+static void
+check_sha1(const char *what, const unsigned char sha1[20],
+           const char *expected)
+{
+   char buf[41];
+
+   _mesa_sha1_format(buf, sha1);
+   if (strcmp(buf, expected)) {
+      fprintf(stderr, "%s: sha1 %s, expected %s\n", what, buf, expected);
+      failures++;
+   }
+}
+
+static void
+check_crc32(const char *what, uint32_t crc, uint32_t expected)
+{
+   if (crc != expected) {
+      fprintf(stderr, "%s: crc32 %08x, expected %08x\n", what, crc, expected);
+      failures++;
+   }
+}
+
+/* One bit at a time, straight from the definition. */
+static uint32_t
+crc32_reference(const uint8_t *p, size_t size)
+{
+   uint32_t crc = 0xffffffff;
+
+   while (size--) {
+      crc ^= *p++;
+      for (unsigned i = 0; i < 8; i++)
+         crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+   }
+
+   return crc;
+}
+
+static void
+sha1_reference(const uint8_t *p, size_t size, unsigned char sha1[20])
+{
+   SHA1_CTX ctx;
+
+   SHA1Init(&ctx);
+   SHA1Update(&ctx, p, size);
+   SHA1Final(sha1, &ctx);
+}
+
+static void
+test_known_answers(void)
+{
+   static const char *abc = "abc";
+   static const char *abcdbcde =
+      "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+   static const char *digits = "123456789";
+   unsigned char sha1[20];
+   struct mesa_sha1 ctx;
+   char a[1000];
+
+   _mesa_sha1_compute("", 0, sha1);
+   check_sha1("empty", sha1, "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+
+   _mesa_sha1_compute(abc, strlen(abc), sha1);
+   check_sha1("abc", sha1, "a9993e364706816aba3e25717850c26c9cd0d89d");
+
+   _mesa_sha1_compute(abcdbcde, strlen(abcdbcde), sha1);
+   check_sha1("abcdbcde", sha1, "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+
+   memset(a, 'a', sizeof(a));
+   _mesa_sha1_init(&ctx);
+   for (unsigned i = 0; i < 1000; i++)
+      _mesa_sha1_update(&ctx, a, sizeof(a));
+   _mesa_sha1_final(&ctx, sha1);
+   check_sha1("million a", sha1, "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+
+   /* util_hash_crc32() doesn't invert its result. */
+   check_crc32("empty", util_hash_crc32(digits, 0), 0xffffffff);
+   check_crc32("123456789", ~util_hash_crc32(digits, strlen(digits)),
+               0xcbf43926);
+   check_crc32("1000 a", util_hash_crc32(a, sizeof(a)),
+               crc32_reference((const uint8_t *)a, sizeof(a)));
+}
+
+static void
+test_all_sizes(const uint8_t *data)
+{
+   for (unsigned offset = 0; offset < 16; offset++) {
+      for (unsigned size = 0; size <= MAX_SIZE; size++) {
+         const uint8_t *p = data + offset;
+         unsigned char sha1[20], expected[20];
+         char what[32], buf[41];
+
+         snprintf(what, sizeof(what), "size %u offset %u", size, offset);
+
+         _mesa_sha1_compute(p, size, sha1);
+         sha1_reference(p, size, expected);
+         _mesa_sha1_format(buf, expected);
+         check_sha1(what, sha1, buf);
+
+         check_crc32(what, util_hash_crc32(p, size),
+                     crc32_reference(p, size));
+      }
+   }
+}
+
+static void
+test_split_updates(const uint8_t *data)
+{
+   for (unsigned first = 0; first <= 130; first++) {
+      for (unsigned second = 0; second <= 200; second += 7) {
+         unsigned size = first + second + 64;
+         unsigned char sha1[20], expected[20];
+         struct mesa_sha1 ctx;
+         char what[32], buf[41];
+         uint32_t crc;
+
+         snprintf(what, sizeof(what), "split %u+%u+64", first, second);
+
+         _mesa_sha1_init(&ctx);
+         _mesa_sha1_update(&ctx, data, first);
+         _mesa_sha1_update(&ctx, data + first, second);
+         _mesa_sha1_update(&ctx, data + first + second, 64);
+         _mesa_sha1_final(&ctx, sha1);
+
+         sha1_reference(data, size, expected);
+         _mesa_sha1_format(buf, expected);
+         check_sha1(what, sha1, buf);
+
+         crc = util_hash_crc32(data, first);
+         crc = util_crc32_update(crc, data + first, second);
+         crc = util_crc32_update(crc, data + first + second, 64);
+         check_crc32(what, crc, crc32_reference(data, size));
+      }
+   }
+}
+
+int
+main(void)
+{
+   uint8_t data[MAX_SIZE + 16];
+   uint32_t seed = 1;
+
+   for (unsigned i = 0; i < sizeof(data); i++) {
+      seed = seed * 1103515245 + 12345;
+      data[i] = seed >> 16;
+   }
+
+   test_known_answers();
+   test_all_sizes(data);
+   test_split_updates(data);
+
+   return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,241 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Times insert/search/remove mixes on hash_table and set, with pointer keys
+ * hashed by _mesa_hash_pointer() like most users of both do.
+ *
+ * Usage: bench [num_keys...]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "hash_table.h"
+#include "set.h"
+
+#define OPS_PER_RUN (1 << 22)
+
+static int64_t
+now_nsec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static uint32_t rand_state = 1;
+
+static uint32_t
+next_rand(void)
+{
+   rand_state = rand_state * 1103515245 + 12345;
+   return rand_state >> 8;
+}
+
+struct bench_ops {
+   const char *name;
+   void *(*create)(void);
+   void (*destroy)(void *t);
+   void (*insert)(void *t, const void *key);
+   bool (*search)(void *t, const void *key);
+   void (*remove)(void *t, const void *key);
+};
+
+static void *
+ht_create(void)
+{
+   return _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                                  _mesa_key_pointer_equal);
+}
+
+static void
+ht_destroy(void *t)
+{
+   _mesa_hash_table_destroy(t, NULL);
+}
+
+static void
+ht_insert(void *t, const void *key)
+{
+   _mesa_hash_table_insert(t, key, NULL);
+}
+
+static bool
+ht_search(void *t, const void *key)
+{
+   return _mesa_hash_table_search(t, key) != NULL;
+}
+
+static void
+ht_remove(void *t, const void *key)
+{
+   _mesa_hash_table_remove(t, _mesa_hash_table_search(t, key));
+}
+
+static void *
+set_create(void)
+{
+   return _mesa_set_create(NULL, _mesa_hash_pointer, _mesa_key_pointer_equal);
+}
+
+static void
+set_destroy(void *t)
+{
+   _mesa_set_destroy(t, NULL);
+}
+
+static void
+set_insert(void *t, const void *key)
+{
+   _mesa_set_add(t, key);
+}
+
+static bool
+set_search(void *t, const void *key)
+{
+   return _mesa_set_search(t, key) != NULL;
+}
+
+static void
+set_remove(void *t, const void *key)
+{
+   _mesa_set_remove(t, _mesa_set_search(t, key));
+}
+
+static const struct bench_ops tables[] = {
+   { "hash_table", ht_create, ht_destroy, ht_insert, ht_search, ht_remove },
+   { "set", set_create, set_destroy, set_insert, set_search, set_remove },
+};
+
+/* Returns the time per operation in ns of each mix for num_keys keys:
+ * inserting them into an empty table, searching hits, searching misses,
+ * 50% search / 25% insert / 25% remove of random keys, and removing the
+ * oldest key after each insert, which is where tombstones pile up.
+ */
+#define NUM_MIXES 5
+static const char *mix_names[NUM_MIXES] = {
+   "insert", "hit", "miss", "mixed", "churn",
+};
+
+static void
+run(const struct bench_ops *ops, unsigned num_keys, double *ns)
+{
+   unsigned num_all_keys = num_keys * 2;
+   char *storage = malloc(num_all_keys + OPS_PER_RUN);
+   unsigned *order = malloc(sizeof(*order) * OPS_PER_RUN);
+   unsigned runs = MAX2(OPS_PER_RUN / num_keys, 1);
+   uint32_t sink = 0;
+   int64_t start;
+   void *t;
+
+   /* Keys 0..num_keys-1 are present, the rest are misses. */
+   for (unsigned i = 0; i < OPS_PER_RUN; i++)
+      order[i] = next_rand() % num_keys;
+
+   start = now_nsec();
+   for (unsigned r = 0; r < runs; r++) {
+      t = ops->create();
+      for (unsigned i = 0; i < num_keys; i++)
+         ops->insert(t, storage + i);
+      if (r != runs - 1)
+         ops->destroy(t);
+   }
+   ns[0] = (double)(now_nsec() - start) / (runs * num_keys);
+
+   start = now_nsec();
+   for (unsigned i = 0; i < OPS_PER_RUN; i++)
+      sink += ops->search(t, storage + order[i]);
+   ns[1] = (double)(now_nsec() - start) / OPS_PER_RUN;
+
+   start = now_nsec();
+   for (unsigned i = 0; i < OPS_PER_RUN; i++)
+      sink += ops->search(t, storage + num_keys + order[i]);
+   ns[2] = (double)(now_nsec() - start) / OPS_PER_RUN;
+
+   start = now_nsec();
+   for (unsigned i = 0; i < OPS_PER_RUN; i++) {
+      const void *key = storage + order[i] + (i & 1) * num_keys;
+
+      switch (i & 3) {
+      case 0:
+      case 2:
+         sink += ops->search(t, key);
+         break;
+      case 1:
+         ops->insert(t, key);
+         break;
+      case 3:
+         ops->remove(t, storage + order[i - 2] + num_keys);
+         break;
+      }
+   }
+   ns[3] = (double)(now_nsec() - start) / OPS_PER_RUN;
+   ops->destroy(t);
+
+   t = ops->create();
+   for (unsigned i = 0; i < num_keys; i++)
+      ops->insert(t, storage + i);
+   start = now_nsec();
+   for (unsigned i = 0; i < OPS_PER_RUN; i++) {
+      ops->insert(t, storage + num_keys + i);
+      ops->remove(t, storage + i);
+      sink += ops->search(t, storage + i + num_keys / 2);
+   }
+   ns[4] = (double)(now_nsec() - start) / OPS_PER_RUN;
+   ops->destroy(t);
+
+   if (sink == 0)
+      printf("unexpected: no hits\n");
+
+   free(order);
+   free(storage);
+}
+
+int
+main(int argc, char **argv)
+{
+   static const unsigned default_sizes[] = { 16, 256, 4096, 65536, 1 << 20 };
+   unsigned num_sizes = argc > 1 ? argc - 1 : ARRAY_SIZE(default_sizes);
+
+   printf("%-10s %8s", "ns/op", "keys");
+   for (unsigned m = 0; m < NUM_MIXES; m++)
+      printf(" %7s", mix_names[m]);
+   printf("\n");
+
+   for (unsigned s = 0; s < num_sizes; s++) {
+      unsigned num_keys = argc > 1 ? atoi(argv[s + 1]) : default_sizes[s];
+
+      for (unsigned i = 0; i < ARRAY_SIZE(tables); i++) {
+         double ns[NUM_MIXES];
+
+         run(&tables[i], num_keys, ns);
+         printf("%-10s %8u", tables[i].name, num_keys);
+         for (unsigned m = 0; m < NUM_MIXES; m++)
+            printf(" %7.1f", ns[m]);
+         printf("\n");
+      }
+   }
+
+   return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "hash_table.h"
+
+/* Removing an entry moves entries of the same probe sequence into its slot,
+ * check that iterating while removing still visits every entry once.
+ */
+
+static uint32_t
+key_value(const void *key)
+{
+   return *(const uint32_t *)key;
+}
+
+/* Few distinct hashes, so that there are long probe sequences. */
+static uint32_t
+key_hash(const void *key)
+{
+   return key_value(key) % 7;
+}
+
+static bool
+uint32_t_key_equals(const void *a, const void *b)
+{
+   return key_value(a) == key_value(b);
+}
+
+int
+main(int argc, char **argv)
+{
+   struct hash_table *ht;
+   struct hash_entry *entry;
+   unsigned size = 1000;
+   uint32_t keys[size];
+   unsigned visited[size];
+   uint32_t i;
+
+   (void) argc;
+   (void) argv;
+
+   ht = _mesa_hash_table_create(NULL, key_hash, uint32_t_key_equals);
+
+   for (i = 0; i < size; i++) {
+      keys[i] = i;
+      visited[i] = 0;
+      _mesa_hash_table_insert(ht, keys + i, NULL);
+   }
+
+   /* Remove every other entry. */
+   hash_table_foreach(ht, entry) {
+      uint32_t value = key_value(entry->key);
+
+      visited[value]++;
+      if (value & 1)
+         _mesa_hash_table_remove(ht, entry);
+   }
+
+   for (i = 0; i < size; i++)
+      assert(visited[i] == 1);
+   assert(ht->entries == size / 2);
+
+   for (i = 0; i < size; i++)
+      assert((_mesa_hash_table_search(ht, keys + i) == NULL) == (i & 1));
+
+   /* And the remaining ones. */
+   hash_table_foreach(ht, entry) {
+      visited[key_value(entry->key)]++;
+      _mesa_hash_table_remove(ht, entry);
+   }
+
+   for (i = 0; i < size; i++)
+      assert(visited[i] == ((i & 1) ? 1 : 2));
+   assert(ht->entries == 0);
+   assert(_mesa_hash_table_next_entry(ht, NULL) == NULL);
+
+   _mesa_hash_table_destroy(ht, NULL);
+
+   return 0;
+}
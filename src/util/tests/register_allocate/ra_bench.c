@@ -0,0 +1,457 @@
+/*
+ * Copyright © 2017 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Replays interference graphs through the register allocator, timing it
+ * and checking the allocations.
+ *
+ * Usage:
+ *   ra_bench                    run generated graphs
+ *   ra_bench -dump FILE         write the generated graphs to FILE
+ *   ra_bench FILE...            replay graphs written by ra_dump_graph(),
+ *                               for example by running a driver with
+ *                               MESA_RA_DUMP_GRAPHS=FILE
+ *
+ * For each graph, this prints its size, the time taken by building it and
+ * by ra_allocate(), whether allocation succeeded, and a checksum of the
+ * registers picked, which lets allocator changes be checked for changing
+ * any allocation.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "ralloc.h"
+#include "register_allocate.h"
+
+struct bench_graph {
+   unsigned num_regs;
+   unsigned round_robin;
+
+   /* Conflicting register pairs, with r1 < r2. */
+   unsigned num_conflicts;
+   unsigned *conflicts;
+
+   unsigned num_classes;
+   unsigned *class_size;
+   unsigned **class_regs;
+   /* NULL if ra_set_finalize() is to compute it. */
+   unsigned **q;
+
+   unsigned num_nodes;
+   unsigned *node_class;
+   int *node_reg;
+
+   /* Interfering node pairs. */
+   unsigned num_edges;
+   unsigned *edges;
+};
+
+static int64_t
+now_nsec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static unsigned *
+append(void *ctx, unsigned *array, unsigned *count, unsigned value)
+{
+   /* Grow by doubling, array sizes are powers of two. */
+   if ((*count & (*count - 1)) == 0)
+      array = reralloc(ctx, array, unsigned, MAX2(*count * 2, 1));
+   array[(*count)++] = value;
+   return array;
+}
+
+/* Reads the next graph from fp, or returns NULL at the end of the file. */
+static struct bench_graph *
+read_graph(void *ctx, FILE *fp)
+{
+   struct bench_graph *bg;
+   char word[32];
+   unsigned i, j, n, count, value;
+
+   if (fscanf(fp, "%31s", word) != 1 || strcmp(word, "ra_graph") != 0)
+      return NULL;
+
+   bg = rzalloc(ctx, struct bench_graph);
+
+   if (fscanf(fp, " regs %u %u", &bg->num_regs, &bg->round_robin) != 2)
+      return NULL;
+
+   /* The conflicts lines are followed by the classes line. */
+   while (fscanf(fp, " %31s", word) == 1 && strcmp(word, "conflicts") == 0) {
+      if (fscanf(fp, "%u %u", &i, &count) != 2)
+         return NULL;
+      while (count--) {
+         if (fscanf(fp, "%u", &j) != 1)
+            return NULL;
+         bg->conflicts = append(bg, bg->conflicts, &bg->num_conflicts, i);
+         bg->conflicts = append(bg, bg->conflicts, &bg->num_conflicts, j);
+      }
+   }
+   bg->num_conflicts /= 2;
+
+   if (strcmp(word, "classes") != 0 ||
+       fscanf(fp, "%u", &bg->num_classes) != 1)
+      return NULL;
+
+   bg->class_size = rzalloc_array(bg, unsigned, bg->num_classes);
+   bg->class_regs = rzalloc_array(bg, unsigned *, bg->num_classes);
+   bg->q = rzalloc_array(bg, unsigned *, bg->num_classes);
+   for (i = 0; i < bg->num_classes; i++) {
+      if (fscanf(fp, " class %u %u", &n, &bg->class_size[i]) != 2 || n != i)
+         return NULL;
+      bg->class_regs[i] = ralloc_array(bg, unsigned, bg->class_size[i]);
+      for (j = 0; j < bg->class_size[i]; j++) {
+         if (fscanf(fp, "%u", &bg->class_regs[i][j]) != 1)
+            return NULL;
+      }
+
+      if (fscanf(fp, " q") != 0)
+         return NULL;
+      bg->q[i] = ralloc_array(bg, unsigned, bg->num_classes);
+      for (j = 0; j < bg->num_classes; j++) {
+         if (fscanf(fp, "%u", &bg->q[i][j]) != 1)
+            return NULL;
+      }
+   }
+
+   if (fscanf(fp, " nodes %u", &bg->num_nodes) != 1)
+      return NULL;
+
+   bg->node_class = ralloc_array(bg, unsigned, bg->num_nodes);
+   bg->node_reg = ralloc_array(bg, int, bg->num_nodes);
+   for (i = 0; i < bg->num_nodes; i++) {
+      if (fscanf(fp, " node %u %d %u", &bg->node_class[i], &bg->node_reg[i],
+                 &count) != 3)
+         return NULL;
+      while (count--) {
+         if (fscanf(fp, "%u", &value) != 1)
+            return NULL;
+         bg->edges = append(bg, bg->edges, &bg->num_edges, i);
+         bg->edges = append(bg, bg->edges, &bg->num_edges, value);
+      }
+   }
+   bg->num_edges /= 2;
+
+   if (fscanf(fp, " %31s", word) != 1 || strcmp(word, "end") != 0)
+      return NULL;
+
+   return bg;
+}
+
+static uint32_t rand_state;
+
+static unsigned
+next_rand(unsigned max)
+{
+   rand_state = rand_state * 1103515245 + 12345;
+   return (rand_state >> 8) % max;
+}
+
+/* Generates a graph like a scalar backend with 128 registers would, with
+ * register classes of 1 to 4 contiguous registers and the live ranges of
+ * a straight-line program.  pressure is the average number of overlapping
+ * live ranges.
+ */
+static struct bench_graph *
+generate_graph(void *ctx, unsigned num_nodes, unsigned pressure,
+               bool round_robin, uint32_t seed)
+{
+   static const unsigned num_base_regs = 128, max_width = 4;
+   struct bench_graph *bg = rzalloc(ctx, struct bench_graph);
+   unsigned first_reg[max_width + 1];
+   unsigned *start, *end;
+   unsigned i, j, w, w2;
+
+   rand_state = seed;
+   bg->round_robin = round_robin;
+
+   /* Registers of class w start at first_reg[w] and cover base registers
+    * s..s+w-1.
+    */
+   for (w = 1; w <= max_width; w++) {
+      first_reg[w] = bg->num_regs;
+      bg->num_regs += num_base_regs - w + 1;
+   }
+
+   for (w = 1; w <= max_width; w++) {
+      for (w2 = w; w2 <= max_width; w2++) {
+         for (i = 0; i < num_base_regs - w + 1; i++) {
+            for (j = 0; j < num_base_regs - w2 + 1; j++) {
+               unsigned r1 = first_reg[w] + i, r2 = first_reg[w2] + j;
+
+               if (r1 < r2 && i < j + w2 && j < i + w) {
+                  bg->conflicts = append(bg, bg->conflicts,
+                                         &bg->num_conflicts, r1);
+                  bg->conflicts = append(bg, bg->conflicts,
+                                         &bg->num_conflicts, r2);
+               }
+            }
+         }
+      }
+   }
+   bg->num_conflicts /= 2;
+
+   bg->num_classes = max_width;
+   bg->class_size = ralloc_array(bg, unsigned, bg->num_classes);
+   bg->class_regs = ralloc_array(bg, unsigned *, bg->num_classes);
+   for (w = 1; w <= max_width; w++) {
+      bg->class_size[w - 1] = num_base_regs - w + 1;
+      bg->class_regs[w - 1] = ralloc_array(bg, unsigned, num_base_regs);
+      for (i = 0; i < num_base_regs - w + 1; i++)
+         bg->class_regs[w - 1][i] = first_reg[w] + i;
+   }
+
+   bg->num_nodes = num_nodes;
+   bg->node_class = ralloc_array(bg, unsigned, num_nodes);
+   bg->node_reg = ralloc_array(bg, int, num_nodes);
+   start = ralloc_array(bg, unsigned, num_nodes);
+   end = ralloc_array(bg, unsigned, num_nodes);
+
+   /* One definition per instruction, live for 1 to 2 * pressure
+    * instructions.  The first nodes are the payload: fixed registers,
+    * live from the start.
+    */
+   for (i = 0; i < num_nodes; i++) {
+      unsigned r = next_rand(100);
+
+      bg->node_class[i] = r < 70 ? 0 : r < 85 ? 1 : r < 92 ? 2 : 3;
+      bg->node_reg[i] = -1;
+      start[i] = i;
+      end[i] = i + 1 + next_rand(2 * pressure);
+
+      if (i < 8) {
+         bg->node_class[i] = 0;
+         bg->node_reg[i] = i;
+         start[i] = 0;
+      }
+   }
+
+   /* Nodes are sorted by start, so node i overlaps the following nodes
+    * that start before it ends.
+    */
+   for (i = 0; i < num_nodes; i++) {
+      for (j = i + 1; j < num_nodes && start[j] < end[i]; j++) {
+         bg->edges = append(bg, bg->edges, &bg->num_edges, i);
+         bg->edges = append(bg, bg->edges, &bg->num_edges, j);
+      }
+   }
+   bg->num_edges /= 2;
+
+   return bg;
+}
+
+static struct ra_graph *
+build_graph(struct bench_graph *bg, struct ra_regs **out_regs)
+{
+   struct ra_regs *regs;
+   struct ra_graph *g;
+   unsigned i, j;
+
+   regs = ra_alloc_reg_set(NULL, bg->num_regs, true);
+   if (bg->round_robin)
+      ra_set_allocate_round_robin(regs);
+   for (i = 0; i < bg->num_conflicts; i++)
+      ra_add_reg_conflict(regs, bg->conflicts[2 * i], bg->conflicts[2 * i + 1]);
+   for (i = 0; i < bg->num_classes; i++) {
+      unsigned c = ra_alloc_reg_class(regs);
+
+      for (j = 0; j < bg->class_size[i]; j++)
+         ra_class_add_reg(regs, c, bg->class_regs[i][j]);
+   }
+   ra_set_finalize(regs, bg->q);
+
+   g = ra_alloc_interference_graph(regs, bg->num_nodes);
+   for (i = 0; i < bg->num_nodes; i++) {
+      ra_set_node_class(g, i, bg->node_class[i]);
+      if (bg->node_reg[i] >= 0)
+         ra_set_node_reg(g, i, bg->node_reg[i]);
+   }
+   for (i = 0; i < bg->num_edges; i++)
+      ra_add_node_interference(g, bg->edges[2 * i], bg->edges[2 * i + 1]);
+
+   *out_regs = regs;
+   return g;
+}
+
+/* Checks that each allocated node got a register of its class, which
+ * doesn't conflict with the registers of the nodes it interferes with.
+ */
+static bool
+check_allocation(struct bench_graph *bg, struct ra_graph *g)
+{
+   BITSET_WORD *conflicts =
+      rzalloc_array(bg, BITSET_WORD, BITSET_WORDS(bg->num_regs * bg->num_regs));
+   bool valid = true;
+   unsigned i, j;
+
+   for (i = 0; i < bg->num_conflicts; i++) {
+      unsigned r1 = bg->conflicts[2 * i], r2 = bg->conflicts[2 * i + 1];
+
+      BITSET_SET(conflicts, r1 * bg->num_regs + r2);
+      BITSET_SET(conflicts, r2 * bg->num_regs + r1);
+   }
+   for (i = 0; i < bg->num_regs; i++)
+      BITSET_SET(conflicts, i * bg->num_regs + i);
+
+   for (i = 0; i < bg->num_nodes && valid; i++) {
+      unsigned reg = ra_get_node_reg(g, i);
+      unsigned c = bg->node_class[i];
+      bool in_class = bg->node_reg[i] >= 0;
+
+      for (j = 0; j < bg->class_size[c]; j++)
+         in_class |= bg->class_regs[c][j] == reg;
+      valid = in_class;
+   }
+
+   for (i = 0; i < bg->num_edges && valid; i++) {
+      unsigned r1 = ra_get_node_reg(g, bg->edges[2 * i]);
+      unsigned r2 = ra_get_node_reg(g, bg->edges[2 * i + 1]);
+
+      valid = !BITSET_TEST(conflicts, r1 * bg->num_regs + r2);
+   }
+
+   ralloc_free(conflicts);
+   return valid;
+}
+
+/* Returns false if the allocation is invalid. */
+static bool
+run_graph(struct bench_graph *bg, const char *name)
+{
+   struct ra_regs *regs;
+   struct ra_graph *g;
+   int64_t start, build_end, alloc_end;
+   uint32_t checksum = 2166136261u;
+   bool ok, valid = true;
+   unsigned i;
+
+   start = now_nsec();
+   g = build_graph(bg, &regs);
+   build_end = now_nsec();
+   ok = ra_allocate(g);
+   alloc_end = now_nsec();
+
+   for (i = 0; i < bg->num_nodes; i++)
+      checksum = (checksum ^ ra_get_node_reg(g, i)) * 0x01000193;
+
+   if (ok)
+      valid = check_allocation(bg, g);
+
+   printf("%-12s %8u %9u %10.3f %10.3f %-4s %08x%s\n", name,
+          bg->num_nodes, bg->num_edges,
+          (build_end - start) / 1e6, (alloc_end - build_end) / 1e6,
+          ok ? "ok" : "fail", checksum, valid ? "" : " INVALID");
+
+   ralloc_free(g);
+   ralloc_free(regs);
+   return valid;
+}
+
+static const struct {
+   unsigned num_nodes, pressure;
+   bool round_robin;
+} generated[] = {
+   { 200, 20, false },
+   { 200, 60, true },
+   { 2000, 40, false },
+   { 2000, 80, true },
+   { 2000, 120, false },
+   { 20000, 40, false },
+   { 20000, 100, true },
+   { 50000, 60, false },
+};
+
+int
+main(int argc, char **argv)
+{
+   void *ctx = ralloc_context(NULL);
+   bool valid = true;
+   FILE *dump = NULL;
+   unsigned i;
+
+   if (argc == 3 && strcmp(argv[1], "-dump") == 0) {
+      dump = fopen(argv[2], "w");
+      if (!dump) {
+         fprintf(stderr, "Failed to open %s\n", argv[2]);
+         return 1;
+      }
+   }
+
+   printf("%-12s %8s %9s %10s %10s %-4s %s\n", "graph", "nodes", "edges",
+          "build ms", "alloc ms", "", "checksum");
+
+   if (argc == 1 || dump) {
+      for (i = 0; i < ARRAY_SIZE(generated); i++) {
+         struct bench_graph *bg =
+            generate_graph(ctx, generated[i].num_nodes, generated[i].pressure,
+                           generated[i].round_robin, i + 1);
+         char name[32];
+
+         if (dump) {
+            struct ra_regs *regs;
+            struct ra_graph *g = build_graph(bg, &regs);
+
+            ra_dump_graph(g, dump);
+            ralloc_free(g);
+            ralloc_free(regs);
+            continue;
+         }
+
+         snprintf(name, sizeof(name), "gen%u", i);
+         valid &= run_graph(bg, name);
+         ralloc_free(bg);
+      }
+   } else {
+      for (int arg = 1; arg < argc; arg++) {
+         FILE *fp = fopen(argv[arg], "r");
+         struct bench_graph *bg;
+
+         if (!fp) {
+            fprintf(stderr, "Failed to open %s\n", argv[arg]);
+            return 1;
+         }
+
+         for (i = 0; (bg = read_graph(ctx, fp)); i++) {
+            char name[32];
+
+            snprintf(name, sizeof(name), "%u", i);
+            valid &= run_graph(bg, name);
+            ralloc_free(bg);
+         }
+         fclose(fp);
+      }
+   }
+
+   if (dump)
+      fclose(dump);
+   ralloc_free(ctx);
+
+   return valid ? 0 : 1;
+}
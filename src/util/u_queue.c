@@ -25,6 +25,8 @@
  */
 
 #include "u_queue.h"
+#include "util/macros.h"
+#include "util/u_atomic.h"
 #include "util/u_string.h"
 
 static void util_queue_killall_and_wait(struct util_queue *queue);
@@ -141,6 +143,112 @@ util_queue_fence_destroy(struct util_queue_fence *fence)
  * util_queue implementation
  */
 
+/* How long threads of a UTIL_QUEUE_INIT_SCALE_THREADS queue stay around
+ * without any work.
+ */
+#define UTIL_QUEUE_IDLE_TIMEOUT_SEC 1
+
+/* Jobs of one priority queued on one thread, in submission order. */
+struct util_queue_ring {
+   struct util_queue_job *jobs;
+   unsigned size; /* a power of two */
+   unsigned head, tail; /* free-running indices */
+};
+
+struct util_queue_worker {
+   mtx_t lock;
+   struct util_queue_ring rings[UTIL_QUEUE_NUM_PRIORITIES];
+
+   /* The number of jobs in each ring, readable without the lock. */
+   int num_queued[UTIL_QUEUE_NUM_PRIORITIES];
+
+   /* The thread exited after idling and hasn't been joined yet. */
+   bool retired;
+};
+
+static void
+ring_push(struct util_queue_ring *ring, const struct util_queue_job *job)
+{
+   if (ring->tail - ring->head == ring->size) {
+      /* The ring is full, make it larger. */
+      unsigned new_size = MAX2(ring->size * 2, 8);
+      struct util_queue_job *jobs =
+         (struct util_queue_job*)malloc(new_size *
+                                        sizeof(struct util_queue_job));
+      assert(jobs);
+
+      for (unsigned i = 0; i < ring->size; i++)
+         jobs[i] = ring->jobs[(ring->head + i) & (ring->size - 1)];
+
+      free(ring->jobs);
+      ring->jobs = jobs;
+      ring->head = 0;
+      ring->tail = ring->size;
+      ring->size = new_size;
+   }
+
+   ring->jobs[ring->tail++ & (ring->size - 1)] = *job;
+}
+
+static bool
+ring_pop(struct util_queue_ring *ring, struct util_queue_job *job)
+{
+   if (ring->head == ring->tail)
+      return false;
+
+   *job = ring->jobs[ring->head++ & (ring->size - 1)];
+   return true;
+}
+
+/* Take the oldest job of the highest priority, preferably from the calling
+ * thread's own rings, otherwise from those of the other threads.
+ */
+static bool
+util_queue_take_job(struct util_queue *queue, unsigned thread_index,
+                    struct util_queue_job *job)
+{
+   for (int prio = UTIL_QUEUE_NUM_PRIORITIES - 1; prio >= 0; prio--) {
+      for (unsigned n = 0; n < queue->num_threads; n++) {
+         struct util_queue_worker *worker =
+            &queue->workers[(thread_index + n) % queue->num_threads];
+         bool found;
+
+         if (p_atomic_read(&worker->num_queued[prio]) == 0)
+            continue;
+
+         mtx_lock(&worker->lock);
+         found = ring_pop(&worker->rings[prio], job);
+         if (found)
+            p_atomic_dec(&worker->num_queued[prio]);
+         mtx_unlock(&worker->lock);
+
+         if (found) {
+            if (queue->flags & UTIL_QUEUE_INIT_RESIZE_IF_FULL) {
+               p_atomic_dec(&queue->num_queued);
+            } else {
+               mtx_lock(&queue->lock);
+               p_atomic_dec(&queue->num_queued);
+               cnd_signal(&queue->has_space_cond);
+               mtx_unlock(&queue->lock);
+            }
+            return true;
+         }
+      }
+   }
+
+   return false;
+}
+
+/* Whether the thread may exit when idle, which only the last running thread
+ * of a scaling queue does. Called with the queue lock held.
+ */
+static bool
+util_queue_thread_may_retire(struct util_queue *queue, unsigned thread_index)
+{
+   return (queue->flags & UTIL_QUEUE_INIT_SCALE_THREADS) &&
+          thread_index > 0 && thread_index == queue->num_running - 1;
+}
+
 struct thread_input {
    struct util_queue *queue;
    int thread_index;
@@ -163,25 +271,50 @@ util_queue_thread_func(void *input)
    while (1) {
       struct util_queue_job job;
 
-      mtx_lock(&queue->lock);
-      assert(queue->num_queued >= 0 && queue->num_queued <= queue->max_jobs);
+      if (p_atomic_read(&queue->kill_threads))
+         break;
 
-      /* wait if the queue is empty */
-      while (!queue->kill_threads && queue->num_queued == 0)
-         cnd_wait(&queue->has_queued_cond, &queue->lock);
+      if (!util_queue_take_job(queue, thread_index, &job)) {
+         bool retire = false;
 
-      if (queue->kill_threads) {
-         mtx_unlock(&queue->lock);
-         break;
-      }
+         mtx_lock(&queue->lock);
 
-      job = queue->jobs[queue->read_idx];
-      memset(&queue->jobs[queue->read_idx], 0, sizeof(struct util_queue_job));
-      queue->read_idx = (queue->read_idx + 1) % queue->max_jobs;
+         /* wait if the queue is empty */
+         while (!queue->kill_threads && p_atomic_read(&queue->num_queued) <= 0) {
+            queue->num_sleeping++;
 
-      queue->num_queued--;
-      cnd_signal(&queue->has_space_cond);
-      mtx_unlock(&queue->lock);
+            if (util_queue_thread_may_retire(queue, thread_index)) {
+               xtime t;
+
+               xtime_get(&t, TIME_UTC);
+               t.sec += UTIL_QUEUE_IDLE_TIMEOUT_SEC;
+               retire = cnd_timedwait(&queue->has_queued_cond, &queue->lock,
+                                      &t) == thrd_busy;
+            } else {
+               cnd_wait(&queue->has_queued_cond, &queue->lock);
+            }
+
+            queue->num_sleeping--;
+
+            if (retire && !queue->kill_threads &&
+                p_atomic_read(&queue->num_queued) <= 0 &&
+                util_queue_thread_may_retire(queue, thread_index))
+               break;
+            retire = false;
+         }
+
+         if (retire) {
+            queue->workers[thread_index].retired = true;
+            p_atomic_dec(&queue->num_running);
+            /* Let the new last thread start its idle timeout. */
+            cnd_broadcast(&queue->has_queued_cond);
+            mtx_unlock(&queue->lock);
+            return 0;
+         }
+
+         mtx_unlock(&queue->lock);
+         continue;
+      }
 
       if (job.job) {
          job.execute(job.job, thread_index);
@@ -192,20 +325,71 @@ util_queue_thread_func(void *input)
    }
 
    /* signal remaining jobs before terminating */
-   mtx_lock(&queue->lock);
-   for (unsigned i = queue->read_idx; i != queue->write_idx;
-        i = (i + 1) % queue->max_jobs) {
-      if (queue->jobs[i].job) {
-         util_queue_fence_signal(queue->jobs[i].fence);
-         queue->jobs[i].job = NULL;
+   for (unsigned i = 0; i < queue->num_threads; i++) {
+      struct util_queue_worker *worker = &queue->workers[i];
+
+      mtx_lock(&worker->lock);
+      for (unsigned prio = 0; prio < UTIL_QUEUE_NUM_PRIORITIES; prio++) {
+         struct util_queue_job job;
+
+         while (ring_pop(&worker->rings[prio], &job)) {
+            if (job.job)
+               util_queue_fence_signal(job.fence);
+         }
+         p_atomic_set(&worker->num_queued[prio], 0);
       }
+      mtx_unlock(&worker->lock);
    }
-   queue->read_idx = queue->write_idx;
-   queue->num_queued = 0;
-   mtx_unlock(&queue->lock);
+   p_atomic_set(&queue->num_queued, 0);
    return 0;
 }
 
+/* Start the thread for slot \p i. Called with the queue lock held, except
+ * from util_queue_init.
+ */
+static bool
+util_queue_start_thread(struct util_queue *queue, unsigned i)
+{
+   struct util_queue_worker *worker = &queue->workers[i];
+   struct thread_input *input;
+
+   if (worker->retired) {
+      thrd_join(queue->threads[i], NULL);
+      worker->retired = false;
+   }
+
+   input = (struct thread_input *) malloc(sizeof(struct thread_input));
+   if (!input)
+      return false;
+
+   input->queue = queue;
+   input->thread_index = i;
+
+   queue->threads[i] = u_thread_create(util_queue_thread_func, input);
+
+   if (!queue->threads[i]) {
+      free(input);
+      return false;
+   }
+
+   if (queue->flags & UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY) {
+#if defined(__linux__) && defined(SCHED_IDLE)
+      struct sched_param sched_param = {0};
+
+      /* The nice() function can only set a maximum of 19.
+       * SCHED_IDLE is the same as nice = 20.
+       *
+       * Note that Linux only allows decreasing the priority. The original
+       * priority can't be restored.
+       */
+      pthread_setschedparam(queue->threads[i], SCHED_IDLE, &sched_param);
+#endif
+   }
+
+   p_atomic_inc(&queue->num_running);
+   return true;
+}
+
 bool
 util_queue_init(struct util_queue *queue,
                 const char *name,
@@ -213,7 +397,7 @@ util_queue_init(struct util_queue *queue,
                 unsigned num_threads,
                 unsigned flags)
 {
-   unsigned i;
+   unsigned i, num_initial_threads;
 
    memset(queue, 0, sizeof(*queue));
    queue->name = name;
@@ -221,11 +405,14 @@ util_queue_init(struct util_queue *queue,
    queue->num_threads = num_threads;
    queue->max_jobs = max_jobs;
 
-   queue->jobs = (struct util_queue_job*)
-                 calloc(max_jobs, sizeof(struct util_queue_job));
-   if (!queue->jobs)
+   queue->workers = (struct util_queue_worker*)
+                    calloc(num_threads, sizeof(struct util_queue_worker));
+   if (!queue->workers)
       goto fail;
 
+   for (i = 0; i < num_threads; i++)
+      (void) mtx_init(&queue->workers[i].lock, mtx_plain);
+
    (void) mtx_init(&queue->lock, mtx_plain);
 
    queue->num_queued = 0;
@@ -237,17 +424,11 @@ util_queue_init(struct util_queue *queue,
       goto fail;
 
    /* start threads */
-   for (i = 0; i < num_threads; i++) {
-      struct thread_input *input =
-         (struct thread_input *) malloc(sizeof(struct thread_input));
-      input->queue = queue;
-      input->thread_index = i;
-
-      queue->threads[i] = u_thread_create(util_queue_thread_func, input);
-
-      if (!queue->threads[i]) {
-         free(input);
+   num_initial_threads =
+      flags & UTIL_QUEUE_INIT_SCALE_THREADS ? 1 : num_threads;
 
+   for (i = 0; i < num_initial_threads; i++) {
+      if (!util_queue_start_thread(queue, i)) {
          if (i == 0) {
             /* no threads created, fail */
             goto fail;
@@ -257,20 +438,6 @@ util_queue_init(struct util_queue *queue,
             break;
          }
       }
-
-      if (flags & UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY) {
-   #if defined(__linux__) && defined(SCHED_IDLE)
-         struct sched_param sched_param = {0};
-
-         /* The nice() function can only set a maximum of 19.
-          * SCHED_IDLE is the same as nice = 20.
-          *
-          * Note that Linux only allows decreasing the priority. The original
-          * priority can't be restored.
-          */
-         pthread_setschedparam(queue->threads[i], SCHED_IDLE, &sched_param);
-   #endif
-      }
    }
 
    add_to_atexit_list(queue);
@@ -279,11 +446,13 @@ util_queue_init(struct util_queue *queue,
 fail:
    free(queue->threads);
 
-   if (queue->jobs) {
+   if (queue->workers) {
       cnd_destroy(&queue->has_space_cond);
       cnd_destroy(&queue->has_queued_cond);
       mtx_destroy(&queue->lock);
-      free(queue->jobs);
+      for (i = 0; i < num_threads; i++)
+         mtx_destroy(&queue->workers[i].lock);
+      free(queue->workers);
    }
    /* also util_queue_is_initialized can be used to check for success */
    memset(queue, 0, sizeof(*queue));
@@ -297,13 +466,17 @@ util_queue_killall_and_wait(struct util_queue *queue)
 
    /* Signal all threads to terminate. */
    mtx_lock(&queue->lock);
-   queue->kill_threads = 1;
+   p_atomic_set(&queue->kill_threads, 1);
    cnd_broadcast(&queue->has_queued_cond);
    mtx_unlock(&queue->lock);
 
-   for (i = 0; i < queue->num_threads; i++)
-      thrd_join(queue->threads[i], NULL);
-   queue->num_threads = 0;
+   /* Threads don't start or retire once kill_threads is set. */
+   for (i = 0; i < queue->num_threads; i++) {
+      if (i < queue->num_running || queue->workers[i].retired)
+         thrd_join(queue->threads[i], NULL);
+      queue->workers[i].retired = false;
+   }
+   queue->num_running = 0;
 }
 
 void
@@ -315,20 +488,29 @@ util_queue_destroy(struct util_queue *queue)
    cnd_destroy(&queue->has_space_cond);
    cnd_destroy(&queue->has_queued_cond);
    mtx_destroy(&queue->lock);
-   free(queue->jobs);
+
+   for (unsigned i = 0; i < queue->num_threads; i++) {
+      mtx_destroy(&queue->workers[i].lock);
+      for (unsigned prio = 0; prio < UTIL_QUEUE_NUM_PRIORITIES; prio++)
+         free(queue->workers[i].rings[prio].jobs);
+   }
+   free(queue->workers);
    free(queue->threads);
 }
 
 void
-util_queue_add_job(struct util_queue *queue,
-                   void *job,
-                   struct util_queue_fence *fence,
-                   util_queue_execute_func execute,
-                   util_queue_execute_func cleanup)
+util_queue_add_job_with_priority(struct util_queue *queue,
+                                 void *job,
+                                 struct util_queue_fence *fence,
+                                 util_queue_execute_func execute,
+                                 util_queue_execute_func cleanup,
+                                 enum util_queue_priority priority)
 {
-   struct util_queue_job *ptr;
+   struct util_queue_worker *worker;
+   struct util_queue_job ptr;
 
    assert(fence->signalled);
+   assert(priority < UTIL_QUEUE_NUM_PRIORITIES);
 
    mtx_lock(&queue->lock);
    if (queue->kill_threads) {
@@ -341,55 +523,49 @@ util_queue_add_job(struct util_queue *queue,
 
    fence->signalled = false;
 
-   assert(queue->num_queued >= 0 && queue->num_queued <= queue->max_jobs);
-
-   if (queue->num_queued == queue->max_jobs) {
-      if (queue->flags & UTIL_QUEUE_INIT_RESIZE_IF_FULL) {
-         /* If the queue is full, make it larger to avoid waiting for a free
-          * slot.
-          */
-         unsigned new_max_jobs = queue->max_jobs + 8;
-         struct util_queue_job *jobs =
-            (struct util_queue_job*)calloc(new_max_jobs,
-                                           sizeof(struct util_queue_job));
-         assert(jobs);
-
-         /* Copy all queued jobs into the new list. */
-         unsigned num_jobs = 0;
-         unsigned i = queue->read_idx;
-
-         do {
-            jobs[num_jobs++] = queue->jobs[i];
-            i = (i + 1) % queue->max_jobs;
-         } while (i != queue->write_idx);
-
-         assert(num_jobs == queue->num_queued);
-
-         free(queue->jobs);
-         queue->jobs = jobs;
-         queue->read_idx = 0;
-         queue->write_idx = num_jobs;
-         queue->max_jobs = new_max_jobs;
-      } else {
-         /* Wait until there is a free slot. */
-         while (queue->num_queued == queue->max_jobs)
-            cnd_wait(&queue->has_space_cond, &queue->lock);
-      }
+   /* Unless the queue may grow, wait until there is a free slot. */
+   if (!(queue->flags & UTIL_QUEUE_INIT_RESIZE_IF_FULL)) {
+      while (p_atomic_read(&queue->num_queued) >= queue->max_jobs)
+         cnd_wait(&queue->has_space_cond, &queue->lock);
    }
 
-   ptr = &queue->jobs[queue->write_idx];
-   assert(ptr->job == NULL);
-   ptr->job = job;
-   ptr->fence = fence;
-   ptr->execute = execute;
-   ptr->cleanup = cleanup;
-   queue->write_idx = (queue->write_idx + 1) % queue->max_jobs;
+   /* Spread the jobs over the running threads. */
+   worker = &queue->workers[queue->next_worker++ % queue->num_running];
+
+   ptr.job = job;
+   ptr.fence = fence;
+   ptr.execute = execute;
+   ptr.cleanup = cleanup;
+
+   mtx_lock(&worker->lock);
+   ring_push(&worker->rings[priority], &ptr);
+   p_atomic_inc(&worker->num_queued[priority]);
+   mtx_unlock(&worker->lock);
 
-   queue->num_queued++;
-   cnd_signal(&queue->has_queued_cond);
+   p_atomic_inc(&queue->num_queued);
+
+   /* Start another thread if there are more jobs than idle threads. */
+   if ((queue->flags & UTIL_QUEUE_INIT_SCALE_THREADS) &&
+       queue->num_running < queue->num_threads &&
+       p_atomic_read(&queue->num_queued) > queue->num_sleeping)
+      util_queue_start_thread(queue, queue->num_running);
+
+   if (queue->num_sleeping)
+      cnd_signal(&queue->has_queued_cond);
    mtx_unlock(&queue->lock);
 }
 
+void
+util_queue_add_job(struct util_queue *queue,
+                   void *job,
+                   struct util_queue_fence *fence,
+                   util_queue_execute_func execute,
+                   util_queue_execute_func cleanup)
+{
+   util_queue_add_job_with_priority(queue, job, fence, execute, cleanup,
+                                    UTIL_QUEUE_PRIORITY_NORMAL);
+}
+
 /**
  * Remove a queued job. If the job hasn't started execution, it's removed from
  * the queue. If the job has started execution, the function waits for it to
@@ -408,20 +584,31 @@ util_queue_drop_job(struct util_queue *queue, struct util_queue_fence *fence)
    if (util_queue_fence_is_signalled(fence))
       return;
 
-   mtx_lock(&queue->lock);
-   for (unsigned i = queue->read_idx; i != queue->write_idx;
-        i = (i + 1) % queue->max_jobs) {
-      if (queue->jobs[i].fence == fence) {
-         if (queue->jobs[i].cleanup)
-            queue->jobs[i].cleanup(queue->jobs[i].job, -1);
-
-         /* Just clear it. The threads will treat as a no-op job. */
-         memset(&queue->jobs[i], 0, sizeof(queue->jobs[i]));
-         removed = true;
-         break;
+   for (unsigned i = 0; i < queue->num_threads && !removed; i++) {
+      struct util_queue_worker *worker = &queue->workers[i];
+
+      mtx_lock(&worker->lock);
+      for (unsigned prio = 0; prio < UTIL_QUEUE_NUM_PRIORITIES; prio++) {
+         struct util_queue_ring *ring = &worker->rings[prio];
+
+         for (unsigned j = ring->head; j != ring->tail; j++) {
+            struct util_queue_job *job = &ring->jobs[j & (ring->size - 1)];
+
+            if (job->fence == fence) {
+               if (job->cleanup)
+                  job->cleanup(job->job, -1);
+
+               /* Just clear it. The threads will treat as a no-op job. */
+               memset(job, 0, sizeof(*job));
+               removed = true;
+               break;
+            }
+         }
+         if (removed)
+            break;
       }
+      mtx_unlock(&worker->lock);
    }
-   mtx_unlock(&queue->lock);
 
    if (removed)
       util_queue_fence_signal(fence);
@@ -433,7 +620,7 @@ int64_t
 util_queue_get_thread_time_nano(struct util_queue *queue, unsigned thread_index)
 {
    /* Allow some flexibility by not raising an error. */
-   if (thread_index >= queue->num_threads)
+   if (thread_index >= queue->num_running)
       return 0;
 
    return u_thread_get_time_nano(queue->threads[thread_index]);
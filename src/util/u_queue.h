@@ -28,6 +28,11 @@
  *
  * Jobs can be added from any thread. After that, the wait call can be used
  * to wait for completion of the job.
+ *
+ * Each thread has its own list of jobs per priority. New jobs are spread
+ * over the threads, and a thread that runs out of work takes jobs from the
+ * others, always picking the highest priority job available. Jobs of the
+ * same priority run in order on queues with a single thread.
  */
 
 #ifndef U_QUEUE_H
@@ -44,6 +49,18 @@ extern "C" {
 
 #define UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY      (1 << 0)
 #define UTIL_QUEUE_INIT_RESIZE_IF_FULL            (1 << 1)
+/* Start with one thread, and only start more (up to num_threads) while
+ * jobs are waiting. Threads other than the first exit after idling for a
+ * while. thread_index is still always less than num_threads.
+ */
+#define UTIL_QUEUE_INIT_SCALE_THREADS             (1 << 2)
+
+enum util_queue_priority {
+   UTIL_QUEUE_PRIORITY_LOW,
+   UTIL_QUEUE_PRIORITY_NORMAL,
+   UTIL_QUEUE_PRIORITY_HIGH,
+   UTIL_QUEUE_NUM_PRIORITIES,
+};
 
 /* Job completion fence.
  * Put this into your job structure.
@@ -63,6 +80,8 @@ struct util_queue_job {
    util_queue_execute_func cleanup;
 };
 
+struct util_queue_worker;
+
 /* Put this into your context. */
 struct util_queue {
    const char *name;
@@ -73,10 +92,13 @@ struct util_queue {
    unsigned flags;
    int num_queued;
    unsigned num_threads;
+   unsigned num_running;      /* threads[0..num_running-1] are alive, only
+                               * changed with the lock held */
+   unsigned num_sleeping;
+   unsigned next_worker;
    int kill_threads;
    int max_jobs;
-   int write_idx, read_idx; /* ring buffer pointers */
-   struct util_queue_job *jobs;
+   struct util_queue_worker *workers; /* jobs queued for each thread */
 
    /* for cleanup at exit(), protected by exit_mutex */
    struct list_head head;
@@ -97,6 +119,12 @@ void util_queue_add_job(struct util_queue *queue,
                         struct util_queue_fence *fence,
                         util_queue_execute_func execute,
                         util_queue_execute_func cleanup);
+void util_queue_add_job_with_priority(struct util_queue *queue,
+                                      void *job,
+                                      struct util_queue_fence *fence,
+                                      util_queue_execute_func execute,
+                                      util_queue_execute_func cleanup,
+                                      enum util_queue_priority priority);
 void util_queue_drop_job(struct util_queue *queue,
                          struct util_queue_fence *fence);
 
@@ -0,0 +1,400 @@
+/*
+ * Copyright © 2017 Advanced Micro Devices, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT. IN NO EVENT SHALL THE COPYRIGHT HOLDERS, AUTHORS
+ * AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ */
+
+/* Tests for util_queue. Run with "bench" as argument to measure the job
+ * throughput and the latency of high priority jobs on a busy queue instead.
+ */
+
+/* Force assertions, even on release builds. */
+#undef NDEBUG
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "u_atomic.h"
+#include "u_queue.h"
+
+struct test_job {
+   struct util_queue_fence fence;
+   unsigned index;
+   int64_t queued, started;
+};
+
+static int64_t
+now_nsec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static struct test_job *
+create_jobs(unsigned count)
+{
+   struct test_job *jobs = calloc(count, sizeof(*jobs));
+
+   assert(jobs);
+   for (unsigned i = 0; i < count; i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      jobs[i].index = i;
+   }
+   return jobs;
+}
+
+static void
+destroy_jobs(struct test_job *jobs, unsigned count)
+{
+   for (unsigned i = 0; i < count; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+   free(jobs);
+}
+
+/* Jobs can be held back until released by the test. */
+static mtx_t gate_mutex = _MTX_INITIALIZER_NP;
+static cnd_t gate_cond;
+static bool gate_open;
+static unsigned gate_waiting;
+
+static void
+gate_close(void)
+{
+   mtx_lock(&gate_mutex);
+   gate_open = false;
+   mtx_unlock(&gate_mutex);
+}
+
+static void
+gate_release(void)
+{
+   mtx_lock(&gate_mutex);
+   gate_open = true;
+   cnd_broadcast(&gate_cond);
+   mtx_unlock(&gate_mutex);
+}
+
+static void
+gate_wait_for(unsigned num_waiting)
+{
+   mtx_lock(&gate_mutex);
+   while (gate_waiting != num_waiting)
+      cnd_wait(&gate_cond, &gate_mutex);
+   mtx_unlock(&gate_mutex);
+}
+
+static void
+gate_job(void *job, int thread_index)
+{
+   mtx_lock(&gate_mutex);
+   gate_waiting++;
+   cnd_broadcast(&gate_cond);
+   while (!gate_open)
+      cnd_wait(&gate_cond, &gate_mutex);
+   gate_waiting--;
+   mtx_unlock(&gate_mutex);
+}
+
+static unsigned order[1000];
+static unsigned num_done;
+
+static void
+record_job(void *job, int thread_index)
+{
+   order[p_atomic_inc_return(&num_done) - 1] = ((struct test_job *)job)->index;
+}
+
+static void
+test_fifo(void)
+{
+   struct util_queue queue;
+   struct test_job *jobs = create_jobs(1000);
+
+   /* Jobs of one priority run in order on a single thread queue, also
+    * when it has to grow.
+    */
+   assert(util_queue_init(&queue, "test", 8, 1,
+                          UTIL_QUEUE_INIT_RESIZE_IF_FULL));
+
+   num_done = 0;
+   for (unsigned i = 0; i < 1000; i++)
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence, record_job, NULL);
+
+   destroy_jobs(jobs, 1000);
+   assert(num_done == 1000);
+   for (unsigned i = 0; i < 1000; i++)
+      assert(order[i] == i);
+
+   util_queue_destroy(&queue);
+}
+
+static void
+test_priority(void)
+{
+   struct util_queue queue;
+   struct util_queue_fence gate_fence;
+   struct test_job *jobs = create_jobs(100);
+
+   assert(util_queue_init(&queue, "test", 8, 1,
+                          UTIL_QUEUE_INIT_RESIZE_IF_FULL));
+
+   /* Keep the thread busy while queueing, then check that all high
+    * priority jobs ran before the low priority ones.
+    */
+   util_queue_fence_init(&gate_fence);
+   gate_close();
+   util_queue_add_job(&queue, (void *) &gate_open, &gate_fence, gate_job, NULL);
+
+   num_done = 0;
+   for (unsigned i = 0; i < 100; i++) {
+      util_queue_add_job_with_priority(&queue, &jobs[i], &jobs[i].fence,
+                                       record_job, NULL,
+                                       i % 2 ? UTIL_QUEUE_PRIORITY_HIGH :
+                                               UTIL_QUEUE_PRIORITY_LOW);
+   }
+   gate_release();
+
+   destroy_jobs(jobs, 100);
+   util_queue_fence_wait(&gate_fence);
+   util_queue_fence_destroy(&gate_fence);
+
+   for (unsigned i = 0; i < 100; i++)
+      assert(order[i] == (i < 50 ? i * 2 + 1 : (i - 50) * 2));
+
+   util_queue_destroy(&queue);
+}
+
+static void
+count_job(void *job, int thread_index)
+{
+   p_atomic_inc(&num_done);
+}
+
+static void
+test_many_threads(void)
+{
+   struct util_queue queue;
+   struct test_job *jobs = create_jobs(10000);
+
+   /* Without RESIZE_IF_FULL, adding blocks until there is room. */
+   assert(util_queue_init(&queue, "test", 16, 4, 0));
+
+   num_done = 0;
+   for (unsigned i = 0; i < 10000; i++)
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence, count_job, NULL);
+
+   destroy_jobs(jobs, 10000);
+   assert(num_done == 10000);
+
+   util_queue_destroy(&queue);
+}
+
+static void
+test_drop_job(void)
+{
+   struct util_queue queue;
+   struct util_queue_fence gate_fence;
+   struct test_job *jobs = create_jobs(2);
+
+   assert(util_queue_init(&queue, "test", 8, 1, 0));
+
+   util_queue_fence_init(&gate_fence);
+   gate_close();
+   util_queue_add_job(&queue, (void *) &gate_open, &gate_fence, gate_job, NULL);
+
+   num_done = 0;
+   util_queue_add_job(&queue, &jobs[0], &jobs[0].fence, count_job, NULL);
+   util_queue_add_job(&queue, &jobs[1], &jobs[1].fence, count_job, NULL);
+
+   util_queue_drop_job(&queue, &jobs[0].fence);
+   assert(util_queue_fence_is_signalled(&jobs[0].fence));
+   gate_release();
+
+   destroy_jobs(jobs, 2);
+   util_queue_fence_wait(&gate_fence);
+   util_queue_fence_destroy(&gate_fence);
+   assert(num_done == 1);
+
+   util_queue_destroy(&queue);
+}
+
+static void
+test_scale_threads(void)
+{
+   struct util_queue queue;
+   struct util_queue_fence fences[2];
+
+   assert(util_queue_init(&queue, "test", 8, 2,
+                          UTIL_QUEUE_INIT_SCALE_THREADS));
+   assert(queue.num_running == 1);
+
+   /* A second thread gets started while the first one is busy. */
+   gate_close();
+   for (unsigned i = 0; i < 2; i++) {
+      util_queue_fence_init(&fences[i]);
+      util_queue_add_job(&queue, (void *) &gate_open, &fences[i], gate_job, NULL);
+   }
+   assert(queue.num_running == 2);
+
+   /* Both jobs are running at the same time. */
+   gate_wait_for(2);
+   gate_release();
+
+   for (unsigned i = 0; i < 2; i++) {
+      util_queue_fence_wait(&fences[i]);
+      util_queue_fence_destroy(&fences[i]);
+   }
+
+   /* And exits again when idle. */
+   for (unsigned i = 0; i < 50 && p_atomic_read(&queue.num_running) > 1; i++) {
+      struct timespec ts = { 0, 100000000 };
+      nanosleep(&ts, NULL);
+   }
+   assert(queue.num_running == 1);
+
+   util_queue_destroy(&queue);
+}
+
+static void
+spin_job(void *data, int thread_index)
+{
+   struct test_job *job = data;
+   int64_t end;
+
+   job->started = now_nsec();
+
+   /* Something like a small compile. */
+   end = job->started + 20000;
+   while (now_nsec() < end)
+      ;
+}
+
+static int
+compare_int64(const void *a, const void *b)
+{
+   int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+   return x < y ? -1 : x > y;
+}
+
+static void
+bench_latency(unsigned num_threads, bool use_priority)
+{
+   const unsigned num_bulk = 20000, num_urgent = 100;
+   struct util_queue queue;
+   struct test_job *bulk = create_jobs(num_bulk);
+   struct test_job *urgent = create_jobs(num_urgent);
+   int64_t latency[100];
+
+   util_queue_init(&queue, "bench", 32, num_threads,
+                   UTIL_QUEUE_INIT_RESIZE_IF_FULL);
+
+   /* Interleave latency critical jobs with a flood of bulk jobs, like
+    * shader compiles queued behind cache writes.
+    */
+   for (unsigned i = 0; i < num_bulk; i++) {
+      util_queue_add_job_with_priority(&queue, &bulk[i], &bulk[i].fence,
+                                       spin_job, NULL,
+                                       use_priority ? UTIL_QUEUE_PRIORITY_LOW :
+                                                      UTIL_QUEUE_PRIORITY_NORMAL);
+
+      if (i % (num_bulk / num_urgent) == 0) {
+         struct test_job *job = &urgent[i / (num_bulk / num_urgent)];
+
+         job->queued = now_nsec();
+         util_queue_add_job_with_priority(&queue, job, &job->fence,
+                                          spin_job, NULL,
+                                          use_priority ? UTIL_QUEUE_PRIORITY_HIGH :
+                                                         UTIL_QUEUE_PRIORITY_NORMAL);
+      }
+   }
+
+   destroy_jobs(bulk, num_bulk);
+   for (unsigned i = 0; i < num_urgent; i++) {
+      util_queue_fence_wait(&urgent[i].fence);
+      latency[i] = urgent[i].started - urgent[i].queued;
+   }
+   destroy_jobs(urgent, num_urgent);
+
+   qsort(latency, num_urgent, sizeof(latency[0]), compare_int64);
+   printf("%u threads, %-11s urgent job latency p50 %8.3f ms, p99 %8.3f ms\n",
+          num_threads, use_priority ? "priorities:" : "fifo:",
+          latency[num_urgent / 2] / 1e6, latency[num_urgent * 99 / 100] / 1e6);
+
+   util_queue_destroy(&queue);
+}
+
+static void
+bench_throughput(unsigned num_threads)
+{
+   const unsigned num_jobs = 200000;
+   struct util_queue queue;
+   struct test_job *jobs = create_jobs(num_jobs);
+   int64_t start;
+
+   util_queue_init(&queue, "bench", 32, num_threads,
+                   UTIL_QUEUE_INIT_RESIZE_IF_FULL);
+
+   num_done = 0;
+   start = now_nsec();
+   for (unsigned i = 0; i < num_jobs; i++)
+      util_queue_add_job(&queue, &jobs[i], &jobs[i].fence, count_job, NULL);
+   for (unsigned i = 0; i < num_jobs; i++)
+      util_queue_fence_wait(&jobs[i].fence);
+
+   printf("%u threads, %.2f M empty jobs/s\n", num_threads,
+          num_jobs / ((now_nsec() - start) / 1e3));
+
+   destroy_jobs(jobs, num_jobs);
+   util_queue_destroy(&queue);
+}
+
+int
+main(int argc, char **argv)
+{
+   cnd_init(&gate_cond);
+
+   if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+      for (unsigned t = 1; t <= 8; t *= 2)
+         bench_throughput(t);
+      for (unsigned t = 1; t <= 4; t *= 2) {
+         bench_latency(t, false);
+         bench_latency(t, true);
+      }
+      return 0;
+   }
+
+   test_fifo();
+   test_priority();
+   test_many_threads();
+   test_drop_job();
+   test_scale_threads();
+
+   return 0;
+}
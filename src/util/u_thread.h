@@ -69,6 +69,36 @@ static inline void u_thread_setname( const char *name )
    (void)name;
 }
 
+/**
+ * Restrict the calling thread to the given set of CPUs.
+ *
+ * \param cpus      array of CPU indices the thread may run on
+ * \param num_cpus  number of entries in \p cpus
+ * \return true on success, false if unsupported or the call failed
+ */
+static inline bool
+u_thread_set_affinity(const unsigned *cpus, unsigned num_cpus)
+{
+#if defined(HAVE_PTHREAD) && defined(HAVE_PTHREAD_SETAFFINITY)
+   cpu_set_t cpuset;
+   unsigned i;
+
+   CPU_ZERO(&cpuset);
+   for (i = 0; i < num_cpus; i++) {
+      if (cpus[i] < CPU_SETSIZE)
+         CPU_SET(cpus[i], &cpuset);
+   }
+   if (CPU_COUNT(&cpuset) == 0)
+      return false;
+
+   return pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) == 0;
+#else
+   (void)cpus;
+   (void)num_cpus;
+   return false;
+#endif
+}
+
 /*
  * Thread statistics.
  */